@@ -0,0 +1,103 @@
+/**
+ * bench.h - Helpers for micro benchmarks
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Benchmark results are written to stdout as JSON Lines: one JSON object per
+ * result, with at least the "bench" and "case" members. This keeps the
+ * output of all benchmarks easy to collect and compare across releases.
+ */
+
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Start result object
+ *
+ * @param bench	Name of benchmark executable
+ * @param name	Name of measured case
+ */
+static inline void bench_begin(const char *bench, const char *name)
+{
+	printf("{\"bench\":\"%s\",\"case\":\"%s\"", bench, name);
+}
+
+static inline void bench_uint(const char *key, uint64_t val)
+{
+	printf(",\"%s\":%llu", key, (unsigned long long) val);
+}
+
+static inline void bench_double(const char *key, double val)
+{
+	printf(",\"%s\":%.3f", key, val);
+}
+
+/**
+ * End result object
+ */
+static inline void bench_end(void)
+{
+	printf("}\n");
+	fflush(stdout);
+}
+
+/**
+ * Write result of a timed loop
+ *
+ * @param bench		Name of benchmark executable
+ * @param name		Name of measured case
+ * @param len		Size parameter of case, eg. bytes per operation
+ * @param ops		Amount of executed operations
+ * @param bytes		Amount of processed bytes, or 0 if not applicable
+ * @param elapsed	Time in ns
+ */
+static inline void bench_report(const char *bench, const char *name,
+				size_t len, uint64_t ops, uint64_t bytes,
+				uint64_t elapsed)
+{
+	bench_begin(bench, name);
+	bench_uint("len", len);
+	bench_uint("ops", ops);
+	bench_double("ns_per_op", (double) elapsed / ops);
+	if (bytes != 0) {
+		bench_double("mb_per_s", (double) bytes * 1000 / elapsed);
+	}
+	bench_end();
+}
+
+#endif // __BENCH_H__
@@ -0,0 +1,86 @@
+/**
+ * bench_crc16.c - Micro benchmark of CRC-16 implementations
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "crc16.h"
+
+#define ITERATIONS 200000
+
+typedef uint16_t (*crc16_fn_t)(const crc16_t *, const uint8_t *, size_t);
+
+static const struct {
+	const char *name;
+	crc16_fn_t fn;
+} impls[] = {
+	{ "bitwise", crc16_bitwise },
+	{ "table", crc16_table },
+	{ "slice4", crc16_slice4 },
+	{ "slice8", crc16_slice8 },
+};
+
+static const size_t lengths[] = { 8, 16, 32, 64, 255 };
+
+int main(void)
+{
+	crc16_t crc;
+	uint8_t data[255];
+	volatile uint16_t sink = 0;
+	size_t i;
+	size_t l;
+	unsigned int n;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = rand();
+	}
+
+	crc16_init(&crc, CRC16_POLY_IBM, CRC16_INIT_IBM);
+
+	for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+		for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+			uint64_t start;
+			uint64_t elapsed;
+
+			start = bench_now_ns();
+			for (n = 0; n < ITERATIONS; n++) {
+				sink ^= impls[i].fn(&crc, data, lengths[l]);
+			}
+			elapsed = bench_now_ns() - start;
+
+			bench_report("crc16", impls[i].name, lengths[l],
+				     ITERATIONS,
+				     (uint64_t) lengths[l] * ITERATIONS,
+				     elapsed);
+		}
+	}
+
+	return (sink == 0x1234) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/**
+ * bench_parse_reg_file.c - Benchmark of register configuration file parsing
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "parse_reg_file.h"
+#include "sparse_buf.h"
+
+#define ITERATIONS 2000
+
+/**
+ * Lines per generated file, repeating all register addresses
+ */
+#define LINES 1024
+
+static const struct {
+	const char *name;
+	const char *fmt;
+	unsigned int addr_flag;
+} formats[] = {
+	{ "addr_val", "%02X %02X\n", 0x00 },
+	{ "wds", "S2 %02X%02X\n", 0x80 },
+};
+
+int main(void)
+{
+	char path[] = "/tmp/bench_parse_reg_file.XXXXXX";
+	sparse_buf_t regs;
+	FILE *fp;
+	size_t f;
+	unsigned int i;
+	int fd;
+	int ret = EXIT_SUCCESS;
+
+	if (sparse_buf_init(&regs, 0x80) != 0) {
+		return EXIT_FAILURE;
+	}
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		uint64_t start;
+		uint64_t elapsed;
+
+		fd = mkstemp(path);
+		if (fd == -1 || (fp = fdopen(fd, "w")) == NULL) {
+			perror("Unable to create configuration file");
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < LINES; i++) {
+			// Address 0x7F is not allowed
+			fprintf(fp, formats[f].fmt,
+				(i % 0x7F) | formats[f].addr_flag, i & 0xff);
+		}
+		fclose(fp);
+
+		start = bench_now_ns();
+		for (i = 0; i < ITERATIONS; i++) {
+			if (parse_reg_file(path, &regs) != 0) {
+				ret = EXIT_FAILURE;
+				break;
+			}
+		}
+		elapsed = bench_now_ns() - start;
+		unlink(path);
+		snprintf(path, sizeof(path), "/tmp/bench_parse_reg_file.XXXXXX");
+
+		bench_begin("parse_reg_file", formats[f].name);
+		bench_uint("len", LINES);
+		bench_uint("ops", ITERATIONS);
+		bench_double("ns_per_op", (double) elapsed / ITERATIONS);
+		bench_double("lines_per_s",
+			     (double) LINES * ITERATIONS * 1000000000 / elapsed);
+		bench_end();
+	}
+
+	sparse_buf_destroy(&regs);
+
+	return ret;
+}
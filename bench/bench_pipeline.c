@@ -0,0 +1,252 @@
+/**
+ * bench_pipeline.c - End-to-end benchmark of the daemon on simulated transceivers
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "spi_sim.h"
+
+/**
+ * Time the simulated transceiver waits before sending, so the client is
+ * connected before the first frame arrives
+ */
+#define START_DELAY_MS 500
+
+#define CONNECT_TIMEOUT_MS 2000
+#define IDLE_TIMEOUT_MS 1000
+
+/**
+ * Register configurations: variable length packets, no header
+ */
+#define SI443X_REGS "33 02\n"
+#define SX1231_REGS "37 80\n38 40\n"
+
+static const struct {
+	const char *model;
+	const char *regs;
+	unsigned int rate;
+	unsigned int count;
+} scenarios[] = {
+	{ "si443x", SI443X_REGS, 1000, 2000 },
+	{ "si443x", SI443X_REGS, 10000, 20000 },
+	{ "sx1231", SX1231_REGS, 1000, 2000 },
+	{ "sx1231", SX1231_REGS, 10000, 20000 },
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *) a;
+	const uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static int connect_client(const char *path)
+{
+	struct sockaddr_un addr;
+	uint64_t deadline;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	deadline = bench_now_ns() + (uint64_t) CONNECT_TIMEOUT_MS * 1000000;
+	while (bench_now_ns() < deadline) {
+		fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+		if (fd == -1) {
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+			return fd;
+		}
+		close(fd);
+		usleep(10000);
+	}
+
+	return -1;
+}
+
+static int write_file(const char *path, const char *data)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		return -1;
+	}
+	fputs(data, fp);
+	return fclose(fp);
+}
+
+/**
+ * Run daemon with simulated transceiver and receive all frames as client
+ */
+static int run(const char *daemon, const char *dir, size_t idx)
+{
+	char cfg_path[256];
+	char sock_path[256];
+	char sock_spec[256 + sizeof(",seqpacket")];
+	char dev_spec[128];
+	uint8_t buf[256];
+	uint64_t *lat;
+	uint64_t first = 0;
+	uint64_t last = 0;
+	uint64_t cpu_ns;
+	unsigned int cnt = 0;
+	struct pollfd pfd;
+	struct rusage ru;
+	ssize_t len;
+	pid_t pid;
+	int status;
+	int fd;
+
+	snprintf(cfg_path, sizeof(cfg_path), "%s/regs.cfg", dir);
+	snprintf(sock_path, sizeof(sock_path), "%s/bench.sock", dir);
+	snprintf(sock_spec, sizeof(sock_spec), "%s,seqpacket", sock_path);
+	snprintf(dev_spec, sizeof(dev_spec),
+		 SPI_SIM_PREFIX "%s:rate=%u:count=%u:delay=%u",
+		 scenarios[idx].model, scenarios[idx].rate,
+		 scenarios[idx].count, START_DELAY_MS);
+
+	if (write_file(cfg_path, scenarios[idx].regs) != 0) {
+		perror("Unable to write register configuration");
+		return -1;
+	}
+	lat = calloc(scenarios[idx].count, sizeof(lat[0]));
+	if (lat == NULL) {
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		free(lat);
+		return -1;
+	} else if (pid == 0) {
+		// Stdout carries the results, keep daemon output out of it
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+		execl(daemon, daemon, "-d", dev_spec, "-c", cfg_path,
+		      "-s", sock_spec, "-C", "none", (char *) NULL);
+		perror("exec");
+		_exit(EXIT_FAILURE);
+	}
+
+	fd = connect_client(sock_path);
+	if (fd == -1) {
+		fprintf(stderr, "Unable to connect to daemon\n");
+	} else {
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		while (cnt < scenarios[idx].count &&
+				poll(&pfd, 1, IDLE_TIMEOUT_MS) > 0) {
+			len = recv(fd, buf, sizeof(buf), 0);
+			if (len <= 0) {
+				break;
+			}
+			last = bench_now_ns();
+			if (cnt == 0) {
+				first = last;
+			}
+			lat[cnt++] = last - spi_sim_frame_time(buf, len);
+		}
+		close(fd);
+	}
+
+	kill(pid, SIGTERM);
+	if (wait4(pid, &status, 0, &ru) == -1) {
+		perror("wait4");
+		free(lat);
+		return -1;
+	}
+	unlink(cfg_path);
+
+	cpu_ns = (uint64_t) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) *
+			1000000000 +
+		 (uint64_t) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+
+	qsort(lat, cnt, sizeof(lat[0]), cmp_u64);
+
+	// CPU time includes the simulator thread of the daemon
+	bench_begin("pipeline", scenarios[idx].model);
+	bench_uint("rate", scenarios[idx].rate);
+	bench_uint("frames", scenarios[idx].count);
+	bench_uint("lost", scenarios[idx].count - cnt);
+	if (cnt > 1 && last > first) {
+		bench_double("frames_per_s",
+			     (double) (cnt - 1) * 1000000000 / (last - first));
+	}
+	if (cnt != 0) {
+		bench_double("cpu_us_per_frame", (double) cpu_ns / cnt / 1000);
+		bench_double("p50_us", (double) lat[cnt / 2] / 1000);
+		bench_double("p99_us", (double) lat[(cnt * 99) / 100] / 1000);
+		bench_double("max_us", (double) lat[cnt - 1] / 1000);
+	}
+	bench_end();
+	free(lat);
+
+	return (cnt != 0) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[] = "/tmp/bench_pipeline.XXXXXX";
+	int ret = EXIT_SUCCESS;
+	size_t i;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <path of rf_pkt_drv>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		if (run(argv[1], dir, i) != 0) {
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	rmdir(dir);
+
+	return ret;
+}
@@ -0,0 +1,104 @@
+/**
+ * bench_ring_buf.c - Benchmark of ring buffer copy operations
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "ring_buf.h"
+
+/**
+ * Bytes moved through the buffer per case
+ */
+#define BYTES_PER_CASE (64 * 1024 * 1024)
+
+/**
+ * Buffer sizes: page multiple, so the buffer is mirrored, and a heap buffer
+ * on which copies wrap around the end
+ */
+static const struct {
+	const char *name;
+	size_t size;
+} buffers[] = {
+	{ "mirrored", 4096 },
+	{ "heap", 4095 },
+};
+
+/**
+ * Chunk sizes, both aligned and odd so that the wrap position varies
+ */
+static const size_t lengths[] = { 1, 16, 63, 64, 255 };
+
+int main(void)
+{
+	uint8_t data[255];
+	uint8_t out[255];
+	char name[64];
+	ring_buf_t rb;
+	volatile uint8_t sink = 0;
+	size_t b;
+	size_t l;
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = rand();
+	}
+
+	for (b = 0; b < sizeof(buffers) / sizeof(buffers[0]); b++) {
+		for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+			const size_t len = lengths[l];
+			const uint64_t ops = BYTES_PER_CASE / len;
+			uint64_t start;
+			uint64_t n;
+
+			// Keep the buffer half full, like a client lagging
+			// behind
+			ring_buf_init(&rb, buffers[b].size);
+			for (i = 0; i < buffers[b].size / 2; i++) {
+				ring_buf_add(&rb, data, 1);
+			}
+
+			start = bench_now_ns();
+			for (n = 0; n < ops; n++) {
+				ring_buf_add(&rb, data, len);
+				ring_buf_get(&rb, out, len);
+				sink ^= out[0];
+			}
+			snprintf(name, sizeof(name), "add_get/%s",
+				 buffers[b].name);
+			bench_report("ring_buf", name, len, ops, ops * len,
+				     bench_now_ns() - start);
+
+			ring_buf_destroy(&rb);
+		}
+	}
+
+	(void) sink;
+	return EXIT_SUCCESS;
+}
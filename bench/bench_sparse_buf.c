@@ -0,0 +1,124 @@
+/**
+ * bench_sparse_buf.c - Benchmark of sparse buffer scanning
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "sparse_buf.h"
+
+#define SCANS 200000
+
+static const size_t sizes[] = { 0x80, 4096 };
+
+/**
+ * Valid byte patterns, a byte at offset off is valid if
+ * (off % period) < run
+ */
+static const struct {
+	const char *name;
+	size_t period;
+	size_t run;
+} patterns[] = {
+	{ "dense", 1, 1 },
+	{ "runs", 16, 8 },
+	{ "sparse", 16, 1 },
+	{ "empty", 1, 0 },
+};
+
+int main(void)
+{
+	sparse_buf_t sb;
+	char name[64];
+	volatile size_t sink = 0;
+	size_t s;
+	size_t p;
+	size_t off;
+	unsigned int n;
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+			uint64_t start;
+			size_t total;
+
+			if (sparse_buf_init(&sb, sizes[s]) != 0) {
+				return EXIT_FAILURE;
+			}
+			for (off = 0; off < sizes[s]; off++) {
+				if (off % patterns[p].period < patterns[p].run) {
+					sparse_buf_write(&sb, off, off);
+				}
+			}
+
+			// Same scan as used to program the configuration
+			start = bench_now_ns();
+			for (n = 0; n < SCANS; n++) {
+				total = 0;
+				off = 0;
+				while ((off = sparse_buf_next_valid(&sb, off))
+						!= SPARSE_BUF_OFF_END) {
+					const size_t len =
+						sparse_buf_valid_length(&sb, off);
+
+					total += len;
+					off += len;
+				}
+				sink += total;
+			}
+			snprintf(name, sizeof(name), "scan/%s",
+				 patterns[p].name);
+			bench_report("sparse_buf", name, sizes[s], SCANS,
+				     (uint64_t) sizes[s] * SCANS,
+				     bench_now_ns() - start);
+
+			start = bench_now_ns();
+			for (n = 0; n < SCANS; n++) {
+				size_t len;
+
+				total = 0;
+				off = 0;
+				while (sparse_buf_next_run(&sb, &off, &len)) {
+					total += len;
+					off += len;
+				}
+				sink += total;
+			}
+			snprintf(name, sizeof(name), "runs/%s",
+				 patterns[p].name);
+			bench_report("sparse_buf", name, sizes[s], SCANS,
+				     (uint64_t) sizes[s] * SCANS,
+				     bench_now_ns() - start);
+
+			sparse_buf_destroy(&sb);
+		}
+	}
+
+	(void) sink;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+/**
+ * crc16.c - Table driven CRC-16 calculation
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "crc16.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void crc16_init(crc16_t *crc, uint16_t poly, uint16_t init)
+{
+	unsigned int i;
+	unsigned int k;
+
+	crc->poly = poly;
+	crc->init = init;
+	crc->skip = 0;
+	crc->lsb_first = false;
+
+	for (i = 0; i < 256; i++) {
+		uint16_t c = i << 8;
+		int j;
+
+		for (j = 0; j < 8; j++) {
+			c = (c & 0x8000) ? (c << 1) ^ poly : (c << 1);
+		}
+		crc->table[0][i] = c;
+	}
+
+	for (k = 1; k < CRC16_SLICES; k++) {
+		for (i = 0; i < 256; i++) {
+			const uint16_t c = crc->table[k - 1][i];
+			crc->table[k][i] = (c << 8) ^ crc->table[0][c >> 8];
+		}
+	}
+}
+
+int crc16_parse(crc16_t *crc, const char *spec)
+{
+	char buf[64];
+	char *tok;
+	char *saveptr;
+	char *endp;
+	unsigned long poly = CRC16_POLY_IBM;
+	unsigned long init = CRC16_INIT_IBM;
+	unsigned long skip = 0;
+	bool lsb_first = false;
+
+	if (strlen(spec) >= sizeof(buf)) {
+		return -1;
+	}
+	strcpy(buf, spec);
+
+	for (tok = strtok_r(buf, ",", &saveptr); tok != NULL;
+			tok = strtok_r(NULL, ",", &saveptr)) {
+		if (strcmp(tok, "ibm") == 0) {
+			poly = CRC16_POLY_IBM;
+			init = CRC16_INIT_IBM;
+		} else if (strcmp(tok, "ccitt") == 0) {
+			poly = CRC16_POLY_CCITT;
+			init = CRC16_INIT_CCITT;
+		} else if (strncmp(tok, "poly=", 5) == 0) {
+			poly = strtoul(&tok[5], &endp, 16);
+			if (tok[5] == '\0' || *endp != '\0' || poly > 0xffff) {
+				return -1;
+			}
+		} else if (strncmp(tok, "init=", 5) == 0) {
+			init = strtoul(&tok[5], &endp, 16);
+			if (tok[5] == '\0' || *endp != '\0' || init > 0xffff) {
+				return -1;
+			}
+		} else if (strncmp(tok, "skip=", 5) == 0) {
+			skip = strtoul(&tok[5], &endp, 10);
+			if (tok[5] == '\0' || *endp != '\0' || skip > 0xff) {
+				return -1;
+			}
+		} else if (strcmp(tok, "lsb") == 0) {
+			lsb_first = true;
+		} else {
+			return -1;
+		}
+	}
+
+	crc16_init(crc, poly, init);
+	crc->skip = skip;
+	crc->lsb_first = lsb_first;
+
+	return 0;
+}
+
+uint16_t crc16_bitwise(const crc16_t *crc, const uint8_t *data, size_t len)
+{
+	uint16_t c = crc->init;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		// from sensof:crc.c:crc16()
+		uint8_t j = 8;
+		bool do_xor;
+		uint8_t b = data[i];
+
+		while (j) {
+			do_xor = (b ^ (c >> 8)) & 0x80;
+
+			c = c << 1;
+
+			if (do_xor) {
+				c ^= crc->poly;
+			}
+
+			b = b << 1;
+			j--;
+		}
+	}
+
+	return c;
+}
+
+uint16_t crc16_table(const crc16_t *crc, const uint8_t *data, size_t len)
+{
+	uint16_t c = crc->init;
+
+	while (len--) {
+		c = (c << 8) ^ crc->table[0][(c >> 8) ^ *data++];
+	}
+
+	return c;
+}
+
+uint16_t crc16_slice4(const crc16_t *crc, const uint8_t *data, size_t len)
+{
+	const uint16_t (*t)[256] = crc->table;
+	uint16_t c = crc->init;
+
+	while (len >= 4) {
+		c = t[3][data[0] ^ (c >> 8)] ^
+		    t[2][data[1] ^ (c & 0xff)] ^
+		    t[1][data[2]] ^
+		    t[0][data[3]];
+		data += 4;
+		len -= 4;
+	}
+
+	while (len--) {
+		c = (c << 8) ^ t[0][(c >> 8) ^ *data++];
+	}
+
+	return c;
+}
+
+uint16_t crc16_slice8(const crc16_t *crc, const uint8_t *data, size_t len)
+{
+	const uint16_t (*t)[256] = crc->table;
+	uint16_t c = crc->init;
+
+	while (len >= 8) {
+		c = t[7][data[0] ^ (c >> 8)] ^
+		    t[6][data[1] ^ (c & 0xff)] ^
+		    t[5][data[2]] ^
+		    t[4][data[3]] ^
+		    t[3][data[4]] ^
+		    t[2][data[5]] ^
+		    t[1][data[6]] ^
+		    t[0][data[7]];
+		data += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		c = (c << 8) ^ t[0][(c >> 8) ^ *data++];
+	}
+
+	return c;
+}
+
+bool crc16_check_frame(const crc16_t *crc, const uint8_t *frame, size_t len)
+{
+	uint16_t c;
+	uint16_t expected;
+
+	if (len < (size_t) crc->skip + 2) {
+		return false;
+	}
+
+	c = crc16(crc, &frame[crc->skip], len - crc->skip - 2);
+	if (crc->lsb_first) {
+		expected = frame[len - 2] | (frame[len - 1] << 8);
+	} else {
+		expected = (frame[len - 2] << 8) | frame[len - 1];
+	}
+
+	return c == expected;
+}
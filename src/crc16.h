@@ -0,0 +1,143 @@
+/**
+ * crc16.h - Table driven CRC-16 calculation
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CRC16_H__
+#define __CRC16_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Amount of lookup tables, allows slicing-by-8
+ */
+#define CRC16_SLICES 8
+
+/**
+ * CRC-16 (IBM), as used by Sensof
+ */
+#define CRC16_POLY_IBM		0x8005
+#define CRC16_INIT_IBM		0x0000
+
+/**
+ * CRC-16-CCITT
+ */
+#define CRC16_POLY_CCITT	0x1021
+#define CRC16_INIT_CCITT	0xffff
+
+/**
+ * CRC-16 parameters and lookup tables
+ *
+ * Only non-reflected(MSB first) CRC's without final XOR are supported.
+ */
+typedef struct {
+	uint16_t poly;		/**< Generator polynomial */
+	uint16_t init;		/**< Initial value */
+	uint8_t skip;		/**< Leading frame bytes not covered by CRC */
+	bool lsb_first;		/**< CRC is stored LSB first in frame */
+	/**
+	 * Lookup tables
+	 *
+	 * table[k][i] is the CRC of byte i followed by k zero bytes.
+	 */
+	uint16_t table[CRC16_SLICES][256];
+} crc16_t;
+
+/**
+ * Initialize CRC object
+ *
+ * Frame layout is set to: CRC covers all bytes and is stored MSB first
+ * at the end of the frame.
+ *
+ * @param crc	CRC object to initialize
+ * @param poly	Generator polynomial
+ * @param init	Initial value
+ */
+void crc16_init(crc16_t *crc, uint16_t poly, uint16_t init);
+
+/**
+ * Initialize CRC object from specification string
+ *
+ * The specification is a comma separated list of a CRC name('ibm' or
+ * 'ccitt') and/or the options: poly=<hex>, init=<hex>, skip=<n>, lsb.
+ * Options override the values of the named CRC. Without name the IBM CRC
+ * is used as base. Eg. "ccitt,skip=1" or "poly=1021,init=1d0f".
+ *
+ * @param crc	CRC object to initialize
+ * @param spec	Specification string
+ *
+ * @returns	0 on success, -1 if spec is invalid
+ */
+int crc16_parse(crc16_t *crc, const char *spec);
+
+/**
+ * Calculate CRC bit by bit, without lookup tables
+ *
+ * Reference implementation.
+ */
+uint16_t crc16_bitwise(const crc16_t *crc, const uint8_t *data, size_t len);
+
+/**
+ * Calculate CRC using single lookup table, one byte per iteration
+ */
+uint16_t crc16_table(const crc16_t *crc, const uint8_t *data, size_t len);
+
+/**
+ * Calculate CRC using slicing-by-4, four bytes per iteration
+ */
+uint16_t crc16_slice4(const crc16_t *crc, const uint8_t *data, size_t len);
+
+/**
+ * Calculate CRC using slicing-by-8, eight bytes per iteration
+ */
+uint16_t crc16_slice8(const crc16_t *crc, const uint8_t *data, size_t len);
+
+/**
+ * Calculate CRC using the fastest available implementation
+ */
+static inline uint16_t crc16(const crc16_t *crc, const uint8_t *data,
+			     size_t len)
+{
+	return crc16_slice8(crc, data, len);
+}
+
+/**
+ * Verify CRC of a frame
+ *
+ * Calculates the CRC over the frame bytes starting at crc->skip up to the
+ * CRC, and compares it to the CRC in the last two bytes of the frame.
+ *
+ * @param crc	CRC object
+ * @param frame	Frame data, including CRC
+ * @param len	Length of frame, including CRC
+ *
+ * @returns	true if CRC is correct
+ */
+bool crc16_check_frame(const crc16_t *crc, const uint8_t *frame, size_t len);
+
+#endif // __CRC16_H__
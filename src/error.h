@@ -58,7 +58,7 @@
 
 
 /************************* Error Macros *************************************/
-#define ERROR_ERRNO_VALID(x) ((x & 0x40000000UL) != 0)
+#define ERROR_ERRNO_VALID(x) ((((x) >> 28) & ERR_FLAG_ERRNO_SET) != 0)
 #define ERROR_CLASS(x) ((x & 0x0fff0000UL) >> 16)
 #define ERROR_CODE(x) (x & 0xffffUL)
 
@@ -77,6 +77,8 @@
 #define ERR_CLASS_GENERIC	0x0000
 #define ERR_CLASS_SPI		0x0001
 #define ERR_CLASS_RFM		0x0002
+#define ERR_CLASS_SYS		0x0003
+#define ERR_CLASS_GPIO		0x0004
 
 
 /************************* Error Codes **************************************/
@@ -94,5 +96,17 @@
 // Class RF
 #define ERR_RFM_CHIP_VERSION	E(ERR_CLASS_RFM, 0x0001, 0)
 #define ERR_RFM_TX_OUT_OF_SYNC	E(ERR_CLASS_RFM, 0x0002, 0)
+#define ERR_RFM_TIMEOUT		E(ERR_CLASS_RFM, 0x0003, 0)
+#define ERR_RFM_BUSY		E(ERR_CLASS_RFM, 0x0004, 0)
+
+// System errors
+#define ERR_EVLOOP		E(ERR_CLASS_SYS, 0x0001, ERR_FLAG_ERRNO_SET)
+#define ERR_SHM			E(ERR_CLASS_SYS, 0x0002, ERR_FLAG_ERRNO_SET)
+#define ERR_THREAD		E(ERR_CLASS_SYS, 0x0003, ERR_FLAG_ERRNO_SET)
+
+// GPIO errors
+#define ERR_GPIO_OPEN_CHIP	E(ERR_CLASS_GPIO, 0x0001, ERR_FLAG_ERRNO_SET)
+#define ERR_GPIO_REQUEST_LINE	E(ERR_CLASS_GPIO, 0x0002, ERR_FLAG_ERRNO_SET)
+#define ERR_GPIO_READ		E(ERR_CLASS_GPIO, 0x0003, ERR_FLAG_ERRNO_SET)
 
 #endif // __ERROR_H__
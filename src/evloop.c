@@ -0,0 +1,135 @@
+/**
+ * evloop.c - epoll based event loop
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "evloop.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "error.h"
+
+int evloop_init(evloop_t *loop)
+{
+	memset(loop, 0, sizeof(*loop));
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd == -1) {
+		return ERR_EVLOOP;
+	}
+
+	return ERR_OK;
+}
+
+void evloop_destroy(evloop_t *loop)
+{
+	if (loop->epfd != -1) {
+		close(loop->epfd);
+		loop->epfd = -1;
+	}
+}
+
+int evloop_add(evloop_t *loop, evloop_src_t *src, int fd, uint32_t events,
+		evloop_cb_t cb, void *ctx)
+{
+	struct epoll_event ev;
+
+	src->fd = fd;
+	src->events = events;
+	src->cb = cb;
+	src->ctx = ctx;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		return ERR_EVLOOP;
+	}
+
+	return ERR_OK;
+}
+
+int evloop_modify(evloop_t *loop, evloop_src_t *src, uint32_t events)
+{
+	struct epoll_event ev;
+
+	if (src->events == events) {
+		return ERR_OK;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, src->fd, &ev) == -1) {
+		return ERR_EVLOOP;
+	}
+	src->events = events;
+
+	return ERR_OK;
+}
+
+void evloop_remove(evloop_t *loop, evloop_src_t *src)
+{
+	int i;
+
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+
+	// Prevent dispatching of already collected events for this source
+	for (i = 0; i < loop->nready; i++) {
+		if (loop->ready[i].data.ptr == src) {
+			loop->ready[i].data.ptr = NULL;
+		}
+	}
+}
+
+int evloop_run_once(evloop_t *loop, int timeout_ms)
+{
+	int err = ERR_OK;
+	int n;
+	int i;
+
+	n = epoll_wait(loop->epfd, loop->ready, EVLOOP_MAX_EVENTS, timeout_ms);
+	if (n == -1) {
+		if (errno == EINTR) {
+			return ERR_OK;
+		}
+		return ERR_EVLOOP;
+	}
+
+	loop->nready = n;
+	for (i = 0; i < n && err == ERR_OK; i++) {
+		evloop_src_t *src = loop->ready[i].data.ptr;
+		if (src == NULL) {
+			continue;
+		}
+		err = src->cb(src, loop->ready[i].events);
+	}
+	loop->nready = 0;
+
+	return err;
+}
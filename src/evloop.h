@@ -0,0 +1,132 @@
+/**
+ * evloop.h - epoll based event loop
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __EVLOOP_H__
+#define __EVLOOP_H__
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/**
+ * Maximum amount of events dispatched per evloop_run_once() call
+ */
+#define EVLOOP_MAX_EVENTS 16
+
+struct evloop_src;
+
+/**
+ * Event callback
+ *
+ * @param src		Event source that triggered
+ * @param events	Bit mask of epoll events (EPOLLIN, EPOLLOUT, ...)
+ *
+ * @returns	0 on success, else an error code which is returned by
+ *		evloop_run_once()
+ */
+typedef int (*evloop_cb_t)(struct evloop_src *src, uint32_t events);
+
+/**
+ * Event source
+ *
+ * Is registered once with the event loop and then stays registered until
+ * removed. Memory of the source object is owned by the caller and must
+ * stay valid while registered.
+ */
+typedef struct evloop_src {
+	int fd;			/**< File descriptor to watch */
+	uint32_t events;	/**< Currently registered epoll events */
+	evloop_cb_t cb;		/**< Callback called on events */
+	void *ctx;		/**< User context */
+} evloop_src_t;
+
+typedef struct {
+	int epfd;
+	struct epoll_event ready[EVLOOP_MAX_EVENTS];
+	int nready;	/**< Amount of valid entries in ready */
+} evloop_t;
+
+/**
+ * Initialize event loop
+ *
+ * @returns	0 on success, else an error code with errno set
+ */
+int evloop_init(evloop_t *loop);
+
+/**
+ * Cleanup event loop
+ *
+ * Event sources are not closed.
+ */
+void evloop_destroy(evloop_t *loop);
+
+/**
+ * Register event source
+ *
+ * @param loop		Event loop object
+ * @param src		Source object to initialize and register
+ * @param fd		File descriptor to watch
+ * @param events	Initial epoll events bit mask, may be 0
+ * @param cb		Callback function
+ * @param ctx		User context, stored in src->ctx
+ *
+ * @returns	0 on success, else an error code with errno set
+ */
+int evloop_add(evloop_t *loop, evloop_src_t *src, int fd, uint32_t events,
+		evloop_cb_t cb, void *ctx);
+
+/**
+ * Change events watched for a registered source
+ *
+ * Only results in a system call if the events mask actually changes.
+ *
+ * @returns	0 on success, else an error code with errno set
+ */
+int evloop_modify(evloop_t *loop, evloop_src_t *src, uint32_t events);
+
+/**
+ * Unregister event source
+ *
+ * Safe to call from within a callback, also for sources other than the one
+ * being dispatched. The file descriptor is not closed.
+ */
+void evloop_remove(evloop_t *loop, evloop_src_t *src);
+
+/**
+ * Wait for events and dispatch them
+ *
+ * @param loop		Event loop object
+ * @param timeout_ms	Maximum time to wait, or -1 to wait indefinitely
+ *
+ * @returns	0 on success or interrupted wait, an error code with errno
+ *		set if waiting failed, or the first error returned by a
+ *		callback. In the last case remaining events are not
+ *		dispatched.
+ */
+int evloop_run_once(evloop_t *loop, int timeout_ms);
+
+#endif // __EVLOOP_H__
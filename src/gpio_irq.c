@@ -0,0 +1,116 @@
+/**
+ * gpio_irq.c - Interrupt pin handling using the GPIO character device
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "gpio_irq.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "error.h"
+
+#define GPIO_IRQ_CONSUMER "rf_pkt_drv"
+
+/**
+ * Amount of events read from kernel per read() call
+ */
+#define GPIO_IRQ_EVENT_BATCH 16
+
+int gpio_irq_open(int *fd, const char *chip_path, unsigned int line)
+{
+	struct gpio_v2_line_request req;
+	int chip_fd;
+	int flags;
+
+	chip_fd = open(chip_path, O_RDONLY | O_CLOEXEC);
+	if (chip_fd == -1) {
+		return ERR_GPIO_OPEN_CHIP;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = line;
+	req.num_lines = 1;
+	strncpy(req.consumer, GPIO_IRQ_CONSUMER, sizeof(req.consumer) - 1);
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+			   GPIO_V2_LINE_FLAG_EDGE_RISING;
+
+	if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) == -1) {
+		SAVE_ERRNO(close(chip_fd));
+		return ERR_GPIO_REQUEST_LINE;
+	}
+	close(chip_fd);
+
+	// Don't hang on spurious wake ups
+	flags = fcntl(req.fd, F_GETFL);
+	if (flags == -1 || fcntl(req.fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		SAVE_ERRNO(close(req.fd));
+		return ERR_GPIO_REQUEST_LINE;
+	}
+
+	*fd = req.fd;
+
+	return ERR_OK;
+}
+
+void gpio_irq_close(int fd)
+{
+	close(fd);
+}
+
+int gpio_irq_read(int fd, uint64_t *timestamp, unsigned int *count)
+{
+	struct gpio_v2_line_event events[GPIO_IRQ_EVENT_BATCH];
+	unsigned int cnt = 0;
+	ssize_t len;
+
+	do {
+		len = read(fd, events, sizeof(events));
+		if (len == -1) {
+			if (errno == EAGAIN || errno == EINTR) {
+				break;
+			}
+			return ERR_GPIO_READ;
+		}
+
+		if (cnt == 0 && len >= sizeof(events[0])) {
+			*timestamp = events[0].timestamp_ns;
+		}
+		cnt += len / sizeof(events[0]);
+	} while (len == sizeof(events));
+
+	if (count != NULL) {
+		*count = cnt;
+	}
+
+	return ERR_OK;
+}
@@ -0,0 +1,67 @@
+/**
+ * gpio_irq.h - Interrupt pin handling using the GPIO character device
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __GPIO_IRQ_H__
+#define __GPIO_IRQ_H__
+
+#include <stdint.h>
+
+/**
+ * Request a GPIO line as rising edge interrupt source
+ *
+ * Uses the GPIO v2 line request API of the GPIO character device. The
+ * returned file descriptor becomes readable(EPOLLIN) on every rising edge.
+ *
+ * @param fd		Pointer to store line request file descriptor in
+ * @param chip_path	Path of GPIO chip device (eg. /dev/gpiochip0)
+ * @param line		Line offset on chip
+ *
+ * @returns	0 on success, else an error code
+ */
+int gpio_irq_open(int *fd, const char *chip_path, unsigned int line);
+
+/**
+ * Release GPIO line
+ */
+void gpio_irq_close(int fd);
+
+/**
+ * Read all pending edge events
+ *
+ * @param fd		Line request file descriptor
+ * @param timestamp	Pointer to store kernel timestamp of oldest pending
+ *			edge in, in nanoseconds(CLOCK_MONOTONIC). Not
+ *			modified if no events were pending.
+ * @param count		Pointer to store amount of read events in, may be
+ *			NULL
+ *
+ * @returns	0 on success, else an error code
+ */
+int gpio_irq_read(int fd, uint64_t *timestamp, unsigned int *count);
+
+#endif // __GPIO_IRQ_H__
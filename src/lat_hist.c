@@ -0,0 +1,129 @@
+/**
+ * lat_hist.c - Log-scale latency histograms
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "lat_hist.h"
+
+#include <inttypes.h>
+
+const char *lat_stage_name(lat_stage_t stage)
+{
+	static const char * const names[LAT_STAGE_CNT] = {
+		[LAT_STAGE_IRQ] = "irq",
+		[LAT_STAGE_SPI] = "spi",
+		[LAT_STAGE_QUEUE] = "queue",
+		[LAT_STAGE_CLIENT] = "client",
+		[LAT_STAGE_TOTAL] = "total",
+	};
+
+	if (stage >= LAT_STAGE_CNT) {
+		return "?";
+	}
+	return names[stage];
+}
+
+void lat_hist_snapshot(const lat_hist_t *h, lat_hist_t *out)
+{
+	size_t i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		out->count[i] = __atomic_load_n(&h->count[i], __ATOMIC_RELAXED);
+	}
+	out->sum_ns = __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED);
+}
+
+uint64_t lat_hist_total(const lat_hist_t *h)
+{
+	uint64_t total = 0;
+	size_t i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		total += __atomic_load_n(&h->count[i], __ATOMIC_RELAXED);
+	}
+
+	return total;
+}
+
+uint64_t lat_hist_percentile(const lat_hist_t *h, unsigned int pct)
+{
+	lat_hist_t snap;
+	uint64_t total;
+	uint64_t rank;
+	uint64_t cnt;
+	size_t i;
+
+	lat_hist_snapshot(h, &snap);
+	total = lat_hist_total(&snap);
+	if (total == 0) {
+		return 0;
+	}
+	if (pct > 100) {
+		pct = 100;
+	}
+
+	// Rank of percentile, rounded up, at least the first sample
+	rank = (total * pct + 99) / 100;
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	cnt = 0;
+	for (i = 0; i < LAT_HIST_BUCKETS - 1; i++) {
+		cnt += snap.count[i];
+		if (cnt >= rank) {
+			break;
+		}
+	}
+
+	return ((uint64_t) 2 << i) - 1;
+}
+
+void lat_hist_print(FILE *fp, const char *name, const lat_hist_t *h)
+{
+	lat_hist_t snap;
+	uint64_t total;
+	size_t i;
+
+	lat_hist_snapshot(h, &snap);
+	total = lat_hist_total(&snap);
+	if (total == 0) {
+		return;
+	}
+
+	fprintf(fp, "%s: count %" PRIu64 ", avg %" PRIu64 " ns, "
+		"p50 < %" PRIu64 " ns, p99 < %" PRIu64 " ns\n",
+		name, total, snap.sum_ns / total,
+		lat_hist_percentile(&snap, 50) + 1,
+		lat_hist_percentile(&snap, 99) + 1);
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		if (snap.count[i] != 0) {
+			fprintf(fp, "%s:   >= %10" PRIu64 " ns: %" PRIu64 "\n",
+				name, (i == 0) ? 0 : (uint64_t) 1 << i,
+				snap.count[i]);
+		}
+	}
+}
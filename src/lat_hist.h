@@ -0,0 +1,165 @@
+/**
+ * lat_hist.h - Log-scale latency histograms
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __LAT_HIST_H__
+#define __LAT_HIST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/**
+ * Amount of histogram buckets
+ *
+ * Bucket i counts latencies in [2^i, 2^(i+1)) ns, bucket 0 also counts 0 ns.
+ * The last bucket counts everything from 2^31 ns(~2.1 s).
+ */
+#define LAT_HIST_BUCKETS 32
+
+/**
+ * Hot path stages
+ */
+typedef enum {
+	LAT_STAGE_IRQ,		/**< IRQ edge to start of rf_handle() */
+	LAT_STAGE_SPI,		/**< Start of rf_handle() to FIFO read
+				     complete */
+	LAT_STAGE_QUEUE,	/**< FIFO read to enqueue in client RX buffer */
+	LAT_STAGE_CLIENT,	/**< Enqueue to client write complete */
+	LAT_STAGE_TOTAL,	/**< Arrival to client write complete */
+	LAT_STAGE_CNT
+} lat_stage_t;
+
+/**
+ * Latency histogram
+ *
+ * Counters are updated with relaxed atomic operations, so multiple threads
+ * can add to, and read from, the same histogram without locking.
+ */
+typedef struct {
+	uint64_t count[LAT_HIST_BUCKETS];
+	uint64_t sum_ns;	/**< Sum of all latencies */
+} lat_hist_t;
+
+/**
+ * Instrumentation statement, only compiled in with ENABLE_LATENCY_STATS
+ */
+#ifdef ENABLE_LATENCY_STATS
+# define LAT_EXEC(X) do { X; } while (0)
+#else
+# define LAT_EXEC(X) do { } while (0)
+#endif
+
+/**
+ * Record latency between two timestamps
+ *
+ * Nothing is recorded if one of the timestamps is unknown(0), or the
+ * histograms are NULL.
+ *
+ * @param hists		Per stage histograms
+ * @param stage		Stage to record
+ * @param start		Start time in ns
+ * @param end		End time in ns
+ */
+#define LAT_RECORD(hists, stage, start, end) \
+	LAT_EXEC(lat_record((hists), (stage), (start), (end)))
+
+/**
+ * Name of stage
+ */
+const char *lat_stage_name(lat_stage_t stage);
+
+/**
+ * Bucket index of latency
+ */
+static inline unsigned int lat_hist_bucket(uint64_t ns)
+{
+	unsigned int b;
+
+	if (ns < 2) {
+		return 0;
+	}
+	b = 63 - __builtin_clzll(ns);
+	return (b < LAT_HIST_BUCKETS) ? b : LAT_HIST_BUCKETS - 1;
+}
+
+/**
+ * Add latency to histogram
+ */
+static inline void lat_hist_add(lat_hist_t *h, uint64_t ns)
+{
+	__atomic_fetch_add(&h->count[lat_hist_bucket(ns)], 1,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * Add latency of stage, see LAT_RECORD()
+ */
+static inline void lat_record(lat_hist_t *hists, lat_stage_t stage,
+			      uint64_t start, uint64_t end)
+{
+	if (hists != NULL && start != 0 && end >= start) {
+		lat_hist_add(&hists[stage], end - start);
+	}
+}
+
+/**
+ * Copy histogram
+ *
+ * Every counter is read atomically, but the copy as a whole is not a
+ * consistent snapshot while the histogram is being updated.
+ */
+void lat_hist_snapshot(const lat_hist_t *h, lat_hist_t *out);
+
+/**
+ * Amount of latencies in histogram
+ */
+uint64_t lat_hist_total(const lat_hist_t *h);
+
+/**
+ * Estimate percentile
+ *
+ * @param h	Histogram
+ * @param pct	Percentile, 0 - 100
+ *
+ * @returns	Upper bound of the bucket containing the percentile in ns, or
+ *		0 if the histogram is empty
+ */
+uint64_t lat_hist_percentile(const lat_hist_t *h, unsigned int pct);
+
+/**
+ * Print summary and non-empty buckets of histogram
+ *
+ * @param fp	Stream to print to
+ * @param name	Name to prefix the lines with
+ * @param h	Histogram
+ */
+void lat_hist_print(FILE *fp, const char *name, const lat_hist_t *h);
+
+#endif // __LAT_HIST_H__
@@ -26,101 +26,2856 @@
  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE // for recvmmsg()/sendmmsg()
+
 #include "config.h"
 #include "version.h"
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <string.h>
-#include <unistd.h>
-#include <signal.h>
-#include <errno.h>
-#include <time.h>
-#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <sched.h>
+#include <malloc.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <netdb.h>
+
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+
+#include "error.h"
+#include "evloop.h"
+#include "pkt_buf.h"
+#include "pkt_filter.h"
+#include "pkt_dedup.h"
+#include "uplink.h"
+#include "ring_buf.h"
+#include "shm_ring.h"
+#include "metrics.h"
+#include "spi.h"
+#include "radio.h"
+#include "debug.h"
+
+#include "rf_dev.h"
+
+#define RING_BUFFER_SIZE 4096
+#define PKT_BUFFER_SLOTS 64
+
+/**
+ * Amount of frames queued per client
+ *
+ * Kept small so that frames of multiple clients are interleaved fairly.
+ */
+#define TX_QUEUE_SLOTS 4
+
+/**
+ * Free RX slots guaranteed before servicing the transceiver
+ */
+#define RX_RESERVE_SLOTS 8
+
+/**
+ * Max. amount of messages moved per recvmmsg()/sendmmsg() call
+ */
+#define CLIENT_MSG_BATCH 16
+
+/**
+ * Max. amount of received frames held for a batching client
+ *
+ * Frames are held in the shared RX buffer, so this leaves room for the other
+ * clients.
+ */
+#define CLIENT_BATCH_MAX (PKT_BUFFER_SLOTS / 2)
+
+/**
+ * Amount of packet slots in shared memory ring of 'shm' clients
+ */
+#define SHM_RING_SLOTS 256
+
+/**
+ * Maximum size of metrics text
+ */
+#define METRICS_BUFFER_SIZE 16384
+
+/**
+ * Default amount of frames spooled for the uplink, must be a power of 2
+ */
+#define UPLINK_SPOOL_SLOTS 1024
+
+/**
+ * Max. amount of messages sent per sendmmsg()/writev() to the uplink
+ */
+#define UPLINK_MSG_BATCH 32
+
+/**
+ * Amount of frames from the uplink queued for transmission
+ */
+#define UPLINK_TX_SLOTS 8
+
+/**
+ * Reconnect interval of the uplink, doubles on every failure
+ */
+#define UPLINK_RETRY_MIN_MS 1000
+#define UPLINK_RETRY_MAX_MS 30000
+
+#define MAX_LISTENERS 4
+#define MAX_CLIENTS 16
+#define MAX_RADIOS 4
+
+unsigned int debug_level = 0;
+
+/**
+ * Policy for clients that don't keep up with the received frames
+ */
+typedef enum {
+	SLOW_CLIENT_DROP,	/**< Drop oldest frames for this client */
+	SLOW_CLIENT_DISCONNECT,	/**< Disconnect client */
+} slow_client_policy_t;
+
+struct drv;
+
+/**
+ * Client socket
+ */
+typedef struct {
+	struct drv *drv;
+	evloop_src_t src;
+	int fd;
+
+	int sock_type;		/**< SOCK_STREAM or SOCK_SEQPACKET */
+	int meta;		/**< Prefix frames with meta data */
+	slow_client_policy_t policy;
+	int radio;		/**< Radio to receive from and transmit on, -1
+				     to receive from all and transmit on 0 */
+	bool shm;		/**< Receives frames through shm_ring */
+	shm_ring_t shm_ring;
+	pkt_filter_t filter;	/**< Received frames to deliver */
+	pid_t pid;		/**< Process of client, for 'filter' command */
+	uint32_t batch_hold;	/**< Max. time in us received frames are held
+				     to write them in one go, 0 to write right
+				     away */
+	size_t batch_frames;	/**< Write once this many frames are held */
+	size_t batch_bytes;	/**< Write once this many bytes are held, 0 if
+				     unlimited */
+	bool rx_flushing;	/**< Writing held frames */
+	uint64_t rx_flush_at;	/**< Time held frames must be written, 0 if
+				     none are held */
+
+	size_t rx_seq;		/**< Sequence number of next RX frame */
+	size_t rx_off;		/**< Bytes of current RX frame already written */
+	pkt_t rx_partial;	/**< Copy of partially written frame dropped
+				     from RX buffer */
+	bool rx_partial_valid;
+	unsigned long rx_dropped;
+
+	pkt_buf_t tx_pkts;	/**< Frames to transmit */
+	ring_buf_t tx_data;	/**< Stream data not yet split into frames */
+} client_t;
+
+/**
+ * Listening socket
+ */
+typedef struct {
+	struct drv *drv;
+	evloop_src_t src;
+	int fd;
+
+	const char *path;
+	int sock_type;		/**< SOCK_STREAM or SOCK_SEQPACKET */
+	int meta;		/**< Prefix frames with meta data */
+	slow_client_policy_t policy;
+	int radio;		/**< Radio of clients, see client_t */
+	bool shm;		/**< Deliver frames through shared memory */
+	pkt_filter_t filter;	/**< Filter of clients, see client_t */
+	uint32_t batch_hold;	/**< Batching of clients, see client_t */
+	size_t batch_frames;
+	size_t batch_bytes;
+} listener_t;
+
+/**
+ * Transceiver serviced by its own radio thread
+ */
+typedef struct {
+	struct drv *drv;
+	evloop_src_t src;	/**< Notifications from radio thread */
+	radio_t radio;
+	size_t tx_hwm;		/**< Max. frames queued in radio.tx_pkts */
+} drv_radio_t;
+
+/**
+ * Connection to remote collector
+ */
+typedef struct {
+	struct drv *drv;
+	evloop_src_t src;
+	int fd;			/**< Socket, -1 while disconnected */
+
+	const char *host;	/**< Collector host, NULL if uplink disabled */
+	const char *port;
+	int sock_type;		/**< SOCK_DGRAM(udp) or SOCK_STREAM(tcp) */
+	struct sockaddr_storage addr;	/**< Resolved collector address */
+	socklen_t addr_len;
+	uint32_t gateway;	/**< Gateway ID in messages */
+	bool connected;		/**< Connection established */
+
+	pkt_buf_t spool;	/**< Received frames not yet sent */
+	size_t spool_slots;
+	size_t tx_off;		/**< Bytes of oldest spooled message already
+				     written to TCP stream */
+
+	uint8_t rx_data[2 * (UPLINK_HDR_LEN + PKT_MAX_LEN)]; /**< TCP stream
+				     data not yet split into messages */
+	size_t rx_len;
+	pkt_buf_t tx_pkts;	/**< Frames to transmit, with radio index */
+
+	evloop_src_t timer_src;
+	int timer_fd;		/**< Reconnect timer */
+	uint32_t retry_ms;	/**< Next reconnect interval */
+
+	// Counters, see metrics_collect()
+	uint64_t sent;		/**< Messages sent to collector */
+	uint64_t spool_drops;	/**< Frames dropped because spool was full */
+	uint64_t tx_frames;	/**< Frames to transmit from collector */
+	uint64_t connects;	/**< Established connections */
+} uplink_t;
+
+/**
+ * Daemon state shared by the event callbacks
+ */
+typedef struct drv {
+	evloop_t loop;
+	int terminate;
+
+	drv_radio_t radios[MAX_RADIOS];
+	size_t radio_cnt;
+
+	pkt_buf_t rx_pkts;	/**< Received frames of all radios, shared by
+				     all clients */
+	size_t tx_next;		/**< Next client to take a TX frame from */
+	pkt_dedup_t dedup;	/**< Duplicate detector, window 0 if disabled */
+
+	listener_t listeners[MAX_LISTENERS];
+	size_t listener_cnt;
+	client_t clients[MAX_CLIENTS];
+	listener_t metrics;	/**< Metrics socket, path NULL if disabled */
+	listener_t control;	/**< Control socket, path NULL if disabled */
+	uplink_t uplink;	/**< Collector connection, host NULL if
+				     disabled */
+
+	evloop_src_t signal_src;
+	int signal_fd;
+	evloop_src_t batch_src;
+	int batch_fd;		/**< Timer to write frames held for clients */
+	uint64_t batch_deadline; /**< Expiration of batch_fd, 0 if disarmed */
+
+	// Counters, see on_metrics()
+	uint64_t loop_wakeups;	/**< Event loop iterations */
+	uint64_t client_drops;	/**< Frames dropped for slow clients */
+	uint64_t rx_duplicates;	/**< Received frames dropped as duplicate */
+	uint64_t rx_filtered;	/**< Received frames dropped by client filters */
+	size_t rx_hwm;		/**< Max. frames queued in rx_pkts */
+} drv_t;
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Packetized Radio Transceiver User Space driver - " VERSION "\n"
+		"Usage: %s [-v] [-d <device>] [-c <config>] [-s <socket>[,<opt>...]]\n"
+		"          [-i <line>] [-I <gpiochip>] [-p <msec>] [-m] [-S]"
+		"\n"
+		"          [-b <backend>] [-C <crc>] [-r <device>,<config>[,<opt>...]]\n"
+		"          [-P <prio>] [-L] [-g <usec>] [-F <clock>[:<clock>]] [-M <mode>]\n"
+		"          [-X] [-k <socket>] [-K <socket>]\n"
+		"          [-T <trace>] [-H <channels>] [-D <msec>]\n"
+		"          [-U <proto>:<host>:<port>[,<opt>...]]\n"
+		"\n"
+		"Options:\n"
+		" -c <path>	Register Configuration file or profile image\n"
+		" -d <path>	SPI device file to use (default: " DEFAULT_DEV_PATH ")\n"
+		" -r <dev>,<cfg>	Transceiver on SPI device <dev> with configuration <cfg>\n"
+		"		Can be given up to %d times, replaces -d and -c.\n"
+		"		Options default to the -i, -I, -b, -P, -g, -F and -M values:\n"
+		"		  irq=<line>, chip=<path>: IRQ GPIO line\n"
+		"		  backend=<name>: transceiver backend\n"
+		"		  cpu=<n>: CPU to run radio thread on\n"
+		"		  prio=<n>: real-time priority of radio thread\n"
+		"		  gap=<usec>: inter frame gap\n"
+		"		  hop=<channels>: channel hop list\n"
+		"		  spi=<clock>[:<clock>], spimode=<n>: SPI link settings\n"
+		" -s <path>	Socket path for clients (default: " DEFAULT_SOCK_PATH ")\n"
+		"		Can be given up to %d times. Options:\n"
+		"		  stream, seqpacket: socket type\n"
+		"		  meta: prefix received frames with meta data\n"
+		"		  drop, disconnect: policy for slow clients\n"
+		"		  (default: drop oldest frames)\n"
+		"		  shm: receive frames through shared memory ring\n"
+		"		  radio=<n>: only use transceiver n, see -r\n"
+		"		  filter=<rules>: only receive matching frames\n"
+		"		  (format: <hdr|addr><offset>[!]=<hex>[/<mask>][:...])\n"
+		"		  hold=<usec>: hold received frames up to <usec>, to\n"
+		"		  write them in batches (default: 0)\n"
+		"		  batch=<frames>[:<bytes>]: write held frames once\n"
+		"		  this many are held (default: %d, max. %d)\n"
+		" -i <line>	IRQ GPIO line offset, or -1 to use polling (default: %d)\n"
+		" -I <path>	GPIO chip device of IRQ line (default: " DEFAULT_GPIO_CHIP ")\n"
+		" -p <msec>	Transceiver poll interval (default: %d)\n"
+		" -m		Default to 'meta' option for all sockets\n"
+		" -S		Default to 'seqpacket' option for all sockets\n"
+		" -b <name>	Transceiver backend, 'auto' to detect from chip version\n"
+		"		(default: " DEFAULT_RF_BACKEND ")\n"
+		" -C <crc>	Check CRC of received frames in software, or 'none'.\n"
+		"		Format: [ibm|ccitt][,poly=<hex>][,init=<hex>][,skip=<n>][,lsb]\n"
+		"		(default: 'ibm' for sx1231, 'none' for si443x)\n"
+		" -P <prio>	Run radio threads with SCHED_FIFO priority <prio>,\n"
+		"		or 0 for normal scheduling (default: 0)\n"
+		" -L		Lock all memory and pre-fault buffers\n"
+		" -g <usec>	Minimum time between transmitted frames (default: 0)\n"
+		" -F <clock>[:<FIFO clock>]\n"
+		"		SPI clock rate in Hz, optionally with 'k' or 'M' suffix,\n"
+		"		and a higher rate for FIFO accesses (default: driver)\n"
+		" -M <mode>	SPI mode, 0-3 (default: driver)\n"
+		" -X		Measure SPI links at increasing clock rates, print the\n"
+		"		fastest reliable one and exit\n"
+		" -k <path>	Socket to read statistics from, in Prometheus text format\n"
+		" -K <path>	Datagram socket accepting control commands\n"
+		" -T <path>	Record all SPI accesses to trace file <path>\n"
+		" -H <list>	Hop over channels, format: <MHz>[@<msec>][:...][:adapt]\n"
+		"		Stays <msec> on a channel (default: %d), 'adapt' adapts\n"
+		"		the dwell times to the amount of received frames\n"
+		" -D <msec>	Drop frames identical to a frame received less than\n"
+		"		<msec> ago, 0 disables this (default: 0)\n"
+		" -U <proto>:<host>:<port>\n"
+		"		Forward frames to collector, proto is 'udp' or 'tcp'.\n"
+		"		Options:\n"
+		"		  gw=<id>: gateway ID in messages (default: 0)\n"
+		"		  spool=<frames>: frames kept while collector is\n"
+		"		  unreachable, power of 2 (default: %d)\n"
+		" -v		Increase verbosity level, use multiple times for more logging\n"
+		" -h		Display this help message\n",
+		name, MAX_RADIOS, MAX_LISTENERS, CLIENT_MSG_BATCH,
+		CLIENT_BATCH_MAX, DEFAULT_IRQ_PIN,
+		DEFAULT_POLL_INTERVAL, RADIO_DEFAULT_DWELL_MS,
+		UPLINK_SPOOL_SLOTS);
+}
+
+/**
+ * Parse socket specification
+ *
+ * Format: <path>[,<opt>...]. The options modify the defaults already stored
+ * in the listener object.
+ *
+ * @param l	Listener object to store settings in
+ * @param spec	Socket specification, is modified
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int listener_parse(listener_t *l, char *spec)
+{
+	struct sockaddr_un local;
+	char *opt;
+
+	l->path = strsep(&spec, ",");
+	if (strlen(l->path) == 0 || strlen(l->path) >= sizeof(local.sun_path)) {
+		fprintf(stderr, "Invalid socket path length (max=%zu)\n",
+			sizeof(local.sun_path) - 1);
+		return -1;
+	}
+
+	while ((opt = strsep(&spec, ",")) != NULL) {
+		if (strcmp(opt, "stream") == 0) {
+			l->sock_type = SOCK_STREAM;
+		} else if (strcmp(opt, "seqpacket") == 0) {
+			l->sock_type = SOCK_SEQPACKET;
+		} else if (strcmp(opt, "meta") == 0) {
+			l->meta = 1;
+		} else if (strcmp(opt, "drop") == 0) {
+			l->policy = SLOW_CLIENT_DROP;
+		} else if (strcmp(opt, "disconnect") == 0) {
+			l->policy = SLOW_CLIENT_DISCONNECT;
+		} else if (strcmp(opt, "shm") == 0) {
+			l->shm = true;
+		} else if (strncmp(opt, "filter=", 7) == 0) {
+			if (pkt_filter_parse(&l->filter, opt + 7) != 0) {
+				return -1;
+			}
+		} else if (strncmp(opt, "hold=", 5) == 0) {
+			char *endp;
+			unsigned long val = strtoul(opt + 5, &endp, 10);
+			if (opt[5] == '\0' || *endp != '\0' ||
+			    val > UINT32_MAX) {
+				fprintf(stderr, "Invalid hold time '%s'\n",
+					opt + 5);
+				return -1;
+			}
+			l->batch_hold = val;
+		} else if (strncmp(opt, "batch=", 6) == 0) {
+			char *endp;
+			l->batch_frames = strtoul(opt + 6, &endp, 10);
+			l->batch_bytes = 0;
+			if (*endp == ':' && endp[1] != '\0') {
+				l->batch_bytes = strtoul(endp + 1, &endp, 10);
+			}
+			if (opt[6] == '\0' || *endp != '\0' ||
+			    l->batch_frames == 0 ||
+			    l->batch_frames > CLIENT_BATCH_MAX) {
+				fprintf(stderr, "Invalid batch size '%s'\n",
+					opt + 6);
+				return -1;
+			}
+		} else if (strncmp(opt, "radio=", 6) == 0) {
+			char *endp;
+			l->radio = strtol(opt + 6, &endp, 10);
+			if (opt[6] == '\0' || *endp != '\0' || l->radio < 0) {
+				fprintf(stderr, "Invalid radio index '%s'\n",
+					opt + 6);
+				return -1;
+			}
+		} else {
+			fprintf(stderr, "Unknown socket option '%s'\n", opt);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Create listening socket
+ */
+static int listener_open(listener_t *l)
+{
+	struct sockaddr_un local;
+
+	if ((l->fd = socket(AF_UNIX, l->sock_type, 0)) == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	local.sun_family = AF_UNIX;
+	assert(strlen(l->path) < sizeof(local.sun_path));
+	strcpy(local.sun_path, l->path);
+	unlink(local.sun_path);
+	if (bind(l->fd, (struct sockaddr *)&local,
+			strlen(local.sun_path) + sizeof(local.sun_family)) == -1) {
+		perror("bind");
+		return -1;
+	}
+
+	if (l->sock_type != SOCK_DGRAM && listen(l->fd, 5) == -1) {
+		perror("listen");
+		return -1;
+	}
+
+	// Identify sender of control commands, see control_exec()
+	if (l->sock_type == SOCK_DGRAM && setsockopt(l->fd, SOL_SOCKET,
+			SO_PASSCRED, &(int) { 1 }, sizeof(int)) == -1) {
+		perror("setsockopt(SO_PASSCRED)");
+		return -1;
+	}
+
+	if (chmod(l->path, 0777) != 0) {
+		perror("chmod");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Close listening socket
+ */
+static void listener_close(listener_t *l)
+{
+	if (l->fd == -1) {
+		return;
+	}
+
+	close(l->fd);
+	unlink(l->path);
+	l->fd = -1;
+}
+
+/**
+ * Look up transceiver backend by name
+ *
+ * @param name	Backend name, or 'auto' to detect the backend
+ * @param ops	Returns backend, or NULL for 'auto'
+ *
+ * @returns	0 on success, -1 if backend is unknown
+ */
+static int backend_parse(const char *name, const rf_ops_t **ops)
+{
+	size_t i;
+
+	*ops = NULL;
+	if (strcmp(name, "auto") == 0) {
+		return 0;
+	}
+
+	*ops = rf_find_backend(name);
+	if (*ops == NULL) {
+		fprintf(stderr, "Unknown backend '%s', supported:", name);
+		for (i = 0; rf_backend_at(i) != NULL; i++) {
+			fprintf(stderr, " %s", rf_backend_at(i)->name);
+		}
+		fprintf(stderr, "\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse real-time priority
+ *
+ * @returns	0 on success, -1 if priority is invalid
+ */
+static int priority_parse(const char *s, int *priority)
+{
+	char *endp;
+
+	*priority = strtol(s, &endp, 10);
+	if (*s == '\0' || *endp != '\0' || *priority < 0 ||
+			*priority > sched_get_priority_max(SCHED_FIFO)) {
+		fprintf(stderr, "Priority must be between 0 and %d\n",
+			sched_get_priority_max(SCHED_FIFO));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse inter frame gap
+ *
+ * @returns	0 on success, -1 if gap is invalid
+ */
+static int gap_parse(const char *s, uint32_t *gap)
+{
+	unsigned long val;
+	char *endp;
+
+	errno = 0;
+	val = strtoul(s, &endp, 10);
+	if (*s == '\0' || *endp != '\0' || errno != 0 || val > UINT32_MAX) {
+		fprintf(stderr, "Invalid inter frame gap '%s'\n", s);
+		return -1;
+	}
+	*gap = val;
+
+	return 0;
+}
+
+/**
+ * Parse SPI clock rate, with optional 'k' or 'M' suffix
+ *
+ * @returns	Pointer to first character after clock rate, or NULL if
+ *		invalid
+ */
+static const char *spi_clock_parse(const char *s, uint32_t *hz)
+{
+	double val;
+	char *endp;
+
+	val = strtod(s, &endp);
+	if (endp == s || val <= 0) {
+		return NULL;
+	}
+	if (*endp == 'k') {
+		val *= 1000;
+		endp++;
+	} else if (*endp == 'M') {
+		val *= 1000000;
+		endp++;
+	}
+	if (val < 1 || val > UINT32_MAX) {
+		return NULL;
+	}
+	*hz = val + 0.5;
+
+	return endp;
+}
+
+/**
+ * Parse SPI clock rates
+ *
+ * Format: <clock>[:<FIFO clock>]
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int spi_speed_parse(const char *s, spi_config_t *cfg)
+{
+	const char *p;
+
+	cfg->fifo_speed_hz = 0;
+	p = spi_clock_parse(s, &cfg->speed_hz);
+	if (p != NULL && *p == ':') {
+		p = spi_clock_parse(p + 1, &cfg->fifo_speed_hz);
+	}
+	if (p == NULL || *p != '\0') {
+		fprintf(stderr, "Invalid SPI clock rate '%s'\n", s);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse SPI mode
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int spi_mode_parse(const char *s, int *mode)
+{
+	char *endp;
+
+	*mode = strtol(s, &endp, 10);
+	if (*s == '\0' || *endp != '\0' || *mode < 0 || *mode > 3) {
+		fprintf(stderr, "SPI mode must be between 0 and 3\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse channel hop list
+ *
+ * Format: <MHz>[@<msec>][:<MHz>[@<msec>]...][:adapt]
+ *
+ * @param s	Hop list
+ * @param r	Radio object to store channels in
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int hop_parse(const char *s, radio_t *r)
+{
+	const char *p = s;
+	char *endp;
+
+	r->channel_cnt = 0;
+	r->hop_adapt = false;
+
+	while (*p != '\0') {
+		if (strncmp(p, "adapt", 5) == 0 &&
+		    (p[5] == ':' || p[5] == '\0')) {
+			r->hop_adapt = true;
+			p += 5;
+		} else {
+			radio_channel_t *ch = &r->channels[r->channel_cnt];
+			double mhz;
+
+			if (r->channel_cnt == RADIO_MAX_CHANNELS) {
+				fprintf(stderr, "Too many channels (max=%d)\n",
+					RADIO_MAX_CHANNELS);
+				return -1;
+			}
+
+			memset(ch, 0, sizeof(*ch));
+			mhz = strtod(p, &endp);
+			if (endp == p || mhz <= 0 || mhz >= 4294) {
+				fprintf(stderr, "Invalid channel frequency in "
+					"'%s'\n", s);
+				return -1;
+			}
+			ch->freq = mhz * 1000000 + 0.5;
+			ch->dwell_ms = RADIO_DEFAULT_DWELL_MS;
+			p = endp;
+
+			if (*p == '@') {
+				unsigned long val;
+
+				errno = 0;
+				val = strtoul(p + 1, &endp, 10);
+				if (endp == p + 1 || errno != 0 || val == 0 ||
+				    val > UINT32_MAX / 1000) {
+					fprintf(stderr, "Invalid dwell time in "
+						"'%s'\n", s);
+					return -1;
+				}
+				ch->dwell_ms = val;
+				p = endp;
+			}
+			r->channel_cnt++;
+		}
+
+		if (*p == ':' && p[1] != '\0') {
+			p++;
+		} else if (*p != '\0') {
+			fprintf(stderr, "Invalid channel list '%s'\n", s);
+			return -1;
+		}
+	}
+
+	if (r->channel_cnt == 0) {
+		fprintf(stderr, "Channel list '%s' has no channels\n", s);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse transceiver specification
+ *
+ * Format: <device>,<config>[,<opt>...]. The options modify the defaults
+ * already stored in the radio object.
+ *
+ * @param r	Radio object to store settings in
+ * @param spec	Transceiver specification, is modified
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int radio_parse(radio_t *r, char *spec)
+{
+	char *opt;
+	char *endp;
+
+	r->dev_path = strsep(&spec, ",");
+	r->cfg_path = strsep(&spec, ",");
+	if (strlen(r->dev_path) == 0 || r->cfg_path == NULL ||
+			strlen(r->cfg_path) == 0) {
+		fprintf(stderr, "Transceiver requires a device and a configuration file\n");
+		return -1;
+	}
+
+	while ((opt = strsep(&spec, ",")) != NULL) {
+		if (strncmp(opt, "irq=", 4) == 0) {
+			r->gpio_pin = strtol(opt + 4, &endp, 10);
+			if (opt[4] == '\0' || *endp != '\0') {
+				fprintf(stderr, "IRQ pin number must be a integer number.\n");
+				return -1;
+			}
+		} else if (strncmp(opt, "chip=", 5) == 0) {
+			r->gpio_chip = opt + 5;
+		} else if (strncmp(opt, "cpu=", 4) == 0) {
+			r->cpu = strtol(opt + 4, &endp, 10);
+			if (opt[4] == '\0' || *endp != '\0' || r->cpu < 0 ||
+					r->cpu >= CPU_SETSIZE) {
+				fprintf(stderr, "Invalid CPU number '%s'\n",
+					opt + 4);
+				return -1;
+			}
+		} else if (strncmp(opt, "prio=", 5) == 0) {
+			if (priority_parse(opt + 5, &r->priority) != 0) {
+				return -1;
+			}
+		} else if (strncmp(opt, "gap=", 4) == 0) {
+			if (gap_parse(opt + 4, &r->tx_gap) != 0) {
+				return -1;
+			}
+		} else if (strncmp(opt, "hop=", 4) == 0) {
+			if (hop_parse(opt + 4, r) != 0) {
+				return -1;
+			}
+		} else if (strncmp(opt, "spi=", 4) == 0) {
+			if (spi_speed_parse(opt + 4, &r->spi) != 0) {
+				return -1;
+			}
+		} else if (strncmp(opt, "spimode=", 8) == 0) {
+			if (spi_mode_parse(opt + 8, &r->spi.mode) != 0) {
+				return -1;
+			}
+		} else if (strncmp(opt, "backend=", 8) == 0) {
+			if (backend_parse(opt + 8, &r->backend) != 0) {
+				return -1;
+			}
+		} else {
+			fprintf(stderr, "Unknown transceiver option '%s'\n",
+				opt);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Parse uplink specification
+ *
+ * Format: <udp|tcp>:<host>:<port>[,<opt>...], IPv6 addresses are enclosed
+ * in brackets.
+ *
+ * @param u	Uplink object to store settings in
+ * @param spec	Uplink specification, is modified
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int uplink_parse(uplink_t *u, char *spec)
+{
+	char *endpoint;
+	char *proto;
+	char *opt;
+	char *endp;
+
+	endpoint = strsep(&spec, ",");
+	proto = strsep(&endpoint, ":");
+	if (strcmp(proto, "udp") == 0) {
+		u->sock_type = SOCK_DGRAM;
+	} else if (strcmp(proto, "tcp") == 0) {
+		u->sock_type = SOCK_STREAM;
+	} else {
+		fprintf(stderr, "Unknown uplink protocol '%s'\n", proto);
+		return -1;
+	}
+
+	if (endpoint != NULL && *endpoint == '[') {
+		u->host = endpoint + 1;
+		endpoint = strchr(endpoint, ']');
+		if (endpoint != NULL) {
+			*endpoint++ = '\0';
+			if (*endpoint != ':') {
+				endpoint = NULL;
+			}
+		}
+	} else if (endpoint != NULL) {
+		u->host = endpoint;
+		endpoint = strrchr(endpoint, ':');
+	}
+	if (endpoint == NULL || *u->host == '\0' || endpoint[1] == '\0') {
+		fprintf(stderr, "Uplink must be given as "
+			"<proto>:<host>:<port>\n");
+		u->host = NULL;
+		return -1;
+	}
+	*endpoint = '\0';
+	u->port = endpoint + 1;
+
+	while ((opt = strsep(&spec, ",")) != NULL) {
+		if (strncmp(opt, "gw=", 3) == 0) {
+			unsigned long val = strtoul(opt + 3, &endp, 0);
+			if (opt[3] == '\0' || *endp != '\0' ||
+			    val > UINT32_MAX) {
+				fprintf(stderr, "Invalid gateway ID '%s'\n",
+					opt + 3);
+				return -1;
+			}
+			u->gateway = val;
+		} else if (strncmp(opt, "spool=", 6) == 0) {
+			u->spool_slots = strtoul(opt + 6, &endp, 10);
+			if (opt[6] == '\0' || *endp != '\0' ||
+			    u->spool_slots == 0 ||
+			    (u->spool_slots & (u->spool_slots - 1)) != 0) {
+				fprintf(stderr, "Spool size must be a power "
+					"of 2\n");
+				return -1;
+			}
+		} else {
+			fprintf(stderr, "Unknown uplink option '%s'\n", opt);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int on_client(evloop_src_t *src, uint32_t events);
+
+/**
+ * Radio a client transmits on
+ */
+static radio_t *client_radio(const client_t *c)
+{
+	return &c->drv->radios[c->radio < 0 ? 0 : c->radio].radio;
+}
+
+/**
+ * Check if frame received by radio passes filter of client
+ */
+static bool client_filter(const client_t *c, const radio_t *r,
+			  const pkt_t *pkt)
+{
+	pkt_filter_layout_t layout;
+
+	if (c->filter.cnt == 0) {
+		return true;
+	}
+
+	layout.hdr_len = r->dev.hdrlen;
+	layout.len_byte = (r->dev.fixpklen == 0);
+
+	return pkt_filter_match(&c->filter, &layout, pkt->data, pkt->meta.len);
+}
+
+/**
+ * Check if received frame should be delivered to client
+ */
+static bool client_wants(const client_t *c, const pkt_t *pkt)
+{
+	return (c->radio < 0 || pkt->meta.radio == c->radio) &&
+		client_filter(c, &c->drv->radios[pkt->meta.radio].radio, pkt);
+}
+
+#ifdef ENABLE_LATENCY_STATS
+/**
+ * Record latency of frame delivered to client
+ */
+static void client_lat_written(client_t *c, const pkt_t *pkt)
+{
+	drv_t *drv = c->drv;
+	lat_hist_t *lat = drv->radios[pkt->meta.radio].radio.dev.lat;
+	const uint64_t now = rf_clock_ns();
+
+	lat_record(lat, LAT_STAGE_CLIENT, *pkt_buf_stamp(&drv->rx_pkts, pkt),
+		   now);
+	lat_record(lat, LAT_STAGE_TOTAL, pkt->meta.timestamp, now);
+}
+#endif
+
+/**
+ * Advance RX position of client over frames of other radios
+ */
+static void client_skip(client_t *c)
+{
+	const pkt_t *pkt;
+
+	if (c->rx_off != 0 && ! c->rx_partial_valid) {
+		// Current frame is partially written
+		return;
+	}
+
+	while ((pkt = pkt_buf_get(&c->drv->rx_pkts, c->rx_seq)) != NULL &&
+			! client_wants(c, pkt)) {
+		c->rx_seq++;
+	}
+}
+
+/**
+ * Release RX frames that were consumed by all clients
+ */
+static void rx_release(drv_t *drv)
+{
+	size_t oldest = pkt_buf_head(&drv->rx_pkts);
+	size_t i;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		const client_t *c = &drv->clients[i];
+
+		if (c->fd != -1 && c->rx_seq < oldest) {
+			oldest = c->rx_seq;
+		}
+	}
+
+	pkt_buf_pop_n(&drv->rx_pkts, oldest - pkt_buf_tail(&drv->rx_pkts));
+}
+
+/**
+ * Close client connection
+ */
+static void client_close(client_t *c)
+{
+	if (c->fd == -1) {
+		return;
+	}
+
+	if (c->rx_dropped) {
+		DBG_PRINTF(DBG_LVL_LOW, "Client dropped %lu frames\n",
+			   c->rx_dropped);
+	}
+
+	evloop_remove(&c->drv->loop, &c->src);
+	close(c->fd);
+	c->fd = -1;
+	if (c->shm) {
+		shm_ring_destroy(&c->shm_ring);
+		c->shm = false;
+	}
+
+	rx_release(c->drv);
+}
+
+/**
+ * Get client representation of received frame
+ *
+ * @param c	Client object
+ * @param pkt	Received packet
+ * @param len	Returns length of data
+ *
+ * @returns	Pointer to data to send to client
+ */
+static const uint8_t *client_frame(const client_t *c, const pkt_t *pkt,
+				   size_t *len)
+{
+	*len = pkt->meta.len;
+	if (c->meta) {
+		// Meta data directly precedes the frame data
+		*len += sizeof(pkt->meta);
+		return (const uint8_t *) &pkt->meta;
+	}
+	return pkt->data;
+}
+
+/**
+ * Check if received frames should be written to client now
+ *
+ * Frames of a batching client are held until batch_frames or batch_bytes
+ * frames are held, the oldest frame was received batch_hold ago, or the
+ * shared RX buffer runs full. All held frames are then written before new
+ * frames are held again. Otherwise rx_flush_at is set to the time the
+ * frames must be written.
+ */
+static bool client_rx_due(client_t *c)
+{
+	drv_t *drv = c->drv;
+	const pkt_t *pkt;
+	size_t frames = 0;
+	size_t bytes = 0;
+	size_t seq;
+	size_t len;
+
+	c->rx_flush_at = 0;
+	if (c->rx_partial_valid || c->rx_off != 0) {
+		return true;
+	}
+	if (c->rx_seq == pkt_buf_head(&drv->rx_pkts)) {
+		c->rx_flushing = false;
+		return false;
+	}
+	if (c->batch_hold == 0 || c->rx_flushing ||
+	    pkt_buf_free(&drv->rx_pkts) < 2 * RX_RESERVE_SLOTS) {
+		c->rx_flushing = true;
+		return true;
+	}
+
+	// client_skip() moved rx_seq to the oldest frame of the client
+	for (seq = c->rx_seq; (pkt = pkt_buf_get(&drv->rx_pkts, seq)) != NULL;
+			seq++) {
+		if (client_wants(c, pkt)) {
+			client_frame(c, pkt, &len);
+			frames++;
+			bytes += len;
+		}
+	}
+	pkt = pkt_buf_get(&drv->rx_pkts, c->rx_seq);
+	c->rx_flush_at = pkt->meta.timestamp + c->batch_hold * 1000ULL;
+
+	if (frames >= c->batch_frames ||
+	    (c->batch_bytes != 0 && bytes >= c->batch_bytes) ||
+	    rf_clock_ns() >= c->rx_flush_at) {
+		c->rx_flush_at = 0;
+		c->rx_flushing = true;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Update the events watched on the client socket to the buffer state
+ */
+static int client_update_events(client_t *c)
+{
+	uint32_t events = 0;
+
+	if (c->fd == -1) {
+		return ERR_OK;
+	}
+
+	client_skip(c);
+	if (! c->shm && client_rx_due(c)) {
+		events |= EPOLLOUT;
+	}
+	if (c->sock_type == SOCK_SEQPACKET) {
+		if (! pkt_buf_full(&c->tx_pkts)) {
+			events |= EPOLLIN;
+		}
+	} else if (! ring_buf_full(&c->tx_data)) {
+		events |= EPOLLIN;
+	}
+
+	return evloop_modify(&c->drv->loop, &c->src, events);
+}
+
+/**
+ * Make room in the shared RX buffer
+ *
+ * Drops the oldest frames until RX_RESERVE_SLOTS slots are free. Clients
+ * that still had to read a dropped frame are handled according to their
+ * slow client policy.
+ */
+static void rx_make_room(drv_t *drv)
+{
+	size_t i;
+
+	while (pkt_buf_free(&drv->rx_pkts) < RX_RESERVE_SLOTS) {
+		const size_t seq = pkt_buf_tail(&drv->rx_pkts);
+
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			client_t *c = &drv->clients[i];
+
+			if (c->fd == -1 || c->rx_seq != seq) {
+				continue;
+			}
+
+			if (! client_wants(c, pkt_buf_get(&drv->rx_pkts, seq))) {
+				c->rx_seq++;
+				continue;
+			}
+
+			if (c->policy == SLOW_CLIENT_DISCONNECT) {
+				// NOTE: not using client_close(), since that
+				// releases RX frames itself
+				fprintf(stderr, "Client too slow, disconnecting\n");
+				evloop_remove(&drv->loop, &c->src);
+				close(c->fd);
+				c->fd = -1;
+				if (c->shm) {
+					shm_ring_destroy(&c->shm_ring);
+					c->shm = false;
+				}
+				continue;
+			}
+
+			if (c->rx_off != 0 && ! c->rx_partial_valid) {
+				// Keep stream intact, by finishing the frame
+				// from a private copy. If a copy is already
+				// being written, rx_off is an offset in it.
+				memcpy(&c->rx_partial,
+				       pkt_buf_get(&drv->rx_pkts, seq),
+				       sizeof(c->rx_partial));
+				c->rx_partial_valid = true;
+			} else {
+				c->rx_dropped++;
+				drv->client_drops++;
+			}
+			c->rx_seq++;
+		}
+
+		pkt_buf_pop(&drv->rx_pkts);
+	}
+}
+
+/**
+ * Publish received frames to shared memory clients
+ *
+ * Copies all frames the client didn't get yet into its shared memory ring,
+ * and wakes up the client once for the whole batch.
+ */
+static void rx_publish_shm(drv_t *drv)
+{
+	const size_t head = pkt_buf_head(&drv->rx_pkts);
+	size_t i;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client_t *c = &drv->clients[i];
+
+		if (c->fd == -1 || ! c->shm) {
+			continue;
+		}
+
+		for (; c->rx_seq != head; c->rx_seq++) {
+			const pkt_t *src = pkt_buf_get(&drv->rx_pkts, c->rx_seq);
+			pkt_t *dst;
+
+			if (! client_wants(c, src)) {
+				continue;
+			}
+
+			dst = shm_ring_alloc(&c->shm_ring);
+			if (dst == NULL) {
+				if (c->policy == SLOW_CLIENT_DISCONNECT) {
+					break;
+				}
+				c->shm_ring.hdr->dropped++;
+				c->rx_dropped++;
+				drv->client_drops++;
+				continue;
+			}
+
+			memcpy(dst, src, sizeof(src->meta) + src->meta.len);
+			shm_ring_publish(&c->shm_ring);
+			LAT_EXEC(client_lat_written(c, src));
+		}
+
+		if (c->rx_seq != head) {
+			fprintf(stderr, "Client too slow, disconnecting\n");
+			client_close(c);
+		} else if (shm_ring_notify(&c->shm_ring) != ERR_OK) {
+			perror("Unable to notify client");
+			client_close(c);
+		}
+	}
+}
+
+/**
+ * Send shared memory ring file descriptors to client
+ *
+ * Sends a message containing SHM_RING_MAGIC as data, with the memfd and
+ * eventfd of the ring attached as SCM_RIGHTS.
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int client_send_shm(client_t *c)
+{
+	const uint32_t magic = SHM_RING_MAGIC;
+	union {
+		struct cmsghdr hdr;
+		uint8_t buf[CMSG_SPACE(2 * sizeof(int))];
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[2];
+
+	iov.iov_base = (void *) &magic;
+	iov.iov_len = sizeof(magic);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+
+	fds[0] = c->shm_ring.mem_fd;
+	fds[1] = c->shm_ring.event_fd;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(c->fd, &msg, MSG_DONTWAIT) != sizeof(magic)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Split stream client data into frames
+ *
+ * Moves complete frames from tx_data into tx_pkts. Frames start with the
+ * transmit header bytes, and are delimited by the length byte following them,
+ * or by the fixed packet length if the transceiver is configured for it.
+ *
+ * @returns	ERR_OK, or ERR_RFM_TX_OUT_OF_SYNC if an invalid length byte
+ *		was found
+ */
+static int client_frame_tx(client_t *c)
+{
+	const rf_dev_t *dev = &client_radio(c)->dev;
+	ring_buf_t *data = &c->tx_data;
+	pkt_t *pkt;
+	size_t len;
+
+	while (! ring_buf_empty(data) &&
+			(pkt = pkt_buf_alloc(&c->tx_pkts)) != NULL) {
+		len = dev->hdrlen + dev->fixpklen;
+		if (dev->fixpklen == 0) {
+			if (ring_buf_bytes_used(data) <= dev->hdrlen) {
+				break;
+			}
+			if (ring_buf_peek(data, dev->hdrlen) == 0) {
+				return ERR_RFM_TX_OUT_OF_SYNC;
+			}
+			len += 1 + ring_buf_peek(data, dev->hdrlen);
+		}
+		if (len > PKT_MAX_LEN) {
+			return ERR_RFM_TX_OUT_OF_SYNC;
+		}
+		if (ring_buf_bytes_used(data) < len) {
+			break;
+		}
+
+		pkt_meta_init(&pkt->meta, 0);
+		pkt->meta.len = len;
+		ring_buf_get(data, pkt->data, len);
+		pkt_buf_commit(&c->tx_pkts);
+	}
+
+	return ERR_OK;
+}
+
+/**
+ * Check if frame to transmit matches the packet format of the transceiver
+ *
+ * Frames start with the transmit header bytes, followed by the length byte
+ * if using variable length packets. Like on stream sockets, a length byte of
+ * 0 is invalid.
+ */
+static bool tx_frame_valid(const radio_t *r, const uint8_t *data, size_t len)
+{
+	const size_t hdrlen = r->dev.hdrlen;
+
+	if (r->dev.fixpklen != 0) {
+		return len == hdrlen + r->dev.fixpklen;
+	}
+	return len > hdrlen + 1 && len == hdrlen + 1 + data[hdrlen];
+}
+
+static int on_uplink(evloop_src_t *src, uint32_t events);
+
+/**
+ * Close uplink connection, and schedule reconnect
+ */
+static void uplink_disconnect(uplink_t *u)
+{
+	struct itimerspec its;
+
+	if (u->fd != -1) {
+		evloop_remove(&u->drv->loop, &u->src);
+		close(u->fd);
+		u->fd = -1;
+	}
+	u->connected = false;
+	// A partially written message is resent on the next connection
+	u->tx_off = 0;
+	u->rx_len = 0;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = u->retry_ms / 1000;
+	its.it_value.tv_nsec = (u->retry_ms % 1000) * 1000000;
+	if (timerfd_settime(u->timer_fd, 0, &its, NULL) == -1) {
+		perror("Unable to arm uplink timer");
+	}
+	DBG_PRINTF(DBG_LVL_LOW, "Uplink disconnected, retrying in %u ms\n",
+		   u->retry_ms);
+
+	u->retry_ms *= 2;
+	if (u->retry_ms > UPLINK_RETRY_MAX_MS) {
+		u->retry_ms = UPLINK_RETRY_MAX_MS;
+	}
+}
+
+/**
+ * Mark uplink connection as established
+ */
+static void uplink_connected(uplink_t *u)
+{
+	DBG_PRINTF(DBG_LVL_LOW, "Uplink connected\n");
+	u->connected = true;
+	u->retry_ms = UPLINK_RETRY_MIN_MS;
+	u->connects++;
+}
+
+/**
+ * Connect to collector
+ *
+ * TCP connections are established in the background, on_uplink() completes
+ * them. On failure a reconnect is scheduled.
+ */
+static void uplink_connect(uplink_t *u)
+{
+	u->fd = socket(u->addr.ss_family,
+		       u->sock_type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (u->fd == -1) {
+		perror("Unable to create uplink socket");
+		uplink_disconnect(u);
+		return;
+	}
+
+	if (connect(u->fd, (struct sockaddr *) &u->addr, u->addr_len) == -1 &&
+	    errno != EINPROGRESS) {
+		perror("Unable to connect uplink");
+		uplink_disconnect(u);
+		return;
+	}
+
+	if (evloop_add(&u->drv->loop, &u->src, u->fd, EPOLLOUT, &on_uplink,
+		       u) != ERR_OK) {
+		perror("Unable to watch uplink socket");
+		close(u->fd);
+		u->fd = -1;
+		uplink_disconnect(u);
+		return;
+	}
+
+	// Datagram sockets only store the destination
+	if (u->sock_type == SOCK_DGRAM) {
+		uplink_connected(u);
+	}
+}
+
+/**
+ * Resolve collector address and connect
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int uplink_open(uplink_t *u)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	int ret;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = u->sock_type;
+	ret = getaddrinfo(u->host, u->port, &hints, &res);
+	if (ret != 0) {
+		fprintf(stderr, "Unable to resolve uplink address %s: %s\n",
+			u->host, gai_strerror(ret));
+		return -1;
+	}
+	memcpy(&u->addr, res->ai_addr, res->ai_addrlen);
+	u->addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	if (pkt_buf_init(&u->spool, u->spool_slots) != 0 ||
+	    pkt_buf_init(&u->tx_pkts, UPLINK_TX_SLOTS) != 0) {
+		fprintf(stderr, "Unable to allocate uplink buffers\n");
+		return -1;
+	}
+
+	u->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				     TFD_NONBLOCK | TFD_CLOEXEC);
+	if (u->timer_fd == -1) {
+		perror("timerfd_create");
+		return -1;
+	}
+
+	u->retry_ms = UPLINK_RETRY_MIN_MS;
+	uplink_connect(u);
+
+	return 0;
+}
+
+/**
+ * Close uplink and free its buffers
+ */
+static void uplink_close(uplink_t *u)
+{
+	if (u->fd != -1) {
+		evloop_remove(&u->drv->loop, &u->src);
+		close(u->fd);
+		u->fd = -1;
+	}
+	if (u->timer_fd != -1) {
+		close(u->timer_fd);
+		u->timer_fd = -1;
+	}
+	pkt_buf_destroy(&u->spool);
+	pkt_buf_destroy(&u->tx_pkts);
+}
+
+/**
+ * Spool received frame for the collector
+ *
+ * If the spool is full the oldest frame is dropped, unless it is partially
+ * written to the TCP stream. Then the new frame is dropped.
+ */
+static void uplink_spool(uplink_t *u, const radio_t *r, const pkt_t *src)
+{
+	pkt_t *dst;
+
+	if (u->host == NULL) {
+		return;
+	}
+
+	if (pkt_buf_full(&u->spool)) {
+		u->spool_drops++;
+		if (u->tx_off != 0) {
+			return;
+		}
+		pkt_buf_pop(&u->spool);
+	}
+
+	dst = pkt_buf_alloc(&u->spool);
+	memcpy(dst, src, sizeof(src->meta) + src->meta.len);
+	dst->meta.radio = r->index;
+	pkt_buf_commit(&u->spool);
+}
+
+/**
+ * Send spooled frames to collector
+ *
+ * Over UDP every message is a datagram, all sent with one sendmmsg(). Over
+ * TCP the messages are gathered into a single writev().
+ *
+ * @returns	0 on success, -1 if the connection failed
+ */
+static int uplink_send(uplink_t *u)
+{
+	uint8_t hdrs[UPLINK_MSG_BATCH][UPLINK_HDR_LEN];
+	struct iovec iov[UPLINK_MSG_BATCH * 2];
+	struct mmsghdr msgs[UPLINK_MSG_BATCH];
+	const pkt_t *pkt;
+	size_t skip;
+	ssize_t wlen;
+	int cnt;
+	int ret;
+	int i;
+
+	while (u->connected && ! pkt_buf_empty(&u->spool)) {
+		for (cnt = 0; cnt < UPLINK_MSG_BATCH &&
+				(pkt = pkt_buf_peek_at(&u->spool, cnt)) != NULL;
+				cnt++) {
+			uplink_encode(hdrs[cnt], UPLINK_MSG_RX, u->gateway, pkt);
+			iov[cnt * 2].iov_base = hdrs[cnt];
+			iov[cnt * 2].iov_len = UPLINK_HDR_LEN;
+			iov[cnt * 2 + 1].iov_base = (void *) pkt->data;
+			iov[cnt * 2 + 1].iov_len = pkt->meta.len;
+		}
+
+		if (u->sock_type == SOCK_DGRAM) {
+			memset(msgs, 0, sizeof(msgs[0]) * cnt);
+			for (i = 0; i < cnt; i++) {
+				msgs[i].msg_hdr.msg_iov = &iov[i * 2];
+				msgs[i].msg_hdr.msg_iovlen = 2;
+			}
+			ret = sendmmsg(u->fd, msgs, cnt, MSG_DONTWAIT);
+			if (ret == -1) {
+				goto fail;
+			}
+			pkt_buf_pop_n(&u->spool, ret);
+			u->sent += ret;
+			continue;
+		}
+
+		// Skip part of first message already written
+		skip = u->tx_off;
+		for (i = 0; skip >= iov[i].iov_len; i++) {
+			skip -= iov[i].iov_len;
+		}
+		iov[i].iov_base = (uint8_t *) iov[i].iov_base + skip;
+		iov[i].iov_len -= skip;
+
+		wlen = writev(u->fd, &iov[i], cnt * 2 - i);
+		if (wlen == -1) {
+			goto fail;
+		}
+		wlen += u->tx_off;
+		for (i = 0; i < cnt; i++) {
+			pkt = pkt_buf_peek(&u->spool);
+			if (wlen < (ssize_t) (UPLINK_HDR_LEN + pkt->meta.len)) {
+				break;
+			}
+			wlen -= UPLINK_HDR_LEN + pkt->meta.len;
+			pkt_buf_pop(&u->spool);
+			u->sent++;
+		}
+		u->tx_off = wlen;
+		if (i < cnt) {
+			// Socket buffer is full
+			return 0;
+		}
+	}
+
+	return 0;
+fail:
+	if (errno == EAGAIN || errno == EINTR) {
+		return 0;
+	}
+	perror("Uplink write failure");
+	return -1;
+}
+
+/**
+ * Queue frame to transmit received from collector
+ */
+static void uplink_handle(uplink_t *u, uplink_msg_type_t type, pkt_t *pkt)
+{
+	drv_t *drv = u->drv;
+	pkt_t *dst;
+
+	if (type != UPLINK_MSG_TX || pkt->meta.radio >= drv->radio_cnt ||
+	    ! tx_frame_valid(&drv->radios[pkt->meta.radio].radio, pkt->data,
+			     pkt->meta.len)) {
+		fprintf(stderr, "Dropping invalid uplink TX frame (len=%u)\n",
+			pkt->meta.len);
+		return;
+	}
+
+	dst = pkt_buf_alloc(&u->tx_pkts);
+	pkt_meta_init(&dst->meta, 0);
+	dst->meta.len = pkt->meta.len;
+	dst->meta.radio = pkt->meta.radio;
+	memcpy(dst->data, pkt->data, pkt->meta.len);
+	pkt_buf_commit(&u->tx_pkts);
+	u->tx_frames++;
+}
+
+/**
+ * Split TCP stream data from collector into messages
+ *
+ * Stops when the TX queue is full, the remaining data is kept.
+ *
+ * @returns	0 on success, -1 if an invalid message was received
+ */
+static int uplink_split(uplink_t *u)
+{
+	uplink_msg_type_t type;
+	uint32_t gateway;
+	size_t off = 0;
+	ssize_t ret;
+	pkt_t pkt;
+
+	while (! pkt_buf_full(&u->tx_pkts)) {
+		ret = uplink_decode(&u->rx_data[off], u->rx_len - off, &type,
+				    &gateway, &pkt);
+		if (ret == -1) {
+			fprintf(stderr, "Invalid message from uplink\n");
+			return -1;
+		} else if (ret == 0) {
+			break;
+		}
+		uplink_handle(u, type, &pkt);
+		off += ret;
+	}
+
+	u->rx_len -= off;
+	memmove(u->rx_data, &u->rx_data[off], u->rx_len);
+
+	return 0;
+}
+
+/**
+ * Read frames to transmit from collector
+ *
+ * @returns	0 on success, -1 if the connection failed
+ */
+static int uplink_read(uplink_t *u)
+{
+	uplink_msg_type_t type;
+	uint32_t gateway;
+	ssize_t ret;
+	pkt_t pkt;
+
+	if (u->sock_type == SOCK_DGRAM) {
+		while (! pkt_buf_full(&u->tx_pkts)) {
+			ret = recv(u->fd, u->rx_data, sizeof(u->rx_data),
+				   MSG_DONTWAIT);
+			if (ret == -1) {
+				goto fail;
+			}
+			if (uplink_decode(u->rx_data, ret, &type, &gateway,
+					  &pkt) != ret) {
+				fprintf(stderr, "Invalid datagram from "
+					"uplink\n");
+				continue;
+			}
+			uplink_handle(u, type, &pkt);
+		}
+
+		// Remaining datagrams are read once the TX queue has room
+		return 0;
+	}
+
+	ret = read(u->fd, &u->rx_data[u->rx_len],
+		   sizeof(u->rx_data) - u->rx_len);
+	if (ret == 0) {
+		DBG_PRINTF(DBG_LVL_LOW, "Uplink closed by collector\n");
+		return -1;
+	}
+	if (ret > 0) {
+		u->rx_len += ret;
+		return uplink_split(u);
+	}
+
+fail:
+	if (errno != EAGAIN && errno != EINTR) {
+		perror("Uplink read failure");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Exchange frames with collector, and update the watched events
+ */
+static void uplink_service(uplink_t *u)
+{
+	uint32_t events = 0;
+
+	if (u->fd == -1) {
+		return;
+	}
+
+	// Messages left in the buffer while the TX queue was full
+	if (u->sock_type == SOCK_STREAM && uplink_split(u) != 0) {
+		uplink_disconnect(u);
+		return;
+	}
+	if (uplink_send(u) != 0) {
+		uplink_disconnect(u);
+		return;
+	}
+
+	if (! u->connected || ! pkt_buf_empty(&u->spool)) {
+		events |= EPOLLOUT;
+	}
+	if (u->connected && ! pkt_buf_full(&u->tx_pkts) &&
+	    u->rx_len < sizeof(u->rx_data)) {
+		events |= EPOLLIN;
+	}
+	if (evloop_modify(&u->drv->loop, &u->src, events) != ERR_OK) {
+		perror("Unable to watch uplink socket");
+		uplink_disconnect(u);
+	}
+}
+
+/**
+ * Move client frames to the TX queues of the radio threads
+ *
+ * Takes one frame per client, and from the uplink, in round-robin order, so
+ * clients are interleaved at frame boundaries. Radio threads that got new
+ * frames are woken up.
+ */
+static void tx_schedule(drv_t *drv)
+{
+	bool woken[MAX_RADIOS] = { false };
+	size_t idle = 0;
+	size_t i;
+
+	// Index MAX_CLIENTS is the uplink
+	while (idle < MAX_CLIENTS + 1) {
+		client_t *c = (drv->tx_next < MAX_CLIENTS) ?
+				&drv->clients[drv->tx_next] : NULL;
+		pkt_buf_t *queue;
+		const pkt_t *src;
+		radio_t *r;
+		pkt_t *dst;
+
+		drv->tx_next = (drv->tx_next + 1) % (MAX_CLIENTS + 1);
+
+		if (c != NULL) {
+			queue = (c->fd != -1) ? &c->tx_pkts : NULL;
+		} else {
+			queue = (drv->uplink.host != NULL) ?
+					&drv->uplink.tx_pkts : NULL;
+		}
+		if (queue == NULL || (src = pkt_buf_peek(queue)) == NULL) {
+			idle++;
+			continue;
+		}
+		r = (c != NULL) ? client_radio(c) :
+				  &drv->radios[src->meta.radio].radio;
+		if ((dst = pkt_buf_alloc(&r->tx_pkts)) == NULL) {
+			idle++;
+			continue;
+		}
+		idle = 0;
+
+		memcpy(dst, src, sizeof(src->meta) + src->meta.len);
+		pkt_buf_commit(&r->tx_pkts);
+		pkt_buf_pop(queue);
+		if (pkt_buf_count(&r->tx_pkts) > drv->radios[r->index].tx_hwm) {
+			drv->radios[r->index].tx_hwm =
+				pkt_buf_count(&r->tx_pkts);
+		}
+		woken[r->index] = true;
+
+		if (c != NULL && client_frame_tx(c) == ERR_RFM_TX_OUT_OF_SYNC) {
+			fprintf(stderr, "TX buffer out-of-sync, Disconnecting client\n");
+			client_close(c);
+		}
+	}
+
+	for (i = 0; i < drv->radio_cnt; i++) {
+		if (woken[i]) {
+			radio_wake(&drv->radios[i].radio);
+		}
+	}
+}
+
+/**
+ * Check if received frame is a duplicate
+ */
+static bool rx_duplicate(drv_t *drv, const pkt_t *pkt)
+{
+	if (drv->dedup.window != 0 &&
+	    pkt_dedup_check(&drv->dedup, pkt->data, pkt->meta.len,
+			    pkt->meta.timestamp)) {
+		drv->rx_duplicates++;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Check if frame received by radio is filtered by all clients
+ *
+ * Duplicate and filtered frames are dropped before they enter the shared RX
+ * buffer, so they don't cost buffer space and client wake-ups.
+ */
+static bool rx_filtered(drv_t *drv, radio_t *r, const pkt_t *pkt)
+{
+	bool filtered = false;
+	size_t i;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		const client_t *c = &drv->clients[i];
+
+		if (c->fd == -1 || (c->radio >= 0 &&
+				    (unsigned int) c->radio != r->index)) {
+			continue;
+		}
+		if (client_filter(c, r, pkt)) {
+			return false;
+		}
+		filtered = true;
+	}
+
+	// Without clients frames are released right away, so don't count them
+	if (filtered) {
+		drv->rx_filtered++;
+	}
+	return filtered;
+}
+
+/**
+ * Move frames received by radio thread into the shared RX buffer
+ */
+static void rx_collect(drv_t *drv, radio_t *r)
+{
+	const pkt_t *src;
+	pkt_t *dst;
+
+	while ((src = pkt_buf_peek(&r->rx_pkts)) != NULL) {
+		if (rx_duplicate(drv, src)) {
+			pkt_buf_pop(&r->rx_pkts);
+			continue;
+		}
+		uplink_spool(&drv->uplink, r, src);
+		if (rx_filtered(drv, r, src)) {
+			pkt_buf_pop(&r->rx_pkts);
+			continue;
+		}
+
+		rx_make_room(drv);
+		dst = pkt_buf_alloc(&drv->rx_pkts);
+
+		memcpy(dst, src, sizeof(src->meta) + src->meta.len);
+		dst->meta.radio = r->index;
+#ifdef ENABLE_LATENCY_STATS
+		*pkt_buf_stamp(&drv->rx_pkts, dst) = rf_clock_ns();
+		lat_record(r->dev.lat, LAT_STAGE_QUEUE,
+			   *pkt_buf_stamp(&r->rx_pkts, src),
+			   *pkt_buf_stamp(&drv->rx_pkts, dst));
+#endif
+		pkt_buf_commit(&drv->rx_pkts);
+		pkt_buf_pop(&r->rx_pkts);
+		if (pkt_buf_count(&drv->rx_pkts) > drv->rx_hwm) {
+			drv->rx_hwm = pkt_buf_count(&drv->rx_pkts);
+		}
+	}
+}
+
+/**
+ * Arm batch timer for the first client that holds frames
+ */
+static int batch_arm(drv_t *drv)
+{
+	struct itimerspec its;
+	uint64_t deadline = 0;
+	size_t i;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		const client_t *c = &drv->clients[i];
+
+		if (c->fd != -1 && c->rx_flush_at != 0 &&
+		    (deadline == 0 || c->rx_flush_at < deadline)) {
+			deadline = c->rx_flush_at;
+		}
+	}
+
+	// An early expiration is harmless, so the timer isn't disarmed
+	if (deadline == 0 || deadline == drv->batch_deadline) {
+		return ERR_OK;
+	}
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / 1000000000;
+	its.it_value.tv_nsec = deadline % 1000000000;
+	if (timerfd_settime(drv->batch_fd, TFD_TIMER_ABSTIME, &its,
+			    NULL) == -1) {
+		return ERR_EVLOOP;
+	}
+	drv->batch_deadline = deadline;
+
+	return ERR_OK;
+}
+
+/**
+ * Exchange frames between clients and radio threads
+ */
+static int service_clients(drv_t *drv)
+{
+	int err;
+	size_t i;
+
+	tx_schedule(drv);
+	rx_publish_shm(drv);
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		err = client_update_events(&drv->clients[i]);
+		if (err != ERR_OK) {
+			return err;
+		}
+	}
+
+	// Frames nobody is waiting for are not kept
+	rx_release(drv);
+
+	uplink_service(&drv->uplink);
+
+	return batch_arm(drv);
+}
+
+static int on_radio(evloop_src_t *src, uint32_t events)
+{
+	drv_radio_t *dr = src->ctx;
+	int err;
+
+	err = radio_clear_notify(&dr->radio);
+	if (err != ERR_OK) {
+		fprintf(stderr, "Radio %u stopped\n", dr->radio.index);
+		return err;
+	}
+
+	rx_collect(dr->drv, &dr->radio);
+
+	return service_clients(dr->drv);
+}
+
+static int on_accept(evloop_src_t *src, uint32_t events)
+{
+	listener_t *l = src->ctx;
+	drv_t *drv = l->drv;
+	struct sockaddr_un remote;
+	struct ucred cred;
+	socklen_t t;
+	client_t *c;
+	size_t i;
+	int fd;
+
+	// Accept new client
+	t = sizeof(remote);
+	if ((fd = accept(l->fd, (struct sockaddr *)&remote, &t)) == -1) {
+		perror("accept");
+		return ERR_OK;
+	}
+
+	c = NULL;
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if (drv->clients[i].fd == -1) {
+			c = &drv->clients[i];
+			break;
+		}
+	}
+	if (c == NULL) {
+		fprintf(stderr, "Too many clients, refusing connection\n");
+		close(fd);
+		return ERR_OK;
+	}
+
+	DBG_PRINTF(DBG_LVL_LOW, "Accepted new client connection\n");
+	c->sock_type = l->sock_type;
+	c->meta = l->meta;
+	c->policy = l->policy;
+	c->radio = l->radio;
+	c->filter = l->filter;
+	c->batch_hold = l->batch_hold;
+	c->batch_frames = l->batch_frames;
+	c->batch_bytes = l->batch_bytes;
+	c->rx_flushing = false;
+	c->rx_flush_at = 0;
+	c->pid = 0;
+	t = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &t) == 0) {
+		c->pid = cred.pid;
+	}
+	c->rx_seq = pkt_buf_head(&drv->rx_pkts);
+	c->rx_off = 0;
+	c->rx_partial_valid = false;
+	c->rx_dropped = 0;
+	pkt_buf_clear(&c->tx_pkts);
+	ring_buf_clear(&c->tx_data);
+
+	c->fd = fd;
+	if (evloop_add(&drv->loop, &c->src, fd, EPOLLIN,
+			&on_client, c) != ERR_OK) {
+		perror("Unable to watch client socket");
+		close(fd);
+		c->fd = -1;
+		return ERR_OK;
+	}
+
+	if (l->shm) {
+		if (shm_ring_create(&c->shm_ring, SHM_RING_SLOTS) != ERR_OK) {
+			perror("Unable to create shared memory ring");
+			client_close(c);
+			return ERR_OK;
+		}
+		c->shm = true;
+
+		if (client_send_shm(c) != 0) {
+			perror("Unable to send shared memory ring to client");
+			client_close(c);
+			return ERR_OK;
+		}
+	}
+
+	return ERR_OK;
+}
+
+
+/**
+ * Read stream client socket
+ *
+ * @returns	0 on success, -1 if client connection should be closed
+ */
+static int client_read_stream(client_t *c)
+{
+	struct iovec iov[2];
+	ssize_t rlen;
+	int iovcnt;
+
+	// Read directly into free space of ring buffer
+	iovcnt = ring_buf_writable_iov(&c->tx_data, iov);
+	if (iovcnt == 0) {
+		return 0;
+	}
+	rlen = readv(c->fd, iov, iovcnt);
+	if (rlen <= 0) {
+		if (rlen < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				return 0;
+			}
+			perror("Client read failure");
+		} else {
+			DBG_PRINTF(DBG_LVL_LOW, "Client disconnected\n");
+		}
+		return -1;
+	}
+
+	ring_buf_commit(&c->tx_data, rlen);
+	DBG_PRINTF(DBG_LVL_HIGH, "Read client %zd bytes\n", rlen);
+
+	if (client_frame_tx(c) == ERR_RFM_TX_OUT_OF_SYNC) {
+		fprintf(stderr, "TX buffer out-of-sync, Disconnecting client\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Read messages from seqpacket client socket
+ *
+ * Every message is received directly into a free TX packet slot.
+ *
+ * @returns	0 on success, -1 if client connection should be closed
+ */
+static int client_read_seqpacket(client_t *c)
+{
+	struct mmsghdr msgs[CLIENT_MSG_BATCH];
+	struct iovec iovs[CLIENT_MSG_BATCH];
+	size_t cnt;
+	size_t used;
+	int ret;
+	int i;
+
+	cnt = pkt_buf_free(&c->tx_pkts);
+	if (cnt > CLIENT_MSG_BATCH) {
+		cnt = CLIENT_MSG_BATCH;
+	}
+	if (cnt == 0) {
+		return 0;
+	}
+
+	memset(msgs, 0, sizeof(msgs[0]) * cnt);
+	for (i = 0; i < cnt; i++) {
+		iovs[i].iov_base = pkt_buf_alloc_at(&c->tx_pkts, i)->data;
+		iovs[i].iov_len = PKT_MAX_LEN;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = recvmmsg(c->fd, msgs, cnt, MSG_DONTWAIT, NULL);
+	if (ret == -1) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		perror("Client read failure");
+		return -1;
+	}
+	DBG_PRINTF(DBG_LVL_HIGH, "Read client %d messages\n", ret);
+
+	// Validate messages and compact the accepted frames
+	used = 0;
+	for (i = 0; i < ret; i++) {
+		pkt_t *pkt = pkt_buf_alloc_at(&c->tx_pkts, i);
+		size_t len = msgs[i].msg_len;
+		bool valid;
+
+		if (len == 0) {
+			DBG_PRINTF(DBG_LVL_LOW, "Client disconnected\n");
+			break;
+		}
+
+		valid = ! (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) &&
+			tx_frame_valid(client_radio(c), pkt->data, len);
+		if (! valid) {
+			fprintf(stderr, "Dropping invalid TX frame (len=%zu)\n",
+				len);
+			continue;
+		}
+
+		if (used != i) {
+			memcpy(pkt_buf_alloc_at(&c->tx_pkts, used)->data,
+			       pkt->data, len);
+			pkt = pkt_buf_alloc_at(&c->tx_pkts, used);
+		}
+		pkt_meta_init(&pkt->meta, 0);
+		pkt->meta.len = len;
+		used++;
+	}
+	pkt_buf_commit_n(&c->tx_pkts, used);
+
+	return (i < ret) ? -1 : 0;
+}
+
+/**
+ * Write received frames to stream client socket
+ *
+ * Gathers multiple frames directly from the shared RX packet slots into a
+ * single writev() call.
+ *
+ * @returns	0 on success, -1 if client connection should be closed
+ */
+static int client_write_stream(client_t *c)
+{
+	struct iovec iov[CLIENT_MSG_BATCH];
+	size_t seqs[CLIENT_MSG_BATCH];	// Sequence number of frame in iov
+	const uint8_t *frame;
+	const pkt_t *pkt;
+	size_t seq;
+	size_t len;
+	ssize_t wlen;
+	int cnt;
+
+	client_skip(c);
+
+	cnt = 0;
+	seq = c->rx_seq;
+	if (c->rx_partial_valid) {
+		frame = client_frame(c, &c->rx_partial, &len);
+		iov[cnt].iov_base = (void *) (frame + c->rx_off);
+		iov[cnt].iov_len = len - c->rx_off;
+		cnt++;
+	}
+	while (cnt < CLIENT_MSG_BATCH &&
+			(pkt = pkt_buf_get(&c->drv->rx_pkts, seq)) != NULL) {
+		if (! client_wants(c, pkt)) {
+			seq++;
+			continue;
+		}
+		frame = client_frame(c, pkt, &len);
+		if (cnt == 0) {
+			frame += c->rx_off;
+			len -= c->rx_off;
+		}
+		iov[cnt].iov_base = (void *) frame;
+		iov[cnt].iov_len = len;
+		seqs[cnt] = seq;
+		cnt++;
+		seq++;
+	}
+	if (cnt == 0) {
+		return 0;
+	}
+
+	wlen = writev(c->fd, iov, cnt);
+	if (wlen == -1) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		perror("Client write failure");
+		return -1;
+	}
+	DBG_PRINTF(DBG_LVL_HIGH, "Written client %zd bytes\n", wlen);
+
+	// Advance over completely written frames
+	for (cnt = 0; wlen > 0 && wlen >= iov[cnt].iov_len; cnt++) {
+		wlen -= iov[cnt].iov_len;
+		if (c->rx_partial_valid) {
+			c->rx_partial_valid = false;
+		} else {
+			c->rx_seq = seqs[cnt] + 1;
+			LAT_EXEC(client_lat_written(c,
+				pkt_buf_get(&c->drv->rx_pkts, seqs[cnt])));
+		}
+		c->rx_off = 0;
+	}
+	if (wlen > 0 && ! c->rx_partial_valid) {
+		c->rx_seq = seqs[cnt];
+	}
+	c->rx_off += wlen;
+
+	return 0;
+}
+
+/**
+ * Write received frames to seqpacket client socket
+ *
+ * Sends one message per frame, directly from the shared RX packet slots.
+ *
+ * @returns	0 on success, -1 if client connection should be closed
+ */
+static int client_write_seqpacket(client_t *c)
+{
+	struct mmsghdr msgs[CLIENT_MSG_BATCH];
+	struct iovec iovs[CLIENT_MSG_BATCH];
+	size_t seqs[CLIENT_MSG_BATCH];	// Sequence number of frame in msgs
+	const pkt_t *pkt;
+	size_t seq;
+	int cnt;
+	int ret;
+
+	client_skip(c);
+
+	cnt = 0;
+	seq = c->rx_seq;
+	while (cnt < CLIENT_MSG_BATCH &&
+			(pkt = pkt_buf_get(&c->drv->rx_pkts, seq)) != NULL) {
+		if (client_wants(c, pkt)) {
+			memset(&msgs[cnt], 0, sizeof(msgs[cnt]));
+			iovs[cnt].iov_base = (void *) client_frame(c, pkt,
+							&iovs[cnt].iov_len);
+			msgs[cnt].msg_hdr.msg_iov = &iovs[cnt];
+			msgs[cnt].msg_hdr.msg_iovlen = 1;
+			seqs[cnt] = seq;
+			cnt++;
+		}
+		seq++;
+	}
+	if (cnt == 0) {
+		return 0;
+	}
+
+	ret = sendmmsg(c->fd, msgs, cnt, MSG_DONTWAIT);
+	if (ret == -1) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		perror("Client write failure");
+		return -1;
+	}
+	c->rx_seq = seqs[ret - 1] + 1;
+	DBG_PRINTF(DBG_LVL_HIGH, "Written client %d messages\n", ret);
+#ifdef ENABLE_LATENCY_STATS
+	for (cnt = 0; cnt < ret; cnt++) {
+		client_lat_written(c, pkt_buf_get(&c->drv->rx_pkts, seqs[cnt]));
+	}
+#endif
+
+	return 0;
+}
+
+static int on_client(evloop_src_t *src, uint32_t events)
+{
+	client_t *c = src->ctx;
+	int ret;
+
+	if (events & EPOLLIN) {
+		if (c->sock_type == SOCK_SEQPACKET) {
+			ret = client_read_seqpacket(c);
+		} else {
+			ret = client_read_stream(c);
+		}
+		if (ret != 0) {
+			client_close(c);
+			return ERR_OK;
+		}
+
+		// New frames to transmit
+		return service_clients(c->drv);
+	} else if (events & (EPOLLHUP | EPOLLERR)) {
+		DBG_PRINTF(DBG_LVL_LOW, "Client disconnected\n");
+		client_close(c);
+		return ERR_OK;
+	}
+
+	if (events & EPOLLOUT) {
+		if (c->sock_type == SOCK_SEQPACKET) {
+			ret = client_write_seqpacket(c);
+		} else {
+			ret = client_write_stream(c);
+		}
+		if (ret != 0) {
+			client_close(c);
+			return ERR_OK;
+		}
+		rx_release(c->drv);
+	}
+
+	ret = client_update_events(c);
+	if (ret != ERR_OK) {
+		return ret;
+	}
+
+	return batch_arm(c->drv);
+}
+
+static int on_uplink(evloop_src_t *src, uint32_t events)
+{
+	uplink_t *u = src->ctx;
+	socklen_t len = sizeof(int);
+	int sock_err = 0;
+
+	if (! u->connected || (events & (EPOLLIN | EPOLLERR)) == EPOLLERR) {
+		// Completed TCP connect, or error like an ICMP port unreachable
+		if (getsockopt(u->fd, SOL_SOCKET, SO_ERROR, &sock_err,
+			       &len) == -1 || sock_err != 0) {
+			fprintf(stderr, "Uplink connection failed: %s\n",
+				strerror(sock_err != 0 ? sock_err : errno));
+			uplink_disconnect(u);
+			return ERR_OK;
+		}
+		if (! u->connected) {
+			uplink_connected(u);
+		}
+	} else if (events & EPOLLIN) {
+		if (uplink_read(u) != 0) {
+			uplink_disconnect(u);
+			return ERR_OK;
+		}
+	} else if (events & EPOLLHUP) {
+		DBG_PRINTF(DBG_LVL_LOW, "Uplink closed by collector\n");
+		uplink_disconnect(u);
+		return ERR_OK;
+	}
+
+	return service_clients(u->drv);
+}
+
+/**
+ * Reconnect uplink
+ */
+static int on_uplink_timer(evloop_src_t *src, uint32_t events)
+{
+	uplink_t *u = src->ctx;
+	uint64_t expirations;
+
+	if (read(u->timer_fd, &expirations, sizeof(expirations)) == -1 &&
+	    errno != EAGAIN) {
+		perror("Unable to read uplink timer");
+		return ERR_EVLOOP;
+	}
+	if (u->fd == -1) {
+		uplink_connect(u);
+	}
+
+	return service_clients(u->drv);
+}
+
+/**
+ * Write frames held for batching clients
+ */
+static int on_batch(evloop_src_t *src, uint32_t events)
+{
+	drv_t *drv = src->ctx;
+	uint64_t expirations;
+
+	if (read(drv->batch_fd, &expirations, sizeof(expirations)) == -1 &&
+	    errno != EAGAIN) {
+		perror("Unable to read batch timer");
+		return ERR_EVLOOP;
+	}
+	drv->batch_deadline = 0;
+
+	return service_clients(drv);
+}
+
+/**
+ * Format statistics of daemon, radios and transceivers
+ *
+ * All counters are read while the radio threads keep running.
+ */
+static void metrics_collect(drv_t *drv, metrics_t *m)
+{
+	char labels[MAX_RADIOS][64];
+	char site_labels[96];
+	char name[64];
+	radio_stats_t rstats[MAX_RADIOS];
+	spi_stats_t spi_stats;
+	size_t clients;
+	size_t i;
+	int s;
+
+	for (i = 0; i < drv->radio_cnt; i++) {
+		radio_t *r = &drv->radios[i].radio;
+
+		snprintf(labels[i], sizeof(labels[i]),
+			 "radio=\"%zu\",backend=\"%s\"", i, r->dev.ops->name);
+		radio_get_stats(r, &rstats[i]);
+	}
+
+	// Transceiver counters
+	for (s = 0; s < RF_STAT_CNT; s++) {
+		snprintf(name, sizeof(name), "rf_pkt_%s_total", rf_stat_name(s));
+		metrics_describe(m, name, "counter", rf_stat_desc(s));
+		for (i = 0; i < drv->radio_cnt; i++) {
+			metrics_sample(m, name, labels[i],
+				rf_stat_get(&drv->radios[i].radio.dev, s));
+		}
+	}
+
+	// Register polling
+	metrics_describe(m, "rf_pkt_poll_waits_total", "counter",
+			 "Waits for a register condition");
+	metrics_describe(m, "rf_pkt_poll_timeouts_total", "counter",
+			 "Waits for a register condition that timed out");
+	for (i = 0; i < drv->radio_cnt; i++) {
+		const rf_poll_stats_t *st = drv->radios[i].radio.dev.poll_stats;
+
+		for (s = 0; s < RF_POLL_SITE_CNT; s++) {
+			snprintf(site_labels, sizeof(site_labels),
+				 "%s,site=\"%s\"", labels[i],
+				 rf_poll_site_name(s));
+			metrics_sample(m, "rf_pkt_poll_waits_total", site_labels,
+				__atomic_load_n(&st[s].calls, __ATOMIC_RELAXED));
+			metrics_sample(m, "rf_pkt_poll_timeouts_total",
+				site_labels, __atomic_load_n(&st[s].timeouts,
+							    __ATOMIC_RELAXED));
+		}
+	}
+
+	// Radio threads
+	metrics_describe(m, "rf_pkt_irq_events_total", "counter",
+			 "IRQ line edges");
+	for (i = 0; i < drv->radio_cnt; i++) {
+		metrics_sample(m, "rf_pkt_irq_events_total", labels[i],
+			       rstats[i].irq_events);
+	}
+	metrics_describe(m, "rf_pkt_timer_events_total", "counter",
+			 "Poll and service timer expirations");
+	for (i = 0; i < drv->radio_cnt; i++) {
+		metrics_sample(m, "rf_pkt_timer_events_total", labels[i],
+			       rstats[i].timer_events);
+	}
+	metrics_describe(m, "rf_pkt_wake_events_total", "counter",
+			 "Radio thread wake-ups to transmit");
+	for (i = 0; i < drv->radio_cnt; i++) {
+		metrics_sample(m, "rf_pkt_wake_events_total", labels[i],
+			       rstats[i].wake_events);
+	}
+	metrics_describe(m, "rf_pkt_radio_rx_queue_max", "gauge",
+			 "Max. received frames queued by radio thread");
+	for (i = 0; i < drv->radio_cnt; i++) {
+		metrics_sample(m, "rf_pkt_radio_rx_queue_max", labels[i],
+			       rstats[i].rx_hwm);
+	}
+	metrics_describe(m, "rf_pkt_radio_tx_queue_max", "gauge",
+			 "Max. frames queued for transmission on radio thread");
+	for (i = 0; i < drv->radio_cnt; i++) {
+		metrics_sample(m, "rf_pkt_radio_tx_queue_max", labels[i],
+			       drv->radios[i].tx_hwm);
+	}
+
+	// Channels of hop lists, one metric at a time to keep samples grouped
+	for (s = 0; s < 3; s++) {
+		static const char * const names[3][2] = {
+			{ "rf_pkt_channel_frames_total",
+			  "Frames received per channel" },
+			{ "rf_pkt_channel_dwell_ms_total",
+			  "Time spent per channel in ms" },
+			{ "rf_pkt_channel_dwell_target_ms",
+			  "Current dwell time per channel in ms" },
+		};
+		const char *type = (s == 2) ? "gauge" : "counter";
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+		metrics_describe(m, names[s][0], type, names[s][1]);
+		for (i = 0; i < drv->radio_cnt; i++) {
+			radio_t *r = &drv->radios[i].radio;
+			radio_channel_stats_t cst;
+			char ch_labels[128];
+			uint64_t val;
+			size_t c;
 
-#include <sys/socket.h>
-#include <sys/un.h>
+			for (c = 0; c < r->channel_cnt; c++) {
+				radio_get_channel_stats(r, c, &cst);
+				snprintf(ch_labels, sizeof(ch_labels),
+					 "%s,channel=\"%zu\",freq=\"%u\"",
+					 labels[i], c, r->channels[c].freq);
+				val = (s == 0) ? cst.frames :
+				      (s == 1) ? cst.dwell_ns / 1000000 :
+						 cst.target_ns / 1000000;
+				metrics_sample(m, names[s][0], ch_labels, val);
+			}
+		}
+	}
 
-#include <sys/select.h>
+	// SPI
+	spi_get_stats(&spi_stats);
+	metrics_describe(m, "rf_pkt_spi_transfers_total", "counter",
+			 "SPI transfer ioctls");
+	metrics_sample(m, "rf_pkt_spi_transfers_total", NULL,
+		       spi_stats.transfers);
+	metrics_describe(m, "rf_pkt_spi_bytes_total", "counter",
+			 "Bytes transferred over SPI");
+	metrics_sample(m, "rf_pkt_spi_bytes_total", NULL, spi_stats.bytes);
 
-#include "error.h"
-#include "ring_buf.h"
-#include "sparse_buf.h"
-#include "parse_reg_file.h"
-#include "debug.h"
+	// I/O thread
+	clients = 0;
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if (drv->clients[i].fd != -1) {
+			clients++;
+		}
+	}
+	metrics_describe(m, "rf_pkt_loop_wakeups_total", "counter",
+			 "Event loop iterations of I/O thread");
+	metrics_sample(m, "rf_pkt_loop_wakeups_total", NULL,
+		       drv->loop_wakeups);
+	metrics_describe(m, "rf_pkt_clients", "gauge", "Connected clients");
+	metrics_sample(m, "rf_pkt_clients", NULL, clients);
+	metrics_describe(m, "rf_pkt_client_drops_total", "counter",
+			 "Frames dropped for slow clients");
+	metrics_sample(m, "rf_pkt_client_drops_total", NULL,
+		       drv->client_drops);
+	metrics_describe(m, "rf_pkt_rx_duplicates_total", "counter",
+			 "Received frames dropped as duplicate");
+	metrics_sample(m, "rf_pkt_rx_duplicates_total", NULL,
+		       drv->rx_duplicates);
+	metrics_describe(m, "rf_pkt_rx_filtered_total", "counter",
+			 "Received frames not matching any client filter");
+	metrics_sample(m, "rf_pkt_rx_filtered_total", NULL, drv->rx_filtered);
+	metrics_describe(m, "rf_pkt_rx_queue_max", "gauge",
+			 "Max. received frames queued for clients");
+	metrics_sample(m, "rf_pkt_rx_queue_max", NULL, drv->rx_hwm);
 
-#ifdef RF_BACKEND_SX1231
-# include "sx1231.h"
-#else
-# include "si443x.h"
-#endif
+	// Uplink
+	if (drv->uplink.host != NULL) {
+		const uplink_t *u = &drv->uplink;
 
-#define RING_BUFFER_SIZE 4096
+		metrics_describe(m, "rf_pkt_uplink_connected", "gauge",
+				 "Connected to collector");
+		metrics_sample(m, "rf_pkt_uplink_connected", NULL,
+			       u->connected);
+		metrics_describe(m, "rf_pkt_uplink_connects_total", "counter",
+				 "Established connections to collector");
+		metrics_sample(m, "rf_pkt_uplink_connects_total", NULL,
+			       u->connects);
+		metrics_describe(m, "rf_pkt_uplink_sent_total", "counter",
+				 "Frames sent to collector");
+		metrics_sample(m, "rf_pkt_uplink_sent_total", NULL, u->sent);
+		metrics_describe(m, "rf_pkt_uplink_spooled", "gauge",
+				 "Frames waiting to be sent to collector");
+		metrics_sample(m, "rf_pkt_uplink_spooled", NULL,
+			       pkt_buf_count(&u->spool));
+		metrics_describe(m, "rf_pkt_uplink_spool_drops_total",
+				 "counter", "Frames dropped from full spool");
+		metrics_sample(m, "rf_pkt_uplink_spool_drops_total", NULL,
+			       u->spool_drops);
+		metrics_describe(m, "rf_pkt_uplink_tx_frames_total", "counter",
+				 "Frames to transmit received from collector");
+		metrics_sample(m, "rf_pkt_uplink_tx_frames_total", NULL,
+			       u->tx_frames);
+	}
+}
 
-unsigned int debug_level = 0;
+/**
+ * Write statistics to connecting client, and close the connection
+ */
+static int on_metrics(evloop_src_t *src, uint32_t events)
+{
+	drv_t *drv = src->ctx;
+	char buf[METRICS_BUFFER_SIZE];
+	metrics_t m;
+	ssize_t ret;
+	int fd;
+
+	if ((fd = accept(drv->metrics.fd, NULL, NULL)) == -1) {
+		perror("accept");
+		return ERR_OK;
+	}
+
+	metrics_init(&m, buf, sizeof(buf));
+	metrics_collect(drv, &m);
+	if (m.truncated) {
+		fprintf(stderr, "Metrics truncated\n");
+	}
+
+	// Text is smaller than the socket buffer, so don't wait for client
+	ret = send(fd, buf, m.len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (ret != (ssize_t) m.len) {
+		DBG_PRINTF(DBG_LVL_LOW, "Short write of metrics\n");
+	}
+	close(fd);
+
+	return ERR_OK;
+}
+
+/**
+ * Execute control command
+ *
+ * Commands:
+ *   profile [<radio>] <name>: switch radio, or all radios with a profile
+ *                             image, to profile
+ *   filter [<rules>]: set filter of all clients of the sending process, see
+ *                     pkt_filter_parse(). Without rules all frames pass.
+ *
+ * @param pid		Process that sent command, 0 if unknown
+ * @param cmd		Command, is modified
+ * @param reply		Buffer for reply
+ * @param reply_size	Size of reply buffer
+ */
+static void control_exec(drv_t *drv, pid_t pid, char *cmd, char *reply,
+			 size_t reply_size)
+{
+	const char *argv[3];
+	size_t argc = 0;
+	char *arg;
+	size_t i;
+
+	while ((arg = strsep(&cmd, " \t\n")) != NULL) {
+		if (*arg == '\0') {
+			continue;
+		}
+		if (argc == sizeof(argv) / sizeof(argv[0])) {
+			snprintf(reply, reply_size, "error: too many "
+				 "arguments\n");
+			return;
+		}
+		argv[argc++] = arg;
+	}
+
+	if (argc >= 2 && strcmp(argv[0], "profile") == 0) {
+		size_t switched = 0;
+		char *endp;
+		long idx = -1;
+
+		if (argc == 3) {
+			idx = strtol(argv[1], &endp, 10);
+			if (*endp != '\0' || idx < 0 ||
+			    (size_t) idx >= drv->radio_cnt) {
+				snprintf(reply, reply_size, "error: invalid "
+					 "radio '%s'\n", argv[1]);
+				return;
+			}
+		}
+		for (i = 0; i < drv->radio_cnt; i++) {
+			if ((idx == -1 || (size_t) idx == i) &&
+			    radio_set_profile(&drv->radios[i].radio,
+					      argv[argc - 1]) == 0) {
+				switched++;
+			}
+		}
+		if (switched == 0) {
+			snprintf(reply, reply_size, "error: unknown profile "
+				 "'%s'\n", argv[argc - 1]);
+			return;
+		}
+		snprintf(reply, reply_size, "ok\n");
+		return;
+	}
+
+	if (argc >= 1 && argc <= 2 && strcmp(argv[0], "filter") == 0) {
+		size_t applied = 0;
+		pkt_filter_t filter;
+
+		if (pkt_filter_parse(&filter, argc == 2 ? argv[1] : "") != 0) {
+			snprintf(reply, reply_size, "error: invalid filter\n");
+			return;
+		}
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			client_t *c = &drv->clients[i];
 
-volatile sig_atomic_t terminate = 0;
+			if (c->fd != -1 && pid != 0 && c->pid == pid) {
+				c->filter = filter;
+				client_skip(c);
+				applied++;
+			}
+		}
+		if (applied == 0) {
+			snprintf(reply, reply_size, "error: no clients of "
+				 "sender\n");
+			return;
+		}
+		snprintf(reply, reply_size, "ok\n");
+		return;
+	}
 
-void terminate_cb(int signum)
+	snprintf(reply, reply_size, "error: unknown command\n");
+}
+
+/**
+ * Execute command datagram, and reply to sender if it has an address
+ */
+static int on_control(evloop_src_t *src, uint32_t events)
 {
-	terminate = 1;
+	drv_t *drv = src->ctx;
+	struct sockaddr_un peer;
+	char cmd[256];
+	char reply[128];
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(struct ucred))];
+	} ctrl;
+	struct iovec iov = { .iov_base = cmd, .iov_len = sizeof(cmd) - 1 };
+	struct msghdr msg = {
+		.msg_name = &peer,
+		.msg_namelen = sizeof(peer),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctrl.buf,
+		.msg_controllen = sizeof(ctrl.buf),
+	};
+	struct cmsghdr *cmsg;
+	pid_t pid = 0;
+	ssize_t ret;
+
+	ret = recvmsg(drv->control.fd, &msg, MSG_DONTWAIT);
+	if (ret < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			perror("recvmsg");
+		}
+		return ERR_OK;
+	}
+	cmd[ret] = '\0';
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+			cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_CREDENTIALS) {
+			struct ucred cred;
+
+			memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+			pid = cred.pid;
+		}
+	}
+
+	control_exec(drv, pid, cmd, reply, sizeof(reply));
+	DBG_PRINTF(DBG_LVL_MID, "Control command reply: %s", reply);
+
+	if (msg.msg_namelen > sizeof(sa_family_t)) {
+		sendto(drv->control.fd, reply, strlen(reply), MSG_DONTWAIT,
+		       (struct sockaddr *) &peer, msg.msg_namelen);
+	}
+
+	// A changed filter can make buffered frames deliverable
+	return service_clients(drv);
 }
 
-void usage(const char *name)
+static int on_signal(evloop_src_t *src, uint32_t events)
 {
-	fprintf(stderr,
-		"Packetized Radio Transceiver User Space driver - " VERSION "\n"
-		"Usage: %s [-v] [-d <device>] [-c <config>] [-s <socket>] [-i <gpio#>]\n"
-		"\n"
-		"Options:\n"
-		" -c <path>	Register Configuration file\n"
-		" -d <path>	SPI device file to use (default: " DEFAULT_DEV_PATH ")\n"
-		" -s <path>	Socket path for clients (default: " DEFAULT_SOCK_PATH ")\n"
-		" -i <gpio#>	IRQ GPIO pin number, or -1 to use polling (default: %d)\n"
-		" -v		Increase verbosity level, use multiple times for more logging\n"
-		" -h		Display this help message\n",
-		name, DEFAULT_IRQ_PIN);
+	drv_t *drv = src->ctx;
+	struct signalfd_siginfo si;
+
+	if (read(drv->signal_fd, &si, sizeof(si)) != sizeof(si)) {
+		return ERR_OK;
+	}
+
+	if (si.ssi_signo == SIGHUP) {
+		size_t i;
+
+		DBG_PRINTF(DBG_LVL_LOW, "Received SIGHUP, reloading "
+			   "configuration\n");
+		for (i = 0; i < drv->radio_cnt; i++) {
+			radio_reload(&drv->radios[i].radio);
+		}
+		return ERR_OK;
+	}
+
+	DBG_PRINTF(DBG_LVL_LOW, "Received signal %u, terminating\n",
+		   si.ssi_signo);
+	drv->terminate = 1;
+
+	return ERR_OK;
+}
+
+#ifdef ENABLE_LATENCY_STATS
+/**
+ * Print latency histograms of all backends
+ */
+static void lat_print(void)
+{
+	const rf_ops_t *ops;
+	lat_hist_t *lat;
+	char name[32];
+	size_t i;
+	int s;
+
+	for (i = 0; (ops = rf_backend_at(i)) != NULL; i++) {
+		lat = rf_lat_hists(i);
+		for (s = 0; s < LAT_STAGE_CNT; s++) {
+			snprintf(name, sizeof(name), "%s %s", ops->name,
+				 lat_stage_name(s));
+			lat_hist_print(stdout, name, &lat[s]);
+		}
+	}
 }
+#endif
 
 int main(int argc, char *argv[])
 {
 	char *dev_path = DEFAULT_DEV_PATH;
-	char *sock_path = DEFAULT_SOCK_PATH;
 	char *cfg_path = DEFAULT_CFG_PATH;
+	char *sock_specs[MAX_LISTENERS];
+	char default_sock_spec[] = DEFAULT_SOCK_PATH;
+	size_t sock_spec_cnt = 0;
+	char *radio_specs[MAX_RADIOS];
+	size_t radio_spec_cnt = 0;
 
 	int opt;
 	int retval = EXIT_FAILURE;
-	int r;
 	int err;
+	size_t i;
 
+	char *gpio_chip = DEFAULT_GPIO_CHIP;
 	int gpio_pin = DEFAULT_IRQ_PIN;
-	int gpio_fd = -1;
-
-	int sock_fd = -1;
-	int client_fd = -1;
-	struct sockaddr_un local;
+	long poll_interval = DEFAULT_POLL_INTERVAL;
+	int default_sock_type = SOCK_STREAM;
+	int default_meta = 0;
+	int priority = 0;
+	uint32_t tx_gap = 0;
+	spi_config_t spi = { .mode = -1 };
+	bool lock_memory = false;
+	bool calibrate = false;
 
 	sigset_t sigmask;
-	sigset_t empty_mask;
-	fd_set rfds;
-	fd_set wfds;
-	fd_set efds;
-	int nfds;
-	struct timespec timeout;
 
-	rf_dev_t dev;
+	drv_t drv;
+	const char *backend_name = DEFAULT_RF_BACKEND;
+	const rf_ops_t *backend = NULL;
+	const char *crc_spec = NULL;
+	const char *trace_path = NULL;
+	const char *hop_spec = NULL;
 
-	ring_buf_t rx_data;
-	ring_buf_t tx_data;
-	sparse_buf_t regs;
+	memset(&drv, 0, sizeof(drv));
+	drv.signal_fd = -1;
+	drv.batch_fd = -1;
+	drv.loop.epfd = -1;
+	for (i = 0; i < MAX_RADIOS; i++) {
+		drv.radios[i].drv = &drv;
+		radio_init(&drv.radios[i].radio, i);
+	}
+	for (i = 0; i < MAX_LISTENERS; i++) {
+		drv.listeners[i].drv = &drv;
+		drv.listeners[i].fd = -1;
+	}
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		drv.clients[i].drv = &drv;
+		drv.clients[i].fd = -1;
+	}
+	drv.metrics.drv = &drv;
+	drv.metrics.fd = -1;
+	drv.metrics.sock_type = SOCK_STREAM;
+	drv.control.drv = &drv;
+	drv.control.fd = -1;
+	drv.control.sock_type = SOCK_DGRAM;
+	drv.uplink.drv = &drv;
+	drv.uplink.fd = -1;
+	drv.uplink.timer_fd = -1;
+	drv.uplink.spool_slots = UPLINK_SPOOL_SLOTS;
 
 	/************************ Argument Parsing **************************/
-	while ((opt = getopt(argc, argv, "hd:c:s:i:v")) != -1) {
+	while ((opt = getopt(argc, argv, "hd:c:s:r:i:I:p:mSb:C:P:Lg:F:M:Xk:K:T:H:D:U:v")) != -1) {
 		switch (opt) {
 		case 'h':
 			usage(argv[0]);
@@ -133,26 +2888,115 @@ int main(int argc, char *argv[])
 		case 'd':
 			dev_path = optarg;
 			break;
+		case 'r':
+			if (radio_spec_cnt >= MAX_RADIOS) {
+				fprintf(stderr, "Too many transceivers (max=%d)\n",
+					MAX_RADIOS);
+				exit(EXIT_FAILURE);
+			}
+			radio_specs[radio_spec_cnt++] = optarg;
+			break;
 		case 'i': {
 			char *endp;
 			gpio_pin = strtol(optarg, &endp, 10);
 			if (*endp != '\0') {
 				fprintf(stderr, "IRQ pin number must be a integer number.\n");
 				exit(EXIT_FAILURE);
-			} else if (gpio_pin >= 1000) {
-				fprintf(stderr, "IRQ pin number < 1000 are currently only supported.\n");
+			}
+			break;
+		}
+		case 'I':
+			gpio_chip = optarg;
+			break;
+		case 'b':
+			backend_name = optarg;
+			break;
+		case 'C':
+			crc_spec = optarg;
+			break;
+		case 'P':
+			if (priority_parse(optarg, &priority) != 0) {
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'L':
+			lock_memory = true;
+			break;
+		case 'g':
+			if (gap_parse(optarg, &tx_gap) != 0) {
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'F':
+			if (spi_speed_parse(optarg, &spi) != 0) {
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'M':
+			if (spi_mode_parse(optarg, &spi.mode) != 0) {
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'X':
+			calibrate = true;
+			break;
+		case 'k':
+			if (strlen(optarg) >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+				fprintf(stderr, "Metrics socket path too long\n");
+				exit(EXIT_FAILURE);
+			}
+			drv.metrics.path = optarg;
+			break;
+		case 'K':
+			if (strlen(optarg) >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+				fprintf(stderr, "Control socket path too long\n");
+				exit(EXIT_FAILURE);
+			}
+			drv.control.path = optarg;
+			break;
+		case 'T':
+			trace_path = optarg;
+			break;
+		case 'H':
+			hop_spec = optarg;
+			break;
+		case 'U':
+			if (uplink_parse(&drv.uplink, optarg) != 0) {
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'D': {
+			char *endp;
+			long window = strtol(optarg, &endp, 10);
+			if (optarg[0] == '\0' || *endp != '\0' || window < 0) {
+				fprintf(stderr, "Duplicate window must be a non-negative integer number.\n");
+				exit(EXIT_FAILURE);
+			}
+			pkt_dedup_init(&drv.dedup, (uint64_t) window * 1000000);
+			break;
+		}
+		case 'p': {
+			char *endp;
+			poll_interval = strtol(optarg, &endp, 10);
+			if (*endp != '\0' || poll_interval <= 0) {
+				fprintf(stderr, "Poll interval must be a positive integer number.\n");
 				exit(EXIT_FAILURE);
 			}
 			break;
 		}
+		case 'm':
+			default_meta = 1;
+			break;
+		case 'S':
+			default_sock_type = SOCK_SEQPACKET;
+			break;
 		case 's':
-			sock_path = optarg;
-			if (strlen(sock_path) >= sizeof(local.sun_path)+1) {
-				fprintf(stderr, "Socket path too long "
-					"(max=%zu)\n",
-					sizeof(local.sun_path)+1);
+			if (sock_spec_cnt >= MAX_LISTENERS) {
+				fprintf(stderr, "Too many sockets (max=%d)\n",
+					MAX_LISTENERS);
 				exit(EXIT_FAILURE);
 			}
+			sock_specs[sock_spec_cnt++] = optarg;
 			break;
 		case 'v':
 			debug_level++;
@@ -169,248 +3013,229 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	if (cfg_path == NULL) {
+	if (cfg_path == NULL && ! calibrate) {
 		fprintf(stderr, "No register configuration file specified\n");
 		exit(EXIT_FAILURE);
 	}
 
-	/************************** Initialization **************************/
-	sparse_buf_init(&regs, 0x80);
-	if (parse_reg_file(cfg_path, &regs) != 0) {
+	if (backend_parse(backend_name, &backend) != 0) {
 		exit(EXIT_FAILURE);
 	}
 
-	// Setup signal handlers
-	sigemptyset(&sigmask);
-	sigaddset(&sigmask, SIGINT);
-	sigaddset(&sigmask, SIGHUP);
-	sigaddset(&sigmask, SIGTERM);
-	if (sigprocmask(SIG_BLOCK, &sigmask, NULL) == -1) {
-		perror("sigprocmask");
-		exit(EXIT_FAILURE);
+	// Report an invalid -C early, radio_open() parses it for every
+	// transceiver
+	if (crc_spec != NULL && strcmp(crc_spec, "none") != 0) {
+		crc16_t crc;	// Only used to validate the specification
+
+		if (crc16_parse(&crc, crc_spec) != 0) {
+			fprintf(stderr, "Invalid CRC specification '%s'\n",
+				crc_spec);
+			exit(EXIT_FAILURE);
+		}
 	}
 
-	sigemptyset(&empty_mask);
+	// Without -r options, a single transceiver is given by -d and -c
+	drv.radio_cnt = (radio_spec_cnt == 0) ? 1 : radio_spec_cnt;
+	for (i = 0; i < drv.radio_cnt; i++) {
+		radio_t *r = &drv.radios[i].radio;
 
-	if (signal(SIGINT, &terminate_cb) == SIG_IGN) {
-		signal(SIGINT, SIG_IGN);
-	}
-	if (signal(SIGHUP, &terminate_cb) == SIG_IGN) {
-		signal(SIGHUP, SIG_IGN);
-	}
-	if (signal(SIGTERM, &terminate_cb) == SIG_IGN) {
-		signal(SIGTERM, SIG_IGN);
+		r->dev_path = dev_path;
+		r->cfg_path = cfg_path;
+		r->gpio_chip = gpio_chip;
+		r->gpio_pin = gpio_pin;
+		r->poll_interval = poll_interval;
+		r->backend = backend;
+		r->crc_spec = crc_spec;
+		r->priority = priority;
+		r->tx_gap = tx_gap;
+		r->spi = spi;
+		if (hop_spec != NULL && hop_parse(hop_spec, r) != 0) {
+			exit(EXIT_FAILURE);
+		}
+		if (radio_spec_cnt != 0 && radio_parse(r, radio_specs[i]) != 0) {
+			exit(EXIT_FAILURE);
+		}
 	}
-	signal(SIGPIPE, SIG_IGN);
 
-	// Initialize buffers
-	ring_buf_init(&rx_data, RING_BUFFER_SIZE);
-	ring_buf_init(&tx_data, RING_BUFFER_SIZE);
+	// Only measure the SPI links, the transceivers aren't configured
+	if (calibrate) {
+		int ret = EXIT_SUCCESS;
 
-	// Setup server socket
-	if ((sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		perror("socket");
-		goto cleanup2;
+		for (i = 0; i < drv.radio_cnt; i++) {
+			if (radio_calibrate_spi(&drv.radios[i].radio) != 0) {
+				ret = EXIT_FAILURE;
+			}
+		}
+		exit(ret);
 	}
 
-	local.sun_family = AF_UNIX;
-	assert(strlen(sock_path) < sizeof(local.sun_path)+1);
-	strcpy(local.sun_path, sock_path);
-	unlink(local.sun_path);
-	if (bind(sock_fd, (struct sockaddr *)&local,
-			strlen(local.sun_path) + sizeof(local.sun_family)) == -1) {
-		perror("bind");
-		goto cleanup2;
+	if (sock_spec_cnt == 0) {
+		sock_specs[sock_spec_cnt++] = default_sock_spec;
 	}
+	for (i = 0; i < sock_spec_cnt; i++) {
+		listener_t *l = &drv.listeners[i];
 
-	if (listen(sock_fd, 5) == -1) {
-		perror("listen");
-		goto cleanup2;
+		l->sock_type = default_sock_type;
+		l->meta = default_meta;
+		l->policy = SLOW_CLIENT_DROP;
+		l->radio = -1;
+		l->batch_frames = CLIENT_MSG_BATCH;
+		if (listener_parse(l, sock_specs[i]) != 0) {
+			exit(EXIT_FAILURE);
+		}
+		if (l->radio >= (int) drv.radio_cnt) {
+			fprintf(stderr, "Socket %s uses unknown radio %d\n",
+				l->path, l->radio);
+			exit(EXIT_FAILURE);
+		}
 	}
+	drv.listener_cnt = sock_spec_cnt;
 
-	if (chmod(sock_path, 0777) != 0) {
-		perror("chmod");
-		goto cleanup2;
+	/************************** Initialization **************************/
+	if (lock_memory) {
+		// Keep all allocations on the heap and never give memory back,
+		// so that no page faults happen after locking memory
+		mallopt(M_MMAP_MAX, 0);
+		mallopt(M_TRIM_THRESHOLD, -1);
+	}
+
+	// Setup signal handling, before starting threads so they inherit the
+	// blocked signals
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGINT);
+	sigaddset(&sigmask, SIGHUP);
+	sigaddset(&sigmask, SIGTERM);
+	if (sigprocmask(SIG_BLOCK, &sigmask, NULL) == -1) {
+		perror("sigprocmask");
+		exit(EXIT_FAILURE);
 	}
+	signal(SIGPIPE, SIG_IGN);
 
-	// Setup Transceiver device
-	if (rf_open(&dev, dev_path) != 0) {
-		perror("rf_open()");
-		goto cleanup2;
+	if ((drv.signal_fd = signalfd(-1, &sigmask, SFD_CLOEXEC)) == -1) {
+		perror("signalfd");
+		exit(EXIT_FAILURE);
 	}
 
-	if (rf_init(&dev, &regs) != 0) {
-		fprintf(stderr, "Failed to initialize transceiver\n");
+	if (evloop_init(&drv.loop) != ERR_OK) {
+		perror("epoll_create");
 		goto cleanup;
 	}
 
-	// Setup interrupt pin
-	if (gpio_pin >= 0) {
-#define GPIO_SYS_PATH "/sys/class/gpio"
-#define GPIO_INT_EDGE "rising"
-		char path_buf[sizeof(GPIO_SYS_PATH"/gpio999/direction")];
+	drv.batch_fd = timerfd_create(CLOCK_MONOTONIC,
+				      TFD_NONBLOCK | TFD_CLOEXEC);
+	if (drv.batch_fd == -1) {
+		perror("timerfd_create");
+		goto cleanup;
+	}
 
-		// configure direction
-		snprintf(path_buf, sizeof(path_buf), GPIO_SYS_PATH"/gpio%u/direction", gpio_pin);
-		if ((gpio_fd = open(path_buf, O_WRONLY)) == -1) {
-			perror(path_buf);
-			goto cleanup;
-		}
-		if (write(gpio_fd, "in", 2) != 2) {
-			perror("Failed to configure IRQ GPIO pin direction");
-			close(gpio_fd);
+	// Initialize buffers
+	if (pkt_buf_init(&drv.rx_pkts, PKT_BUFFER_SLOTS) != 0) {
+		fprintf(stderr, "Unable to allocate packet buffers\n");
+		goto cleanup;
+	}
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		if (pkt_buf_init(&drv.clients[i].tx_pkts, TX_QUEUE_SLOTS) != 0) {
+			fprintf(stderr, "Unable to allocate packet buffers\n");
 			goto cleanup;
 		}
-		close(gpio_fd);
+		ring_buf_init(&drv.clients[i].tx_data, RING_BUFFER_SIZE);
+	}
 
-		// configure trigger edge
-		snprintf(path_buf, sizeof(path_buf), GPIO_SYS_PATH"/gpio%u/edge", gpio_pin);
-		if ((gpio_fd = open(path_buf, O_WRONLY)) == -1) {
-			perror(path_buf);
+	// Setup server sockets
+	for (i = 0; i < drv.listener_cnt; i++) {
+		if (listener_open(&drv.listeners[i]) != 0) {
 			goto cleanup;
 		}
-		if (write(gpio_fd, GPIO_INT_EDGE, strlen(GPIO_INT_EDGE)) != strlen(GPIO_INT_EDGE)) {
-			perror("Failed to configure IRQ GPIO trigger edge");
-			close(gpio_fd);
+	}
+	if (drv.metrics.path != NULL && listener_open(&drv.metrics) != 0) {
+		goto cleanup;
+	}
+	if (drv.control.path != NULL && listener_open(&drv.control) != 0) {
+		goto cleanup;
+	}
+	if (drv.uplink.host != NULL) {
+		if (uplink_open(&drv.uplink) != 0) {
 			goto cleanup;
 		}
-		close(gpio_fd);
-
-		// open value file
-		snprintf(path_buf, sizeof(path_buf), GPIO_SYS_PATH"/gpio%u/value", gpio_pin);
-		if ((gpio_fd = open(path_buf, O_RDONLY)) == -1) {
-			perror(path_buf);
+		if (evloop_add(&drv.loop, &drv.uplink.timer_src,
+				drv.uplink.timer_fd, EPOLLIN, &on_uplink_timer,
+				&drv.uplink) != ERR_OK) {
+			perror("epoll_ctl");
 			goto cleanup;
 		}
 	}
 
-	/*************************** Main loop ******************************/
-	for (;;) {
-		// Setup select structures
-		FD_ZERO(&rfds);
-		FD_ZERO(&wfds);
-		FD_ZERO(&efds);
-
-		nfds = sock_fd;
-		FD_SET(sock_fd, &rfds);
-
-		if (client_fd != -1) {
-			if (client_fd > nfds) {
-				nfds = client_fd;
-			}
-			if (! ring_buf_empty(&rx_data)) {
-				FD_SET(client_fd, &wfds);
-			}
-			if (! ring_buf_full(&tx_data)) {
-				FD_SET(client_fd, &rfds);
-			}
-		}
-		if (gpio_fd != -1) {
-			FD_SET(gpio_fd, &efds);
-			if (gpio_fd > nfds) {
-				nfds = gpio_fd;
-			}
+	// Setup Transceivers
+	if (trace_path != NULL && spi_trace_open(trace_path) != 0) {
+		perror("Unable to create SPI trace");
+		goto cleanup;
+	}
+	for (i = 0; i < drv.radio_cnt; i++) {
+		if (radio_open(&drv.radios[i].radio) != 0) {
+			goto cleanup;
 		}
+	}
 
-		timeout.tv_sec = 1;
-		timeout.tv_nsec = 0;
-
-		// Wait for events
-		r = pselect(nfds + 1, &rfds, &wfds, &efds, &timeout,
-			    &empty_mask);
-		if (r == -1 && errno != EINTR) {
-			perror("select()");
+	// Register event sources
+	if (evloop_add(&drv.loop, &drv.signal_src, drv.signal_fd, EPOLLIN,
+			&on_signal, &drv) != ERR_OK) {
+		perror("epoll_ctl");
+		goto cleanup;
+	}
+	if (evloop_add(&drv.loop, &drv.batch_src, drv.batch_fd, EPOLLIN,
+			&on_batch, &drv) != ERR_OK) {
+		perror("epoll_ctl");
+		goto cleanup;
+	}
+	for (i = 0; i < drv.listener_cnt; i++) {
+		listener_t *l = &drv.listeners[i];
+		if (evloop_add(&drv.loop, &l->src, l->fd, EPOLLIN,
+				&on_accept, l) != ERR_OK) {
+			perror("epoll_ctl");
 			goto cleanup;
 		}
-
-		if (terminate) {
-			break;
+	}
+	if (drv.metrics.fd != -1 &&
+	    evloop_add(&drv.loop, &drv.metrics.src, drv.metrics.fd, EPOLLIN,
+			&on_metrics, &drv) != ERR_OK) {
+		perror("epoll_ctl");
+		goto cleanup;
+	}
+	if (drv.control.fd != -1 &&
+	    evloop_add(&drv.loop, &drv.control.src, drv.control.fd, EPOLLIN,
+			&on_control, &drv) != ERR_OK) {
+		perror("epoll_ctl");
+		goto cleanup;
+	}
+	for (i = 0; i < drv.radio_cnt; i++) {
+		drv_radio_t *dr = &drv.radios[i];
+		if (evloop_add(&drv.loop, &dr->src, dr->radio.notify_fd,
+				EPOLLIN, &on_radio, dr) != ERR_OK) {
+			perror("epoll_ctl");
+			goto cleanup;
 		}
+	}
 
-		// Service sockets
-		if (r > 0) {
-			if (FD_ISSET(sock_fd, &rfds)) {
-				struct sockaddr_un remote;
-				socklen_t t;
-
-				// Disconnect previous client
-				if (client_fd != -1) {
-					DBG_PRINTF(DBG_LVL_LOW, "Closing old connection in favor of new one\n");
-					close(client_fd);
-					client_fd = -1;
-				}
+	// Lock all memory. This also faults in all pages of the buffers, and
+	// of the radio thread stacks once they are created.
+	if (lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		perror("mlockall");
+		goto cleanup;
+	}
 
-				// Accept new client
-				t = sizeof(remote);
-				if ((client_fd = accept(sock_fd, (struct sockaddr *)&remote, &t)) == -1) {
-					perror("accept");
-					continue;
-				}
-				DBG_PRINTF(DBG_LVL_LOW, "Accepted new client connection\n");
-				ring_buf_clear(&rx_data);
-				ring_buf_clear(&tx_data);
-			} else if (client_fd != -1) {
-				if (FD_ISSET(client_fd, &rfds)) {
-					// Read client socket
-					ssize_t rlen;
-					uint8_t rdbuf[1024];
-
-					// TODO: loop to read every thing till buffer is full?
-					rlen = ring_buf_bytes_free(&tx_data);
-					if (rlen > sizeof(rdbuf)) {
-						rlen = sizeof(rdbuf);
-					}
-					rlen = read(client_fd, rdbuf, rlen);
-					if (rlen <= 0) {
-						if (rlen < 0) {
-							perror("Client read failure");
-						} else {
-							DBG_PRINTF(DBG_LVL_LOW, "Client disconnected\n");
-						}
-						close(client_fd);
-						client_fd = -1;
-						continue;
-					}
-
-					ring_buf_add(&tx_data, rdbuf, rlen);
-					DBG_PRINTF(DBG_LVL_HIGH, "Read client %zd bytes\n", rlen);
-				}
-				if (FD_ISSET(client_fd, &wfds)) {
-					// Write client socket
-					ssize_t wlen;
-
-					wlen = write(client_fd, ring_buf_begin(&rx_data),
-						     ring_buf_bytes_readable(&rx_data));
-					if (wlen == -1) {
-						perror("Client write failure");
-						close(client_fd);
-						client_fd = -1;
-						continue;
-					}
-					ring_buf_consume(&rx_data, wlen);
-					DBG_PRINTF(DBG_LVL_HIGH, "Written client %zd bytes\n", wlen);
-				}
-			}
-			if (gpio_fd != -1 && FD_ISSET(gpio_fd, &efds)) {
-				// clear readable status, but we don't care about the data
-				char rdbuf[10];
-				lseek(gpio_fd, 0, SEEK_SET);
-				if (read(gpio_fd, rdbuf, sizeof(rdbuf)) < 0) {
-					if (errno != EINTR) {
-						perror("Error reading from interrupt pin");
-						goto cleanup;
-					}
-				}
-				DBG_PRINTF(DBG_LVL_HIGH, "Interrupt Requested\n");
-			}
+	// Start radio threads
+	for (i = 0; i < drv.radio_cnt; i++) {
+		if (radio_start(&drv.radios[i].radio) != ERR_OK) {
+			perror("Unable to start radio thread");
+			goto cleanup;
 		}
+	}
 
-		err = rf_handle(&dev, &rx_data, &tx_data);
-		if (err == ERR_RFM_TX_OUT_OF_SYNC) {
-			fprintf(stderr, "TX buffer out-of-sync, Disconnecting client\n");
-			close(client_fd);
-			client_fd = -1;
-		} else if (err != ERR_OK) {
+	/*************************** Main loop ******************************/
+	while (! drv.terminate) {
+		err = evloop_run_once(&drv.loop, -1);
+		drv.loop_wakeups++;
+		if (err != ERR_OK) {
 			char err_buf[sizeof("ERROR: 0x00112233")];
 			snprintf(err_buf, sizeof(err_buf), "ERROR: 0x%08x", err);
 			if (ERROR_ERRNO_VALID(err)) {
@@ -424,21 +3249,32 @@ int main(int argc, char *argv[])
 
 	retval = EXIT_SUCCESS;
 cleanup:
-	if (gpio_fd != -1) {
-		close(gpio_fd);
+	for (i = 0; i < MAX_RADIOS; i++) {
+		radio_stop(&drv.radios[i].radio);
+	}
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		client_close(&drv.clients[i]);
+		pkt_buf_destroy(&drv.clients[i].tx_pkts);
+		ring_buf_destroy(&drv.clients[i].tx_data);
+	}
+	for (i = 0; i < drv.listener_cnt; i++) {
+		listener_close(&drv.listeners[i]);
 	}
-	rf_close(&dev);
-cleanup2:
-	if (client_fd != -1) {
-		close(client_fd);
+	listener_close(&drv.metrics);
+	listener_close(&drv.control);
+	uplink_close(&drv.uplink);
+	for (i = 0; i < MAX_RADIOS; i++) {
+		radio_close(&drv.radios[i].radio);
 	}
-	if (sock_fd != -1) {
-		close(sock_fd);
-		unlink(local.sun_path);
+	spi_trace_close();
+	LAT_EXEC(lat_print());
+	evloop_destroy(&drv.loop);
+	close(drv.signal_fd);
+	if (drv.batch_fd != -1) {
+		close(drv.batch_fd);
 	}
 
-	ring_buf_destroy(&rx_data);
-	ring_buf_destroy(&tx_data);
+	pkt_buf_destroy(&drv.rx_pkts);
 
 	return retval;
 }
@@ -0,0 +1,82 @@
+/**
+ * metrics.c - Prometheus text format writer
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+/**
+ * Append line to buffer, or nothing if it doesn't completely fit
+ */
+static void _printf(metrics_t *m, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (m->truncated) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	ret = vsnprintf(&m->buf[m->len], m->size - m->len, fmt, ap);
+	va_end(ap);
+
+	if (ret < 0 || (size_t) ret >= m->size - m->len) {
+		m->buf[m->len] = '\0';
+		m->truncated = true;
+		return;
+	}
+	m->len += ret;
+}
+
+void metrics_init(metrics_t *m, char *buf, size_t size)
+{
+	m->buf = buf;
+	m->size = size;
+	m->len = 0;
+	m->truncated = false;
+	buf[0] = '\0';
+}
+
+void metrics_describe(metrics_t *m, const char *name, const char *type,
+		      const char *help)
+{
+	_printf(m, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_sample(metrics_t *m, const char *name, const char *labels,
+		    uint64_t value)
+{
+	if (labels != NULL && labels[0] != '\0') {
+		_printf(m, "%s{%s} %" PRIu64 "\n", name, labels, value);
+	} else {
+		_printf(m, "%s %" PRIu64 "\n", name, value);
+	}
+}
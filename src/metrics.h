@@ -0,0 +1,81 @@
+/**
+ * metrics.h - Prometheus text format writer
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Metrics text writer
+ *
+ * Formats metrics in the Prometheus text exposition format into a fixed
+ * size buffer. Output that doesn't fit is dropped and marks the buffer as
+ * truncated; the buffer always contains complete lines.
+ */
+typedef struct {
+	char *buf;
+	size_t size;		/**< Size of buf */
+	size_t len;		/**< Length of text in buf, excl. '\0' */
+	bool truncated;		/**< Output didn't fit */
+} metrics_t;
+
+/**
+ * Initialize metrics writer
+ *
+ * @param m	Object to initialize
+ * @param buf	Buffer to write to
+ * @param size	Size of buf, must be at least 1
+ */
+void metrics_init(metrics_t *m, char *buf, size_t size);
+
+/**
+ * Write HELP and TYPE lines of metric
+ *
+ * @param m	Metrics writer
+ * @param name	Metric name
+ * @param type	Metric type, eg. "counter" or "gauge"
+ * @param help	Description
+ */
+void metrics_describe(metrics_t *m, const char *name, const char *type,
+		      const char *help);
+
+/**
+ * Write sample of metric
+ *
+ * @param m		Metrics writer
+ * @param name		Metric name
+ * @param labels	Labels without braces, eg. 'radio="0"', or NULL
+ * @param value		Value of sample
+ */
+void metrics_sample(metrics_t *m, const char *name, const char *labels,
+		    uint64_t value);
+
+#endif // __METRICS_H__
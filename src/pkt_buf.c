@@ -0,0 +1,85 @@
+/**
+ * pkt_buf.c - Packet based ring buffer with per packet meta data
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pkt_buf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int pkt_buf_init(pkt_buf_t *obj, size_t cnt)
+{
+	memset(obj, 0, sizeof(*obj));
+
+	if (cnt == 0 || (cnt & (cnt - 1)) != 0) {
+		return -1;
+	}
+
+	obj->slots = (pkt_t *) calloc(cnt, sizeof(pkt_t));
+	if (obj->slots == NULL) {
+		return -1;
+	}
+	obj->mask = cnt - 1;
+
+#ifdef ENABLE_LATENCY_STATS
+	obj->stamps = (uint64_t *) calloc(cnt, sizeof(uint64_t));
+	if (obj->stamps == NULL) {
+		free(obj->slots);
+		obj->slots = NULL;
+		return -1;
+	}
+#endif
+
+	return 0;
+}
+
+void pkt_buf_destroy(pkt_buf_t *obj)
+{
+	free(obj->slots);
+#ifdef ENABLE_LATENCY_STATS
+	free(obj->stamps);
+#endif
+	memset(obj, 0, sizeof(*obj));
+}
+
+void pkt_buf_clear(pkt_buf_t *obj)
+{
+	obj->head = obj->tail = 0;
+}
+
+void pkt_meta_init(pkt_meta_t *meta, uint64_t timestamp)
+{
+	memset(meta, 0, sizeof(*meta));
+
+	if (timestamp == 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+	meta->timestamp = timestamp;
+}
@@ -0,0 +1,321 @@
+/**
+ * pkt_buf.h - Packet based ring buffer with per packet meta data
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PKT_BUF_H__
+#define __PKT_BUF_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+
+/**
+ * Maximum length of a frame, including length byte
+ */
+#define PKT_MAX_LEN 256
+
+/**
+ * Packet flags
+ */
+#define PKT_FLAG_CRC_OK	0x01	/**< CRC verified by hardware or software */
+
+/**
+ * Packet meta data
+ *
+ * The layout of this structure is also used on the client socket when
+ * meta data is requested. So fields may only be added in place of the
+ * reserved bytes.
+ */
+typedef struct {
+	uint64_t timestamp;	/**< Time of arrival in ns(CLOCK_MONOTONIC) */
+	int32_t afc;		/**< AFC correction in Hz */
+	int32_t fei;		/**< Frequency error in Hz */
+	int16_t rssi;		/**< RSSI in 0.5 dBm steps */
+	uint16_t len;		/**< Length of frame data */
+	uint8_t lna;		/**< LNA gain setting, backend specific */
+	uint8_t flags;		/**< PKT_FLAG_* */
+	uint8_t radio;		/**< Index of receiving transceiver */
+	uint8_t channel;	/**< Index of channel in hop list, 0 if not
+				     hopping */
+} pkt_meta_t;
+
+/**
+ * Packet slot
+ *
+ * The frame data directly follows the meta data, so both can be send as a
+ * single block.
+ */
+typedef struct {
+	pkt_meta_t meta;
+	uint8_t data[PKT_MAX_LEN];	/**< Frame as on the client socket */
+} pkt_t;
+
+/**
+ * Packet buffer
+ *
+ * A single producer and a single consumer may use the buffer from different
+ * threads without locking. The producer only modifies head, the consumer only
+ * tail; both are accessed with acquire/release semantics.
+ */
+typedef struct {
+	pkt_t *slots;
+	size_t mask;	/**< Amount of slots - 1 */
+	size_t head;	/**< Free running write index */
+	size_t tail;	/**< Free running read index */
+#ifdef ENABLE_LATENCY_STATS
+	uint64_t *stamps;	/**< Per slot hot path timestamp, see
+				     lat_hist.h */
+#endif
+} pkt_buf_t;
+
+/**
+ * Initialize packet buffer
+ *
+ * @param obj	Object to initialize
+ * @param cnt	Amount of packet slots, must be a power of 2
+ *
+ * @returns	0 on success, -1 on error
+ */
+int pkt_buf_init(pkt_buf_t *obj, size_t cnt);
+
+/**
+ * Destroy packet buffer object
+ */
+void pkt_buf_destroy(pkt_buf_t *obj);
+
+/**
+ * Drop all packets from buffer
+ */
+void pkt_buf_clear(pkt_buf_t *obj);
+
+/**
+ * Initialize packet meta data
+ *
+ * Clears all meta data fields and sets the arrival time.
+ *
+ * @param meta		Meta data to initialize
+ * @param timestamp	Arrival time in ns(CLOCK_MONOTONIC), or 0 to use the
+ *			current time
+ */
+void pkt_meta_init(pkt_meta_t *meta, uint64_t timestamp);
+
+/**
+ * Reserve slot for next packet
+ *
+ * Returns a pointer to the next free slot, which can directly be filled by
+ * the caller. The packet is only added to the buffer once
+ * pkt_buf_commit() is called.
+ *
+ * @returns	Pointer to free slot, or NULL if buffer is full
+ */
+static inline pkt_t *pkt_buf_alloc(pkt_buf_t *obj);
+
+/**
+ * Reserve n-th free slot
+ *
+ * Like pkt_buf_alloc(), but allows filling multiple slots before committing
+ * them with pkt_buf_commit_n().
+ *
+ * @param obj	Packet buffer object
+ * @param n	Index of free slot, 0 is the slot returned by pkt_buf_alloc()
+ *
+ * @returns	Pointer to free slot, or NULL if less then n+1 slots are free
+ */
+static inline pkt_t *pkt_buf_alloc_at(pkt_buf_t *obj, size_t n);
+
+/**
+ * Add packet in slot returned by pkt_buf_alloc() to buffer
+ */
+static inline void pkt_buf_commit(pkt_buf_t *obj);
+
+/**
+ * Add first n reserved slots to buffer
+ */
+static inline void pkt_buf_commit_n(pkt_buf_t *obj, size_t n);
+
+/**
+ * Get oldest packet in buffer
+ *
+ * @returns	Pointer to oldest packet, or NULL if buffer is empty
+ */
+static inline pkt_t *pkt_buf_peek(pkt_buf_t *obj);
+
+/**
+ * Get n-th oldest packet in buffer
+ *
+ * @returns	Pointer to packet, or NULL if buffer contains less then n+1
+ *		packets
+ */
+static inline pkt_t *pkt_buf_peek_at(pkt_buf_t *obj, size_t n);
+
+/**
+ * Remove oldest packet from buffer
+ */
+static inline void pkt_buf_pop(pkt_buf_t *obj);
+
+/**
+ * Remove n oldest packets from buffer
+ */
+static inline void pkt_buf_pop_n(pkt_buf_t *obj, size_t n);
+
+/**
+ * Get packet by sequence number
+ *
+ * Every packet committed to the buffer gets the next sequence number. This
+ * allows multiple readers to each keep their own position in the buffer.
+ *
+ * @param obj	Packet buffer object
+ * @param seq	Sequence number of packet
+ *
+ * @returns	Pointer to packet, or NULL if packet is not in buffer
+ */
+static inline pkt_t *pkt_buf_get(pkt_buf_t *obj, size_t seq);
+
+#ifdef ENABLE_LATENCY_STATS
+/**
+ * Timestamp of packet slot
+ *
+ * Stored outside of the slot, to not change the slot layout. The meaning
+ * depends on the buffer, eg. the time the packet was read from the
+ * transceiver.
+ *
+ * @param obj	Packet buffer object
+ * @param pkt	Slot of this buffer
+ */
+static inline uint64_t *pkt_buf_stamp(pkt_buf_t *obj, const pkt_t *pkt)
+{
+	return &obj->stamps[pkt - obj->slots];
+}
+#endif
+
+/**
+ * Sequence number of next packet to be committed
+ */
+static inline size_t pkt_buf_head(const pkt_buf_t *obj);
+
+/**
+ * Sequence number of oldest packet in buffer
+ */
+static inline size_t pkt_buf_tail(const pkt_buf_t *obj);
+
+static inline size_t pkt_buf_size(const pkt_buf_t *obj);
+static inline size_t pkt_buf_count(const pkt_buf_t *obj);
+static inline size_t pkt_buf_free(const pkt_buf_t *obj);
+static inline bool pkt_buf_empty(const pkt_buf_t *obj);
+static inline bool pkt_buf_full(const pkt_buf_t *obj);
+
+/*************** Static function implementations ***********************/
+
+static inline size_t pkt_buf_size(const pkt_buf_t *obj)
+{
+	return obj->mask + 1;
+}
+
+static inline size_t pkt_buf_head(const pkt_buf_t *obj)
+{
+	return __atomic_load_n(&obj->head, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t pkt_buf_tail(const pkt_buf_t *obj)
+{
+	return __atomic_load_n(&obj->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t pkt_buf_count(const pkt_buf_t *obj)
+{
+	return pkt_buf_head(obj) - pkt_buf_tail(obj);
+}
+
+static inline size_t pkt_buf_free(const pkt_buf_t *obj)
+{
+	return pkt_buf_size(obj) - pkt_buf_count(obj);
+}
+
+static inline bool pkt_buf_empty(const pkt_buf_t *obj)
+{
+	return pkt_buf_count(obj) == 0;
+}
+
+static inline bool pkt_buf_full(const pkt_buf_t *obj)
+{
+	return pkt_buf_count(obj) > obj->mask;
+}
+
+static inline pkt_t *pkt_buf_alloc_at(pkt_buf_t *obj, size_t n)
+{
+	if (n >= pkt_buf_free(obj)) {
+		return NULL;
+	}
+	return &obj->slots[(pkt_buf_head(obj) + n) & obj->mask];
+}
+
+static inline pkt_t *pkt_buf_alloc(pkt_buf_t *obj)
+{
+	return pkt_buf_alloc_at(obj, 0);
+}
+
+static inline void pkt_buf_commit_n(pkt_buf_t *obj, size_t n)
+{
+	__atomic_store_n(&obj->head, obj->head + n, __ATOMIC_RELEASE);
+}
+
+static inline void pkt_buf_commit(pkt_buf_t *obj)
+{
+	pkt_buf_commit_n(obj, 1);
+}
+
+static inline pkt_t *pkt_buf_peek_at(pkt_buf_t *obj, size_t n)
+{
+	if (n >= pkt_buf_count(obj)) {
+		return NULL;
+	}
+	return &obj->slots[(pkt_buf_tail(obj) + n) & obj->mask];
+}
+
+static inline pkt_t *pkt_buf_peek(pkt_buf_t *obj)
+{
+	return pkt_buf_peek_at(obj, 0);
+}
+
+static inline void pkt_buf_pop_n(pkt_buf_t *obj, size_t n)
+{
+	__atomic_store_n(&obj->tail, obj->tail + n, __ATOMIC_RELEASE);
+}
+
+static inline void pkt_buf_pop(pkt_buf_t *obj)
+{
+	pkt_buf_pop_n(obj, 1);
+}
+
+static inline pkt_t *pkt_buf_get(pkt_buf_t *obj, size_t seq)
+{
+	return pkt_buf_peek_at(obj, seq - pkt_buf_tail(obj));
+}
+
+#endif // __PKT_BUF_H__
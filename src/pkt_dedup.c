@@ -0,0 +1,96 @@
+/**
+ * pkt_dedup.c - Time windowed duplicate frame suppression
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pkt_dedup.h"
+
+#include <string.h>
+
+#define FNV64_OFFSET 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+
+/**
+ * FNV-1a hash of frame data, never 0
+ */
+static uint64_t _hash(const uint8_t *data, size_t len)
+{
+	uint64_t h = FNV64_OFFSET;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= data[i];
+		h *= FNV64_PRIME;
+	}
+	// Length is hashed too, to tell apart frames with trailing zeros
+	h ^= len;
+	h *= FNV64_PRIME;
+
+	return (h != 0) ? h : 1;
+}
+
+void pkt_dedup_init(pkt_dedup_t *obj, uint64_t window)
+{
+	obj->window = window;
+	memset(obj->slots, 0, sizeof(obj->slots));
+}
+
+bool pkt_dedup_check(pkt_dedup_t *obj, const uint8_t *data, size_t len,
+		     uint64_t now)
+{
+	const uint64_t h = _hash(data, len);
+	pkt_dedup_slot_t *bucket;
+	pkt_dedup_slot_t *victim;
+	size_t i;
+
+	// The high bits select the bucket, they are mixed best by FNV
+	bucket = &obj->slots[(h >> 32) & (PKT_DEDUP_SLOTS - PKT_DEDUP_WAYS)];
+	victim = &bucket[0];
+
+	for (i = 0; i < PKT_DEDUP_WAYS; i++) {
+		pkt_dedup_slot_t *slot = &bucket[i];
+
+		if (slot->hash == h) {
+			if (now < slot->time + obj->window) {
+				return true;
+			}
+			// Expired copy, start new window
+			victim = slot;
+			break;
+		}
+		if (slot->hash == 0 || slot->time < victim->time) {
+			victim = slot;
+			if (slot->hash == 0) {
+				break;
+			}
+		}
+	}
+
+	victim->hash = h;
+	victim->time = now;
+
+	return false;
+}
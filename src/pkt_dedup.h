@@ -0,0 +1,88 @@
+/**
+ * pkt_dedup.h - Time windowed duplicate frame suppression
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PKT_DEDUP_H__
+#define __PKT_DEDUP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * Amount of frames remembered, must be a power of 2
+ */
+#define PKT_DEDUP_SLOTS 1024
+
+/**
+ * Amount of slots per bucket, must be a power of 2
+ */
+#define PKT_DEDUP_WAYS 4
+
+typedef struct {
+	uint64_t hash;		/**< Hash of frame data, 0 if slot is unused */
+	uint64_t time;		/**< Time frame was first seen */
+} pkt_dedup_slot_t;
+
+/**
+ * Duplicate frame detector
+ *
+ * Remembers the hashes of recently seen frames in a set associative table of
+ * fixed size. A frame is a duplicate if a frame with the same data was seen
+ * less than the window ago. When a bucket is full the oldest frame in it is
+ * forgotten, so under heavy load duplicates may pass.
+ */
+typedef struct {
+	uint64_t window;	/**< Duplicate window in ns */
+	pkt_dedup_slot_t slots[PKT_DEDUP_SLOTS];
+} pkt_dedup_t;
+
+/**
+ * Initialize duplicate detector
+ *
+ * @param obj		Object to initialize
+ * @param window	Duplicate window in ns
+ */
+void pkt_dedup_init(pkt_dedup_t *obj, uint64_t window);
+
+/**
+ * Check if frame is a duplicate, and remember it if not
+ *
+ * The window starts at the first copy of a frame, duplicates don't extend
+ * it. So a frame that is repeated periodically passes once per window.
+ *
+ * @param obj	Duplicate detector
+ * @param data	Frame data
+ * @param len	Length of frame data
+ * @param now	Arrival time of frame in ns
+ *
+ * @returns	true if the frame is a duplicate
+ */
+bool pkt_dedup_check(pkt_dedup_t *obj, const uint8_t *data, size_t len,
+		     uint64_t now);
+
+#endif // __PKT_DEDUP_H__
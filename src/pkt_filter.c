@@ -0,0 +1,190 @@
+/**
+ * pkt_filter.c - Match received frames against header and address rules
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pkt_filter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "dehexify.h"
+
+/**
+ * Parse hex string of n characters into out, and store byte count in len
+ *
+ * @returns	0 on success, else -1
+ */
+static int _parse_hex(const char *s, size_t n, uint8_t *out, uint8_t *len)
+{
+	if (n == 0 || n % 2 != 0 || n / 2 > PKT_FILTER_MAX_LEN) {
+		return -1;
+	}
+	*len = n / 2;
+
+	return dehexify(s, *len, out);
+}
+
+/**
+ * Parse single rule of n characters
+ */
+static int _parse_rule(pkt_filter_rule_t *rule, const char *s, size_t n)
+{
+	const char *end = s + n;
+	const char *p;
+	uint8_t mask_len;
+	unsigned long off;
+	size_t i;
+
+	memset(rule, 0, sizeof(*rule));
+
+	if (n > 3 && strncmp(s, "hdr", 3) == 0) {
+		rule->field = PKT_FILTER_HDR;
+		s += 3;
+	} else if (n > 4 && strncmp(s, "addr", 4) == 0) {
+		rule->field = PKT_FILTER_ADDR;
+		s += 4;
+	} else {
+		return -1;
+	}
+
+	off = 0;
+	for (p = s; p < end && isdigit((unsigned char) *p); p++) {
+		off = off * 10 + (*p - '0');
+		if (off > UINT8_MAX) {
+			return -1;
+		}
+	}
+	if (p == s || p == end) {
+		return -1;
+	}
+	rule->off = off;
+
+	if (*p == '!') {
+		rule->negate = true;
+		p++;
+	}
+	if (p == end || *p != '=') {
+		return -1;
+	}
+	p++;
+
+	s = memchr(p, '/', end - p);
+	if (s == NULL) {
+		if (_parse_hex(p, end - p, rule->value, &rule->len) != 0) {
+			return -1;
+		}
+		memset(rule->mask, 0xff, rule->len);
+	} else {
+		if (_parse_hex(p, s - p, rule->value, &rule->len) != 0 ||
+		    _parse_hex(s + 1, end - s - 1, rule->mask, &mask_len) != 0 ||
+		    mask_len != rule->len) {
+			return -1;
+		}
+		// Masked value bits are ignored
+		for (i = 0; i < rule->len; i++) {
+			rule->value[i] &= rule->mask[i];
+		}
+	}
+
+	return 0;
+}
+
+int pkt_filter_parse(pkt_filter_t *obj, const char *spec)
+{
+	const char *end;
+	size_t n;
+
+	obj->cnt = 0;
+
+	while (*spec != '\0') {
+		end = strchr(spec, ':');
+		n = (end != NULL) ? (size_t) (end - spec) : strlen(spec);
+
+		if (obj->cnt == PKT_FILTER_MAX_RULES) {
+			fprintf(stderr, "Too many filter rules (max=%d)\n",
+				PKT_FILTER_MAX_RULES);
+			return -1;
+		}
+		if (_parse_rule(&obj->rules[obj->cnt], spec, n) != 0) {
+			fprintf(stderr, "Invalid filter rule '%.*s'\n",
+				(int) n, spec);
+			return -1;
+		}
+		obj->cnt++;
+
+		spec += n;
+		if (*spec == ':') {
+			spec++;
+		}
+	}
+
+	return 0;
+}
+
+bool pkt_filter_match(const pkt_filter_t *obj,
+		      const pkt_filter_layout_t *layout,
+		      const uint8_t *data, size_t len)
+{
+	const size_t payload_off = layout->hdr_len +
+				   (layout->len_byte ? 1 : 0);
+	const pkt_filter_rule_t *rule;
+	size_t field_off;
+	size_t field_len;
+	bool match;
+	size_t i;
+
+	for (rule = obj->rules; rule < &obj->rules[obj->cnt]; rule++) {
+		if (rule->field == PKT_FILTER_HDR) {
+			field_off = 0;
+			field_len = layout->hdr_len;
+		} else {
+			field_off = payload_off;
+			field_len = (len > payload_off) ? len - payload_off : 0;
+		}
+		if (field_len > len - field_off) {
+			field_len = len - field_off;
+		}
+		if ((size_t) rule->off + rule->len > field_len) {
+			return false;
+		}
+
+		match = true;
+		for (i = 0; i < rule->len; i++) {
+			if ((data[field_off + rule->off + i] & rule->mask[i]) !=
+					rule->value[i]) {
+				match = false;
+				break;
+			}
+		}
+		if (match == rule->negate) {
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,117 @@
+/**
+ * pkt_filter.h - Match received frames against header and address rules
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PKT_FILTER_H__
+#define __PKT_FILTER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * Maximum amount of rules in a filter
+ */
+#define PKT_FILTER_MAX_RULES 8
+
+/**
+ * Maximum amount of bytes compared by a rule
+ */
+#define PKT_FILTER_MAX_LEN 8
+
+/**
+ * Part of the frame a rule is applied to
+ */
+typedef enum {
+	PKT_FILTER_HDR,		/**< Transmit header bytes, before length
+				     byte */
+	PKT_FILTER_ADDR,	/**< Leading payload bytes, after length byte */
+} pkt_filter_field_t;
+
+/**
+ * Frame matches rule if (frame[off + i] & mask[i]) == value[i], for all i
+ * below len. Bytes outside of the field never match.
+ */
+typedef struct {
+	pkt_filter_field_t field;
+	uint8_t off;		/**< Offset in field */
+	uint8_t len;		/**< Amount of bytes to compare */
+	bool negate;		/**< Rule matches if bytes don't match */
+	uint8_t value[PKT_FILTER_MAX_LEN];
+	uint8_t mask[PKT_FILTER_MAX_LEN];
+} pkt_filter_rule_t;
+
+/**
+ * Filter, matches frames that match all rules
+ */
+typedef struct {
+	size_t cnt;		/**< Amount of rules, 0 matches all frames */
+	pkt_filter_rule_t rules[PKT_FILTER_MAX_RULES];
+} pkt_filter_t;
+
+/**
+ * Layout of frame data
+ *
+ * Frames consist of hdr_len transmit header bytes, the length byte if the
+ * packets have a variable length, and the payload.
+ */
+typedef struct {
+	uint8_t hdr_len;	/**< Amount of header bytes */
+	bool len_byte;		/**< Frame contains length byte */
+} pkt_filter_layout_t;
+
+/**
+ * Parse filter specification
+ *
+ * The specification is a list of rules separated by ':'. A rule has the
+ * format '<field><offset>=<hex value>[/<hex mask>]', where field is 'hdr' or
+ * 'addr'. With '!=' instead of '=' the rule matches frames that don't
+ * contain the value. Eg. 'hdr0=a5:addr1!=ff' matches frames with a first
+ * header byte of 0xa5, and a second payload byte other than 0xff.
+ *
+ * @param obj	Filter to initialize
+ * @param spec	Filter specification, an empty string matches all frames
+ *
+ * @returns	0 on success, else -1 and an error is logged to stderr
+ */
+int pkt_filter_parse(pkt_filter_t *obj, const char *spec);
+
+/**
+ * Check if frame matches filter
+ *
+ * @param obj		Filter object
+ * @param layout	Layout of the frame
+ * @param data		Frame data
+ * @param len		Length of frame data
+ *
+ * @returns	true if the frame matches all rules
+ */
+bool pkt_filter_match(const pkt_filter_t *obj,
+		      const pkt_filter_layout_t *layout,
+		      const uint8_t *data, size_t len);
+
+#endif // __PKT_FILTER_H__
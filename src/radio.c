@@ -0,0 +1,863 @@
+/**
+ * radio.c - Transceiver service thread
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE // for pthread_attr_setaffinity_np()
+
+#include "radio.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "error.h"
+#include "gpio_irq.h"
+#include "spi_sim.h"
+#include "sparse_buf.h"
+#include "parse_reg_file.h"
+#include "debug.h"
+
+/**
+ * SPI clock rates tested by radio_calibrate_spi(), the first one is assumed
+ * to work on any board
+ */
+static const uint32_t spi_cal_speeds[] = {
+	500000, 1000000, 2000000, 4000000, 5000000, 8000000, 10000000,
+	12000000, 16000000, 20000000
+};
+#define SPI_CAL_SPEED_CNT (sizeof(spi_cal_speeds) / sizeof(spi_cal_speeds[0]))
+
+static void _signal(int fd)
+{
+	const uint64_t one = 1;
+
+	// Can only fail if the counter overflows, which is as good as set
+	if (write(fd, &one, sizeof(one)) == -1) {
+		// Ignore
+	}
+}
+
+static void _clear(int fd)
+{
+	uint64_t cnt;
+
+	if (read(fd, &cnt, sizeof(cnt)) == -1) {
+		// Not signaled
+	}
+}
+
+/**
+ * Update counter, only called by radio thread
+ */
+static inline void _count(uint64_t *cnt, uint64_t n)
+{
+	__atomic_store_n(cnt, *cnt + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Arm poll timer to expire at time requested by backend
+ *
+ * The timer keeps its poll interval, so it continues polling from the
+ * requested time on.
+ */
+static int _arm_timer(radio_t *r, uint64_t deadline)
+{
+	struct itimerspec its;
+
+	if (deadline == r->timer_deadline) {
+		return ERR_OK;
+	}
+
+	its.it_interval.tv_sec = r->poll_interval / 1000;
+	its.it_interval.tv_nsec = (r->poll_interval % 1000) * 1000000;
+	its.it_value.tv_sec = deadline / 1000000000;
+	its.it_value.tv_nsec = deadline % 1000000000;
+	if (timerfd_settime(r->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+		return ERR_EVLOOP;
+	}
+	r->timer_deadline = deadline;
+
+	return ERR_OK;
+}
+
+/**
+ * Dwell time of channel, scaled by its hit rate relative to the average
+ */
+static uint64_t _adapt_dwell(const radio_t *r, const radio_channel_t *ch,
+			     uint64_t dwell)
+{
+	double mean = 0;
+	double scale;
+	size_t i;
+
+	for (i = 0; i < r->channel_cnt; i++) {
+		mean += r->channels[i].rate;
+	}
+	mean /= r->channel_cnt;
+	if (mean <= 0) {
+		return dwell;
+	}
+
+	scale = ch->rate / mean;
+	if (scale < RADIO_DWELL_SCALE_MIN) {
+		scale = RADIO_DWELL_SCALE_MIN;
+	} else if (scale > RADIO_DWELL_SCALE_MAX) {
+		scale = RADIO_DWELL_SCALE_MAX;
+	}
+
+	return dwell * scale;
+}
+
+/**
+ * Start dwelling on current channel
+ */
+static int _arm_hop(radio_t *r, uint64_t now)
+{
+	radio_channel_t *ch = &r->channels[r->dev.channel];
+	uint64_t dwell = (uint64_t) ch->dwell_ms * 1000000;
+	struct itimerspec its;
+
+	r->hop_start = now;
+	r->hop_frames = ch->stats.frames;
+	if (r->channel_cnt < 2) {
+		return ERR_OK;
+	}
+
+	if (r->hop_adapt) {
+		dwell = _adapt_dwell(r, ch, dwell);
+	}
+	__atomic_store_n(&ch->stats.target_ns, dwell, __ATOMIC_RELAXED);
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = dwell / 1000000000;
+	its.it_value.tv_nsec = dwell % 1000000000;
+	if (timerfd_settime(r->hop_fd, 0, &its, NULL) == -1) {
+		return ERR_EVLOOP;
+	}
+
+	return ERR_OK;
+}
+
+/**
+ * Account time spent on previous channel, after backend switched channel
+ */
+static int _hop_done(radio_t *r)
+{
+	radio_channel_t *ch = &r->channels[r->dev.channel];
+	const uint64_t now = rf_clock_ns();
+	const uint64_t dwell = now - r->hop_start;
+
+	_count(&ch->stats.dwell_ns, dwell);
+	if (dwell > 0) {
+		const double rate = (ch->stats.frames - r->hop_frames) * 1e9 /
+				    dwell;
+
+		ch->rate += (rate - ch->rate) / 4;
+	}
+	r->dev.channel = r->hop_next;
+
+	return _arm_hop(r, now);
+}
+
+static void _free_regs(sparse_buf_t *regs)
+{
+	if (regs != NULL) {
+		sparse_buf_destroy(regs);
+		free(regs);
+	}
+}
+
+/**
+ * Program configuration handed over by radio_reload()
+ */
+static int _reconfigure(radio_t *r)
+{
+	sparse_buf_t *regs;
+	sparse_buf_t *expected = NULL;
+	int err;
+
+	regs = __atomic_exchange_n(&r->reload, NULL, __ATOMIC_ACQUIRE);
+	if (regs == NULL) {
+		return ERR_OK;
+	}
+
+	err = rf_reconfigure(&r->dev, regs);
+	if (err == ERR_RFM_BUSY) {
+		// Retry after the transmission, unless it was replaced by a
+		// newer configuration in the meantime
+		if (! __atomic_compare_exchange_n(&r->reload, &expected, regs,
+						  false, __ATOMIC_RELEASE,
+						  __ATOMIC_RELAXED)) {
+			_free_regs(regs);
+		}
+		return ERR_OK;
+	}
+	_free_regs(regs);
+	if (err != ERR_OK) {
+		fprintf(stderr, "Radio %u: Failed to reconfigure transceiver\n",
+			r->index);
+		return err;
+	}
+
+	// The configuration has the frequency of the file, not of the channel
+	if (r->channel_cnt != 0) {
+		err = rf_retune(&r->dev, r->channels[r->dev.channel].freq);
+		if (err != ERR_OK) {
+			fprintf(stderr, "Radio %u: Failed to retune transceiver\n",
+				r->index);
+			return err;
+		}
+	}
+	DBG_PRINTF(DBG_LVL_LOW, "Radio %u: Reconfigured transceiver\n",
+		   r->index);
+
+	return ERR_OK;
+}
+
+static int _service(radio_t *r)
+{
+	const size_t rx_head = pkt_buf_head(&r->rx_pkts);
+	const size_t tx_tail = pkt_buf_tail(&r->tx_pkts);
+	const uint8_t channel = r->dev.channel;
+	int err;
+
+	if (__atomic_load_n(&r->reload, __ATOMIC_RELAXED) != NULL) {
+		err = _reconfigure(r);
+		if (err != ERR_OK) {
+			return err;
+		}
+	}
+
+	err = rf_handle(&r->dev, &r->rx_pkts, &r->tx_pkts);
+	if (err != ERR_OK) {
+		return err;
+	}
+
+	if (r->channel_cnt != 0) {
+		_count(&r->channels[channel].stats.frames,
+		       pkt_buf_head(&r->rx_pkts) - rx_head);
+		if (r->hop_next != r->dev.channel && r->dev.retune_freq == 0) {
+			err = _hop_done(r);
+			if (err != ERR_OK) {
+				perror("Error arming dwell timer");
+				return err;
+			}
+		}
+	}
+
+	if (r->dev.next_service != 0) {
+		err = _arm_timer(r, r->dev.next_service);
+		if (err != ERR_OK) {
+			perror("Error arming poll timer");
+			return err;
+		}
+	}
+
+	if (pkt_buf_head(&r->rx_pkts) != rx_head ||
+	    pkt_buf_tail(&r->tx_pkts) != tx_tail) {
+		_signal(r->notify_fd);
+	}
+	if (pkt_buf_count(&r->rx_pkts) > r->stats.rx_hwm) {
+		_count(&r->stats.rx_hwm,
+		       pkt_buf_count(&r->rx_pkts) - r->stats.rx_hwm);
+	}
+
+	return ERR_OK;
+}
+
+static int _on_irq(evloop_src_t *src, uint32_t events)
+{
+	radio_t *r = src->ctx;
+	unsigned int cnt;
+	int err;
+
+	err = gpio_irq_read(r->dev.irq_fd, &r->dev.irq_timestamp, &cnt);
+	if (err != ERR_OK) {
+		perror("Error reading from interrupt pin");
+		return err;
+	}
+	_count(&r->stats.irq_events, cnt);
+	DBG_PRINTF(DBG_LVL_HIGH,
+		   "Radio %u: Interrupt Requested (%u edges, t=%llu ns)\n",
+		   r->index, cnt, (unsigned long long) r->dev.irq_timestamp);
+
+	return _service(r);
+}
+
+static int _on_timer(evloop_src_t *src, uint32_t events)
+{
+	radio_t *r = src->ctx;
+	uint64_t expirations;
+
+	if (read(r->timer_fd, &expirations, sizeof(expirations)) < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			perror("Error reading poll timer");
+			return ERR_EVLOOP;
+		}
+	}
+	r->timer_deadline = 0;
+	_count(&r->stats.timer_events, 1);
+
+	return _service(r);
+}
+
+static int _on_hop(evloop_src_t *src, uint32_t events)
+{
+	radio_t *r = src->ctx;
+	uint64_t expirations;
+
+	if (read(r->hop_fd, &expirations, sizeof(expirations)) < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			perror("Error reading dwell timer");
+			return ERR_EVLOOP;
+		}
+		return ERR_OK;
+	}
+
+	// Backend switches as soon as no frame is being received
+	r->hop_next = (r->dev.channel + 1) % r->channel_cnt;
+	r->dev.retune_freq = r->channels[r->hop_next].freq;
+
+	return _service(r);
+}
+
+static int _on_wake(evloop_src_t *src, uint32_t events)
+{
+	radio_t *r = src->ctx;
+
+	_clear(r->wake_fd);
+	_count(&r->stats.wake_events, 1);
+
+	return _service(r);
+}
+
+static void *_thread_main(void *arg)
+{
+	radio_t *r = arg;
+	int err = ERR_OK;
+
+	while (! __atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+		err = evloop_run_once(&r->loop, -1);
+		if (err != ERR_OK) {
+			break;
+		}
+	}
+
+	__atomic_store_n(&r->err, err, __ATOMIC_RELEASE);
+	_signal(r->notify_fd);
+
+	return NULL;
+}
+
+void radio_init(radio_t *r, unsigned int index)
+{
+	memset(r, 0, sizeof(*r));
+	r->index = index;
+	r->gpio_pin = -1;
+	r->cpu = -1;
+	r->spi.mode = -1;
+
+	r->dev.fd = -1;
+	r->dev.irq_fd = -1;
+	r->loop.epfd = -1;
+	r->notify_fd = -1;
+	r->gpio_fd = -1;
+	r->timer_fd = -1;
+	r->hop_fd = -1;
+	r->wake_fd = -1;
+}
+
+/**
+ * Read register configuration file or selected profile of profile image
+ *
+ * @param profiles	Returns profile image, cnt is 0 if the file is a
+ *			register configuration file
+ * @param name		Profile to select, or NULL for the base profile
+ * @param profile	Returns index of selected profile
+ */
+static int _load_config(radio_t *r, sparse_buf_t *regs,
+			reg_profile_t *profiles, const char *name,
+			size_t *profile)
+{
+	int idx = -1;
+
+	if (! reg_profile_is_image(r->cfg_path)) {
+		memset(profiles, 0, sizeof(*profiles));
+		*profile = 0;
+		return parse_reg_file(r->cfg_path, regs);
+	}
+
+	if (reg_profile_open(profiles, r->cfg_path) != 0) {
+		return -1;
+	}
+	if (name != NULL) {
+		idx = reg_profile_find(profiles, name);
+	}
+	*profile = (idx < 0) ? 0 : idx;
+	if (reg_profile_get(profiles, *profile, regs) != 0) {
+		fprintf(stderr, "%s: Register address out of range\n",
+			r->cfg_path);
+		reg_profile_close(profiles);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Hand configuration over to radio thread
+ */
+static void _hand_over(radio_t *r, sparse_buf_t *regs)
+{
+	// Replaces a configuration the radio thread didn't program yet
+	_free_regs(__atomic_exchange_n(&r->reload, regs, __ATOMIC_ACQ_REL));
+	_signal(r->wake_fd);
+}
+
+static sparse_buf_t *_alloc_regs(void)
+{
+	sparse_buf_t *regs;
+
+	regs = malloc(sizeof(*regs));
+	if (regs == NULL || sparse_buf_init(regs, RF_REG_SPACE) != 0) {
+		free(regs);
+		fprintf(stderr, "Unable to allocate register buffer\n");
+		return NULL;
+	}
+
+	return regs;
+}
+
+int radio_open(radio_t *r)
+{
+	sparse_buf_t regs;
+	struct itimerspec its;
+	const char *crc_spec;
+	int err;
+
+	sparse_buf_init(&regs, RF_REG_SPACE);
+	if (_load_config(r, &regs, &r->profiles, NULL, &r->profile) != 0) {
+		goto fail;
+	}
+	if (r->profiles.cnt != 0) {
+		DBG_PRINTF(DBG_LVL_LOW, "Radio %u: Using profile '%s' of %s\n",
+			   r->index, reg_profile_name(&r->profiles, 0),
+			   r->cfg_path);
+	}
+
+	if (pkt_buf_init(&r->rx_pkts, RADIO_RX_SLOTS) != 0 ||
+	    pkt_buf_init(&r->tx_pkts, RADIO_TX_SLOTS) != 0) {
+		fprintf(stderr, "Unable to allocate packet buffers\n");
+		goto fail;
+	}
+
+	if ((r->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ||
+	    (r->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+		perror("eventfd");
+		goto fail;
+	}
+
+	if (evloop_init(&r->loop) != ERR_OK) {
+		perror("epoll_create");
+		goto fail;
+	}
+
+	// Setup Transceiver device
+	err = rf_open(&r->dev, r->dev_path, r->backend, &r->spi);
+	if (err == ERR_RFM_CHIP_VERSION) {
+		fprintf(stderr, "No supported transceiver found on %s\n",
+			r->dev_path);
+		goto fail;
+	} else if (err != ERR_OK) {
+		perror("rf_open()");
+		goto fail;
+	}
+	DBG_PRINTF(DBG_LVL_LOW, "Radio %u: Using %s backend on %s\n",
+		   r->index, r->dev.ops->name, r->dev_path);
+
+	// Software CRC check, default depends on backend
+	crc_spec = r->crc_spec;
+	if (crc_spec == NULL) {
+		crc_spec = r->dev.ops->default_sw_crc;
+	}
+	if (crc_spec != NULL && strcmp(crc_spec, "none") != 0) {
+		if (crc16_parse(&r->sw_crc, crc_spec) != 0) {
+			fprintf(stderr, "Invalid CRC specification '%s'\n",
+				crc_spec);
+			goto fail;
+		}
+		r->dev.sw_crc = &r->sw_crc;
+	}
+	r->dev.tx_gap = r->tx_gap;
+
+	if (rf_init(&r->dev, &regs) != 0) {
+		fprintf(stderr, "Failed to initialize transceiver on %s\n",
+			r->dev_path);
+		goto fail;
+	}
+
+	// Start on first channel of hop list
+	if (r->channel_cnt != 0) {
+		size_t i;
+
+		for (i = 0; i < r->channel_cnt; i++) {
+			const uint32_t freq = r->channels[i].freq;
+
+			if (freq < r->dev.ops->freq_min ||
+			    freq > r->dev.ops->freq_max) {
+				fprintf(stderr, "Frequency %u Hz not supported "
+					"by %s transceiver\n", freq,
+					r->dev.ops->name);
+				goto fail;
+			}
+		}
+		if (rf_retune(&r->dev, r->channels[0].freq) != ERR_OK) {
+			fprintf(stderr, "Failed to tune transceiver on %s\n",
+				r->dev_path);
+			goto fail;
+		}
+		r->dev.channel = 0;
+		r->hop_next = 0;
+
+		r->hop_fd = timerfd_create(CLOCK_MONOTONIC,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+		if (r->hop_fd == -1) {
+			perror("timerfd_create");
+			goto fail;
+		}
+		if (_arm_hop(r, rf_clock_ns()) != ERR_OK) {
+			perror("timerfd_settime");
+			goto fail;
+		}
+	}
+
+	// Setup interrupt pin
+	if (r->gpio_pin >= 0) {
+		err = gpio_irq_open(&r->gpio_fd, r->gpio_chip, r->gpio_pin);
+		if (err != ERR_OK) {
+			fprintf(stderr, "Unable to request IRQ line %d of %s: %s\n",
+				r->gpio_pin, r->gpio_chip, strerror(errno));
+			r->gpio_fd = -1;
+			goto fail;
+		}
+		r->dev.irq_fd = r->gpio_fd;
+	} else {
+		// Simulated transceivers have an emulated IRQ line
+		r->dev.irq_fd = spi_sim_irq_fd(r->dev.fd);
+	}
+
+	// Setup poll timer, also used as fall back for missed interrupts
+	r->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				     TFD_NONBLOCK | TFD_CLOEXEC);
+	if (r->timer_fd == -1) {
+		perror("timerfd_create");
+		goto fail;
+	}
+	its.it_interval.tv_sec = r->poll_interval / 1000;
+	its.it_interval.tv_nsec = (r->poll_interval % 1000) * 1000000;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(r->timer_fd, 0, &its, NULL) == -1) {
+		perror("timerfd_settime");
+		goto fail;
+	}
+
+	// Register event sources
+	if (evloop_add(&r->loop, &r->timer_src, r->timer_fd, EPOLLIN,
+			&_on_timer, r) != ERR_OK ||
+	    evloop_add(&r->loop, &r->wake_src, r->wake_fd, EPOLLIN,
+			&_on_wake, r) != ERR_OK) {
+		perror("epoll_ctl");
+		goto fail;
+	}
+	if (r->dev.irq_fd != -1 &&
+	    evloop_add(&r->loop, &r->gpio_src, r->dev.irq_fd, EPOLLIN,
+			&_on_irq, r) != ERR_OK) {
+		perror("epoll_ctl");
+		goto fail;
+	}
+	if (r->hop_fd != -1 &&
+	    evloop_add(&r->loop, &r->hop_src, r->hop_fd, EPOLLIN,
+			&_on_hop, r) != ERR_OK) {
+		perror("epoll_ctl");
+		goto fail;
+	}
+
+	sparse_buf_destroy(&regs);
+	return 0;
+fail:
+	sparse_buf_destroy(&regs);
+	return -1;
+}
+
+int radio_start(radio_t *r)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	cpu_set_t cpus;
+	int ret;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, RADIO_STACK_SIZE);
+	if (r->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(r->cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+	if (r->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = r->priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	__atomic_store_n(&r->stop, 0, __ATOMIC_RELAXED);
+	r->err = ERR_OK;
+	ret = pthread_create(&r->thread, &attr, &_thread_main, r);
+	pthread_attr_destroy(&attr);
+	if (ret != 0) {
+		errno = ret;
+		return ERR_THREAD;
+	}
+	r->running = true;
+
+	return ERR_OK;
+}
+
+void radio_stop(radio_t *r)
+{
+	if (! r->running) {
+		return;
+	}
+
+	__atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+	_signal(r->wake_fd);
+	pthread_join(r->thread, NULL);
+	r->running = false;
+}
+
+void radio_close(radio_t *r)
+{
+	unsigned int i;
+
+	radio_stop(r);
+
+	for (i = 0; i < RF_POLL_SITE_CNT; i++) {
+		const rf_poll_stats_t *st = &r->dev.poll_stats[i];
+
+		if (st->calls == 0) {
+			continue;
+		}
+		DBG_PRINTF(DBG_LVL_LOW, "Radio %u: %s waits: %llu, reads: %llu, "
+			   "sleeps: %llu, timeouts: %llu, waited: %llu us\n",
+			   r->index, rf_poll_site_name(i),
+			   (unsigned long long) st->calls,
+			   (unsigned long long) st->reads,
+			   (unsigned long long) st->sleeps,
+			   (unsigned long long) st->timeouts,
+			   (unsigned long long) st->wait_ns / 1000);
+	}
+
+	if (r->gpio_fd != -1) {
+		gpio_irq_close(r->gpio_fd);
+		r->gpio_fd = -1;
+	}
+	r->dev.irq_fd = -1;
+	if (r->timer_fd != -1) {
+		close(r->timer_fd);
+		r->timer_fd = -1;
+	}
+	if (r->hop_fd != -1) {
+		close(r->hop_fd);
+		r->hop_fd = -1;
+	}
+	rf_close(&r->dev);
+	evloop_destroy(&r->loop);
+	if (r->wake_fd != -1) {
+		close(r->wake_fd);
+		r->wake_fd = -1;
+	}
+	if (r->notify_fd != -1) {
+		close(r->notify_fd);
+		r->notify_fd = -1;
+	}
+	pkt_buf_destroy(&r->rx_pkts);
+	pkt_buf_destroy(&r->tx_pkts);
+	_free_regs(r->reload);
+	r->reload = NULL;
+	reg_profile_close(&r->profiles);
+}
+
+int radio_calibrate_spi(radio_t *r)
+{
+	rf_spi_cal_t res[SPI_CAL_SPEED_CNT];
+	spi_config_t ref = r->spi;
+	uint32_t best = 0;
+	size_t i;
+	int err;
+
+	ref.speed_hz = spi_cal_speeds[0];
+	ref.fifo_speed_hz = 0;
+	for (i = 0; i < SPI_CAL_SPEED_CNT; i++) {
+		res[i].speed_hz = spi_cal_speeds[i];
+	}
+
+	err = rf_open(&r->dev, r->dev_path, r->backend, &ref);
+	if (err == ERR_RFM_CHIP_VERSION) {
+		fprintf(stderr, "No supported transceiver found on %s\n",
+			r->dev_path);
+		return -1;
+	} else if (err != ERR_OK) {
+		perror("rf_open()");
+		return -1;
+	}
+
+	err = rf_spi_calibrate(&r->dev, &ref, res, SPI_CAL_SPEED_CNT);
+	if (err != ERR_OK) {
+		fprintf(stderr, "SPI calibration of %s failed: %s\n",
+			r->dev_path, strerror(errno));
+		rf_close(&r->dev);
+		return -1;
+	}
+
+	printf("Radio %u: %s on %s\n", r->index, r->dev.ops->name,
+	       r->dev_path);
+	for (i = 0; i < SPI_CAL_SPEED_CNT && res[i].reads != 0; i++) {
+		printf("  %6.2f MHz: %8.1f kB/s, %u/%u reads corrupt\n",
+		       res[i].speed_hz / 1e6, res[i].bytes_per_s / 1e3,
+		       res[i].errors, res[i].reads);
+		if (res[i].errors == 0) {
+			best = res[i].speed_hz;
+		}
+	}
+	rf_close(&r->dev);
+
+	if (best == 0) {
+		fprintf(stderr, "Radio %u: SPI link unreliable at %u Hz\n",
+			r->index, spi_cal_speeds[0]);
+		return -1;
+	}
+	printf("  Recommended: spi=%u\n", best);
+
+	return 0;
+}
+
+int radio_reload(radio_t *r)
+{
+	sparse_buf_t *regs;
+	reg_profile_t profiles;
+	const char *name = NULL;
+	size_t profile;
+
+	if ((regs = _alloc_regs()) == NULL) {
+		return -1;
+	}
+	if (r->profiles.cnt != 0) {
+		name = reg_profile_name(&r->profiles, r->profile);
+	}
+	if (_load_config(r, regs, &profiles, name, &profile) != 0) {
+		fprintf(stderr, "Radio %u: Keeping current configuration\n",
+			r->index);
+		_free_regs(regs);
+		return -1;
+	}
+
+	// The radio thread only uses the handed over copy
+	reg_profile_close(&r->profiles);
+	r->profiles = profiles;
+	r->profile = profile;
+
+	_hand_over(r, regs);
+
+	return 0;
+}
+
+int radio_set_profile(radio_t *r, const char *name)
+{
+	sparse_buf_t *regs;
+	int idx;
+
+	if (r->profiles.cnt == 0 ||
+	    (idx = reg_profile_find(&r->profiles, name)) < 0) {
+		return -1;
+	}
+	if ((regs = _alloc_regs()) == NULL) {
+		return -1;
+	}
+	if (reg_profile_get(&r->profiles, idx, regs) != 0) {
+		_free_regs(regs);
+		return -1;
+	}
+	r->profile = idx;
+	DBG_PRINTF(DBG_LVL_LOW, "Radio %u: Switching to profile '%s'\n",
+		   r->index, name);
+
+	_hand_over(r, regs);
+
+	return 0;
+}
+
+void radio_wake(radio_t *r)
+{
+	_signal(r->wake_fd);
+}
+
+void radio_get_stats(const radio_t *r, radio_stats_t *stats)
+{
+	stats->irq_events = __atomic_load_n(&r->stats.irq_events,
+					    __ATOMIC_RELAXED);
+	stats->timer_events = __atomic_load_n(&r->stats.timer_events,
+					      __ATOMIC_RELAXED);
+	stats->wake_events = __atomic_load_n(&r->stats.wake_events,
+					     __ATOMIC_RELAXED);
+	stats->rx_hwm = __atomic_load_n(&r->stats.rx_hwm, __ATOMIC_RELAXED);
+}
+
+void radio_get_channel_stats(const radio_t *r, size_t idx,
+			     radio_channel_stats_t *stats)
+{
+	const radio_channel_stats_t *st = &r->channels[idx].stats;
+
+	stats->frames = __atomic_load_n(&st->frames, __ATOMIC_RELAXED);
+	stats->dwell_ns = __atomic_load_n(&st->dwell_ns, __ATOMIC_RELAXED);
+	stats->target_ns = __atomic_load_n(&st->target_ns, __ATOMIC_RELAXED);
+}
+
+int radio_clear_notify(radio_t *r)
+{
+	_clear(r->notify_fd);
+
+	return __atomic_load_n(&r->err, __ATOMIC_ACQUIRE);
+}
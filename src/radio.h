@@ -0,0 +1,268 @@
+/**
+ * radio.h - Transceiver service thread
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __RADIO_H__
+#define __RADIO_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "evloop.h"
+#include "pkt_buf.h"
+#include "crc16.h"
+#include "rf_dev.h"
+#include "reg_profile.h"
+
+/**
+ * Amount of frames queued between radio thread and I/O thread
+ */
+#define RADIO_RX_SLOTS 64
+#define RADIO_TX_SLOTS 4
+
+/**
+ * Stack size of radio thread
+ *
+ * The thread only has a shallow call stack. Keeping it small limits the
+ * memory that gets locked when all memory is locked.
+ */
+#define RADIO_STACK_SIZE (256 * 1024)
+
+/**
+ * Maximum amount of channels to hop over
+ */
+#define RADIO_MAX_CHANNELS 16
+
+/**
+ * Default time to stay on a channel, in ms
+ */
+#define RADIO_DEFAULT_DWELL_MS 100
+
+/**
+ * Bounds of adapted dwell time, as factor of the configured dwell time
+ */
+#define RADIO_DWELL_SCALE_MIN 0.25
+#define RADIO_DWELL_SCALE_MAX 4.0
+
+/**
+ * Radio thread counters
+ *
+ * Only written by the radio thread, read with radio_get_stats().
+ */
+typedef struct {
+	uint64_t irq_events;	/**< IRQ edges */
+	uint64_t timer_events;	/**< Poll/service timer expirations */
+	uint64_t wake_events;	/**< Wake-ups by the I/O thread */
+	uint64_t rx_hwm;	/**< Max. frames queued in rx_pkts */
+} radio_stats_t;
+
+/**
+ * Channel counters
+ *
+ * Only written by the radio thread, read with radio_get_channel_stats().
+ */
+typedef struct {
+	uint64_t frames;	/**< Frames received on channel */
+	uint64_t dwell_ns;	/**< Total time spent on channel */
+	uint64_t target_ns;	/**< Last dwell time used for the channel */
+} radio_channel_stats_t;
+
+/**
+ * Channel of hop list
+ */
+typedef struct {
+	uint32_t freq;		/**< Carrier frequency in Hz */
+	uint32_t dwell_ms;	/**< Time to stay on channel */
+	radio_channel_stats_t stats;
+	double rate;		/**< Average frames/s while on the channel */
+} radio_channel_t;
+
+/**
+ * Transceiver with its own service thread
+ *
+ * The radio thread only waits for the IRQ line, poll timer and wake-up
+ * events, and does the SPI I/O. Frames are exchanged with the I/O thread
+ * through rx_pkts and tx_pkts, which are lock-free single producer/single
+ * consumer queues. The I/O thread is notified through notify_fd.
+ */
+typedef struct {
+	unsigned int index;
+
+	// Configuration, set before radio_open()
+	const char *dev_path;	/**< SPI device */
+	const char *cfg_path;	/**< Register configuration file or profile
+				     image */
+	const char *gpio_chip;	/**< GPIO chip device of IRQ line */
+	int gpio_pin;		/**< IRQ GPIO line, or -1 to only poll */
+	long poll_interval;	/**< Poll interval in ms */
+	uint32_t tx_gap;	/**< Minimum time between TX frames in us */
+	int cpu;		/**< CPU to run thread on, or -1 for any */
+	int priority;		/**< SCHED_FIFO priority, or 0 for normal
+				     scheduling */
+	const rf_ops_t *backend; /**< Backend, or NULL to detect */
+	spi_config_t spi;	/**< SPI link settings */
+	const char *crc_spec;	/**< Software CRC, 'none' or NULL for default */
+	radio_channel_t channels[RADIO_MAX_CHANNELS]; /**< Hop list */
+	size_t channel_cnt;	/**< Channels to hop over, 0 to stay on the
+				     frequency of the configuration */
+	bool hop_adapt;		/**< Adapt dwell times to hit rate */
+
+	rf_dev_t dev;
+	reg_profile_t profiles;	/**< Profile image, cnt is 0 if cfg_path is a
+				     register configuration file */
+	size_t profile;		/**< Selected profile */
+	pkt_buf_t rx_pkts;	/**< Received frames, filled by radio thread */
+	pkt_buf_t tx_pkts;	/**< Frames to transmit, emptied by radio
+				     thread */
+	int notify_fd;		/**< eventfd signaled by radio thread */
+	int err;		/**< Error that stopped the radio thread */
+	radio_stats_t stats;
+
+	// Radio thread state
+	evloop_t loop;
+	evloop_src_t gpio_src;
+	evloop_src_t timer_src;
+	evloop_src_t wake_src;
+	evloop_src_t hop_src;
+	int gpio_fd;
+	int timer_fd;
+	int hop_fd;		/**< Dwell timer */
+	size_t hop_next;	/**< Channel being switched to, equals
+				     dev.channel if not hopping */
+	uint64_t hop_start;	/**< Time current channel was entered */
+	uint64_t hop_frames;	/**< Frames of current channel at hop_start */
+	uint64_t timer_deadline;	/**< Requested service time timer_fd is
+					     armed for, 0 if only polling */
+	int wake_fd;		/**< eventfd signaled by I/O thread */
+	sparse_buf_t *reload;	/**< Configuration to program, set by
+				     radio_reload() */
+	int stop;
+	crc16_t sw_crc;
+	pthread_t thread;
+	bool running;
+} radio_t;
+
+/**
+ * Initialize radio object with default configuration
+ */
+void radio_init(radio_t *r, unsigned int index);
+
+/**
+ * Open and configure transceiver
+ *
+ * Errors are reported on stderr.
+ *
+ * @returns	0 on success, -1 on error
+ */
+int radio_open(radio_t *r);
+
+/**
+ * Measure SPI link of transceiver and print recommended clock rate
+ *
+ * Opens the transceiver, without configuring it, and tests it with
+ * rf_spi_calibrate() at clock rates from 500 kHz up to 20 MHz, in the
+ * configured SPI mode. The results are printed on stdout, errors are reported
+ * on stderr.
+ *
+ * @returns	0 if a working clock rate was found, -1 if not or on error
+ */
+int radio_calibrate_spi(radio_t *r);
+
+/**
+ * Start radio thread
+ *
+ * The thread is created with the configured CPU affinity and scheduling
+ * priority.
+ *
+ * @returns	ERR_OK on success, else error code
+ */
+int radio_start(radio_t *r);
+
+/**
+ * Stop radio thread and wait for it to exit
+ */
+void radio_stop(radio_t *r);
+
+/**
+ * Close transceiver and free resources
+ */
+void radio_close(radio_t *r);
+
+/**
+ * Wake up radio thread to transmit newly queued frames
+ */
+void radio_wake(radio_t *r);
+
+/**
+ * Reload register configuration file
+ *
+ * Parses the configuration file and hands it to the radio thread, which
+ * only writes the registers that changed, without resetting the transceiver
+ * or dropping queued frames. Registers removed from the file keep their
+ * current value. A reloaded profile image keeps the selected profile if it
+ * still exists, else the base profile is selected. Errors are reported on
+ * stderr.
+ *
+ * @returns	0 on success, -1 if the configuration file is invalid
+ */
+int radio_reload(radio_t *r);
+
+/**
+ * Switch to profile of profile image
+ *
+ * Like radio_reload(), only the registers that differ from the current
+ * configuration are written.
+ *
+ * @returns	0 on success, -1 if the profile doesn't exist
+ */
+int radio_set_profile(radio_t *r, const char *name);
+
+/**
+ * Get radio thread counters
+ *
+ * Can be called while the radio thread is running.
+ */
+void radio_get_stats(const radio_t *r, radio_stats_t *stats);
+
+/**
+ * Get channel counters
+ *
+ * Can be called while the radio thread is running.
+ */
+void radio_get_channel_stats(const radio_t *r, size_t idx,
+			     radio_channel_stats_t *stats);
+
+/**
+ * Clear notification of radio thread
+ *
+ * Called by the I/O thread when notify_fd is readable.
+ *
+ * @returns	ERR_OK, or the error that stopped the radio thread
+ */
+int radio_clear_notify(radio_t *r);
+
+#endif // __RADIO_H__
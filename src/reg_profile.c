@@ -0,0 +1,380 @@
+/**
+ * reg_profile.c - Precompiled register configuration profiles
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "reg_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "crc16.h"
+
+#define BURST_MAX_LEN 255
+
+static uint16_t _image_crc(const uint8_t *image, size_t size)
+{
+	crc16_t crc;
+
+	crc16_init(&crc, 0x1021, 0xffff);
+	return crc16(&crc, image + sizeof(reg_profile_hdr_t),
+		     size - sizeof(reg_profile_hdr_t));
+}
+
+/**
+ * Check that burst records of profile fit in image
+ */
+static int _check_entry(const reg_profile_t *prof,
+			const reg_profile_entry_t *e, size_t data_off)
+{
+	const uint8_t *p;
+	const uint8_t *end;
+	size_t i;
+
+	if (memchr(e->name, '\0', sizeof(e->name)) == NULL ||
+	    e->off < data_off || e->off > prof->size ||
+	    e->len > prof->size - e->off) {
+		return -1;
+	}
+
+	p = prof->image + e->off;
+	end = p + e->len;
+	for (i = 0; i < e->burst_cnt; i++) {
+		if (end - p < 2 || p[1] == 0 || end - p - 2 < p[1]) {
+			return -1;
+		}
+		p += 2 + p[1];
+	}
+
+	return (p == end) ? 0 : -1;
+}
+
+/**
+ * Write burst records of profile into register buffer
+ */
+static int _apply(const reg_profile_t *prof, const reg_profile_entry_t *e,
+		  sparse_buf_t *regs)
+{
+	const uint8_t *p = prof->image + e->off;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < e->burst_cnt; i++) {
+		for (j = 0; j < p[1]; j++) {
+			if (sparse_buf_write(regs, p[0] + j, p[2 + j]) != 0) {
+				return -1;
+			}
+		}
+		p += 2 + p[1];
+	}
+
+	return 0;
+}
+
+/**
+ * Write runs of valid registers as burst records
+ *
+ * @returns	0 on success, -1 if a register address doesn't fit in a burst
+ *		record
+ */
+static int _emit(uint8_t *out, sparse_buf_t *regs, uint16_t *burst_cnt,
+		 size_t *len)
+{
+	uint8_t *p = out;
+	size_t off = 0;
+	size_t run;
+
+	*burst_cnt = 0;
+	while (sparse_buf_next_run(regs, &off, &run)) {
+		while (run > 0) {
+			const size_t n = (run < BURST_MAX_LEN) ?
+					 run : BURST_MAX_LEN;
+
+			if (off + n - 1 > UINT8_MAX) {
+				return -1;
+			}
+			*p++ = off;
+			*p++ = n;
+			memcpy(p, sparse_buf_at(regs, off), n);
+			p += n;
+			(*burst_cnt)++;
+			off += n;
+			run -= n;
+		}
+	}
+	*len = p - out;
+
+	return 0;
+}
+
+bool reg_profile_is_image(const char *filename)
+{
+	char magic[REG_PROFILE_MAGIC_LEN];
+	bool retval = false;
+	FILE *fp;
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		return false;
+	}
+	if (fread(magic, sizeof(magic), 1, fp) == 1) {
+		retval = (memcmp(magic, REG_PROFILE_MAGIC, sizeof(magic)) == 0);
+	}
+	fclose(fp);
+
+	return retval;
+}
+
+int reg_profile_init(reg_profile_t *prof, const void *image, size_t size)
+{
+	const reg_profile_hdr_t *hdr = image;
+	size_t data_off;
+	size_t i;
+
+	memset(prof, 0, sizeof(*prof));
+
+	if (size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, REG_PROFILE_MAGIC, sizeof(hdr->magic)) != 0) {
+		fprintf(stderr, "Not a register profile image\n");
+		return -1;
+	}
+	if (hdr->size != size) {
+		fprintf(stderr, "Truncated register profile image\n");
+		return -1;
+	}
+	if (hdr->crc != _image_crc(image, size)) {
+		fprintf(stderr, "Register profile image checksum mismatch\n");
+		return -1;
+	}
+
+	data_off = sizeof(*hdr) + hdr->profile_cnt * sizeof(reg_profile_entry_t);
+	if (hdr->profile_cnt == 0 || hdr->profile_cnt > REG_PROFILE_MAX ||
+	    data_off > size) {
+		fprintf(stderr, "Invalid profile count in register profile "
+			"image\n");
+		return -1;
+	}
+
+	prof->image = image;
+	prof->size = size;
+	prof->entries = (const reg_profile_entry_t *) (prof->image +
+						       sizeof(*hdr));
+	prof->cnt = hdr->profile_cnt;
+
+	for (i = 0; i < prof->cnt; i++) {
+		if (_check_entry(prof, &prof->entries[i], data_off) != 0) {
+			fprintf(stderr, "Invalid profile %zu in register "
+				"profile image\n", i);
+			memset(prof, 0, sizeof(*prof));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int reg_profile_open(reg_profile_t *prof, const char *filename)
+{
+	struct stat st;
+	void *image;
+	int fd;
+
+	memset(prof, 0, sizeof(*prof));
+
+	if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1) {
+		fprintf(stderr, "Unable to open file '%s': %s\n",
+			filename, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "Unable to stat file '%s': %s\n",
+			filename, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < (off_t) sizeof(reg_profile_hdr_t)) {
+		fprintf(stderr, "%s: Not a register profile image\n", filename);
+		close(fd);
+		return -1;
+	}
+
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		fprintf(stderr, "Unable to map file '%s': %s\n",
+			filename, strerror(errno));
+		return -1;
+	}
+
+	if (reg_profile_init(prof, image, st.st_size) != 0) {
+		fprintf(stderr, "%s: Unusable register profile image\n",
+			filename);
+		munmap(image, st.st_size);
+		return -1;
+	}
+	prof->mapped = true;
+
+	return 0;
+}
+
+void reg_profile_close(reg_profile_t *prof)
+{
+	if (prof->mapped) {
+		munmap((void *) prof->image, prof->size);
+	}
+	memset(prof, 0, sizeof(*prof));
+}
+
+int reg_profile_find(const reg_profile_t *prof, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < prof->cnt; i++) {
+		if (strcmp(prof->entries[i].name, name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int reg_profile_get(const reg_profile_t *prof, size_t idx, sparse_buf_t *regs)
+{
+	sparse_buf_clear(regs);
+
+	if (_apply(prof, &prof->entries[0], regs) != 0) {
+		return -1;
+	}
+	if (idx != 0 && _apply(prof, &prof->entries[idx], regs) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int reg_profile_compile(sparse_buf_t *regs, const char * const *names,
+			size_t cnt, uint8_t **image, size_t *size)
+{
+	reg_profile_hdr_t *hdr;
+	reg_profile_entry_t *entries;
+	sparse_buf_t delta;
+	size_t max_size;
+	int err;
+	size_t off;
+	size_t i;
+	size_t j;
+
+	if (cnt == 0 || cnt > REG_PROFILE_MAX) {
+		fprintf(stderr, "Invalid amount of profiles (max=%d)\n",
+			REG_PROFILE_MAX);
+		return -1;
+	}
+	for (i = 0; i < cnt; i++) {
+		if (strlen(names[i]) == 0 ||
+		    strlen(names[i]) >= REG_PROFILE_NAME_LEN) {
+			fprintf(stderr, "Invalid profile name '%s' (max. "
+				"length=%d)\n", names[i],
+				REG_PROFILE_NAME_LEN - 1);
+			return -1;
+		}
+		for (j = 0; j < i; j++) {
+			if (strcmp(names[i], names[j]) == 0) {
+				fprintf(stderr, "Duplicate profile name "
+					"'%s'\n", names[i]);
+				return -1;
+			}
+		}
+	}
+
+	// Worst case every register is a burst of its own
+	off = sizeof(*hdr) + cnt * sizeof(*entries);
+	max_size = off;
+	for (i = 0; i < cnt; i++) {
+		max_size += 3 * sparse_buf_size(&regs[i]);
+	}
+	if ((*image = calloc(1, max_size)) == NULL) {
+		fprintf(stderr, "Unable to allocate profile image\n");
+		return -1;
+	}
+	hdr = (reg_profile_hdr_t *) *image;
+	entries = (reg_profile_entry_t *) (*image + sizeof(*hdr));
+
+	for (i = 0; i < cnt; i++) {
+		sparse_buf_t *p = &regs[i];
+		size_t len;
+
+		// Other profiles only store registers that differ from base
+		if (i != 0) {
+			size_t r;
+
+			if (sparse_buf_init(&delta, sparse_buf_size(p)) != 0) {
+				fprintf(stderr, "Unable to allocate buffer\n");
+				goto fail;
+			}
+			for (r = 0; r < sparse_buf_size(p); r++) {
+				if (! sparse_buf_is_valid(p, r) ||
+				    (sparse_buf_is_valid(&regs[0], r) &&
+				     *sparse_buf_at(p, r) ==
+				     *sparse_buf_at(&regs[0], r))) {
+					continue;
+				}
+				sparse_buf_write(&delta, r, *sparse_buf_at(p, r));
+			}
+			p = &delta;
+		}
+
+		err = _emit(*image + off, p, &entries[i].burst_cnt, &len);
+		if (i != 0) {
+			sparse_buf_destroy(&delta);
+		}
+		if (err != 0) {
+			fprintf(stderr, "Register address of profile '%s' out "
+				"of range\n", names[i]);
+			goto fail;
+		}
+
+		strcpy(entries[i].name, names[i]);
+		entries[i].off = off;
+		entries[i].len = len;
+		off += len;
+	}
+
+	memcpy(hdr->magic, REG_PROFILE_MAGIC, sizeof(hdr->magic));
+	hdr->size = off;
+	hdr->profile_cnt = cnt;
+	hdr->crc = _image_crc(*image, off);
+	*size = off;
+
+	return 0;
+fail:
+	free(*image);
+	*image = NULL;
+	return -1;
+}
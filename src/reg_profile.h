@@ -0,0 +1,157 @@
+/**
+ * reg_profile.h - Precompiled register configuration profiles
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __REG_PROFILE_H__
+#define __REG_PROFILE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "sparse_buf.h"
+
+/**
+ * Binary profile image
+ *
+ * An image holds one or more register configurations. The first profile is
+ * the base profile and contains the complete configuration. The other
+ * profiles only contain the registers that differ from the base profile, so
+ * switching profiles only writes these.
+ *
+ * Layout, all values in host byte order:
+ *   reg_profile_hdr_t
+ *   reg_profile_entry_t[profile_cnt]
+ *   burst records of all profiles
+ *
+ * A burst record is an address byte, a length byte and 'length' register
+ * values, written to consecutive registers in a single SPI transfer.
+ */
+#define REG_PROFILE_MAGIC "RFPROF01"
+#define REG_PROFILE_MAGIC_LEN 8
+#define REG_PROFILE_NAME_LEN 16
+#define REG_PROFILE_MAX 64
+
+typedef struct {
+	char magic[REG_PROFILE_MAGIC_LEN];	/**< REG_PROFILE_MAGIC */
+	uint32_t size;		/**< Size of image in bytes */
+	uint16_t crc;		/**< CRC-16(CCITT) of image after header */
+	uint16_t profile_cnt;	/**< Amount of profiles, incl. base profile */
+} reg_profile_hdr_t;
+
+typedef struct {
+	char name[REG_PROFILE_NAME_LEN];	/**< NUL padded name */
+	uint32_t off;		/**< Offset of burst records in image */
+	uint16_t len;		/**< Size of burst records in bytes */
+	uint16_t burst_cnt;	/**< Amount of burst records */
+} reg_profile_entry_t;
+
+/**
+ * Validated profile image
+ */
+typedef struct {
+	const uint8_t *image;
+	size_t size;
+	bool mapped;		/**< Image is mmap()-ed by reg_profile_open() */
+	const reg_profile_entry_t *entries;
+	size_t cnt;		/**< Amount of profiles */
+} reg_profile_t;
+
+/**
+ * Check if file is a profile image
+ *
+ * @returns	true if the file starts with REG_PROFILE_MAGIC
+ */
+bool reg_profile_is_image(const char *filename);
+
+/**
+ * Validate profile image in memory
+ *
+ * The image must stay valid as long as the profile object is used.
+ *
+ * @returns	0 on Success, else -1 and an error is logged to stderr
+ */
+int reg_profile_init(reg_profile_t *prof, const void *image, size_t size);
+
+/**
+ * Map profile image file into memory and validate it
+ *
+ * @returns	0 on Success, else -1 and an error is logged to stderr
+ */
+int reg_profile_open(reg_profile_t *prof, const char *filename);
+
+/**
+ * Release profile image
+ */
+void reg_profile_close(reg_profile_t *prof);
+
+/**
+ * Find profile by name
+ *
+ * @returns	Index of profile, or -1 if not found
+ */
+int reg_profile_find(const reg_profile_t *prof, const char *name);
+
+/**
+ * Name of profile
+ */
+static inline const char *reg_profile_name(const reg_profile_t *prof,
+					   size_t idx)
+{
+	return prof->entries[idx].name;
+}
+
+/**
+ * Get register configuration of profile
+ *
+ * Fills regs with the base profile, overlaid with the registers of the
+ * selected profile.
+ *
+ * @param prof	Profile image
+ * @param idx	Index of profile
+ * @param regs	Buffer to store register values in, is cleared first
+ *
+ * @returns	0 on Success, -1 if a register doesn't fit in regs
+ */
+int reg_profile_get(const reg_profile_t *prof, size_t idx, sparse_buf_t *regs);
+
+/**
+ * Compile register configurations into profile image
+ *
+ * @param regs	Register configurations, the first one is the base profile
+ * @param names	Names of profiles, at most REG_PROFILE_NAME_LEN - 1
+ *		characters
+ * @param cnt	Amount of profiles
+ * @param image	Returns image allocated with malloc()
+ * @param size	Returns size of image
+ *
+ * @returns	0 on Success, else -1 and an error is logged to stderr
+ */
+int reg_profile_compile(sparse_buf_t *regs, const char * const *names,
+			size_t cnt, uint8_t **image, size_t *size);
+
+#endif // __REG_PROFILE_H__
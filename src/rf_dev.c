@@ -0,0 +1,514 @@
+/**
+ * rf_dev.c - Radio transceiver device interface
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "rf_dev.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "error.h"
+#include "spi.h"
+#include "spi_sim.h"
+#include "gpio_irq.h"
+#include "si443x.h"
+#include "sx1231.h"
+
+/**
+ * Maximum time to wait for the IRQ line per poll, in ms
+ *
+ * The awaited condition doesn't necessarily raise an interrupt, so the
+ * register is still polled at this interval.
+ */
+#define RF_WAIT_IRQ_MS 10
+
+/**
+ * Known backends, in auto detection order
+ */
+static const rf_ops_t * const backends[] = {
+	&si443x_ops,
+	&sx1231_ops,
+};
+#define BACKEND_CNT (sizeof(backends) / sizeof(backends[0]))
+
+#ifdef ENABLE_LATENCY_STATS
+static lat_hist_t lat_hists[BACKEND_CNT][LAT_STAGE_CNT];
+
+lat_hist_t *rf_lat_hists(size_t idx)
+{
+	if (idx >= BACKEND_CNT) {
+		return NULL;
+	}
+	return lat_hists[idx];
+}
+#endif
+
+const rf_ops_t *rf_find_backend(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < BACKEND_CNT; i++) {
+		if (strcmp(backends[i]->name, name) == 0) {
+			return backends[i];
+		}
+	}
+
+	return NULL;
+}
+
+const rf_ops_t *rf_backend_at(size_t idx)
+{
+	if (idx >= BACKEND_CNT) {
+		return NULL;
+	}
+	return backends[idx];
+}
+
+/**
+ * Close SPI device, or simulated device
+ */
+static void _close_fd(int fd)
+{
+	spi_configure(fd, NULL, -1);
+	if (! spi_sim_close(fd)) {
+		close(fd);
+	}
+}
+
+int rf_open(rf_dev_t *dev, const char *spi_path, const rf_ops_t *backend,
+	    const spi_config_t *spi)
+{
+	int err = ERR_UNSPEC;
+	size_t i;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->irq_fd = -1;
+
+	if (sparse_buf_init(&dev->shadow, RF_REG_SPACE) != 0) {
+		dev->fd = -1;
+		return ERR_UNSPEC;
+	}
+
+	if (strncmp(spi_path, SPI_SIM_PREFIX, strlen(SPI_SIM_PREFIX)) == 0) {
+		err = spi_sim_open(&dev->fd, spi_path + strlen(SPI_SIM_PREFIX));
+		if (err != ERR_OK) {
+			dev->fd = -1;
+			goto fail;
+		}
+	} else {
+		dev->fd = open(spi_path, O_RDWR);
+		if (dev->fd == -1) {
+			err = ERR_SPI_OPEN_DEV;
+			goto fail;
+		}
+	}
+
+	// The FIFO register is only known after detecting the backend
+	if (spi != NULL) {
+		TRY(spi_configure(dev->fd, spi, -1));
+	}
+
+	if (backend != NULL) {
+		TRY(backend->probe(dev->fd));
+	} else {
+		err = ERR_RFM_CHIP_VERSION;
+		for (i = 0; i < BACKEND_CNT && err == ERR_RFM_CHIP_VERSION; i++) {
+			backend = backends[i];
+			err = backend->probe(dev->fd);
+		}
+		if (err != ERR_OK) {
+			goto fail;
+		}
+	}
+
+	if (spi != NULL) {
+		TRY(spi_configure(dev->fd, spi, backend->fifo_addr));
+	}
+
+	dev->ops = backend;
+	dev->handle = backend->handle;
+#ifdef ENABLE_LATENCY_STATS
+	for (i = 0; i < BACKEND_CNT; i++) {
+		if (backends[i] == backend) {
+			dev->lat = lat_hists[i];
+		}
+	}
+#endif
+	TRY(backend->open(dev));
+
+	return ERR_OK;
+fail:
+	if (dev->fd != -1) {
+		SAVE_ERRNO(_close_fd(dev->fd));
+	}
+	dev->fd = -1;
+	dev->ops = NULL;
+	sparse_buf_destroy(&dev->shadow);
+	return err;
+}
+
+void rf_close(rf_dev_t *dev)
+{
+	if (dev->ops != NULL) {
+		dev->ops->close(dev);
+		dev->ops = NULL;
+	}
+	if (dev->fd != -1) {
+		_close_fd(dev->fd);
+		dev->fd = -1;
+	}
+	sparse_buf_destroy(&dev->shadow);
+}
+
+/**
+ * Write test pattern to scratch registers and read it back
+ *
+ * @param seed	State of pattern generator, updated
+ * @param res	Measurement to add reads to
+ * @param ns	Time spent on reads is added to this
+ */
+static int _spi_cal_round(rf_dev_t *dev, uint32_t *seed, rf_spi_cal_t *res,
+			  uint64_t *ns)
+{
+	const rf_ops_t *ops = dev->ops;
+	uint8_t pattern[RF_REG_SPACE];
+	uint8_t buf[RF_REG_SPACE];
+	uint64_t start;
+	size_t i;
+	int err;
+
+	// xorshift32, so all bits toggle between rounds
+	for (i = 0; i < ops->scratch_len; i++) {
+		*seed ^= *seed << 13;
+		*seed ^= *seed >> 17;
+		*seed ^= *seed << 5;
+		pattern[i] = *seed;
+	}
+	TRY(spi_write_regs(dev->fd, ops->scratch_addr, pattern,
+			   ops->scratch_len));
+
+	for (i = 0; i < RF_SPI_CAL_READS; i++) {
+		start = rf_clock_ns();
+		TRY(spi_read_regs(dev->fd, ops->scratch_addr, buf,
+				  ops->scratch_len));
+		*ns += rf_clock_ns() - start;
+
+		res->reads++;
+		if (memcmp(buf, pattern, ops->scratch_len) != 0) {
+			res->errors++;
+		}
+	}
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
+int rf_spi_calibrate(rf_dev_t *dev, const spi_config_t *ref,
+		     rf_spi_cal_t *res, size_t cnt)
+{
+	const rf_ops_t *ops = dev->ops;
+	uint8_t saved[RF_REG_SPACE];
+	spi_config_t cfg = *ref;
+	uint32_t seed = 0x2545f491;
+	uint64_t ns;
+	size_t i;
+	unsigned int round;
+	int err;
+
+	for (i = 0; i < cnt; i++) {
+		res[i].reads = 0;
+		res[i].errors = 0;
+		res[i].bytes_per_s = 0;
+	}
+
+	if ((err = spi_configure(dev->fd, ref, ops->fifo_addr)) != ERR_OK ||
+	    (err = spi_read_regs(dev->fd, ops->scratch_addr, saved,
+				 ops->scratch_len)) != ERR_OK) {
+		return err;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		cfg.speed_hz = res[i].speed_hz;
+		cfg.fifo_speed_hz = res[i].speed_hz;
+		TRY(spi_configure(dev->fd, &cfg, ops->fifo_addr));
+
+		ns = 0;
+		for (round = 0; round < RF_SPI_CAL_ROUNDS; round++) {
+			TRY(_spi_cal_round(dev, &seed, &res[i], &ns));
+		}
+		if (ns != 0) {
+			res[i].bytes_per_s = (uint64_t) res[i].reads *
+				(1 + ops->scratch_len) * 1000000000 / ns;
+		}
+		if (res[i].errors != 0) {
+			break;
+		}
+	}
+
+	err = ERR_OK;
+fail:
+	// Writes at a too high clock rate may have been corrupted as well
+	if (spi_configure(dev->fd, ref, ops->fifo_addr) == ERR_OK &&
+	    spi_write_regs(dev->fd, ops->scratch_addr, saved,
+			   ops->scratch_len) != ERR_OK && err == ERR_OK) {
+		err = ERR_SPI_IOCTL;
+	}
+	return err;
+}
+
+int rf_reconfigure(rf_dev_t *dev, sparse_buf_t *regs)
+{
+	sparse_buf_t changed;
+	size_t off = 0;
+	size_t len;
+	size_t i;
+	int err;
+
+	if (sparse_buf_init(&changed, sparse_buf_size(&dev->shadow)) != 0) {
+		return ERR_UNSPEC;
+	}
+
+	// Collect registers that differ from what was last written
+	while (sparse_buf_next_run(regs, &off, &len)) {
+		for (i = off; i < off + len; i++) {
+			const uint8_t val = *sparse_buf_at(regs, i);
+
+			if (sparse_buf_is_valid(&dev->shadow, i) &&
+			    *sparse_buf_at(&dev->shadow, i) == val) {
+				continue;
+			}
+			if (sparse_buf_write(&changed, i, val) != 0) {
+				err = ERR_RANGE;
+				goto fail;
+			}
+		}
+		off += len;
+	}
+
+	err = ERR_OK;
+	if (sparse_buf_next_valid(&changed, 0) != SPARSE_BUF_OFF_END) {
+		err = dev->ops->reconfigure(dev, &changed);
+	}
+fail:
+	sparse_buf_destroy(&changed);
+	return err;
+}
+
+int rf_shadow_update(rf_dev_t *dev, sparse_buf_t *regs)
+{
+	size_t off = 0;
+	size_t len;
+	size_t i;
+
+	while (sparse_buf_next_run(regs, &off, &len)) {
+		for (i = off; i < off + len; i++) {
+			if (sparse_buf_write(&dev->shadow, i,
+					     *sparse_buf_at(regs, i)) != 0) {
+				return ERR_RANGE;
+			}
+		}
+		off += len;
+	}
+
+	return ERR_OK;
+}
+
+int rf_read_cfg_reg(rf_dev_t *dev, uint8_t addr, uint8_t *val)
+{
+	if (sparse_buf_is_valid(&dev->shadow, addr)) {
+		*val = *sparse_buf_at(&dev->shadow, addr);
+		return ERR_OK;
+	}
+
+	return spi_read_reg(dev->fd, addr, val);
+}
+
+const char *rf_poll_site_name(rf_poll_site_t site)
+{
+	static const char * const names[RF_POLL_SITE_CNT] = {
+		[RF_POLL_MODE] = "mode",
+		[RF_POLL_RX] = "rx",
+		[RF_POLL_RESET] = "reset",
+	};
+
+	if (site >= RF_POLL_SITE_CNT) {
+		return "?";
+	}
+	return names[site];
+}
+
+const char *rf_stat_name(rf_stat_t stat)
+{
+	static const char * const names[RF_STAT_CNT] = {
+		[RF_STAT_RX_PACKETS] = "rx_packets",
+		[RF_STAT_RX_BYTES] = "rx_bytes",
+		[RF_STAT_TX_PACKETS] = "tx_packets",
+		[RF_STAT_TX_BYTES] = "tx_bytes",
+		[RF_STAT_CRC_ERRORS] = "crc_errors",
+		[RF_STAT_RX_OVERFLOWS] = "rx_overflows",
+		[RF_STAT_LEN_ERRORS] = "len_errors",
+		[RF_STAT_FIFO_OVERRUNS] = "fifo_overruns",
+		[RF_STAT_FIFO_UNDERFLOWS] = "fifo_underflows",
+		[RF_STAT_FIFO_RESETS] = "fifo_resets",
+		[RF_STAT_TIMEOUTS] = "timeouts",
+	};
+
+	if (stat >= RF_STAT_CNT) {
+		return "?";
+	}
+	return names[stat];
+}
+
+const char *rf_stat_desc(rf_stat_t stat)
+{
+	static const char * const descs[RF_STAT_CNT] = {
+		[RF_STAT_RX_PACKETS] = "Received frames",
+		[RF_STAT_RX_BYTES] = "Bytes of received frames",
+		[RF_STAT_TX_PACKETS] = "Transmitted frames",
+		[RF_STAT_TX_BYTES] = "Bytes of transmitted frames",
+		[RF_STAT_CRC_ERRORS] = "Frames dropped by software CRC check",
+		[RF_STAT_RX_OVERFLOWS] = "Frames dropped because RX buffer was full",
+		[RF_STAT_LEN_ERRORS] = "Frames dropped because of invalid length",
+		[RF_STAT_FIFO_OVERRUNS] = "Hardware FIFO overruns",
+		[RF_STAT_FIFO_UNDERFLOWS] = "Hardware FIFO underflows",
+		[RF_STAT_FIFO_RESETS] = "RX FIFO resets",
+		[RF_STAT_TIMEOUTS] = "Timed out receptions, transmissions and mode switches",
+	};
+
+	if (stat >= RF_STAT_CNT) {
+		return "?";
+	}
+	return descs[stat];
+}
+
+/**
+ * Increment polling statistic, see rf_stat_add()
+ */
+static inline void _poll_stat_add(uint64_t *stat, uint64_t n)
+{
+	__atomic_store_n(stat, *stat + n, __ATOMIC_RELAXED);
+}
+
+void rf_wait_start(rf_dev_t *dev, rf_wait_t *w, rf_poll_site_t site,
+		   unsigned int timeout_us)
+{
+	w->stats = &dev->poll_stats[site];
+	w->start = rf_clock_ns();
+	w->deadline = w->start + (uint64_t) timeout_us * 1000;
+	w->sleep_ns = RF_WAIT_SLEEP_MIN_NS;
+	w->iter = 0;
+	w->use_irq = (dev->irq_fd != -1);
+
+	_poll_stat_add(&w->stats->calls, 1);
+	_poll_stat_add(&w->stats->reads, 1);
+}
+
+int rf_wait_next(rf_dev_t *dev, rf_wait_t *w)
+{
+	struct timespec ts;
+	struct pollfd pfd;
+	uint64_t irq_timestamp;
+	uint64_t remaining;
+	uint64_t now;
+	int ret;
+
+	now = rf_clock_ns();
+	if (now >= w->deadline) {
+		_poll_stat_add(&w->stats->timeouts, 1);
+		return ERR_RFM_TIMEOUT;
+	}
+	_poll_stat_add(&w->stats->reads, 1);
+
+	if (w->iter < RF_WAIT_SPIN) {
+		w->iter++;
+		return ERR_OK;
+	}
+
+	remaining = w->deadline - now;
+	_poll_stat_add(&w->stats->sleeps, 1);
+	if (w->sleep_ns >= RF_WAIT_SLEEP_MAX_NS && w->use_irq) {
+		// Wait for IRQ, but not past the deadline
+		pfd.fd = dev->irq_fd;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, (remaining < RF_WAIT_IRQ_MS * 1000000) ?
+				(remaining + 999999) / 1000000 : RF_WAIT_IRQ_MS);
+		if (ret > 0) {
+			if (gpio_irq_read(dev->irq_fd, &irq_timestamp, NULL)
+					!= ERR_OK) {
+				return ERR_GPIO_READ;
+			}
+			if (dev->irq_timestamp == 0) {
+				dev->irq_timestamp = irq_timestamp;
+			}
+		}
+	} else {
+		if (w->sleep_ns < remaining) {
+			remaining = w->sleep_ns;
+		}
+		ts.tv_sec = remaining / 1000000000;
+		ts.tv_nsec = remaining % 1000000000;
+		nanosleep(&ts, NULL);
+
+		w->sleep_ns *= 2;
+		if (w->sleep_ns > RF_WAIT_SLEEP_MAX_NS) {
+			w->sleep_ns = RF_WAIT_SLEEP_MAX_NS;
+		}
+	}
+	_poll_stat_add(&w->stats->wait_ns, rf_clock_ns() - now);
+
+	return ERR_OK;
+}
+
+int rf_poll_reg(rf_dev_t *dev, rf_poll_site_t site, uint8_t addr,
+		uint8_t mask, uint8_t expect, unsigned int timeout_us,
+		uint8_t *val)
+{
+	int err = ERR_UNSPEC;
+	rf_wait_t w;
+	uint8_t tmp;
+
+	if (val == NULL) {
+		val = &tmp;
+	}
+
+	rf_wait_start(dev, &w, site, timeout_us);
+	do {
+		TRY(spi_read_reg(dev->fd, addr, val));
+		if ((*val & mask) == expect) {
+			return ERR_OK;
+		}
+	} while ((err = rf_wait_next(dev, &w)) == ERR_OK);
+
+fail:
+	return err;
+}
@@ -0,0 +1,493 @@
+/**
+ * rf_dev.h - Radio transceiver device interface
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __RF_DEV_H__
+#define __RF_DEV_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "pkt_buf.h"
+#include "spi.h"
+#include "sparse_buf.h"
+#include "crc16.h"
+#include "lat_hist.h"
+
+typedef struct rf_dev rf_dev_t;
+
+/**
+ * Register polling call sites, for statistics
+ */
+typedef enum {
+	RF_POLL_MODE,		/**< Wait for operating mode switch */
+	RF_POLL_RX,		/**< Wait for reception to complete */
+	RF_POLL_RESET,		/**< Wait for chip to become ready after
+				     reset */
+	RF_POLL_SITE_CNT
+} rf_poll_site_t;
+
+/**
+ * Statistics of a register polling call site
+ *
+ * Like the counters, only written by the thread servicing the device, and
+ * read by other threads with __atomic_load_n().
+ */
+typedef struct {
+	uint64_t calls;		/**< Amount of waits */
+	uint64_t reads;		/**< Amount of register polls */
+	uint64_t sleeps;	/**< Amount of sleeps/IRQ waits */
+	uint64_t timeouts;	/**< Amount of waits that timed out */
+	uint64_t wait_ns;	/**< Total time waited */
+} rf_poll_stats_t;
+
+/**
+ * Register polling wait state
+ *
+ * Polls back-to-back for RF_WAIT_SPIN times, then sleeps between polls with
+ * an exponentially increasing time up to RF_WAIT_SLEEP_MAX_NS. From then on
+ * the IRQ line is waited for, if available, so the wait ends early on a
+ * transceiver interrupt. Clear use_irq when waiting for a condition that
+ * isn't signaled on the IRQ line.
+ */
+typedef struct {
+	rf_poll_stats_t *stats;
+	uint64_t start;
+	uint64_t deadline;
+	uint64_t sleep_ns;	/**< Next sleep time */
+	unsigned int iter;
+	bool use_irq;		/**< Wait for IRQ after backing off */
+} rf_wait_t;
+
+/**
+ * Transceiver counters
+ */
+typedef enum {
+	RF_STAT_RX_PACKETS,	/**< Frames added to RX buffer */
+	RF_STAT_RX_BYTES,	/**< Bytes of frames added to RX buffer */
+	RF_STAT_TX_PACKETS,	/**< Frames transmission was started for */
+	RF_STAT_TX_BYTES,	/**< Bytes of frames transmission was started
+				     for */
+	RF_STAT_CRC_ERRORS,	/**< Frames dropped by software CRC check */
+	RF_STAT_RX_OVERFLOWS,	/**< Frames dropped because RX buffer was
+				     full */
+	RF_STAT_LEN_ERRORS,	/**< Frames dropped because of invalid length */
+	RF_STAT_FIFO_OVERRUNS,	/**< Hardware FIFO overruns */
+	RF_STAT_FIFO_UNDERFLOWS, /**< Hardware FIFO underflows */
+	RF_STAT_FIFO_RESETS,	/**< RX FIFO resets to recover reception */
+	RF_STAT_TIMEOUTS,	/**< Timed out receptions and transmissions */
+	RF_STAT_CNT
+} rf_stat_t;
+
+/**
+ * Size of register address space of the supported transceivers
+ */
+#define RF_REG_SPACE 0x80
+
+/**
+ * Test pattern writes per SPI clock rate by rf_spi_calibrate(), every
+ * pattern is read back RF_SPI_CAL_READS times
+ */
+#define RF_SPI_CAL_ROUNDS 64
+#define RF_SPI_CAL_READS 16
+
+#define RF_WAIT_SPIN 8
+#define RF_WAIT_SLEEP_MIN_NS 10000
+#define RF_WAIT_SLEEP_MAX_NS 1000000
+
+typedef int (*rf_handle_fn_t)(rf_dev_t *dev, pkt_buf_t *rx_buf,
+			      pkt_buf_t *tx_buf);
+
+/**
+ * Transceiver backend operations
+ */
+typedef struct rf_ops {
+	const char *name;
+
+	/**
+	 * Default software CRC specification, or NULL for none
+	 */
+	const char *default_sw_crc;
+
+	uint32_t freq_min;	/**< Lowest carrier frequency in Hz */
+	uint32_t freq_max;	/**< Highest carrier frequency in Hz */
+
+	uint8_t fifo_addr;	/**< FIFO register */
+
+	/**
+	 * Registers without side effects that can be overwritten while
+	 * the transceiver isn't initialized, used by rf_spi_calibrate()
+	 */
+	uint8_t scratch_addr;
+	uint8_t scratch_len;
+
+	/**
+	 * Check if transceiver connected to SPI device is supported
+	 *
+	 * @returns	ERR_OK if supported, ERR_RFM_CHIP_VERSION if not
+	 */
+	int (*probe)(int fd);
+
+	/**
+	 * Allocate private state and read current configuration
+	 */
+	int (*open)(rf_dev_t *dev);
+
+	/**
+	 * Free private state
+	 */
+	void (*close)(rf_dev_t *dev);
+
+	/**
+	 * Reset transceiver, program register configuration and start
+	 * receiving
+	 */
+	int (*init)(rf_dev_t *dev, sparse_buf_t *regs);
+
+	/**
+	 * Program changed registers without resetting the transceiver
+	 *
+	 * Re-applies the settings the backend relies on and restarts
+	 * receiving.
+	 *
+	 * @returns	ERR_OK on success, ERR_RFM_BUSY without accessing the
+	 *		transceiver if a transmission is in progress, else
+	 *		error code
+	 */
+	int (*reconfigure)(rf_dev_t *dev, sparse_buf_t *changed);
+
+	/**
+	 * Switch carrier frequency and restart receiving
+	 *
+	 * Only writes the frequency registers, in a single burst. Must only
+	 * be called while no frame is being received or transmitted, use
+	 * rf_dev_t::retune_freq for that.
+	 *
+	 * @returns	ERR_OK on success, ERR_RANGE if the frequency isn't
+	 *		supported, else error code
+	 */
+	int (*retune)(rf_dev_t *dev, uint32_t freq);
+
+	/**
+	 * Service transceiver
+	 *
+	 * Moves received frames into rx_buf and transmits frames from tx_buf.
+	 */
+	rf_handle_fn_t handle;
+} rf_ops_t;
+
+/**
+ * Result of SPI link measurement at a clock rate, see rf_spi_calibrate()
+ */
+typedef struct {
+	uint32_t speed_hz;	/**< Clock rate, set by caller */
+	uint32_t reads;		/**< Burst reads made, 0 if not tested */
+	uint32_t errors;	/**< Burst reads returning wrong data */
+	uint64_t bytes_per_s;	/**< Burst read throughput, incl. address
+				     bytes */
+} rf_spi_cal_t;
+
+/**
+ * Transceiver device
+ */
+struct rf_dev {
+	const rf_ops_t *ops;
+	rf_handle_fn_t handle;	/**< Copy of ops->handle for the hot path */
+	void *priv;		/**< Backend private state */
+
+	int fd;
+	sparse_buf_t shadow;	/**< Register configuration last written to
+				     transceiver */
+	uint8_t fixpklen;	/**< Length of packet or 0 if var. length */
+	uint8_t hdrlen;		/**< Transmit header bytes preceding length
+				     byte in frames */
+	const crc16_t *sw_crc;	/**< CRC to check in software on received
+				     frames, or NULL */
+	uint64_t irq_timestamp;	/**< Time of last IRQ edge in
+				     ns(CLOCK_MONOTONIC), 0 if unknown */
+	uint32_t tx_gap;	/**< Minimum time between transmitted frames
+				     in us */
+	uint32_t retune_freq;	/**< Carrier frequency in Hz to switch to
+				     between frames, 0 if none. Cleared by the
+				     backend after switching */
+	uint8_t channel;	/**< Channel index stored in meta data of
+				     received frames */
+	uint64_t next_service;	/**< Time in ns(CLOCK_MONOTONIC) the backend
+				     must be serviced again, 0 if only on
+				     IRQ/poll */
+	int irq_fd;		/**< GPIO IRQ line request, or -1 if not
+				     used */
+	rf_poll_stats_t poll_stats[RF_POLL_SITE_CNT];
+	uint64_t stats[RF_STAT_CNT]; /**< Counters, see rf_stat_add() */
+#ifdef ENABLE_LATENCY_STATS
+	lat_hist_t *lat;	/**< Latency histograms of backend */
+	uint64_t lat_handle_ns;	/**< Start of current rf_handle() call */
+	uint64_t lat_fifo_ns;	/**< Last FIFO read completion */
+#endif
+};
+
+/**
+ * Find backend by name
+ *
+ * @returns	Backend operations, or NULL if not found
+ */
+const rf_ops_t *rf_find_backend(const char *name);
+
+/**
+ * Iterate over known backends
+ *
+ * @param idx	Index of backend
+ *
+ * @returns	Backend operations, or NULL if idx is past the last backend
+ */
+const rf_ops_t *rf_backend_at(size_t idx);
+
+/**
+ * Open transceiver device
+ *
+ * @param dev		Device object to initialize
+ * @param spi_path	Path of SPI device the transceiver is connected to, or
+ *			SPI_SIM_PREFIX followed by the specification of a
+ *			simulated transceiver(see spi_sim_open())
+ * @param backend	Backend to use, or NULL to detect it from the chip
+ *			version registers
+ * @param spi		SPI link settings, or NULL for the driver defaults
+ *
+ * @returns	ERR_OK on success, else error code
+ */
+int rf_open(rf_dev_t *dev, const char *spi_path, const rf_ops_t *backend,
+	    const spi_config_t *spi);
+
+/**
+ * Close transceiver device
+ */
+void rf_close(rf_dev_t *dev);
+
+/**
+ * Measure SPI link at increasing clock rates
+ *
+ * Must be called on an opened, but not initialized, transceiver. For every
+ * clock rate, test patterns are written to the scratch registers and burst
+ * read back, counting the reads that return other data. Measuring stops
+ * after the first clock rate with errors. The scratch registers are
+ * restored, and the link settings reset to ref, afterwards.
+ *
+ * @param dev	Transceiver device
+ * @param ref	Link settings the transceiver is known to work with
+ * @param res	Clock rates to test in ascending order, results are stored
+ *		in the entries
+ * @param cnt	Amount of clock rates
+ *
+ * @returns	ERR_OK on success, else error code
+ */
+int rf_spi_calibrate(rf_dev_t *dev, const spi_config_t *ref,
+		     rf_spi_cal_t *res, size_t cnt);
+
+/**
+ * Name of register polling call site
+ */
+const char *rf_poll_site_name(rf_poll_site_t site);
+
+/**
+ * Name of counter
+ */
+const char *rf_stat_name(rf_stat_t stat);
+
+/**
+ * Description of counter
+ */
+const char *rf_stat_desc(rf_stat_t stat);
+
+/**
+ * Increment counter
+ *
+ * Counters are only written by the thread servicing the device, so no
+ * atomic read-modify-write is needed. Other threads can read them at any
+ * time with rf_stat_get().
+ */
+static inline void rf_stat_add(rf_dev_t *dev, rf_stat_t stat, uint64_t n)
+{
+	__atomic_store_n(&dev->stats[stat], dev->stats[stat] + n,
+			 __ATOMIC_RELAXED);
+}
+
+/**
+ * Read counter
+ */
+static inline uint64_t rf_stat_get(const rf_dev_t *dev, rf_stat_t stat)
+{
+	return __atomic_load_n(&dev->stats[stat], __ATOMIC_RELAXED);
+}
+
+/**
+ * Start waiting for a register condition
+ *
+ * Usage:
+ *   rf_wait_start(dev, &w, RF_POLL_..., timeout);
+ *   do {
+ *     read registers, break if condition met
+ *   } while ((err = rf_wait_next(dev, &w)) == ERR_OK);
+ *
+ * @param dev		Device object
+ * @param w		Wait state to initialize
+ * @param site		Call site to account the wait to
+ * @param timeout_us	Maximum time to wait
+ */
+void rf_wait_start(rf_dev_t *dev, rf_wait_t *w, rf_poll_site_t site,
+		   unsigned int timeout_us);
+
+/**
+ * Back off before next poll
+ *
+ * @returns	ERR_OK to poll again, ERR_RFM_TIMEOUT if the deadline passed,
+ *		or ERR_GPIO_READ if IRQ line could not be read
+ */
+int rf_wait_next(rf_dev_t *dev, rf_wait_t *w);
+
+/**
+ * Wait for register condition to be met
+ *
+ * Polls register until (value & mask) == expect, using rf_wait_next().
+ *
+ * @param dev		Device object
+ * @param site		Call site to account the wait to
+ * @param addr		Register to poll
+ * @param mask		Bits to check
+ * @param expect	Expected value of bits
+ * @param timeout_us	Maximum time to wait
+ * @param val		Returns last read register value, may be NULL
+ *
+ * @returns	ERR_OK on success, ERR_RFM_TIMEOUT if condition was not met
+ *		in time, else error code
+ */
+int rf_poll_reg(rf_dev_t *dev, rf_poll_site_t site, uint8_t addr,
+		uint8_t mask, uint8_t expect, unsigned int timeout_us,
+		uint8_t *val);
+
+/**
+ * Current time in ns(CLOCK_MONOTONIC)
+ */
+static inline uint64_t rf_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef ENABLE_LATENCY_STATS
+/**
+ * Latency histograms of backend
+ *
+ * @param idx	Index of backend, see rf_backend_at()
+ *
+ * @returns	Per stage histograms, or NULL if idx is past the last backend
+ */
+lat_hist_t *rf_lat_hists(size_t idx);
+
+/**
+ * Mark completion of packet read from FIFO
+ *
+ * Records the IRQ and SPI stages. Must be called before dev->irq_timestamp
+ * is cleared.
+ */
+static inline void rf_lat_fifo(rf_dev_t *dev)
+{
+	dev->lat_fifo_ns = rf_clock_ns();
+	lat_record(dev->lat, LAT_STAGE_IRQ, dev->irq_timestamp,
+		   dev->lat_handle_ns);
+	lat_record(dev->lat, LAT_STAGE_SPI, dev->lat_handle_ns,
+		   dev->lat_fifo_ns);
+}
+#endif
+
+/**
+ * Reset transceiver, program register configuration and start receiving
+ */
+static inline int rf_init(rf_dev_t *dev, sparse_buf_t *regs)
+{
+	// Reset restores the register defaults
+	sparse_buf_clear(&dev->shadow);
+	return dev->ops->init(dev, regs);
+}
+
+/**
+ * Switch carrier frequency, see rf_ops_t::retune
+ */
+static inline int rf_retune(rf_dev_t *dev, uint32_t freq)
+{
+	return dev->ops->retune(dev, freq);
+}
+
+/**
+ * Reprogram register configuration without resetting the transceiver
+ *
+ * Only the registers that differ from the shadow copy of the last written
+ * configuration are written. Registers missing from regs keep their
+ * current value.
+ *
+ * @returns	ERR_OK on success, ERR_RFM_BUSY if a transmission is in
+ *		progress and the call must be retried later, else error code
+ */
+int rf_reconfigure(rf_dev_t *dev, sparse_buf_t *regs);
+
+/**
+ * Record registers written to the transceiver in the shadow configuration
+ *
+ * Called by the backends after programming the register configuration.
+ *
+ * @returns	ERR_OK on success, ERR_RANGE if a register is outside the
+ *		register space
+ */
+int rf_shadow_update(rf_dev_t *dev, sparse_buf_t *regs);
+
+/**
+ * Read configuration register
+ *
+ * Returns the value from the shadow configuration, and only reads the
+ * register from the transceiver if it wasn't configured.
+ */
+int rf_read_cfg_reg(rf_dev_t *dev, uint8_t addr, uint8_t *val);
+
+/**
+ * Service transceiver
+ *
+ * Never blocks for the duration of a transmission. If the backend is
+ * waiting for the transceiver, it sets dev->next_service to the time it
+ * must be called again.
+ */
+static inline int rf_handle(rf_dev_t *dev, pkt_buf_t *rx_buf,
+			    pkt_buf_t *tx_buf)
+{
+	dev->next_service = 0;
+	LAT_EXEC(dev->lat_handle_ns = rf_clock_ns());
+	return dev->handle(dev, rx_buf, tx_buf);
+}
+
+#endif // __RF_DEV_H__
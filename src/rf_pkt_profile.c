@@ -0,0 +1,213 @@
+/**
+ * rf_pkt_profile.c - Compile register configuration files into profile image
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+#include "version.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sparse_buf.h"
+#include "parse_reg_file.h"
+#include "reg_profile.h"
+#include "rf_dev.h"
+
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Register Profile Compiler - " VERSION "\n"
+		"Usage: %s -o <image> [<name>=]<config>...\n"
+		"       %s -l <image>\n"
+		"\n"
+		"Compiles register configuration files into a profile image for\n"
+		"rf_pkt_drv. The first configuration is the base profile, the\n"
+		"other profiles only store the registers that differ from it.\n"
+		"The profile name defaults to the file name without directory\n"
+		"and extension.\n"
+		"\n"
+		"Options:\n"
+		" -o <path>	Image file to write\n"
+		" -l <path>	List profiles of image file\n"
+		" -h		Display this help message\n",
+		name, name);
+}
+
+/**
+ * Split '<name>=<config>' argument, or derive name from file name
+ *
+ * @returns	Name allocated with malloc(), or NULL on error
+ */
+static char *profile_name(char *arg, char **path)
+{
+	char *name;
+	char *p;
+
+	if ((p = strchr(arg, '=')) != NULL) {
+		*p = '\0';
+		*path = p + 1;
+		return strdup(arg);
+	}
+
+	*path = arg;
+	name = strrchr(arg, '/');
+	name = strdup(name == NULL ? arg : name + 1);
+	if (name != NULL && (p = strrchr(name, '.')) != NULL && p != name) {
+		*p = '\0';
+	}
+
+	return name;
+}
+
+static int list_profiles(const char *path)
+{
+	reg_profile_t prof;
+	size_t i;
+
+	if (reg_profile_open(&prof, path) != 0) {
+		return -1;
+	}
+
+	printf("%s: %zu bytes\n", path, prof.size);
+	for (i = 0; i < prof.cnt; i++) {
+		const reg_profile_entry_t *e = &prof.entries[i];
+
+		printf("%-*s %s %u bursts, %u registers\n",
+		       REG_PROFILE_NAME_LEN, e->name,
+		       (i == 0) ? "base " : "delta", e->burst_cnt,
+		       e->len - 2 * e->burst_cnt);
+	}
+	reg_profile_close(&prof);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *out_path = NULL;
+	const char *list_path = NULL;
+	sparse_buf_t *regs = NULL;
+	char **names = NULL;
+	size_t cnt;
+	uint8_t *image = NULL;
+	size_t size;
+	FILE *fp;
+	int retval = EXIT_FAILURE;
+	int opt;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "ho:l:")) != -1) {
+		switch (opt) {
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'l':
+			list_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (list_path != NULL) {
+		return list_profiles(list_path) == 0 ? EXIT_SUCCESS :
+						       EXIT_FAILURE;
+	}
+	if (out_path == NULL || optind >= argc) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	cnt = argc - optind;
+	regs = calloc(cnt, sizeof(*regs));
+	names = calloc(cnt, sizeof(*names));
+	if (regs == NULL || names == NULL) {
+		perror("calloc");
+		goto cleanup;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		char *path;
+
+		if ((names[i] = profile_name(argv[optind + i], &path)) == NULL) {
+			perror("strdup");
+			goto cleanup;
+		}
+		if (sparse_buf_init(&regs[i], RF_REG_SPACE) != 0) {
+			fprintf(stderr, "Unable to allocate register buffer\n");
+			goto cleanup;
+		}
+		if (parse_reg_file(path, &regs[i]) != 0) {
+			goto cleanup;
+		}
+	}
+
+	if (reg_profile_compile(regs, (const char * const *) names, cnt,
+				&image, &size) != 0) {
+		goto cleanup;
+	}
+
+	if ((fp = fopen(out_path, "wb")) == NULL) {
+		fprintf(stderr, "Unable to create file '%s': %s\n",
+			out_path, strerror(errno));
+		goto cleanup;
+	}
+	if (fwrite(image, size, 1, fp) != 1) {
+		fprintf(stderr, "Unable to write file '%s': %s\n",
+			out_path, strerror(errno));
+		fclose(fp);
+		unlink(out_path);
+		goto cleanup;
+	}
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "Unable to write file '%s': %s\n",
+			out_path, strerror(errno));
+		unlink(out_path);
+		goto cleanup;
+	}
+
+	retval = EXIT_SUCCESS;
+cleanup:
+	free(image);
+	for (i = 0; regs != NULL && names != NULL && i < cnt; i++) {
+		sparse_buf_destroy(&regs[i]);
+		free(names[i]);
+	}
+	free(regs);
+	free(names);
+
+	return retval;
+}
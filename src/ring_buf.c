@@ -26,14 +26,68 @@
  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE // for memfd_create()
+
 #include "ring_buf.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * Map buffer memory twice, back to back
+ *
+ * @returns	true on success, false if mirroring is not possible
+ */
+static bool _map_mirrored(ring_buf_t *obj, size_t size)
+{
+	const long page_size = sysconf(_SC_PAGESIZE);
+	uint8_t *addr;
+	int fd;
+
+	if (page_size <= 0 || size == 0 || size % page_size != 0) {
+		return false;
+	}
+
+	fd = memfd_create("ring_buf", MFD_CLOEXEC);
+	if (fd == -1) {
+		return false;
+	}
+	if (ftruncate(fd, size) == -1) {
+		goto fail;
+	}
+
+	// Reserve address range, then map the file twice over it
+	addr = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+		    -1, 0);
+	if (addr == MAP_FAILED) {
+		goto fail;
+	}
+	if (mmap(addr, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+	    mmap(addr + size, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(addr, 2 * size);
+		goto fail;
+	}
+	close(fd);
+
+	obj->buf = addr;
+	obj->mirrored = true;
+
+	return true;
+fail:
+	close(fd);
+	return false;
+}
 
 void ring_buf_init(ring_buf_t *obj, size_t size)
 {
-	obj->buf = (uint8_t *) malloc(size);
+	obj->mirrored = false;
+	if (! _map_mirrored(obj, size)) {
+		obj->buf = (uint8_t *) malloc(size);
+	}
 	obj->size = size;
 	obj->woff = obj->roff = 0;
 }
@@ -64,8 +118,8 @@ void ring_buf_add(ring_buf_t *obj, const uint8_t *data, size_t len)
 			memcpy(&obj->buf[obj->woff], data, copy_len);
 
 			obj->woff += copy_len;
-			if (obj->woff == obj->size)
-				obj->woff = 0;
+			if (obj->woff >= obj->size)
+				obj->woff -= obj->size;
 
 			len -= copy_len;
 			data += copy_len;
@@ -95,12 +149,66 @@ void ring_buf_consume(ring_buf_t *obj, size_t cnt)
 {
 	assert(cnt <= ring_buf_bytes_used(obj));
 
-	obj->roff = (obj->roff + cnt) % obj->size;
+	obj->roff += cnt;
+	if (obj->roff >= obj->size)
+		obj->roff -= obj->size;
 
 	if (obj->roff == obj->woff)
 		obj->roff = obj->woff = 0;
 }
 
+int ring_buf_readable_iov(ring_buf_t *obj, struct iovec iov[2])
+{
+	if (obj->mirrored || obj->woff >= obj->roff) {
+		if (obj->woff == obj->roff) {
+			return 0;
+		}
+		iov[0].iov_base = &obj->buf[obj->roff];
+		iov[0].iov_len = ring_buf_bytes_used(obj);
+		return 1;
+	}
+
+	iov[0].iov_base = &obj->buf[obj->roff];
+	iov[0].iov_len = obj->size - obj->roff;
+	if (obj->woff == 0) {
+		return 1;
+	}
+	iov[1].iov_base = &obj->buf[0];
+	iov[1].iov_len = obj->woff;
+	return 2;
+}
+
+int ring_buf_writable_iov(ring_buf_t *obj, struct iovec iov[2])
+{
+	const size_t writable = ring_buf_bytes_writable(obj);
+
+	if (writable == 0) {
+		return 0;
+	}
+
+	iov[0].iov_base = &obj->buf[obj->woff];
+	iov[0].iov_len = writable;
+
+	// Free space wraps to begin of buffer, if read pointer isn't in the
+	// way. One byte before the read pointer is always kept free.
+	if (! obj->mirrored && obj->woff >= obj->roff && obj->roff > 1) {
+		iov[1].iov_base = &obj->buf[0];
+		iov[1].iov_len = obj->roff - 1;
+		return 2;
+	}
+
+	return 1;
+}
+
+void ring_buf_commit(ring_buf_t *obj, size_t cnt)
+{
+	assert(cnt <= ring_buf_bytes_free(obj));
+
+	obj->woff += cnt;
+	if (obj->woff >= obj->size)
+		obj->woff -= obj->size;
+}
+
 void ring_buf_clear(ring_buf_t *obj)
 {
 	obj->roff = obj->woff = 0;
@@ -127,7 +235,9 @@ size_t ring_buf_bytes_used(const ring_buf_t *obj)
 
 size_t ring_buf_bytes_readable(const ring_buf_t *obj)
 {
-	if (obj->woff < obj->roff) {
+	if (obj->mirrored) {
+		return ring_buf_bytes_used(obj);
+	} else if (obj->woff < obj->roff) {
 		return obj->size - obj->roff;
 	} else {
 		return obj->woff - obj->roff;
@@ -137,7 +247,9 @@ size_t ring_buf_bytes_readable(const ring_buf_t *obj)
 size_t ring_buf_bytes_writable(const ring_buf_t *obj)
 {
 	//TODO: we don't want to export this function, since writing directly to the buffer is probably not a good idea? but does allow read() directly into buffer...
-	if (obj->woff < obj->roff) {
+	if (obj->mirrored) {
+		return ring_buf_bytes_free(obj);
+	} else if (obj->woff < obj->roff) {
 		return obj->roff - obj->woff - 1;
 	} else if (obj->roff == 0) {
 		return obj->size - obj->woff - 1;
@@ -161,8 +273,24 @@ uint8_t *ring_buf_begin(ring_buf_t *obj)
 	return &obj->buf[obj->roff];
 }
 
+uint8_t ring_buf_peek(const ring_buf_t *obj, size_t off)
+{
+	assert(off < ring_buf_bytes_used(obj));
+
+	off += obj->roff;
+	if (off >= obj->size)
+		off -= obj->size;
+
+	return obj->buf[off];
+}
+
 void ring_buf_destroy(ring_buf_t *obj)
 {
-	free(obj->buf);
+	if (obj->mirrored) {
+		munmap(obj->buf, 2 * obj->size);
+		obj->mirrored = false;
+	} else {
+		free(obj->buf);
+	}
 	obj->buf = NULL;
 }
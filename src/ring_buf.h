@@ -32,12 +32,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 typedef struct {
 	uint8_t *buf;
 	size_t size;
 	size_t woff;
 	size_t roff;
+	bool mirrored;	/**< buf is mapped twice, back to back */
 } ring_buf_t;
 
 /**
@@ -45,6 +47,11 @@ typedef struct {
  *
  * Initialized the ring buffer, to be able to store size-1 bytes.
  *
+ * If size is a multiple of the page size, the buffer memory is mapped twice
+ * directly after each other. All data and free space is then contiguous in
+ * memory, and readable/writable segments never wrap. For other sizes a
+ * normal heap buffer is used.
+ *
  * @param obj	Object to initialize
  * @param size	Size of buffer
  */
@@ -113,6 +120,55 @@ void ring_buf_clear(ring_buf_t *obj);
  */
 uint8_t *ring_buf_begin(ring_buf_t *obj);
 
+/**
+ * Return byte of data without consuming it
+ *
+ * @param obj	Ring buffer object
+ * @param off	Offset from begin of data, must be < ring_buf_bytes_used()
+ *
+ * @returns	Byte at offset 'off'
+ */
+uint8_t ring_buf_peek(const ring_buf_t *obj, size_t off);
+
+/**
+ * Get readable data as I/O vectors
+ *
+ * Fills 'iov' with the up to two segments of data in the buffer, oldest
+ * first. This allows passing the data to writev() without copying. Use
+ * ring_buf_consume() afterwards to remove the bytes that were used.
+ *
+ * @param obj	Ring buffer object
+ * @param iov	Array of 2 I/O vectors to fill
+ *
+ * @returns	Amount of I/O vectors filled in, 0 if buffer is empty
+ */
+int ring_buf_readable_iov(ring_buf_t *obj, struct iovec iov[2]);
+
+/**
+ * Get free space as I/O vectors
+ *
+ * Fills 'iov' with the up to two segments of free space in the buffer, in
+ * write order. This allows reading data directly into the buffer with
+ * readv(). Use ring_buf_commit() afterwards to add the bytes that were
+ * written.
+ *
+ * @param obj	Ring buffer object
+ * @param iov	Array of 2 I/O vectors to fill
+ *
+ * @returns	Amount of I/O vectors filled in, 0 if buffer is full
+ */
+int ring_buf_writable_iov(ring_buf_t *obj, struct iovec iov[2]);
+
+/**
+ * Commit bytes written directly into buffer
+ *
+ * Moves the write pointer 'cnt' bytes forward.
+ *
+ * @param obj	Ring buffer object
+ * @param cnt	Amount of bytes written, must be <= ring_buf_bytes_free()
+ */
+void ring_buf_commit(ring_buf_t *obj, size_t cnt);
+
 size_t ring_buf_size(ring_buf_t *obj);
 size_t ring_buf_bytes_free(const ring_buf_t *obj);
 size_t ring_buf_bytes_used(const ring_buf_t *obj);
@@ -0,0 +1,232 @@
+/**
+ * shm_ring.c - Shared memory single producer/single consumer packet ring
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE // for memfd_create()
+
+#include "shm_ring.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "error.h"
+
+/**
+ * Offset of first slot, header rounded up to whole cache lines
+ */
+#define SHM_RING_SLOT_OFFSET \
+	((sizeof(shm_ring_hdr_t) + SHM_RING_CACHE_LINE - 1) & \
+	 ~(SHM_RING_CACHE_LINE - 1))
+
+static void _init_local(shm_ring_t *ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->hdr = MAP_FAILED;
+	ring->mem_fd = -1;
+	ring->event_fd = -1;
+}
+
+int shm_ring_create(shm_ring_t *ring, size_t slot_cnt)
+{
+	int err = ERR_UNSPEC;
+	shm_ring_hdr_t *hdr;
+
+	_init_local(ring);
+
+	if (slot_cnt == 0 || (slot_cnt & (slot_cnt - 1)) != 0) {
+		return ERR_INVAL;
+	}
+
+	ring->map_size = SHM_RING_SLOT_OFFSET + slot_cnt * sizeof(pkt_t);
+	ring->mask = slot_cnt - 1;
+
+	ring->mem_fd = memfd_create("rf_pkt_ring",
+				    MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (ring->mem_fd == -1) {
+		err = ERR_SHM;
+		goto fail;
+	}
+	if (ftruncate(ring->mem_fd, ring->map_size) == -1) {
+		err = ERR_SHM;
+		goto fail;
+	}
+	// Prevent consumer from resizing the file under our mapping
+	if (fcntl(ring->mem_fd, F_ADD_SEALS,
+			F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+		err = ERR_SHM;
+		goto fail;
+	}
+
+	ring->hdr = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, ring->mem_fd, 0);
+	if (ring->hdr == MAP_FAILED) {
+		err = ERR_SHM;
+		goto fail;
+	}
+	ring->slots = (pkt_t *) ((uint8_t *) ring->hdr + SHM_RING_SLOT_OFFSET);
+
+	ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->event_fd == -1) {
+		err = ERR_SHM;
+		goto fail;
+	}
+
+	hdr = ring->hdr;
+	hdr->magic = SHM_RING_MAGIC;
+	hdr->version = SHM_RING_VERSION;
+	hdr->slot_cnt = slot_cnt;
+	hdr->slot_size = sizeof(pkt_t);
+	hdr->slot_offset = SHM_RING_SLOT_OFFSET;
+
+	return ERR_OK;
+fail:
+	SAVE_ERRNO(shm_ring_destroy(ring));
+	return err;
+}
+
+int shm_ring_attach(shm_ring_t *ring, int mem_fd, int event_fd)
+{
+	int err = ERR_UNSPEC;
+	shm_ring_hdr_t *hdr;
+	struct stat st;
+
+	_init_local(ring);
+
+	if (fstat(mem_fd, &st) == -1) {
+		return ERR_SHM;
+	}
+	if (st.st_size < sizeof(shm_ring_hdr_t)) {
+		return ERR_INVAL;
+	}
+
+	hdr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   mem_fd, 0);
+	if (hdr == MAP_FAILED) {
+		return ERR_SHM;
+	}
+
+	ring->hdr = hdr;
+	ring->map_size = st.st_size;
+
+	if (hdr->magic != SHM_RING_MAGIC ||
+			hdr->version != SHM_RING_VERSION ||
+			hdr->slot_size != sizeof(pkt_t) ||
+			hdr->slot_cnt == 0 ||
+			(hdr->slot_cnt & (hdr->slot_cnt - 1)) != 0 ||
+			hdr->slot_offset < sizeof(shm_ring_hdr_t) ||
+			hdr->slot_offset + (size_t) hdr->slot_cnt *
+				sizeof(pkt_t) > ring->map_size) {
+		err = ERR_INVAL;
+		goto fail;
+	}
+
+	ring->slots = (pkt_t *) ((uint8_t *) hdr + hdr->slot_offset);
+	ring->mask = hdr->slot_cnt - 1;
+	ring->tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+	ring->mem_fd = mem_fd;
+	ring->event_fd = event_fd;
+
+	return ERR_OK;
+fail:
+	munmap(hdr, ring->map_size);
+	ring->hdr = MAP_FAILED;
+	return err;
+}
+
+void shm_ring_destroy(shm_ring_t *ring)
+{
+	if (ring->hdr != MAP_FAILED) {
+		munmap(ring->hdr, ring->map_size);
+	}
+	if (ring->mem_fd != -1) {
+		close(ring->mem_fd);
+	}
+	if (ring->event_fd != -1) {
+		close(ring->event_fd);
+	}
+	_init_local(ring);
+}
+
+int shm_ring_notify(shm_ring_t *ring)
+{
+	const uint64_t one = 1;
+
+	if (ring->head == ring->notified) {
+		return ERR_OK;
+	}
+
+	// Order the head update before reading the waiting flag. Pairs with
+	// the fence in shm_ring_wait().
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (! __atomic_load_n(&ring->hdr->waiting, __ATOMIC_RELAXED)) {
+		return ERR_OK;
+	}
+
+	if (write(ring->event_fd, &one, sizeof(one)) == -1 &&
+			errno != EAGAIN) {
+		return ERR_SHM;
+	}
+	ring->notified = ring->head;
+
+	return ERR_OK;
+}
+
+int shm_ring_wait(shm_ring_t *ring, int timeout_ms)
+{
+	struct pollfd pfd;
+	uint64_t cnt;
+	int ret;
+
+	// Announce wait, then check again to not miss a packet published
+	// in between
+	__atomic_store_n(&ring->hdr->waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (shm_ring_peek(ring) != NULL) {
+		__atomic_store_n(&ring->hdr->waiting, 0, __ATOMIC_RELAXED);
+		return ERR_OK;
+	}
+
+	pfd.fd = ring->event_fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, timeout_ms);
+	__atomic_store_n(&ring->hdr->waiting, 0, __ATOMIC_RELAXED);
+	if (ret == -1) {
+		return (errno == EINTR) ? ERR_OK : ERR_SHM;
+	}
+	if (ret > 0 && read(ring->event_fd, &cnt, sizeof(cnt)) == -1 &&
+			errno != EAGAIN) {
+		return ERR_SHM;
+	}
+
+	return ERR_OK;
+}
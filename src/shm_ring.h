@@ -0,0 +1,206 @@
+/**
+ * shm_ring.h - Shared memory single producer/single consumer packet ring
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pkt_buf.h"
+
+/**
+ * Magic value at start of shared memory, "RFPR"
+ */
+#define SHM_RING_MAGIC 0x52465052
+#define SHM_RING_VERSION 1
+
+#define SHM_RING_CACHE_LINE 64
+
+/**
+ * Header at start of shared memory
+ *
+ * The header is followed by slot_cnt slots of type pkt_t. The producer only
+ * writes head, the consumer only writes tail and waiting. The indices are
+ * free running, the slot of index i is (i & (slot_cnt - 1)).
+ */
+typedef struct {
+	uint32_t magic;		/**< SHM_RING_MAGIC */
+	uint32_t version;	/**< SHM_RING_VERSION */
+	uint32_t slot_cnt;	/**< Amount of slots, power of 2 */
+	uint32_t slot_size;	/**< Size of a slot, sizeof(pkt_t) */
+	uint32_t slot_offset;	/**< Offset of first slot from begin of
+				     header */
+	uint32_t reserved;
+	uint64_t dropped;	/**< Packets dropped because ring was full */
+
+	/** Index of next packet to be published */
+	uint64_t head __attribute__((aligned(SHM_RING_CACHE_LINE)));
+
+	/** Index of next packet to be consumed */
+	uint64_t tail __attribute__((aligned(SHM_RING_CACHE_LINE)));
+	/** Consumer is about to wait for the event fd */
+	uint32_t waiting;
+} shm_ring_hdr_t;
+
+/**
+ * Process local state of a shared memory ring
+ *
+ * The indices and slot count are kept in local memory as well, so that the
+ * other process can't make this process access memory outside the ring.
+ */
+typedef struct {
+	shm_ring_hdr_t *hdr;
+	pkt_t *slots;
+	size_t map_size;
+	size_t mask;		/**< Amount of slots - 1 */
+	uint64_t head;		/**< Producer: next index to publish */
+	uint64_t tail;		/**< Consumer: next index to consume */
+	uint64_t notified;	/**< Producer: head at last notification */
+	int mem_fd;		/**< memfd containing the ring */
+	int event_fd;		/**< eventfd signaled on new packets */
+} shm_ring_t;
+
+/**
+ * Create shared memory ring
+ *
+ * Creates a memfd containing the ring, and a eventfd to wake up the
+ * consumer. Both file descriptors can be passed to the consumer process.
+ *
+ * @param ring		Ring object to initialize
+ * @param slot_cnt	Amount of packet slots, must be a power of 2
+ *
+ * @returns	ERR_OK on success, ERR_INVAL or ERR_SHM on error
+ */
+int shm_ring_create(shm_ring_t *ring, size_t slot_cnt);
+
+/**
+ * Attach to shared memory ring created by other process
+ *
+ * The file descriptors are owned by the ring object after a successful
+ * call.
+ *
+ * @param ring		Ring object to initialize
+ * @param mem_fd	memfd received from producer
+ * @param event_fd	eventfd received from producer
+ *
+ * @returns	ERR_OK on success, ERR_INVAL or ERR_SHM on error
+ */
+int shm_ring_attach(shm_ring_t *ring, int mem_fd, int event_fd);
+
+/**
+ * Unmap ring and close file descriptors
+ */
+void shm_ring_destroy(shm_ring_t *ring);
+
+/******************************* Producer ***********************************/
+/**
+ * Get slot for next packet
+ *
+ * @returns	Pointer to free slot, or NULL if ring is full
+ */
+static inline pkt_t *shm_ring_alloc(shm_ring_t *ring);
+
+/**
+ * Publish packet in slot returned by shm_ring_alloc() to consumer
+ */
+static inline void shm_ring_publish(shm_ring_t *ring);
+
+/**
+ * Wake up consumer if it waits for packets
+ *
+ * Only signals the event fd if the consumer announced it's going to wait,
+ * and packets were published since the last notification. Call this once
+ * after publishing a batch of packets.
+ *
+ * @returns	ERR_OK on success, ERR_SHM on error
+ */
+int shm_ring_notify(shm_ring_t *ring);
+
+/******************************* Consumer ***********************************/
+/**
+ * Get oldest published packet
+ *
+ * @returns	Pointer to packet, or NULL if ring is empty
+ */
+static inline const pkt_t *shm_ring_peek(shm_ring_t *ring);
+
+/**
+ * Release oldest packet back to producer
+ */
+static inline void shm_ring_pop(shm_ring_t *ring);
+
+/**
+ * Wait till ring contains packets
+ *
+ * @param ring		Ring object
+ * @param timeout_ms	Max. time to wait in milliseconds, -1 for infinite
+ *
+ * @returns	ERR_OK if packets are available or timeout expired, ERR_SHM on
+ *		error
+ */
+int shm_ring_wait(shm_ring_t *ring, int timeout_ms);
+
+/*************** Static function implementations ***********************/
+
+static inline pkt_t *shm_ring_alloc(shm_ring_t *ring)
+{
+	const uint64_t tail = __atomic_load_n(&ring->hdr->tail,
+					      __ATOMIC_ACQUIRE);
+
+	if (ring->head - tail > ring->mask) {
+		return NULL;
+	}
+	return &ring->slots[ring->head & ring->mask];
+}
+
+static inline void shm_ring_publish(shm_ring_t *ring)
+{
+	ring->head++;
+	__atomic_store_n(&ring->hdr->head, ring->head, __ATOMIC_RELEASE);
+}
+
+static inline const pkt_t *shm_ring_peek(shm_ring_t *ring)
+{
+	const uint64_t head = __atomic_load_n(&ring->hdr->head,
+					      __ATOMIC_ACQUIRE);
+
+	if (head == ring->tail) {
+		return NULL;
+	}
+	return &ring->slots[ring->tail & ring->mask];
+}
+
+static inline void shm_ring_pop(shm_ring_t *ring)
+{
+	ring->tail++;
+	__atomic_store_n(&ring->hdr->tail, ring->tail, __ATOMIC_RELEASE);
+}
+
+#endif // __SHM_RING_H__
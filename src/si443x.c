@@ -46,48 +46,182 @@
 
 #define SI443X_FIFO_SIZE 64
 
+/**
+ * RX FIFO almost full threshold, in bytes
+ *
+ * Raises an interrupt when multiple packets are queued in the FIFO before
+ * the valid packet interrupt was serviced.
+ */
+#define SI443X_RX_AFULL_THRESHOLD 48
+
+/**
+ * Maximum amount of packets drained from FIFO per service pass
+ *
+ * The smallest packet is 2 bytes, so the FIFO can't contain more.
+ */
+#define SI443X_MAX_DRAIN (SI443X_FIFO_SIZE / 2)
+
+/**
+ * TX FIFO almost empty threshold, in bytes
+ *
+ * The FIFO is refilled with SI443X_FIFO_SIZE - SI443X_TX_AEMPTY_THRESHOLD
+ * bytes every time it drops below this level.
+ */
+#define SI443X_TX_AEMPTY_THRESHOLD 16
+
+/**
+ * Interval to check the TX FIFO, in case the IRQ is not used
+ */
+#define SI443X_TX_POLL_NS 1000000
+
+/**
+ * Maximum time a transmission may take
+ */
+#define SI443X_TX_TIMEOUT_NS 3000000000ULL
+
+/**
+ * Operating mode values, used in multi packet RX FIFO mode
+ */
+#define SI443X_MODE_READY OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON
+#define SI443X_MODE_RX (OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON | \
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1_RXON)
+#define SI443X_MODE_TX (OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON | \
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1_TXON)
+#define SI443X_CTRL2 OPERATING_MODE_AND_FUNCTION_CONTROL_2_RXMPK
+
+/**
+ * Maximum time the reception of a packet may take after sync word detection
+ */
+#define SI443X_RX_TIMEOUT_US 500000
+
+/**
+ * Maximum time for the chip to become ready after a software reset
+ */
+#define SI443X_RESET_TIMEOUT_US 100000
+
+/**
+ * AFC correction step of AFC_CORRECTION_READ register, for hbsel = 0
+ */
+#define SI443X_AFC_STEP 625
+
+/**
+ * Carrier frequency range, and start of high band
+ */
+#define SI443X_FREQ_MIN 240000000
+#define SI443X_FREQ_MAX 959999999
+#define SI443X_FREQ_HBSEL 480000000
+
+/**
+ * Frequency band width, in Hz per band select step and high band select
+ */
+#define SI443X_FREQ_BAND 10000000
+
+/**
+ * Si443x private device state
+ */
+typedef struct {
+	uint8_t hbsel; /**< High band select, scales AFC correction */
+
+	const pkt_t *tx_pkt;	/**< Frame being transmitted, or NULL */
+	const uint8_t *tx_payload; /**< Payload of tx_pkt */
+	uint8_t tx_len;		/**< Length of payload */
+	uint8_t tx_off;		/**< Payload bytes written to FIFO */
+	uint64_t tx_deadline;	/**< End of TX timeout or inter frame gap */
+
+	unsigned long rx_passes;	/**< Service passes that read packets */
+	unsigned long rx_packets;	/**< Packets read from FIFO */
+	unsigned int rx_max_drain;	/**< Max. packets read in one pass */
+} si443x_priv_t;
+
+static int _probe(int fd);
+static int _open(rf_dev_t *dev);
+static void _close(rf_dev_t *dev);
+static int _init(rf_dev_t *dev, sparse_buf_t *regs);
+static int _reconfigure(rf_dev_t *dev, sparse_buf_t *changed);
+static int _handle(rf_dev_t *dev, pkt_buf_t *rx_buf, pkt_buf_t *tx_buf);
+static int _handle_rx(rf_dev_t *dev, pkt_buf_t *rx_buf,
+		      const uint8_t status[3]);
+static int _receive_frame(rf_dev_t *dev, pkt_buf_t *rx_buf,
+			  uint8_t *dev_status);
+static int _tx_start(rf_dev_t *dev, pkt_buf_t *tx_buf);
+static int _tx_continue(rf_dev_t *dev, pkt_buf_t *tx_buf,
+			const uint8_t status[3]);
+static int _tx_abort(rf_dev_t *dev, pkt_buf_t *tx_buf);
 static int _reset(rf_dev_t *dev);
 static int _reset_rx_fifo(rf_dev_t *dev);
 static int _sync_config(rf_dev_t *dev);
 static int _configure(rf_dev_t *dev, sparse_buf_t *regs);
+static int _start_rx(rf_dev_t *dev);
+static int _retune(rf_dev_t *dev, uint32_t freq);
 static void _dump_status(rf_dev_t *dev);
 
-int rf_open(rf_dev_t *dev, const char *spi_path)
+const rf_ops_t si443x_ops = {
+	.name = "si443x",
+	.default_sw_crc = NULL,
+	.freq_min = SI443X_FREQ_MIN,
+	.freq_max = SI443X_FREQ_MAX,
+	.fifo_addr = FIFO_ACCESS,
+	.scratch_addr = SYNC_WORD_3,
+	.scratch_len = 8,	// Sync word and transmit header
+	.probe = _probe,
+	.open = _open,
+	.close = _close,
+	.init = _init,
+	.reconfigure = _reconfigure,
+	.retune = _retune,
+	.handle = _handle,
+};
+
+static int _probe(int fd)
 {
 	int err = ERR_UNSPEC;
-	int fd;
 	uint8_t val;
 
-	fd = open(spi_path, O_RDWR);
-	if (fd == -1) {
-		return ERR_SPI_OPEN_DEV;
-	}
-
-	dev->fd = fd;
-
 	// Check device version
-	TRY(spi_read_reg(dev->fd, DEVICE_TYPE, &val));
+	TRY(spi_read_reg(fd, DEVICE_TYPE, &val));
 	if (val != DEVICE_TYPE_EZRADIOPRO) {
 		err = ERR_RFM_CHIP_VERSION;
 		goto fail;
 	}
 
+	return ERR_OK;
+fail:
+	return err;
+}
+
+static int _open(rf_dev_t *dev)
+{
+	int err = ERR_UNSPEC;
+
+	dev->priv = calloc(1, sizeof(si443x_priv_t));
+	if (dev->priv == NULL) {
+		return ERR_UNSPEC;
+	}
+
 	// Read config
 	TRY(_sync_config(dev));
 
 	return ERR_OK;
 fail:
-	SAVE_ERRNO(rf_close(dev));
+	_close(dev);
 	return err;
 }
 
-void rf_close(rf_dev_t *dev)
+static void _close(rf_dev_t *dev)
 {
-	close(dev->fd);
-	dev->fd = -1;
+	si443x_priv_t *priv = dev->priv;
+
+	if (priv != NULL && priv->rx_passes != 0) {
+		DBG_PRINTF(DBG_LVL_LOW, "Read %lu packets in %lu passes, "
+			   "max. %u per pass\n", priv->rx_packets,
+			   priv->rx_passes, priv->rx_max_drain);
+	}
+
+	free(dev->priv);
+	dev->priv = NULL;
 }
 
-int rf_init(rf_dev_t *dev, sparse_buf_t *regs)
+static int _init(rf_dev_t *dev, sparse_buf_t *regs)
 {
 	int err = ERR_UNSPEC;
 
@@ -97,89 +231,300 @@ int rf_init(rf_dev_t *dev, sparse_buf_t *regs)
 	// Program register configuration
 	TRY(_configure(dev, regs));
 
-	// enable receiver in multi packet FIFO mode
-	//TODO: use defines
-	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1, 0x05));
-	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_2, 0x10));
+	TRY(_start_rx(dev));
+	((si443x_priv_t *) dev->priv)->tx_pkt = NULL;
 
 	err = ERR_OK;
 fail:
 	return err;
 }
 
-int rf_handle(rf_dev_t *dev, ring_buf_t *rx_buf, ring_buf_t *tx_buf)
+static int _reconfigure(rf_dev_t *dev, sparse_buf_t *changed)
+{
+	int err = ERR_UNSPEC;
+
+	if (((si443x_priv_t *) dev->priv)->tx_pkt != NULL) {
+		return ERR_RFM_BUSY;
+	}
+
+	// Leave RX mode, and drop frames received with the old configuration
+	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+			       SI443X_MODE_READY));
+	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_2,
+			       SI443X_CTRL2 |
+			       OPERATING_MODE_AND_FUNCTION_CONTROL_2_FFCLRRX));
+
+	TRY(_configure(dev, changed));
+
+	TRY(_start_rx(dev));
+
+	err = ERR_OK;
+fail:
+	return err;
+}
+
+/**
+ * Enable the settings the driver relies on and enter RX mode
+ *
+ * Interrupt on every valid packet, when packets pile up in the FIFO, and to
+ * refill the TX FIFO. This is in addition to the interrupts of the
+ * configuration.
+ */
+static int _start_rx(rf_dev_t *dev)
 {
 	int err = ERR_UNSPEC;
-	uint8_t buf[64];
-	uint8_t hdrlen;
-	uint8_t pktlen;
 	uint8_t val;
 
-	// Check if packet available
-	TRY(spi_read_reg(dev->fd, DEVICE_STATUS, &val));
-	if ((val & DEVICE_STATUS_RXFFEM)) {
-		return ERR_OK;
+	TRY(spi_write_reg(dev->fd, RX_FIFO_CONTROL, SI443X_RX_AFULL_THRESHOLD));
+	TRY(spi_write_reg(dev->fd, TX_FIFO_CONTROL_2, SI443X_TX_AEMPTY_THRESHOLD));
+	TRY(rf_read_cfg_reg(dev, INTERRUPT_ENABLE_1, &val));
+	TRY(spi_write_reg(dev->fd, INTERRUPT_ENABLE_1, val |
+			       INTERRUPT_STATUS_1_IPKVALID |
+			       INTERRUPT_STATUS_1_IRXFFAFULL |
+			       INTERRUPT_STATUS_1_ITXFFAEM |
+			       INTERRUPT_STATUS_1_IPKSENT));
+
+	// enable receiver in multi packet FIFO mode
+	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+			       SI443X_MODE_RX));
+	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_2,
+			       SI443X_CTRL2));
+
+	err = ERR_OK;
+fail:
+	return err;
+}
+
+static int _handle(rf_dev_t *dev, pkt_buf_t *rx_buf, pkt_buf_t *tx_buf)
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	uint8_t status[3];
+	bool rx_busy = false;
+
+	// NOTE: Reads DEVICE_STATUS, INTERRUPT_STATUS_1 & INTERRUPT_STATUS_2,
+	// which also clears the pending interrupts. This is the only status
+	// read per pass, the FIFO state after every packet is read in the same
+	// transaction as the packet.
+	TRY(spi_read_regs(dev->fd, DEVICE_STATUS, status, sizeof(status)));
+
+	if (priv->tx_pkt != NULL) {
+		TRY(_tx_continue(dev, tx_buf, status));
+		if (priv->tx_pkt != NULL) {
+			return ERR_OK;
+		}
+	} else if (! (status[0] & DEVICE_STATUS_RXFFEM)) {
+		TRY(_handle_rx(dev, rx_buf, status));
+	} else {
+		// Sync word detected, but no data in FIFO yet
+		rx_busy = (status[2] & INTERRUPT_STATUS_2_ISWDET) != 0;
+	}
+
+	// Switch channel between frames
+	if (dev->retune_freq != 0) {
+		if (rx_busy) {
+			dev->next_service = rf_clock_ns() + SI443X_TX_POLL_NS;
+			return ERR_OK;
+		}
+		TRY(_retune(dev, dev->retune_freq));
+		dev->retune_freq = 0;
+	}
+
+	// Only leave RX mode if no packet is being received
+	if (! pkt_buf_empty(tx_buf)) {
+		if (rx_busy) {
+			dev->next_service = rf_clock_ns() + SI443X_TX_POLL_NS;
+		} else {
+			TRY(_tx_start(dev, tx_buf));
+		}
 	}
 
+	return ERR_OK;
+fail:
+	return err;
+}
+
+/**
+ * Read all received packets from FIFO
+ *
+ * @param dev		Device object
+ * @param rx_buf	Buffer to store packets in
+ * @param status	DEVICE_STATUS and INTERRUPT_STATUS_1/2 of this pass
+ */
+static int _handle_rx(rf_dev_t *dev, pkt_buf_t *rx_buf,
+		      const uint8_t status[3])
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	unsigned int cnt;
+	uint8_t val;
+
 	DBG_PRINTF(DBG_LVL_LOW, "> Received packet: \n");
 	DBG_EXEC(DBG_LVL_HIGH, _dump_status(dev));
 
 	// Wait till done receiving current packet
 	//NOTE: DEVICE_STATUS.RXFFEM is also != 1 for partial packets!
-	TRY(spi_read_reg(dev->fd, INTERRUPT_STATUS_2, &val));
-	while ((val & INTERRUPT_STATUS_2_ISWDET)) {
-		TRY(spi_read_reg(dev->fd, INTERRUPT_STATUS_2, &val));
-		//TODO: add timeout?
+	if (status[2] & INTERRUPT_STATUS_2_ISWDET) {
+		err = rf_poll_reg(dev, RF_POLL_RX, INTERRUPT_STATUS_2,
+				  INTERRUPT_STATUS_2_ISWDET, 0,
+				  SI443X_RX_TIMEOUT_US, &val);
+		if (err == ERR_RFM_TIMEOUT) {
+			fprintf(stderr, "ERROR: Timeout receiving packet\n");
+			rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
+			TRY(_reset_rx_fifo(dev));
+			return ERR_OK;
+		}
+		TRY(err);
 	}
 
+	// Drain all packets queued in the multi packet FIFO
+	cnt = 0;
+	do {
+		TRY(_receive_frame(dev, rx_buf, &val));
+		cnt++;
+	} while (! (val & DEVICE_STATUS_RXFFEM) && cnt < SI443X_MAX_DRAIN);
+
+	priv->rx_passes++;
+	priv->rx_packets += cnt;
+	if (cnt > priv->rx_max_drain) {
+		priv->rx_max_drain = cnt;
+	}
+	DBG_PRINTF(DBG_LVL_MID, "Drained %u packets from FIFO%s\n", cnt,
+		   (status[1] & INTERRUPT_STATUS_1_IRXFFAFULL) ?
+		   " (almost full)" : "");
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
+/**
+ * Read next packet from RX FIFO
+ *
+ * @param dev		Device object
+ * @param rx_buf	Buffer to store packet in
+ * @param dev_status	Returns DEVICE_STATUS after reading the packet.
+ *			RXFFEM is set if the FIFO was reset.
+ */
+static int _receive_frame(rf_dev_t *dev, pkt_buf_t *rx_buf,
+			  uint8_t *dev_status)
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	spi_batch_t batch;
+	pkt_t overflow_pkt;
+	pkt_t *pkt;
+	uint8_t *buf;
+	uint8_t rssi;
+	uint8_t afc;
+	bool drop;
+	uint8_t hdrlen;
+	uint8_t pktlen;
+	uint8_t val;
+
+	// Read directly into the next free slot. The FIFO must be emptied even
+	// if there is no room, so use a scratch slot in that case.
+	pkt = pkt_buf_alloc(rx_buf);
+	if (pkt == NULL) {
+		pkt = &overflow_pkt;
+	}
+	buf = pkt->data;
+
 	// Read Header
-	hdrlen = dev->txhdlen;
+	hdrlen = dev->hdrlen;
 	if (dev->fixpklen == 0) {
 		hdrlen += 1;
-	}
-	if (hdrlen) {
+
 		TRY(spi_read_regs(dev->fd, FIFO_ACCESS, buf, hdrlen));
 
 		DBG_PRINTF(DBG_LVL_MID, "hdr: ");
 		DBG_HEXDUMP(DBG_LVL_MID, buf, hdrlen);
 		DBG_EXEC(DBG_LVL_HIGH, _dump_status(dev));
-	}
-	if (dev->fixpklen == 0) {
+
 		pktlen = buf[hdrlen - 1];
-		if (pktlen > SI443X_FIFO_SIZE - 3) {
+		if (pktlen > SI443X_FIFO_SIZE - hdrlen) {
 			fprintf(stderr, "ERROR: Packet len too big (%.2x)\n",
 				pktlen);
+			rf_stat_add(dev, RF_STAT_LEN_ERRORS, 1);
 			goto recover;
 		}
+
+		// Read Payload
+		spi_batch_init(&batch);
+		TRY(spi_batch_read(&batch, FIFO_ACCESS, &buf[hdrlen], pktlen));
 	} else {
+		// Header and payload can be read in a single burst
 		pktlen = dev->fixpklen;
-	}
 
-	// Read Payload
-	TRY(spi_read_regs(dev->fd, FIFO_ACCESS, &buf[hdrlen], pktlen));
+		spi_batch_init(&batch);
+		TRY(spi_batch_read(&batch, FIFO_ACCESS, buf, hdrlen + pktlen));
+	}
 
+	// Check FIFO over/underflow condition, in same transaction as payload
+	TRY(spi_batch_read(&batch, DEVICE_STATUS, &val, 1));
+	TRY(spi_batch_read(&batch, RECEIVED_SIGNAL_STRENGTH_INDICATOR, &rssi, 1));
+	TRY(spi_batch_read(&batch, AFC_CORRECTION_READ, &afc, 1));
+	TRY(spi_batch_submit(dev->fd, &batch));
+	*dev_status = val;
+	LAT_EXEC(rf_lat_fifo(dev));
+
+	// NOTE: RSSI and AFC aren't latched per packet, so they are only
+	// reliable if no new packet was received in the meantime.
+	pkt_meta_init(&pkt->meta, dev->irq_timestamp);
+	pkt->meta.channel = dev->channel;
+	dev->irq_timestamp = 0;
+	pkt->meta.rssi = rssi - 240; // RSSI[dBm] ~= RSSI / 2 - 120
+	pkt->meta.afc = (int8_t) afc * SI443X_AFC_STEP * (priv->hbsel + 1);
+
+	if (dev->fixpklen != 0 && hdrlen) {
+		DBG_PRINTF(DBG_LVL_MID, "hdr: ");
+		DBG_HEXDUMP(DBG_LVL_MID, buf, hdrlen);
+	}
 	DBG_HEXDUMP(DBG_LVL_MID, &buf[hdrlen], pktlen);
 	DBG_EXEC(DBG_LVL_HIGH, _dump_status(dev));
 
-	// Check FIFO over/underflow condition
-	TRY(spi_read_reg(dev->fd, DEVICE_STATUS, &val));
 	if (val & (DEVICE_STATUS_FFOVFL |
 			DEVICE_STATUS_FFUNFL)) {
 		fprintf(stderr, "ERROR: Device "
 			"overflow/underflow (%.2x)\n", val);
+		rf_stat_add(dev, (val & DEVICE_STATUS_FFOVFL) ?
+				RF_STAT_FIFO_OVERRUNS : RF_STAT_FIFO_UNDERFLOWS,
+			    1);
 		goto recover;
 	}
 
-	// Add to ring buffer
-	if (ring_buf_bytes_free(rx_buf) >= hdrlen + pktlen) {
-		ring_buf_add(rx_buf, buf, hdrlen + pktlen);
+	// Local CRC check
+	drop = false;
+	if (dev->sw_crc != NULL) {
+		if (! crc16_check_frame(dev->sw_crc, &buf[hdrlen], pktlen)) {
+			drop = true;
+		} else {
+			// Strip CRC
+			pktlen -= 2;
+			if (dev->fixpklen == 0) {
+				buf[hdrlen - 1] = pktlen;
+			}
+			pkt->meta.flags |= PKT_FLAG_CRC_OK;
+		}
+	}
+	pkt->meta.len = hdrlen + pktlen;
+
+	// Add to packet buffer
+	if (!drop && pkt != &overflow_pkt) {
+		LAT_EXEC(*pkt_buf_stamp(rx_buf, pkt) = dev->lat_fifo_ns);
+		pkt_buf_commit(rx_buf);
+		rf_stat_add(dev, RF_STAT_RX_PACKETS, 1);
+		rf_stat_add(dev, RF_STAT_RX_BYTES, pkt->meta.len);
 	} else {
-		DBG_PRINTF(DBG_LVL_LOW, "Dropping packet: RX buffer overflow\n");
+		DBG_PRINTF(DBG_LVL_LOW, "Dropping packet: %s\n", drop ? "CRC error" : "RX buffer overflow");
+		rf_stat_add(dev, drop ? RF_STAT_CRC_ERRORS :
+				RF_STAT_RX_OVERFLOWS, 1);
 	}
 
 	return ERR_OK;
 
 recover:
+	*dev_status = DEVICE_STATUS_RXFFEM;
 	TRY(_reset_rx_fifo(dev));
 	return ERR_OK;
 
@@ -187,19 +532,200 @@ fail:
 	return err;
 }
 
+/**
+ * Start transmission of next frame
+ *
+ * The header, length and first part of the payload are written and TX mode
+ * is entered in a single SPI transaction. The rest of the payload is
+ * streamed into the FIFO by _tx_continue().
+ *
+ * Frames have the same layout as received frames: header bytes, then the
+ * length byte if using variable length packets, then the payload.
+ */
+static int _tx_start(rf_dev_t *dev, pkt_buf_t *tx_buf)
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	spi_batch_t batch;
+	const pkt_t *pkt;
+	uint64_t now;
+	size_t hdrlen;
+	size_t paylen;
+
+	now = rf_clock_ns();
+	if (now < priv->tx_deadline) {
+		// Inter frame gap
+		dev->next_service = priv->tx_deadline;
+		return ERR_OK;
+	}
+
+	while ((pkt = pkt_buf_peek(tx_buf)) != NULL) {
+		hdrlen = dev->hdrlen;
+		if (dev->fixpklen == 0) {
+			paylen = (pkt->meta.len > hdrlen) ?
+					pkt->data[hdrlen] : 0;
+			if (paylen != 0 && pkt->meta.len == hdrlen + 1 + paylen) {
+				break;
+			}
+		} else {
+			paylen = dev->fixpklen;
+			if (pkt->meta.len == hdrlen + paylen) {
+				break;
+			}
+		}
+		fprintf(stderr, "ERROR: Invalid TX frame length(%u), dropping\n",
+			pkt->meta.len);
+		rf_stat_add(dev, RF_STAT_LEN_ERRORS, 1);
+		pkt_buf_pop(tx_buf);
+	}
+	if (pkt == NULL) {
+		return ERR_OK;
+	}
+
+	priv->tx_pkt = pkt;
+	priv->tx_payload = &pkt->data[pkt->meta.len - paylen];
+	priv->tx_len = paylen;
+	priv->tx_off = (paylen < SI443X_FIFO_SIZE) ? paylen : SI443X_FIFO_SIZE;
+	priv->tx_deadline = now + SI443X_TX_TIMEOUT_NS;
+
+	spi_batch_init(&batch);
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+				SI443X_MODE_READY));
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_2,
+				SI443X_CTRL2 |
+				OPERATING_MODE_AND_FUNCTION_CONTROL_2_FFCTRTX));
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_2,
+				SI443X_CTRL2));
+	if (hdrlen != 0) {
+		TRY(spi_batch_write(&batch, TRANSMIT_HEADER_3, pkt->data,
+				    hdrlen));
+	}
+	if (dev->fixpklen == 0) {
+		TRY(spi_batch_write_reg(&batch, TRANSMIT_PACKET_LENGTH,
+					paylen));
+	}
+	TRY(spi_batch_write(&batch, FIFO_ACCESS, priv->tx_payload,
+			    priv->tx_off));
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+				SI443X_MODE_TX));
+	TRY(spi_batch_submit(dev->fd, &batch));
+
+	DBG_PRINTF(DBG_LVL_LOW, "> Transmitting packet (%zu bytes)\n", paylen);
+	rf_stat_add(dev, RF_STAT_TX_PACKETS, 1);
+	rf_stat_add(dev, RF_STAT_TX_BYTES, pkt->meta.len);
+	dev->next_service = now + SI443X_TX_POLL_NS;
+
+	return ERR_OK;
+fail:
+	priv->tx_pkt = NULL;
+	return err;
+}
+
+/**
+ * Continue transmission
+ *
+ * Refills the FIFO when it's almost empty, and returns to RX mode once the
+ * packet is sent.
+ *
+ * @param dev		Device object
+ * @param tx_buf	Frames to transmit, tx_pkt is the oldest frame
+ * @param status	DEVICE_STATUS and INTERRUPT_STATUS_1/2 of this pass
+ */
+static int _tx_continue(rf_dev_t *dev, pkt_buf_t *tx_buf,
+			const uint8_t status[3])
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	uint64_t now;
+	size_t len;
+
+	now = rf_clock_ns();
+
+	if (status[1] & INTERRUPT_STATUS_1_IPKSENT) {
+		// Chip returns to ready mode after sending
+		TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+				       SI443X_MODE_RX));
+		pkt_buf_pop(tx_buf);
+		priv->tx_pkt = NULL;
+		priv->tx_deadline = now + (uint64_t) dev->tx_gap * 1000;
+		return ERR_OK;
+	}
+
+	if (status[0] & DEVICE_STATUS_FFUNFL) {
+		fprintf(stderr, "ERROR: TX FIFO underflow\n");
+		rf_stat_add(dev, RF_STAT_FIFO_UNDERFLOWS, 1);
+		return _tx_abort(dev, tx_buf);
+	}
+	if (now >= priv->tx_deadline) {
+		fprintf(stderr, "ERROR: TX timeout\n");
+		rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
+		return _tx_abort(dev, tx_buf);
+	}
+
+	if (priv->tx_off < priv->tx_len &&
+			(status[1] & INTERRUPT_STATUS_1_ITXFFAEM)) {
+		len = priv->tx_len - priv->tx_off;
+		if (len > SI443X_FIFO_SIZE - SI443X_TX_AEMPTY_THRESHOLD) {
+			len = SI443X_FIFO_SIZE - SI443X_TX_AEMPTY_THRESHOLD;
+		}
+		TRY(spi_write_regs(dev->fd, FIFO_ACCESS,
+				   &priv->tx_payload[priv->tx_off], len));
+		priv->tx_off += len;
+	}
+
+	dev->next_service = now + SI443X_TX_POLL_NS;
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
+/**
+ * Drop frame being transmitted and return to RX mode
+ */
+static int _tx_abort(rf_dev_t *dev, pkt_buf_t *tx_buf)
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	spi_batch_t batch;
+
+	pkt_buf_pop(tx_buf);
+	priv->tx_pkt = NULL;
+	priv->tx_deadline = 0;
+
+	spi_batch_init(&batch);
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+				SI443X_MODE_READY));
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_2,
+				SI443X_CTRL2 |
+				OPERATING_MODE_AND_FUNCTION_CONTROL_2_FFCTRTX));
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_2,
+				SI443X_CTRL2));
+	TRY(spi_batch_write_reg(&batch, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+				SI443X_MODE_RX));
+	TRY(spi_batch_submit(dev->fd, &batch));
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
 static int _reset(rf_dev_t *dev)
 {
 	int err = ERR_UNSPEC;
-	uint8_t val;
 
 	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
 			       OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON |
 			       OPERATING_MODE_AND_FUNCTION_CONTROL_1_SWRES));
 
-	do {
-		//TODO: add timeout
-		TRY(spi_read_reg(dev->fd, INTERRUPT_STATUS_2, &val));
-	} while ((val & INTERRUPT_STATUS_2_ICHIPRDY) == 0);
+	err = rf_poll_reg(dev, RF_POLL_RESET, INTERRUPT_STATUS_2,
+			  INTERRUPT_STATUS_2_ICHIPRDY,
+			  INTERRUPT_STATUS_2_ICHIPRDY,
+			  SI443X_RESET_TIMEOUT_US, NULL);
+	if (err == ERR_RFM_TIMEOUT) {
+		fprintf(stderr, "ERROR: Timeout waiting for chip ready\n");
+	}
+	TRY(err);
 
 	return ERR_OK;
 fail:
@@ -212,6 +738,7 @@ static int _reset_rx_fifo(rf_dev_t *dev)
 	uint8_t ctrl[2];
 
 	DBG_PRINTF(DBG_LVL_HIGH, "resetting RX fifo\n");
+	rf_stat_add(dev, RF_STAT_FIFO_RESETS, 1);
 
 	// Get current control values
 	TRY(spi_read_regs(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
@@ -245,20 +772,69 @@ fail:
 	return err;
 }
 
+static int _retune(rf_dev_t *dev, uint32_t freq)
+{
+	si443x_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	uint8_t hbsel;
+	uint32_t band;
+	uint32_t fc;
+	uint8_t regs[3];
+	size_t i;
+
+	if (freq < SI443X_FREQ_MIN || freq > SI443X_FREQ_MAX) {
+		return ERR_RANGE;
+	}
+
+	// f = 10 MHz * (hbsel + 1) * (fb + 24 + fc / 64000)
+	hbsel = (freq >= SI443X_FREQ_HBSEL) ? 1 : 0;
+	band = SI443X_FREQ_BAND * (hbsel + 1);
+	fc = (uint64_t) (freq % band) * 64000 / band;
+
+	TRY(rf_read_cfg_reg(dev, FREQUENCY_BAND_SELECT, &regs[0]));
+	regs[0] = (regs[0] & FREQUENCY_BAND_SELECT_SBSEL) |
+		  (hbsel ? FREQUENCY_BAND_SELECT_HBSEL : 0) |
+		  ((freq / band - 24) & FREQUENCY_BAND_SELECT_FB);
+	regs[1] = fc >> 8;
+	regs[2] = fc & 0xff;
+
+	// The synthesizer is tuned when entering RX mode. Frames in the FIFO
+	// were already drained, and no sync word was detected.
+	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+			       SI443X_MODE_READY));
+	TRY(spi_write_regs(dev->fd, FREQUENCY_BAND_SELECT, regs, sizeof(regs)));
+	TRY(spi_write_reg(dev->fd, OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+			       SI443X_MODE_RX));
+
+	for (i = 0; i < sizeof(regs); i++) {
+		sparse_buf_write(&dev->shadow, FREQUENCY_BAND_SELECT + i,
+				 regs[i]);
+	}
+	priv->hbsel = hbsel;
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
 static int _sync_config(rf_dev_t *dev)
 {
+	si443x_priv_t *priv = dev->priv;
 	int err = ERR_UNSPEC;
 	uint8_t val;
 
-	TRY(spi_read_reg(dev->fd, HEADER_CONTROL_2, &val));
+	TRY(rf_read_cfg_reg(dev, HEADER_CONTROL_2, &val));
 
-	dev->txhdlen = (val >> HEADER_CONTROL_2_HDLEN_SHIFT) & HEADER_CONTROL_2_HDLEN_MASK;
+	dev->hdrlen = (val >> HEADER_CONTROL_2_HDLEN_SHIFT) & HEADER_CONTROL_2_HDLEN_MASK;
 	if ((val & HEADER_CONTROL_2_FIXPKLEN)) {
-		TRY(spi_read_reg(dev->fd, TRANSMIT_PACKET_LENGTH, &dev->fixpklen));
+		TRY(rf_read_cfg_reg(dev, TRANSMIT_PACKET_LENGTH, &dev->fixpklen));
 	} else {
 		dev->fixpklen = 0;
 	}
 
+	TRY(rf_read_cfg_reg(dev, FREQUENCY_BAND_SELECT, &val));
+	priv->hbsel = (val & FREQUENCY_BAND_SELECT_HBSEL) ? 1 : 0;
+
 	return ERR_OK;
 fail:
 	return err;
@@ -268,10 +844,10 @@ static int _configure(rf_dev_t *dev, sparse_buf_t *regs)
 {
 	int err = ERR_UNSPEC;
 	size_t off = 0;
+	size_t len;
 
-	while ((off = sparse_buf_next_valid(regs, off))
-			!= SPARSE_BUF_OFF_END) {
-		const size_t len = sparse_buf_valid_length(regs, off);
+	// Write every run of configured registers in a single burst
+	while (sparse_buf_next_run(regs, &off, &len)) {
 		const uint8_t *startp = sparse_buf_at(regs, off);
 
 		if (startp == NULL) {
@@ -282,6 +858,7 @@ static int _configure(rf_dev_t *dev, sparse_buf_t *regs)
 
 		off += len;
 	}
+	TRY(rf_shadow_update(dev, regs));
 
 	TRY(_sync_config(dev));
 
@@ -207,6 +207,12 @@ enum {
 	HEADER_CONTROL_2_SKIPSYN	= 0x80,
 };
 
+enum {
+	FREQUENCY_BAND_SELECT_FB	= 0x1f,
+	FREQUENCY_BAND_SELECT_HBSEL	= 0x20,
+	FREQUENCY_BAND_SELECT_SBSEL	= 0x40,
+};
+
 /*
 enum RFM22B_Modulation_Type {
 	UNMODULATED_CARRIER                         = 0x00,
@@ -43,7 +43,7 @@
 static inline void sparse_buf_make_valid(sparse_buf_t *obj, size_t off)
 {
 	const size_t idx = off / UINT_BIT_CNT;
-	const unsigned int mask = 1 << (off % UINT_BIT_CNT);
+	const unsigned int mask = 1U << (off % UINT_BIT_CNT);
 
 	if (off >= obj->size) {
 		return;
@@ -98,37 +98,71 @@ int sparse_buf_write(sparse_buf_t *obj, size_t off, uint8_t val)
 	return 0;
 }
 
-size_t sparse_buf_next_valid(const sparse_buf_t *obj, size_t off)
+/**
+ * Find first byte at or after 'off' with the given validity
+ *
+ * Scans the bitmap a word at a time, so runs of invalid bytes(when searching
+ * a valid byte) or valid bytes(when searching an invalid byte) are skipped
+ * without testing every bit.
+ *
+ * @returns	Offset of byte, or the buffer size if there is none
+ */
+static size_t _scan(const sparse_buf_t *obj, size_t off, bool valid)
 {
-	while (off < obj->size) {
-		if (sparse_buf_is_valid(obj, off))
-			return off;
-		off++;
+	const size_t words = (obj->size + UINT_BIT_CNT - 1) / UINT_BIT_CNT;
+	size_t idx;
+	unsigned int w;
+
+	if (off >= obj->size) {
+		return obj->size;
+	}
+
+	idx = off / UINT_BIT_CNT;
+	w = valid ? obj->valid[idx] : ~obj->valid[idx];
+	w &= ~0U << (off % UINT_BIT_CNT);
+	while (w == 0) {
+		if (++idx >= words) {
+			return obj->size;
+		}
+		w = valid ? obj->valid[idx] : ~obj->valid[idx];
 	}
 
-	return SPARSE_BUF_OFF_END;
+	// Padding bits after the end are never valid
+	off = idx * UINT_BIT_CNT + __builtin_ctz(w);
+	return (off < obj->size) ? off : obj->size;
 }
 
-size_t sparse_buf_next_invalid(const sparse_buf_t *obj, size_t off)
+size_t sparse_buf_next_valid(const sparse_buf_t *obj, size_t off)
 {
-	while (off < obj->size) {
-		if (! sparse_buf_is_valid(obj, off))
-			return off;
-		off++;
-	}
+	off = _scan(obj, off, true);
+	return (off < obj->size) ? off : SPARSE_BUF_OFF_END;
+}
 
-	return SPARSE_BUF_OFF_END;
+size_t sparse_buf_next_invalid(const sparse_buf_t *obj, size_t off)
+{
+	off = _scan(obj, off, false);
+	return (off < obj->size) ? off : SPARSE_BUF_OFF_END;
 }
 
 size_t sparse_buf_valid_length(const sparse_buf_t *obj, size_t off)
 {
-	int retval = 0;
-	while (off < obj->size) {
-		if (! sparse_buf_is_valid(obj, off))
-			return retval;
-		off++;
-		retval++;
+	if (off >= obj->size) {
+		return 0;
+	}
+	return _scan(obj, off, false) - off;
+}
+
+bool sparse_buf_next_run(const sparse_buf_t *obj, size_t *off, size_t *len)
+{
+	const size_t start = _scan(obj, *off, true);
+
+	if (start >= obj->size) {
+		*off = SPARSE_BUF_OFF_END;
+		*len = 0;
+		return false;
 	}
 
-	return retval;
+	*off = start;
+	*len = _scan(obj, start, false) - start;
+	return true;
 }
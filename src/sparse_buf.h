@@ -115,6 +115,26 @@ size_t sparse_buf_next_invalid(const sparse_buf_t *obj, size_t off);
  */
 size_t sparse_buf_valid_length(const sparse_buf_t *obj, size_t off);
 
+/**
+ * Find next run of sequential valid bytes
+ *
+ * Iterate over all runs with:
+ *
+ *     size_t off = 0, len;
+ *     while (sparse_buf_next_run(obj, &off, &len)) {
+ *         ...
+ *         off += len;
+ *     }
+ *
+ * @param obj	Buffer object
+ * @param off	Offset to start searching at, set to offset of run on return
+ *		(or SPARSE_BUF_OFF_END if there is none)
+ * @param len	Pointer to store length of run in
+ *
+ * @returns	True if a run was found, false at the end of the buffer
+ */
+bool sparse_buf_next_run(const sparse_buf_t *obj, size_t *off, size_t *len);
+
 
 /*************** Static function implementations ***********************/
 
@@ -141,7 +161,7 @@ static inline bool sparse_buf_is_valid(const sparse_buf_t *obj, size_t off)
 {
 	if (off < obj->size) {
 		const size_t idx = off / UINT_BIT_CNT;
-		const unsigned int mask = 1 << (off % UINT_BIT_CNT);
+		const unsigned int mask = 1U << (off % UINT_BIT_CNT);
 		return (obj->valid[idx] & mask) != 0;
 	}
 	return false;
@@ -33,6 +33,8 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 
@@ -40,6 +42,146 @@
 #include "error.h"
 #include "debug.h"
 
+static spi_stats_t spi_stats;
+
+/**
+ * Devices of which the messages are executed by a hook function
+ */
+static struct {
+	int fd;
+	spi_hook_fn_t fn;
+	void *ctx;
+} spi_hooks[SPI_HOOK_MAX];
+static unsigned int spi_hook_cnt;
+
+/**
+ * Devices with link settings
+ */
+static struct {
+	int fd;
+	int fifo_addr;
+	uint32_t speed_hz;
+	uint32_t fifo_speed_hz;
+} spi_configs[SPI_CONFIG_MAX];
+static unsigned int spi_config_cnt;
+
+/**
+ * Trace file, or NULL if not recording
+ */
+static FILE *spi_trace;
+static pthread_mutex_t spi_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Account SPI transfer
+ *
+ * @param len	Amount of bytes transferred
+ */
+static inline void _spi_count(size_t len)
+{
+	__atomic_fetch_add(&spi_stats.transfers, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&spi_stats.bytes, len, __ATOMIC_RELAXED);
+}
+
+/**
+ * Append accesses of SPI message to trace file
+ */
+static void _spi_trace(int fd, const struct spi_ioc_transfer *xfer,
+		       unsigned int cnt)
+{
+	spi_trace_rec_t rec;
+	struct timespec ts;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	memset(&rec, 0, sizeof(rec));
+	rec.timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	rec.dev = fd;
+
+	pthread_mutex_lock(&spi_trace_lock);
+	for (i = 0; i + 1 < cnt; i += 2) {
+		const uint8_t *data = (const uint8_t *)(uintptr_t)
+			(xfer[i + 1].tx_buf ? xfer[i + 1].tx_buf :
+			 xfer[i + 1].rx_buf);
+
+		rec.addr = *(const uint8_t *)(uintptr_t) xfer[i].tx_buf;
+		rec.len = xfer[i + 1].len;
+		fwrite(&rec, sizeof(rec), 1, spi_trace);
+		fwrite(data, 1, rec.len, spi_trace);
+	}
+	pthread_mutex_unlock(&spi_trace_lock);
+}
+
+/**
+ * Set clock and word size of transfers of SPI message
+ */
+static void _spi_setup(int fd, struct spi_ioc_transfer *xfer,
+		       unsigned int cnt)
+{
+	unsigned int i;
+	uint32_t speed;
+
+	for (i = 0; i < spi_config_cnt; i++) {
+		if (spi_configs[i].fd == fd) {
+			break;
+		}
+	}
+	if (i == spi_config_cnt) {
+		return;
+	}
+
+	for (; cnt >= 2; cnt -= 2, xfer += 2) {
+		const uint8_t addr = *(const uint8_t *)(uintptr_t) xfer[0].tx_buf;
+
+		speed = spi_configs[i].speed_hz;
+		if ((addr & 0x7f) == spi_configs[i].fifo_addr) {
+			speed = spi_configs[i].fifo_speed_hz;
+		}
+		xfer[0].speed_hz = speed;
+		xfer[1].speed_hz = speed;
+		xfer[0].bits_per_word = 8;
+		xfer[1].bits_per_word = 8;
+	}
+}
+
+/**
+ * Execute SPI message, by the hook of the device if set
+ *
+ * @param fd	File descriptor of SPI device
+ * @param xfer	Transfers of message
+ * @param cnt	Amount of transfers
+ *
+ * @returns	0 on success
+ */
+static int _spi_message(int fd, struct spi_ioc_transfer *xfer,
+			unsigned int cnt)
+{
+	unsigned int i;
+	int err;
+
+	_spi_setup(fd, xfer, cnt);
+
+	for (i = 0; i < spi_hook_cnt; i++) {
+		if (spi_hooks[i].fd == fd) {
+			break;
+		}
+	}
+	if (i < spi_hook_cnt) {
+		err = spi_hooks[i].fn(spi_hooks[i].ctx, xfer, cnt);
+	} else {
+		err = ioctl(fd, SPI_IOC_MESSAGE(cnt), xfer);
+	}
+	if (err < 0) {
+		perror("SPI_IOC_MESSAGE");
+		return ERR_SPI_IOCTL;
+	}
+
+	if (spi_trace != NULL) {
+		_spi_trace(fd, xfer, cnt);
+	}
+
+	return ERR_OK;
+}
+
 /**
  * Execute a SPI transfer
  *
@@ -82,11 +224,11 @@ static int _spi_transfer(int fd, bool do_write, uint8_t addr,
 	}
 	xfer[1].len = len;
 
-	err = ioctl(fd, SPI_IOC_MESSAGE(2), xfer);
-	if (err < 0) {
-		perror("SPI_IOC_MESSAGE");
-		return ERR_SPI_IOCTL;
+	err = _spi_message(fd, xfer, 2);
+	if (err != ERR_OK) {
+		return err;
 	}
+	_spi_count(1 + len);
 
 	DBG_PRINTF(DBG_LVL_EXTREEM, "SPI %s @ 0x%02x:\n", do_write ? "WRITE" : "READ", addr & 0x7f);
 	DBG_HEXDUMP(DBG_LVL_EXTREEM, data, len);
@@ -114,3 +256,248 @@ int spi_write_regs(int fd, uint8_t addr,
 {
 	return _spi_transfer(fd, true, addr, (uint8_t *) data, len);
 }
+
+void spi_batch_init(spi_batch_t *batch)
+{
+	batch->cnt = 0;
+	memset(batch->xfer, 0, sizeof(batch->xfer));
+}
+
+/**
+ * Queue access
+ *
+ * @param batch		Batch to add access to
+ * @param do_write	If True, queue a write operation. Else read.
+ * @param addr		Register address at which to start operation
+ * @param data		Buffer containing data to write or to store read data
+ * @param len		Amount of bytes to read/write
+ *
+ * @returns	0 on success
+ */
+static int _spi_batch_add(spi_batch_t *batch, bool do_write, uint8_t addr,
+				uint8_t *data, size_t len)
+{
+	struct spi_ioc_transfer *xfer;
+
+	if (addr & 0x80) {
+		return ERR_INVAL;
+	}
+	if (batch->cnt >= SPI_BATCH_MAX_OPS) {
+		return ERR_RANGE;
+	}
+
+	xfer = &batch->xfer[batch->cnt * 2];
+
+	// Release chip select after previous access
+	if (batch->cnt > 0) {
+		xfer[-1].cs_change = 1;
+	}
+
+	if (do_write) {
+		addr |= 0x80;
+	}
+	batch->addr[batch->cnt] = addr;
+
+	// Send (rw // addr)
+	xfer[0].tx_buf = (unsigned long) &batch->addr[batch->cnt];
+	xfer[0].len = 1;
+
+	// Read/write data
+	if (do_write) {
+		xfer[1].tx_buf = (unsigned long) data;
+	} else {
+		xfer[1].rx_buf = (unsigned long) data;
+	}
+	xfer[1].len = len;
+
+	batch->cnt++;
+
+	return ERR_OK;
+}
+
+int spi_batch_read(spi_batch_t *batch, uint8_t addr, uint8_t *data,
+		   size_t len)
+{
+	return _spi_batch_add(batch, false, addr, data, len);
+}
+
+int spi_batch_write(spi_batch_t *batch, uint8_t addr, const uint8_t *data,
+		    size_t len)
+{
+	return _spi_batch_add(batch, true, addr, (uint8_t *) data, len);
+}
+
+int spi_batch_write_reg(spi_batch_t *batch, uint8_t addr, uint8_t data)
+{
+	if (batch->cnt >= SPI_BATCH_MAX_OPS) {
+		return ERR_RANGE;
+	}
+
+	batch->val[batch->cnt] = data;
+	return _spi_batch_add(batch, true, addr, &batch->val[batch->cnt], 1);
+}
+
+int spi_batch_submit(int fd, spi_batch_t *batch)
+{
+	unsigned int i;
+	size_t len;
+	int err;
+
+	if (batch->cnt == 0) {
+		return ERR_OK;
+	}
+
+	err = _spi_message(fd, batch->xfer, batch->cnt * 2);
+	if (err != ERR_OK) {
+		spi_batch_init(batch);
+		return err;
+	}
+
+	len = 0;
+	for (i = 0; i < batch->cnt; i++) {
+		const struct spi_ioc_transfer *xfer = &batch->xfer[i * 2 + 1];
+		const uint8_t *data = (const uint8_t *)(uintptr_t)
+			(xfer->tx_buf ? xfer->tx_buf : xfer->rx_buf);
+
+		len += 1 + xfer->len;
+
+		DBG_PRINTF(DBG_LVL_EXTREEM, "SPI %s @ 0x%02x:\n",
+			   (batch->addr[i] & 0x80) ? "WRITE" : "READ",
+			   batch->addr[i] & 0x7f);
+		DBG_HEXDUMP(DBG_LVL_EXTREEM, data, xfer->len);
+	}
+
+	_spi_count(len);
+
+	memset(batch->xfer, 0, batch->cnt * 2 * sizeof(batch->xfer[0]));
+	batch->cnt = 0;
+
+	return ERR_OK;
+}
+
+void spi_get_stats(spi_stats_t *stats)
+{
+	stats->transfers = __atomic_load_n(&spi_stats.transfers,
+					   __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&spi_stats.bytes, __ATOMIC_RELAXED);
+}
+
+int spi_set_hook(int fd, spi_hook_fn_t fn, void *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < spi_hook_cnt; i++) {
+		if (spi_hooks[i].fd == fd) {
+			break;
+		}
+	}
+
+	if (fn == NULL) {
+		if (i < spi_hook_cnt) {
+			spi_hooks[i] = spi_hooks[--spi_hook_cnt];
+		}
+		return ERR_OK;
+	}
+
+	if (i == spi_hook_cnt) {
+		if (spi_hook_cnt >= SPI_HOOK_MAX) {
+			return ERR_RANGE;
+		}
+		spi_hook_cnt++;
+	}
+	spi_hooks[i].fd = fd;
+	spi_hooks[i].fn = fn;
+	spi_hooks[i].ctx = ctx;
+
+	return ERR_OK;
+}
+
+int spi_configure(int fd, const spi_config_t *cfg, int fifo_addr)
+{
+	unsigned int i;
+	uint32_t speed;
+	uint32_t max_speed;
+	uint8_t mode;
+	uint8_t bits = 8;
+
+	for (i = 0; i < spi_config_cnt; i++) {
+		if (spi_configs[i].fd == fd) {
+			break;
+		}
+	}
+
+	if (cfg == NULL) {
+		if (i < spi_config_cnt) {
+			spi_configs[i] = spi_configs[--spi_config_cnt];
+		}
+		return ERR_OK;
+	}
+
+	if (i == spi_config_cnt && spi_config_cnt >= SPI_CONFIG_MAX) {
+		return ERR_RANGE;
+	}
+
+	speed = cfg->speed_hz;
+	max_speed = (cfg->fifo_speed_hz > speed) ? cfg->fifo_speed_hz : speed;
+
+	// Simulated devices have no driver to program
+	for (i = 0; i < spi_hook_cnt && spi_hooks[i].fd != fd; i++);
+	if (i == spi_hook_cnt) {
+		// Keep register accesses at the driver default clock
+		if (speed == 0 && max_speed != 0 &&
+		    ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed) == -1) {
+			return ERR_SPI_IOCTL;
+		}
+		if (cfg->mode >= 0) {
+			mode = cfg->mode;
+			if (ioctl(fd, SPI_IOC_WR_MODE, &mode) == -1) {
+				return ERR_SPI_IOCTL;
+			}
+		}
+		if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) == -1) {
+			return ERR_SPI_IOCTL;
+		}
+		// Transfers can't be clocked faster than the device maximum
+		if (max_speed != 0 &&
+		    ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &max_speed) == -1) {
+			return ERR_SPI_IOCTL;
+		}
+	}
+
+	for (i = 0; i < spi_config_cnt && spi_configs[i].fd != fd; i++);
+	if (i == spi_config_cnt) {
+		spi_config_cnt++;
+	}
+	spi_configs[i].fd = fd;
+	spi_configs[i].fifo_addr = fifo_addr;
+	spi_configs[i].speed_hz = speed;
+	spi_configs[i].fifo_speed_hz = cfg->fifo_speed_hz ?
+				       cfg->fifo_speed_hz : speed;
+
+	return ERR_OK;
+}
+
+int spi_trace_open(const char *path)
+{
+	spi_trace_close();
+
+	spi_trace = fopen(path, "w");
+	if (spi_trace == NULL) {
+		return -1;
+	}
+	if (fwrite(SPI_TRACE_MAGIC, strlen(SPI_TRACE_MAGIC), 1, spi_trace) != 1) {
+		SAVE_ERRNO(fclose(spi_trace));
+		spi_trace = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void spi_trace_close(void)
+{
+	if (spi_trace != NULL) {
+		fclose(spi_trace);
+		spi_trace = NULL;
+	}
+}
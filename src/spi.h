@@ -29,6 +29,95 @@
 #ifndef __SPI_H__
 #define __SPI_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/spi/spidev.h>
+
+/**
+ * Maximum amount of register accesses in a single SPI batch
+ */
+#define SPI_BATCH_MAX_OPS 8
+
+/**
+ * Batch of register accesses
+ *
+ * Queues multiple register reads/writes which are then executed using a
+ * single SPI_IOC_MESSAGE ioctl. Chip select is toggled between the
+ * individual accesses.
+ */
+typedef struct {
+	unsigned int cnt;			/**< Amount of queued
+						     accesses */
+	uint8_t addr[SPI_BATCH_MAX_OPS];	/**< (rw // addr) bytes */
+	uint8_t val[SPI_BATCH_MAX_OPS];		/**< Storage for single byte
+						     writes */
+	struct spi_ioc_transfer xfer[SPI_BATCH_MAX_OPS * 2];
+} spi_batch_t;
+
+/**
+ * SPI transfer counters, of all devices
+ */
+typedef struct {
+	uint64_t transfers;	/**< SPI_IOC_MESSAGE ioctls */
+	uint64_t bytes;		/**< Bytes transferred, incl. address bytes */
+} spi_stats_t;
+
+/**
+ * SPI link settings of a device
+ */
+typedef struct {
+	uint32_t speed_hz;	/**< Clock of register accesses, 0 for the
+				     driver default */
+	uint32_t fifo_speed_hz;	/**< Clock of FIFO accesses, 0 to use
+				     speed_hz */
+	int mode;		/**< SPI mode(0-3), -1 for the driver default */
+} spi_config_t;
+
+/**
+ * Maximum amount of devices with link settings, see spi_configure()
+ */
+#define SPI_CONFIG_MAX 4
+
+/**
+ * Maximum amount of devices with a hook, see spi_set_hook()
+ */
+#define SPI_HOOK_MAX 4
+
+/**
+ * Function executing SPI messages instead of the SPI driver
+ *
+ * Every access of the message consists of two transfers: the (rw // addr)
+ * byte, followed by the data.
+ *
+ * @param ctx	Context passed to spi_set_hook()
+ * @param xfer	Transfers of message
+ * @param cnt	Amount of transfers
+ *
+ * @returns	>= 0 on success, -1 with errno set on error
+ */
+typedef int (*spi_hook_fn_t)(void *ctx, struct spi_ioc_transfer *xfer,
+			     unsigned int cnt);
+
+/**
+ * Magic at start of SPI trace file
+ */
+#define SPI_TRACE_MAGIC "RFSPITR1"
+
+/**
+ * Record header of SPI trace file
+ *
+ * A record is written for every register access, after the access completed.
+ * The header is followed by the len data bytes, which are the read data for
+ * read accesses. All fields are in host byte order.
+ */
+typedef struct {
+	uint64_t timestamp;	/**< Time of access in ns (CLOCK_MONOTONIC) */
+	uint16_t len;		/**< Amount of data bytes */
+	uint8_t addr;		/**< (rw // addr) byte */
+	uint8_t dev;		/**< File descriptor of device */
+	uint8_t reserved[4];
+} spi_trace_rec_t;
+
 /**
  * Read a single byte from SPI device
  *
@@ -75,4 +164,120 @@ int spi_write_reg(int fd, uint8_t addr, uint8_t data);
  */
 int spi_write_regs(int fd, uint8_t addr, const uint8_t *data, size_t len);
 
+/**
+ * Initialize/Clear an SPI batch
+ */
+void spi_batch_init(spi_batch_t *batch);
+
+/**
+ * Queue burst read
+ *
+ * The data buffer is only filled after spi_batch_submit() returns.
+ *
+ * @param batch	Batch to add access to
+ * @param addr	Address to start burst read
+ * @param data	Pointer to buffer to store read data
+ * @param len	Amount of bytes to read
+ *
+ * @returns	0 on success, ERR_RANGE if the batch is full
+ */
+int spi_batch_read(spi_batch_t *batch, uint8_t addr, uint8_t *data,
+		   size_t len);
+
+/**
+ * Queue burst write
+ *
+ * The data buffer must stay valid until spi_batch_submit() returns.
+ *
+ * @param batch	Batch to add access to
+ * @param addr	Address to start burst write
+ * @param data	Pointer to buffer containing data to write
+ * @param len	Amount of bytes to write
+ *
+ * @returns	0 on success, ERR_RANGE if the batch is full
+ */
+int spi_batch_write(spi_batch_t *batch, uint8_t addr, const uint8_t *data,
+		    size_t len);
+
+/**
+ * Queue single byte write
+ *
+ * @param batch	Batch to add access to
+ * @param addr	Target address to write
+ * @param data	value to write
+ *
+ * @returns	0 on success, ERR_RANGE if the batch is full
+ */
+int spi_batch_write_reg(spi_batch_t *batch, uint8_t addr, uint8_t data);
+
+/**
+ * Execute all queued accesses in a single SPI transaction
+ *
+ * The batch is cleared afterwards, also on failure.
+ *
+ * @param fd	File descriptor of SPI device
+ * @param batch	Batch to execute
+ *
+ * @returns	0 on success
+ */
+int spi_batch_submit(int fd, spi_batch_t *batch);
+
+/**
+ * Get SPI transfer counters
+ *
+ * Can be called from any thread.
+ */
+void spi_get_stats(spi_stats_t *stats);
+
+/**
+ * Execute SPI messages of a device by a function instead of the driver
+ *
+ * Hooks must be set before any other thread accesses SPI devices.
+ *
+ * @param fd	File descriptor of device
+ * @param fn	Function to execute messages, or NULL to remove hook
+ * @param ctx	Context passed to fn
+ *
+ * @returns	0 on success, ERR_RANGE if too many hooks are set
+ */
+int spi_set_hook(int fd, spi_hook_fn_t fn, void *ctx);
+
+/**
+ * Set SPI link settings of a device
+ *
+ * The mode and the highest clock are programmed into the SPI driver, and
+ * every transfer of the device is made at the clock of its access type.
+ * Accesses of fifo_addr use the FIFO clock, all others the register clock.
+ * For devices with a hook only the clocks of the transfers are set.
+ *
+ * Must be called before any other thread accesses the device.
+ *
+ * @param fd		File descriptor of device
+ * @param cfg		Link settings, or NULL to remove them
+ * @param fifo_addr	Address of FIFO register, or -1 if unknown
+ *
+ * @returns	0 on success, ERR_RANGE if too many devices have settings,
+ *		ERR_SPI_IOCTL with errno set if the driver rejected them
+ */
+int spi_configure(int fd, const spi_config_t *cfg, int fifo_addr);
+
+/**
+ * Start recording all SPI accesses to a trace file
+ *
+ * Must be called before any other thread accesses SPI devices. The accesses
+ * of all devices are recorded, see spi_trace_rec_t for the format.
+ *
+ * @param path	Path of trace file, truncated if it exists
+ *
+ * @returns	0 on success, -1 with errno set on error
+ */
+int spi_trace_open(const char *path);
+
+/**
+ * Stop recording SPI accesses and close trace file
+ *
+ * Must only be called when no other thread accesses SPI devices.
+ */
+void spi_trace_close(void);
+
 #endif // __SPI_H__
@@ -0,0 +1,1009 @@
+/**
+ * spi_sim.c - Simulated SPI transceivers
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE // for pipe2()
+#include "spi_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "spi.h"
+#include "error.h"
+#include "si443x_enums.h"
+#include "sx1231_enums.h"
+
+#define SPI_SIM_DEFAULT_RATE 100
+#define SPI_SIM_DEFAULT_LEN 16
+
+/**
+ * Storage of emulated FIFO, must be at least the size of the largest FIFO
+ */
+#define SPI_SIM_FIFO_MAX 128
+
+/**
+ * Maximum time the simulator thread sleeps, bounds the time to stop it
+ */
+#define SPI_SIM_MAX_SLEEP_NS 10000000
+
+/**
+ * Poll interval of the simulator thread while waiting for the receiver
+ */
+#define SPI_SIM_START_POLL_NS 1000000
+
+typedef struct spi_sim spi_sim_t;
+
+/**
+ * Emulated transceiver chip
+ *
+ * All functions are called with the lock of the device held.
+ */
+typedef struct {
+	const char *name;
+	size_t fifo_size;
+	uint8_t fifo_addr;	/**< Register address without auto increment */
+	void (*reset)(spi_sim_t *s);
+	uint8_t (*read)(spi_sim_t *s, uint8_t addr);
+	void (*write)(spi_sim_t *s, uint8_t addr, uint8_t val);
+	bool (*rx_enabled)(spi_sim_t *s);
+	/** Payload length of fixed length packets, or 0 if variable */
+	size_t (*payload_len)(spi_sim_t *s);
+	/** Store received frame in FIFO */
+	void (*rx_frame)(spi_sim_t *s, const uint8_t *payload, size_t len);
+} spi_sim_model_t;
+
+typedef struct {
+	uint8_t data[SPI_SIM_FIFO_MAX];
+	size_t head;
+	size_t cnt;
+} spi_sim_fifo_t;
+
+struct spi_sim {
+	int fd;			/**< Placeholder file descriptor of device */
+	int irq_pipe[2];	/**< Emulated GPIO line request */
+	const spi_sim_model_t *model;	/**< Emulated chip, NULL if replaying */
+	pthread_mutex_t lock;
+
+	// Frame generation
+	uint64_t rate;
+	size_t len;
+	uint64_t count;
+	uint64_t delay_ns;
+	uint8_t seq;
+	pthread_t thread;
+	bool running;
+	int stop;
+	spi_sim_stats_t stats;
+
+	// Chip state
+	uint8_t regs[0x80];
+	spi_sim_fifo_t rx_fifo;	/**< RX FIFO, or shared FIFO of the SX1231 */
+	spi_sim_fifo_t tx_fifo;
+	uint8_t irq1;		/**< Latched interrupt status */
+	uint8_t irq2;
+	bool overflow;
+	bool underflow;
+	bool payload_ready;
+	bool packet_sent;
+	bool sending;
+	size_t tx_len;
+	size_t tx_sent;
+	uint64_t clock;		/**< Highest reliable SPI clock, 0 if any */
+
+	// Replay
+	FILE *trace;
+	int trace_dev;
+	uint64_t trace_recs;
+};
+
+static spi_sim_t *sims[SPI_SIM_MAX];
+
+static uint64_t _now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static spi_sim_t *_find(int fd)
+{
+	unsigned int i;
+
+	if (fd == -1) {
+		return NULL;
+	}
+	for (i = 0; i < SPI_SIM_MAX; i++) {
+		if (sims[i] != NULL && sims[i]->fd == fd) {
+			return sims[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Signal rising edge on emulated IRQ line
+ */
+static void _irq(spi_sim_t *s)
+{
+	struct gpio_v2_line_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.timestamp_ns = _now();
+	ev.id = GPIO_V2_LINE_EVENT_RISING_EDGE;
+
+	// If the pipe is full the line is already pending
+	if (write(s->irq_pipe[1], &ev, sizeof(ev)) != sizeof(ev)) {
+		return;
+	}
+}
+
+static bool _fifo_push(spi_sim_t *s, spi_sim_fifo_t *f, uint8_t val)
+{
+	if (f->cnt >= s->model->fifo_size) {
+		return false;
+	}
+	f->data[(f->head + f->cnt) % SPI_SIM_FIFO_MAX] = val;
+	f->cnt++;
+	return true;
+}
+
+static bool _fifo_pop(spi_sim_fifo_t *f, uint8_t *val)
+{
+	if (f->cnt == 0) {
+		return false;
+	}
+	*val = f->data[f->head];
+	f->head = (f->head + 1) % SPI_SIM_FIFO_MAX;
+	f->cnt--;
+	return true;
+}
+
+static void _fifo_clear(spi_sim_fifo_t *f)
+{
+	f->head = 0;
+	f->cnt = 0;
+}
+
+/**
+ * Clear FIFO's and transient state
+ */
+static void _clear(spi_sim_t *s)
+{
+	_fifo_clear(&s->rx_fifo);
+	_fifo_clear(&s->tx_fifo);
+	s->irq1 = 0;
+	s->irq2 = 0;
+	s->overflow = false;
+	s->underflow = false;
+	s->payload_ready = false;
+	s->packet_sent = false;
+	s->sending = false;
+}
+
+/************************* Si443x *******************************************/
+static void _si443x_tx(spi_sim_t *s)
+{
+	uint8_t val;
+
+	// Bytes are sent as soon as they are written
+	while (_fifo_pop(&s->tx_fifo, &val)) {
+		s->tx_sent++;
+	}
+
+	if (s->tx_sent >= s->regs[TRANSMIT_PACKET_LENGTH]) {
+		s->sending = false;
+		s->regs[OPERATING_MODE_AND_FUNCTION_CONTROL_1] &=
+			~OPERATING_MODE_AND_FUNCTION_CONTROL_1_TXON;
+		s->irq1 |= INTERRUPT_STATUS_1_IPKSENT;
+		s->stats.tx_frames++;
+	} else {
+		s->irq1 |= INTERRUPT_STATUS_1_ITXFFAEM;
+	}
+	_irq(s);
+}
+
+static void _si443x_reset(spi_sim_t *s)
+{
+	memset(s->regs, 0, sizeof(s->regs));
+	s->regs[DEVICE_TYPE] = DEVICE_TYPE_EZRADIOPRO;
+	s->regs[DEVICE_VERSION] = DEVICE_VERSION_SI443X_B1;
+	s->regs[OPERATING_MODE_AND_FUNCTION_CONTROL_1] =
+		OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON;
+	s->regs[RECEIVED_SIGNAL_STRENGTH_INDICATOR] = 0x80;
+	s->regs[HEADER_CONTROL_2] = 0x22;
+	s->regs[TX_FIFO_CONTROL_2] = 0x04;
+	s->regs[RX_FIFO_CONTROL] = 0x37;
+	_clear(s);
+	s->irq2 = INTERRUPT_STATUS_2_IPOR | INTERRUPT_STATUS_2_ICHIPRDY;
+}
+
+static uint8_t _si443x_read(spi_sim_t *s, uint8_t addr)
+{
+	uint8_t val;
+
+	switch (addr) {
+	case DEVICE_STATUS:
+		val = (s->rx_fifo.cnt == 0) ? DEVICE_STATUS_RXFFEM : 0;
+		if (s->overflow) {
+			val |= DEVICE_STATUS_FFOVFL;
+		}
+		if (s->underflow) {
+			val |= DEVICE_STATUS_FFUNFL;
+		}
+		break;
+	case INTERRUPT_STATUS_1:
+		val = s->irq1;
+		s->irq1 = 0;
+		break;
+	case INTERRUPT_STATUS_2:
+		val = s->irq2;
+		s->irq2 = 0;
+		break;
+	case FIFO_ACCESS:
+		if (! _fifo_pop(&s->rx_fifo, &val)) {
+			s->underflow = true;
+			val = 0;
+		}
+		break;
+	default:
+		val = s->regs[addr];
+		break;
+	}
+
+	return val;
+}
+
+static void _si443x_write(spi_sim_t *s, uint8_t addr, uint8_t val)
+{
+	switch (addr) {
+	case DEVICE_TYPE:
+	case DEVICE_VERSION:
+	case DEVICE_STATUS:
+	case INTERRUPT_STATUS_1:
+	case INTERRUPT_STATUS_2:
+		break;
+	case OPERATING_MODE_AND_FUNCTION_CONTROL_1:
+		if (val & OPERATING_MODE_AND_FUNCTION_CONTROL_1_SWRES) {
+			_si443x_reset(s);
+			break;
+		}
+		s->regs[addr] = val;
+		if ((val & OPERATING_MODE_AND_FUNCTION_CONTROL_1_TXON) &&
+				! s->sending) {
+			s->sending = true;
+			s->tx_sent = 0;
+			_si443x_tx(s);
+		}
+		break;
+	case OPERATING_MODE_AND_FUNCTION_CONTROL_2:
+		s->regs[addr] = val;
+		if (val & OPERATING_MODE_AND_FUNCTION_CONTROL_2_FFCLRRX) {
+			_fifo_clear(&s->rx_fifo);
+			s->overflow = false;
+			s->underflow = false;
+		}
+		if (val & OPERATING_MODE_AND_FUNCTION_CONTROL_2_FFCTRTX) {
+			_fifo_clear(&s->tx_fifo);
+		}
+		break;
+	case FIFO_ACCESS:
+		if (! _fifo_push(s, &s->tx_fifo, val)) {
+			s->overflow = true;
+		}
+		if (s->sending) {
+			_si443x_tx(s);
+		}
+		break;
+	default:
+		s->regs[addr] = val;
+		break;
+	}
+}
+
+static bool _si443x_rx_enabled(spi_sim_t *s)
+{
+	return (s->regs[OPERATING_MODE_AND_FUNCTION_CONTROL_1] &
+		OPERATING_MODE_AND_FUNCTION_CONTROL_1_RXON) && ! s->sending;
+}
+
+static size_t _si443x_payload_len(spi_sim_t *s)
+{
+	if (s->regs[HEADER_CONTROL_2] & HEADER_CONTROL_2_FIXPKLEN) {
+		return s->regs[TRANSMIT_PACKET_LENGTH];
+	}
+	return 0;
+}
+
+static void _si443x_rx_frame(spi_sim_t *s, const uint8_t *payload,
+			     size_t len)
+{
+	const uint8_t hc2 = s->regs[HEADER_CONTROL_2];
+	const bool fixed = (hc2 & HEADER_CONTROL_2_FIXPKLEN) != 0;
+	size_t hdrlen;
+	size_t i;
+
+	hdrlen = (hc2 >> HEADER_CONTROL_2_HDLEN_SHIFT) &
+		HEADER_CONTROL_2_HDLEN_MASK;
+	if (hdrlen + (fixed ? 0 : 1) + len >
+			s->model->fifo_size - s->rx_fifo.cnt) {
+		s->overflow = true;
+		s->stats.rx_dropped++;
+		return;
+	}
+
+	for (i = 0; i < hdrlen; i++) {
+		_fifo_push(s, &s->rx_fifo, 0);
+	}
+	if (! fixed) {
+		_fifo_push(s, &s->rx_fifo, len);
+	}
+	for (i = 0; i < len; i++) {
+		_fifo_push(s, &s->rx_fifo, payload[i]);
+	}
+
+	s->irq1 |= INTERRUPT_STATUS_1_IPKVALID;
+	if (s->rx_fifo.cnt > s->regs[RX_FIFO_CONTROL]) {
+		s->irq1 |= INTERRUPT_STATUS_1_IRXFFAFULL;
+	}
+	_irq(s);
+}
+
+static const spi_sim_model_t si443x_model = {
+	.name = "si443x",
+	.fifo_size = 64,
+	.fifo_addr = FIFO_ACCESS,
+	.reset = _si443x_reset,
+	.read = _si443x_read,
+	.write = _si443x_write,
+	.rx_enabled = _si443x_rx_enabled,
+	.payload_len = _si443x_payload_len,
+	.rx_frame = _si443x_rx_frame,
+};
+
+/************************* SX1231 *******************************************/
+static void _sx1231_tx(spi_sim_t *s)
+{
+	uint8_t val;
+
+	while (! s->packet_sent && _fifo_pop(&s->rx_fifo, &val)) {
+		if (s->tx_sent == 0) {
+			if (s->regs[RegPacketConfig1] &
+					PACKET_CONFIG1_PACKETFORMAT) {
+				s->tx_len = val + 1;
+			} else {
+				s->tx_len = s->regs[RegPayloadLength];
+			}
+		}
+		s->tx_sent++;
+		if (s->tx_sent >= s->tx_len) {
+			s->packet_sent = true;
+			s->stats.tx_frames++;
+			_irq(s);
+		}
+	}
+}
+
+static void _sx1231_reset(spi_sim_t *s)
+{
+	memset(s->regs, 0, sizeof(s->regs));
+	s->regs[RegOpMode] = OP_MODE_MODE_STDBY;
+	s->regs[RegVersion] = SX1231_VERSION | 0x04;
+	s->regs[RegRssiValue] = 0x80;
+	s->regs[RegPacketConfig1] = PACKET_CONFIG1_CRCON;
+	s->regs[RegPayloadLength] = 0x40;
+	s->regs[RegFifoThresh] = FIFO_THRESH_TXSTARTCONDITION | 0x0F;
+	_clear(s);
+}
+
+static uint8_t _sx1231_read(spi_sim_t *s, uint8_t addr)
+{
+	const uint8_t mode = s->regs[RegOpMode] & 0x1c;
+	uint8_t val;
+
+	switch (addr) {
+	case RegFifo:
+		if (! _fifo_pop(&s->rx_fifo, &val)) {
+			val = 0;
+		}
+		if (s->rx_fifo.cnt == 0) {
+			s->payload_ready = false;
+		}
+		break;
+	case RegIrqFlags1:
+		val = IRQ_FLAGS1_MODEREADY;
+		if (mode == OP_MODE_MODE_RX) {
+			val |= IRQ_FLAGS1_RXREADY;
+		} else if (mode == OP_MODE_MODE_TX) {
+			val |= IRQ_FLAGS1_TXREADY;
+		}
+		break;
+	case RegIrqFlags2:
+		val = 0;
+		if (s->rx_fifo.cnt >= s->model->fifo_size) {
+			val |= IRQ_FLAGS2_FIFOFULL;
+		}
+		if (s->rx_fifo.cnt != 0) {
+			val |= IRQ_FLAGS2_FIFONOTEMPTY;
+		}
+		if (s->rx_fifo.cnt > (s->regs[RegFifoThresh] &
+				      FIFO_THRESH_FIFOTHRESHOLD_MASK)) {
+			val |= IRQ_FLAGS2_FIFOLEVEL;
+		}
+		if (s->overflow) {
+			val |= IRQ_FLAGS2_FIFOOVERRUN;
+		}
+		if (s->packet_sent) {
+			val |= IRQ_FLAGS2_PACKETSENT;
+		}
+		if (s->payload_ready) {
+			val |= IRQ_FLAGS2_PAYLOADREADY | IRQ_FLAGS2_CRCOK;
+		}
+		break;
+	default:
+		val = s->regs[addr];
+		break;
+	}
+
+	return val;
+}
+
+static void _sx1231_write(spi_sim_t *s, uint8_t addr, uint8_t val)
+{
+	const uint8_t old_mode = s->regs[RegOpMode] & 0x1c;
+
+	switch (addr) {
+	case RegVersion:
+	case RegIrqFlags1:
+		break;
+	case RegFifo:
+		if (! _fifo_push(s, &s->rx_fifo, val)) {
+			s->overflow = true;
+		}
+		if (s->sending) {
+			_sx1231_tx(s);
+		}
+		break;
+	case RegOpMode:
+		s->regs[addr] = val;
+		if ((val & 0x1c) != OP_MODE_MODE_TX) {
+			s->sending = false;
+			s->packet_sent = false;
+		} else if (old_mode != OP_MODE_MODE_TX) {
+			s->sending = true;
+			s->tx_sent = 0;
+			_sx1231_tx(s);
+		}
+		break;
+	case RegIrqFlags2:
+		// Clearing the overrun flag also clears the FIFO
+		if (val & IRQ_FLAGS2_FIFOOVERRUN) {
+			_fifo_clear(&s->rx_fifo);
+			s->overflow = false;
+			s->payload_ready = false;
+		}
+		break;
+	default:
+		s->regs[addr] = val;
+		break;
+	}
+}
+
+static bool _sx1231_rx_enabled(spi_sim_t *s)
+{
+	return (s->regs[RegOpMode] & 0x1c) == OP_MODE_MODE_RX;
+}
+
+static size_t _sx1231_payload_len(spi_sim_t *s)
+{
+	if (s->regs[RegPacketConfig1] & PACKET_CONFIG1_PACKETFORMAT) {
+		return 0;
+	}
+	return s->regs[RegPayloadLength];
+}
+
+static void _sx1231_rx_frame(spi_sim_t *s, const uint8_t *payload,
+			     size_t len)
+{
+	const bool fixed = ! (s->regs[RegPacketConfig1] &
+			      PACKET_CONFIG1_PACKETFORMAT);
+	size_t i;
+
+	// With AutoRxRestartOn the next packet is only received once the
+	// previous one is read. Frames larger than the FIFO aren't emulated.
+	if (s->payload_ready) {
+		s->stats.rx_dropped++;
+		return;
+	}
+	if ((fixed ? 0 : 1) + len > s->model->fifo_size - s->rx_fifo.cnt) {
+		s->overflow = true;
+		s->stats.rx_dropped++;
+		return;
+	}
+
+	if (! fixed) {
+		_fifo_push(s, &s->rx_fifo, len);
+	}
+	for (i = 0; i < len; i++) {
+		_fifo_push(s, &s->rx_fifo, payload[i]);
+	}
+
+	s->payload_ready = true;
+	_irq(s);
+}
+
+static const spi_sim_model_t sx1231_model = {
+	.name = "sx1231",
+	.fifo_size = 66,
+	.fifo_addr = RegFifo,
+	.reset = _sx1231_reset,
+	.read = _sx1231_read,
+	.write = _sx1231_write,
+	.rx_enabled = _sx1231_rx_enabled,
+	.payload_len = _sx1231_payload_len,
+	.rx_frame = _sx1231_rx_frame,
+};
+
+static const spi_sim_model_t * const models[] = {
+	&si443x_model,
+	&sx1231_model,
+};
+
+/************************* Generic ******************************************/
+/**
+ * Send frame to emulated chip, must be called with lock held
+ */
+static void _rx(spi_sim_t *s)
+{
+	uint8_t payload[255];
+	uint64_t now;
+	size_t len;
+	size_t i;
+
+	len = s->model->payload_len(s);
+	if (len == 0) {
+		len = s->len;
+	}
+	if (len < sizeof(now)) {
+		len = sizeof(now);
+	}
+
+	for (i = 0; i < len - sizeof(now); i++) {
+		payload[i] = s->seq + i;
+	}
+	now = _now();
+	memcpy(&payload[len - sizeof(now)], &now, sizeof(now));
+	s->seq++;
+
+	s->stats.rx_generated++;
+	if (! s->model->rx_enabled(s)) {
+		s->stats.rx_dropped++;
+		return;
+	}
+	s->model->rx_frame(s, payload, len);
+}
+
+/**
+ * Execute single access on emulated chip
+ */
+static void _access(spi_sim_t *s, uint8_t addr, uint8_t *data, size_t len)
+{
+	const bool do_write = (addr & 0x80) != 0;
+	uint8_t a;
+	size_t i;
+
+	addr &= 0x7f;
+	for (i = 0; i < len; i++) {
+		a = (addr == s->model->fifo_addr) ? addr : ((addr + i) & 0x7f);
+		if (do_write) {
+			s->model->write(s, a, data[i]);
+		} else {
+			data[i] = s->model->read(s, a);
+		}
+	}
+}
+
+/**
+ * Execute single access from trace
+ *
+ * @returns	0 on success, -1 with errno set if the trace ended or
+ *		diverged
+ */
+static int _replay(spi_sim_t *s, uint8_t addr, uint8_t *data, size_t len)
+{
+	spi_trace_rec_t rec;
+	uint8_t buf[256];
+
+	for (;;) {
+		if (fread(&rec, sizeof(rec), 1, s->trace) != 1) {
+			errno = ENODATA;
+			return -1;
+		}
+		if (s->trace_dev == -1) {
+			s->trace_dev = rec.dev;
+		}
+		if (rec.dev == s->trace_dev) {
+			break;
+		}
+		if (fseek(s->trace, rec.len, SEEK_CUR) != 0) {
+			return -1;
+		}
+	}
+	s->trace_recs++;
+
+	if (rec.addr != addr || rec.len != len || len > sizeof(buf)) {
+		fprintf(stderr, "SPI replay diverged at access %llu: "
+			"%s @ 0x%02x of %zu bytes, trace has %s @ 0x%02x of "
+			"%u bytes\n", (unsigned long long) s->trace_recs,
+			(addr & 0x80) ? "WRITE" : "READ", addr & 0x7f, len,
+			(rec.addr & 0x80) ? "WRITE" : "READ", rec.addr & 0x7f,
+			rec.len);
+		errno = EPROTO;
+		return -1;
+	}
+
+	if (fread(buf, 1, len, s->trace) != len) {
+		errno = ENODATA;
+		return -1;
+	}
+	if (! (addr & 0x80)) {
+		memcpy(data, buf, len);
+	} else if (memcmp(data, buf, len) != 0) {
+		fprintf(stderr, "SPI replay diverged at access %llu: "
+			"different data written @ 0x%02x\n",
+			(unsigned long long) s->trace_recs, addr & 0x7f);
+		errno = EPROTO;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _transfer(void *ctx, struct spi_ioc_transfer *xfer,
+		     unsigned int cnt)
+{
+	spi_sim_t *s = ctx;
+	unsigned int i;
+	int ret = 0;
+	int c;
+
+	pthread_mutex_lock(&s->lock);
+	for (i = 0; i + 1 < cnt; i += 2) {
+		const uint8_t addr = *(const uint8_t *)(uintptr_t) xfer[i].tx_buf;
+		uint8_t *data = (uint8_t *)(uintptr_t)
+			(xfer[i + 1].tx_buf ? xfer[i + 1].tx_buf :
+			 xfer[i + 1].rx_buf);
+
+		if (s->trace != NULL) {
+			ret = _replay(s, addr, data, xfer[i + 1].len);
+			if (ret != 0) {
+				break;
+			}
+		} else {
+			_access(s, addr, data, xfer[i + 1].len);
+
+			// Emulate read data sampled too late on a slow link
+			if (s->clock != 0 && xfer[i + 1].speed_hz > s->clock &&
+			    ! (addr & 0x80) && xfer[i + 1].len > 0) {
+				data[xfer[i + 1].len - 1] ^= 0x01;
+			}
+		}
+	}
+
+	// Keep the radio thread servicing the device until the trace ends
+	if (ret == 0 && s->trace != NULL) {
+		if ((c = fgetc(s->trace)) != EOF) {
+			ungetc(c, s->trace);
+			_irq(s);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return ret;
+}
+
+static void *_thread_main(void *arg)
+{
+	spi_sim_t *s = arg;
+	struct timespec ts;
+	uint64_t start = 0;
+	uint64_t sent = 0;
+	uint64_t due;
+	uint64_t next;
+	uint64_t now;
+
+	while (! __atomic_load_n(&s->stop, __ATOMIC_ACQUIRE) &&
+			(s->count == 0 || sent < s->count)) {
+		now = _now();
+		if (start == 0) {
+			// Start sending once the receiver is enabled
+			pthread_mutex_lock(&s->lock);
+			if (s->model->rx_enabled(s)) {
+				start = now + s->delay_ns;
+			}
+			pthread_mutex_unlock(&s->lock);
+			next = (start != 0) ? start : now + SPI_SIM_START_POLL_NS;
+		} else if (now < start) {
+			next = start;
+		} else {
+			due = (uint64_t) ((double) (now - start) * s->rate /
+					  1000000000) + 1;
+			if (s->count != 0 && due > s->count) {
+				due = s->count;
+			}
+			if (sent < due) {
+				pthread_mutex_lock(&s->lock);
+				while (sent < due) {
+					_rx(s);
+					sent++;
+				}
+				pthread_mutex_unlock(&s->lock);
+			}
+			next = start + (uint64_t) ((double) sent * 1000000000 /
+						   s->rate);
+		}
+
+		if (next > now + SPI_SIM_MAX_SLEEP_NS) {
+			next = now + SPI_SIM_MAX_SLEEP_NS;
+		}
+		ts.tv_sec = next / 1000000000;
+		ts.tv_nsec = next % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	return NULL;
+}
+
+/**
+ * Parse device specification
+ *
+ * @returns	0 on success, -1 on error
+ */
+static int _parse(spi_sim_t *s, char *spec, const char **replay_path)
+{
+	char *saveptr;
+	char *tok;
+	char *endp;
+	unsigned long long val;
+	size_t i;
+
+	tok = strtok_r(spec, ":", &saveptr);
+	if (tok == NULL) {
+		return -1;
+	}
+	if (strncmp(tok, "replay=", 7) == 0) {
+		*replay_path = &tok[7];
+		return (strtok_r(NULL, ":", &saveptr) == NULL) ? 0 : -1;
+	}
+	for (i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+		if (strcmp(tok, models[i]->name) == 0) {
+			s->model = models[i];
+		}
+	}
+	if (s->model == NULL) {
+		return -1;
+	}
+
+	while ((tok = strtok_r(NULL, ":", &saveptr)) != NULL) {
+		char *arg = strchr(tok, '=');
+
+		if (arg == NULL) {
+			return -1;
+		}
+		*arg++ = '\0';
+		val = strtoull(arg, &endp, 10);
+		if (*arg == '\0' || *endp != '\0') {
+			return -1;
+		}
+
+		if (strcmp(tok, "rate") == 0) {
+			s->rate = val;
+		} else if (strcmp(tok, "len") == 0) {
+			if (val < sizeof(uint64_t) || val > 255) {
+				return -1;
+			}
+			s->len = val;
+		} else if (strcmp(tok, "count") == 0) {
+			s->count = val;
+		} else if (strcmp(tok, "delay") == 0) {
+			s->delay_ns = val * 1000000;
+		} else if (strcmp(tok, "clock") == 0) {
+			s->clock = val;
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int spi_sim_open(int *fd, const char *spec)
+{
+	const char *replay_path = NULL;
+	char magic[sizeof(SPI_TRACE_MAGIC) - 1];
+	spi_sim_t *s;
+	char *tmp;
+	unsigned int i;
+	int err = ERR_UNSPEC;
+
+	for (i = 0; i < SPI_SIM_MAX && sims[i] != NULL; i++);
+	if (i == SPI_SIM_MAX) {
+		return ERR_RANGE;
+	}
+
+	s = calloc(1, sizeof(*s));
+	tmp = strdup(spec);
+	if (s == NULL || tmp == NULL) {
+		free(s);
+		free(tmp);
+		return ERR_UNSPEC;
+	}
+	s->fd = -1;
+	s->irq_pipe[0] = -1;
+	s->irq_pipe[1] = -1;
+	s->trace_dev = -1;
+	s->rate = SPI_SIM_DEFAULT_RATE;
+	s->len = SPI_SIM_DEFAULT_LEN;
+	pthread_mutex_init(&s->lock, NULL);
+
+	if (_parse(s, tmp, &replay_path) != 0) {
+		fprintf(stderr, "Invalid simulated device '%s'\n", spec);
+		err = ERR_INVAL;
+		goto fail;
+	}
+
+	err = ERR_SPI_OPEN_DEV;
+	if ((s->fd = open("/dev/null", O_RDWR | O_CLOEXEC)) == -1 ||
+	    pipe2(s->irq_pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+		goto fail;
+	}
+
+	if (replay_path != NULL) {
+		s->trace = fopen(replay_path, "r");
+		if (s->trace == NULL) {
+			goto fail;
+		}
+		if (fread(magic, sizeof(magic), 1, s->trace) != 1 ||
+		    memcmp(magic, SPI_TRACE_MAGIC, sizeof(magic)) != 0) {
+			fprintf(stderr, "%s is not a SPI trace\n", replay_path);
+			err = ERR_INVAL;
+			goto fail;
+		}
+		// Start servicing, like an interrupt pending at power up
+		_irq(s);
+	} else {
+		s->model->reset(s);
+	}
+
+	if ((err = spi_set_hook(s->fd, _transfer, s)) != ERR_OK) {
+		goto fail;
+	}
+
+	if (s->model != NULL && s->rate != 0) {
+		if ((errno = pthread_create(&s->thread, NULL, _thread_main, s))
+				!= 0) {
+			spi_set_hook(s->fd, NULL, NULL);
+			err = ERR_THREAD;
+			goto fail;
+		}
+		s->running = true;
+	}
+
+	free(tmp);
+	sims[i] = s;
+	*fd = s->fd;
+
+	return ERR_OK;
+fail:
+	SAVE_ERRNO(
+		if (s->trace != NULL) fclose(s->trace);
+		if (s->irq_pipe[0] != -1) close(s->irq_pipe[0]);
+		if (s->irq_pipe[1] != -1) close(s->irq_pipe[1]);
+		if (s->fd != -1) close(s->fd);
+	);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+	free(tmp);
+	return err;
+}
+
+bool spi_sim_close(int fd)
+{
+	spi_sim_t *s = _find(fd);
+	unsigned int i;
+
+	if (s == NULL) {
+		return false;
+	}
+
+	if (s->running) {
+		__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(s->thread, NULL);
+	}
+	spi_set_hook(s->fd, NULL, NULL);
+
+	if (s->trace != NULL) {
+		fclose(s->trace);
+	}
+	close(s->irq_pipe[0]);
+	close(s->irq_pipe[1]);
+	close(s->fd);
+	pthread_mutex_destroy(&s->lock);
+
+	for (i = 0; i < SPI_SIM_MAX; i++) {
+		if (sims[i] == s) {
+			sims[i] = NULL;
+		}
+	}
+	free(s);
+
+	return true;
+}
+
+int spi_sim_irq_fd(int fd)
+{
+	spi_sim_t *s = _find(fd);
+
+	return (s != NULL) ? s->irq_pipe[0] : -1;
+}
+
+int spi_sim_rx(int fd)
+{
+	spi_sim_t *s = _find(fd);
+
+	if (s == NULL || s->model == NULL) {
+		return ERR_INVAL;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	_rx(s);
+	pthread_mutex_unlock(&s->lock);
+
+	return ERR_OK;
+}
+
+void spi_sim_get_stats(int fd, spi_sim_stats_t *stats)
+{
+	spi_sim_t *s = _find(fd);
+
+	memset(stats, 0, sizeof(*stats));
+	if (s == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	*stats = s->stats;
+	pthread_mutex_unlock(&s->lock);
+}
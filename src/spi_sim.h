@@ -0,0 +1,146 @@
+/**
+ * spi_sim.h - Simulated SPI transceivers
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SPI_SIM_H__
+#define __SPI_SIM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * Device path prefix selecting a simulated transceiver, see rf_open()
+ */
+#define SPI_SIM_PREFIX "sim:"
+
+/**
+ * Maximum amount of simultaneously opened simulated devices
+ */
+#define SPI_SIM_MAX 4
+
+/**
+ * Counters of a simulated transceiver
+ */
+typedef struct {
+	uint64_t rx_generated;	/**< Frames sent to the transceiver */
+	uint64_t rx_dropped;	/**< Of which not stored in the RX FIFO */
+	uint64_t tx_frames;	/**< Frames transmitted by the transceiver */
+} spi_sim_stats_t;
+
+/**
+ * Open simulated transceiver
+ *
+ * Specification format:
+ * <model>[:rate=<pps>][:len=<n>][:count=<n>][:delay=<msec>][:clock=<hz>]
+ * or replay=<path>.
+ *
+ * Models are 'si443x' and 'sx1231', which emulate the FIFO, interrupt flags
+ * and mode switching of the chip as used by the backends. Frames are
+ * received at the given rate(default: 100 frames/s) by a simulator thread,
+ * up to count frames(default: unlimited). The first frame is received delay
+ * ms after the receiver is first enabled. With a rate of 0 frames are only
+ * received through spi_sim_rx(). The payload length defaults to 16 bytes,
+ * and the last 8 bytes of every payload are the time the frame was sent,
+ * see spi_sim_frame_time(). With clock set, the last byte of every read
+ * made at a higher SPI clock(see spi_configure()) has a bit flipped.
+ *
+ * 'replay' returns the read data of a trace recorded with spi_trace_open()
+ * for all accesses. The sequence of accesses must be the same as in the
+ * trace. Only the accesses of the first device in the trace are used.
+ *
+ * In both cases an IRQ line is emulated, see spi_sim_irq_fd().
+ *
+ * Simulated devices are opened and closed by the main thread only.
+ *
+ * @param fd	Pointer to store file descriptor of device in. The file
+ *		descriptor can be used with the spi_* functions
+ * @param spec	Device specification
+ *
+ * @returns	0 on success, ERR_INVAL for an invalid specification, else
+ *		an error code with errno set
+ */
+int spi_sim_open(int *fd, const char *spec);
+
+/**
+ * Close simulated transceiver
+ *
+ * @param fd	File descriptor of device
+ *
+ * @returns	True if fd was a simulated device, false if not(and fd isn't
+ *		closed)
+ */
+bool spi_sim_close(int fd);
+
+/**
+ * Get IRQ line of simulated transceiver
+ *
+ * The returned file descriptor behaves as a GPIO line request, see
+ * gpio_irq_read(). It is closed by spi_sim_close().
+ *
+ * @returns	File descriptor, or -1 if fd isn't a simulated device
+ */
+int spi_sim_irq_fd(int fd);
+
+/**
+ * Send a single frame to the simulated transceiver
+ *
+ * Can be called from any thread.
+ *
+ * @returns	0 on success, ERR_INVAL if fd isn't a simulated device
+ *		emulating a chip
+ */
+int spi_sim_rx(int fd);
+
+/**
+ * Get counters of simulated transceiver
+ *
+ * Can be called from any thread.
+ */
+void spi_sim_get_stats(int fd, spi_sim_stats_t *stats);
+
+/**
+ * Get the time a simulated frame was sent
+ *
+ * @param frame	Received frame, without CRC
+ * @param len	Length of received frame
+ *
+ * @returns	Time in ns(CLOCK_MONOTONIC), or 0 if the frame is too short
+ */
+static inline uint64_t spi_sim_frame_time(const uint8_t *frame, size_t len)
+{
+	uint64_t t;
+
+	if (len < sizeof(t)) {
+		return 0;
+	}
+	memcpy(&t, &frame[len - sizeof(t)], sizeof(t));
+	return t;
+}
+
+#endif // __SPI_SIM_H__
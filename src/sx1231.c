@@ -46,52 +46,157 @@
 
 #define SX1231_FIFO_SIZE 66
 
+/**
+ * FIFO level threshold, in bytes
+ *
+ * Packets that don't fit the FIFO are streamed: during reception the FIFO is
+ * read in chunks of this size when the level exceeds the threshold, during
+ * transmission it is refilled when the level drops to the threshold.
+ */
+#define SX1231_FIFO_THRESHOLD 32
+
+/**
+ * Length of packet status registers block, RegAfcMsb till RegRssiValue
+ */
+#define SX1231_PKT_STATUS_LEN (RegRssiValue - RegAfcMsb + 1)
+
+#define SX1231_FSTEP 61 // Depends on Oscillator frequency!!!
+
+/**
+ * Crystal oscillator frequency, Frf = f * 2^19 / FXOSC
+ */
+#define SX1231_FXOSC 32000000
+
+/**
+ * Carrier frequency range, over all bands
+ */
+#define SX1231_FREQ_MIN 290000000
+#define SX1231_FREQ_MAX 1020000000
+
+/**
+ * Maximum time for a operating mode switch
+ */
+#define SX1231_MODE_TIMEOUT_US 10000
+
+/**
+ * Maximum time the reception of a packet may take after sync word detection
+ */
+#define SX1231_RX_TIMEOUT_US 500000
+
+/**
+ * Interval to check for end of transmission, in case the IRQ is not used
+ */
+#define SX1231_TX_POLL_NS 1000000
+
+/**
+ * Maximum time a transmission may take
+ */
+#define SX1231_TX_TIMEOUT_NS 1000000000
+
+/**
+ * Transmitter state
+ */
+typedef enum {
+	SX1231_TX_IDLE,		/**< Receiving, no gap pending */
+	SX1231_TX_SENDING,	/**< Transmitting, waiting for PacketSent */
+	SX1231_TX_GAP,		/**< Receiving, until inter frame gap passed */
+} sx1231_tx_state_t;
+
+/**
+ * SX1231 private device state
+ */
+typedef struct {
+	sx1231_tx_state_t tx_state;
+	uint64_t tx_deadline;	/**< End of TX timeout or inter frame gap */
+	const pkt_t *tx_pkt;	/**< Frame being streamed, or NULL */
+	uint16_t tx_off;	/**< Bytes of tx_pkt written to FIFO */
+	bool rx_stream;		/**< Received packets may exceed FIFO size */
+} sx1231_priv_t;
+
+static int _probe(int fd);
+static int _open(rf_dev_t *dev);
+static void _close(rf_dev_t *dev);
+static int _init(rf_dev_t *dev, sparse_buf_t *regs);
+static int _reconfigure(rf_dev_t *dev, sparse_buf_t *changed);
+static int _handle(rf_dev_t *dev, pkt_buf_t *rx_buf, pkt_buf_t *tx_buf);
 static int _reset(rf_dev_t *dev);
 static int _reset_rx_fifo(rf_dev_t *dev);
 static int _sync_config(rf_dev_t *dev);
 static int _configure(rf_dev_t *dev, sparse_buf_t *regs);
+static int _start_rx(rf_dev_t *dev);
+static int _retune(rf_dev_t *dev, uint32_t freq);
 static int _switch_mode(rf_dev_t *dev, int mode);
-static int _send_frame(rf_dev_t *dev, ring_buf_t *tx_buf);
-static int _receive_frame(rf_dev_t *dev, ring_buf_t *rx_buf);
+static int _wait_payload(rf_dev_t *dev, uint8_t irq_flags[2]);
+static int _tx_done(rf_dev_t *dev, pkt_buf_t *tx_buf);
+static int _tx_refill(rf_dev_t *dev);
+static int _tx_start(rf_dev_t *dev, pkt_buf_t *tx_buf);
+static int _send_frame(rf_dev_t *dev, pkt_buf_t *tx_buf, uint64_t now);
+static int _receive_frame(rf_dev_t *dev, pkt_buf_t *rx_buf,
+			  uint8_t irq_flags[2]);
+static int _receive_stream(rf_dev_t *dev, uint8_t *buf, size_t len,
+			   uint8_t irq_flags[2]);
 static void _dump_status(rf_dev_t *dev);
-static void _dump_packet_status(rf_dev_t *dev);
+static void _dump_packet_status(rf_dev_t *dev, const pkt_meta_t *meta);
+
+const rf_ops_t sx1231_ops = {
+	.name = "sx1231",
+	.default_sw_crc = "ibm",
+	.freq_min = SX1231_FREQ_MIN,
+	.freq_max = SX1231_FREQ_MAX,
+	.fifo_addr = RegFifo,
+	.scratch_addr = RegSyncValue,
+	.scratch_len = 8,	// Sync word
+	.probe = _probe,
+	.open = _open,
+	.close = _close,
+	.init = _init,
+	.reconfigure = _reconfigure,
+	.retune = _retune,
+	.handle = _handle,
+};
 
-int rf_open(rf_dev_t *dev, const char *spi_path)
+static int _probe(int fd)
 {
 	int err = ERR_UNSPEC;
-	int fd;
 	uint8_t val;
 
-	fd = open(spi_path, O_RDWR);
-	if (fd == -1) {
-		return ERR_SPI_OPEN_DEV;
-	}
-
-	dev->fd = fd;
-
 	// Check device version
-	TRY(spi_read_reg(dev->fd, RegVersion, &val));
+	TRY(spi_read_reg(fd, RegVersion, &val));
 	if ((val & SX1231_VERSION_MASK) != SX1231_VERSION) {
 		err = ERR_RFM_CHIP_VERSION;
 		goto fail;
 	}
 
+	return ERR_OK;
+fail:
+	return err;
+}
+
+static int _open(rf_dev_t *dev)
+{
+	int err = ERR_UNSPEC;
+
+	dev->priv = calloc(1, sizeof(sx1231_priv_t));
+	if (dev->priv == NULL) {
+		return ERR_UNSPEC;
+	}
+
 	// Read config
 	TRY(_sync_config(dev));
 
 	return ERR_OK;
 fail:
-	SAVE_ERRNO(rf_close(dev));
+	_close(dev);
 	return err;
 }
 
-void rf_close(rf_dev_t *dev)
+static void _close(rf_dev_t *dev)
 {
-	close(dev->fd);
-	dev->fd = -1;
+	free(dev->priv);
+	dev->priv = NULL;
 }
 
-int rf_init(rf_dev_t *dev, sparse_buf_t *regs)
+static int _init(rf_dev_t *dev, sparse_buf_t *regs)
 {
 	int err = ERR_UNSPEC;
 
@@ -101,6 +206,50 @@ int rf_init(rf_dev_t *dev, sparse_buf_t *regs)
 	// Program register configuration
 	TRY(_configure(dev, regs));
 
+	TRY(_start_rx(dev));
+	((sx1231_priv_t *) dev->priv)->tx_state = SX1231_TX_IDLE;
+	((sx1231_priv_t *) dev->priv)->tx_pkt = NULL;
+
+	err = ERR_OK;
+fail:
+	return err;
+}
+
+static int _reconfigure(rf_dev_t *dev, sparse_buf_t *changed)
+{
+	int err = ERR_UNSPEC;
+
+	if (((sx1231_priv_t *) dev->priv)->tx_state == SX1231_TX_SENDING) {
+		return ERR_RFM_BUSY;
+	}
+
+	// Switching to standby also drops frames received with the old
+	// configuration
+	TRY(_switch_mode(dev, OP_MODE_MODE_STDBY));
+
+	TRY(_configure(dev, changed));
+
+	TRY(_start_rx(dev));
+
+	err = ERR_OK;
+fail:
+	return err;
+}
+
+/**
+ * Enable the settings the driver relies on and enter RX mode
+ *
+ * Start transmission as soon as the first byte is in the FIFO, and set the
+ * level used for streaming long packets.
+ */
+static int _start_rx(rf_dev_t *dev)
+{
+	int err = ERR_UNSPEC;
+
+	TRY(spi_write_reg(dev->fd, RegFifoThresh,
+			       FIFO_THRESH_TXSTARTCONDITION |
+			       SX1231_FIFO_THRESHOLD));
+
 	// Switch to receive mode
 	TRY(_switch_mode(dev, OP_MODE_MODE_RX));
 
@@ -109,34 +258,56 @@ fail:
 	return err;
 }
 
-int rf_handle(rf_dev_t *dev, ring_buf_t *rx_buf, ring_buf_t *tx_buf)
+static int _handle(rf_dev_t *dev, pkt_buf_t *rx_buf, pkt_buf_t *tx_buf)
 {
+	sx1231_priv_t *priv = dev->priv;
 	int err = ERR_UNSPEC;
 	uint8_t irq_flags[2];
 
+	// Nothing can be received while transmitting
+	if (priv->tx_state == SX1231_TX_SENDING) {
+		TRY(_tx_done(dev, tx_buf));
+		if (priv->tx_state == SX1231_TX_SENDING) {
+			return ERR_OK;
+		}
+	}
+
 	TRY(spi_read_regs(dev->fd, RegIrqFlags1, irq_flags, 2));
 
 	// Check FIFO over/underflow condition
 	if (irq_flags[1] & IRQ_FLAGS2_FIFOOVERRUN) {
 		fprintf(stderr, "ERROR: FIFO overrun\n");
+		rf_stat_add(dev, RF_STAT_FIFO_OVERRUNS, 1);
 
 		// clear flag & fifo
 		TRY(spi_write_reg(dev->fd, RegIrqFlags2, IRQ_FLAGS2_FIFOOVERRUN));
 	} else {
-		while ((irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH) &&
+		if ((irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH) &&
 				!(irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY)) {
-			// Currently receiving packet, wait for completion or crc error
-			TRY(spi_read_regs(dev->fd, RegIrqFlags1, irq_flags, 2));
-			//TODO: add timeout...
+			// Currently receiving packet
+			TRY(_wait_payload(dev, irq_flags));
 		}
 
-		if (irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY) {
-			TRY(_receive_frame(dev, rx_buf));
+		if ((irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY) ||
+				((irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH) &&
+				 (irq_flags[1] & IRQ_FLAGS2_FIFOLEVEL))) {
+			TRY(_receive_frame(dev, rx_buf, irq_flags));
+		}
+	}
+
+	// Switch channel between frames
+	if (dev->retune_freq != 0) {
+		TRY(spi_read_reg(dev->fd, RegIrqFlags1, &irq_flags[0]));
+		if (irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH) {
+			dev->next_service = rf_clock_ns() + SX1231_TX_POLL_NS;
+			return ERR_OK;
 		}
+		TRY(_retune(dev, dev->retune_freq));
+		dev->retune_freq = 0;
 	}
 
-	if (! ring_buf_empty(tx_buf)) {
-		TRY(_send_frame(dev, tx_buf));
+	if (! pkt_buf_empty(tx_buf)) {
+		TRY(_tx_start(dev, tx_buf));
 	}
 
 	err = 0;
@@ -158,6 +329,7 @@ static int _reset_rx_fifo(rf_dev_t *dev)
 {
 	int err = ERR_UNSPEC;
 
+	rf_stat_add(dev, RF_STAT_FIFO_RESETS, 1);
 	TRY(_switch_mode(dev, OP_MODE_MODE_STDBY));
 	TRY(_switch_mode(dev, OP_MODE_MODE_RX));
 
@@ -166,16 +338,55 @@ fail:
 	return err;
 }
 
+static int _retune(rf_dev_t *dev, uint32_t freq)
+{
+	int err = ERR_UNSPEC;
+	uint64_t frf;
+	uint8_t regs[3];
+	uint8_t val;
+	size_t i;
+
+	if (freq < SX1231_FREQ_MIN || freq > SX1231_FREQ_MAX) {
+		return ERR_RANGE;
+	}
+
+	frf = ((uint64_t) freq << 19) / SX1231_FXOSC;
+	regs[0] = frf >> 16;
+	regs[1] = frf >> 8;
+	regs[2] = frf;
+
+	// New frequency is applied when RegFrfLsb is written, restart the
+	// receiver to lock on it
+	TRY(spi_write_regs(dev->fd, RegFrfMsb, regs, sizeof(regs)));
+	TRY(rf_read_cfg_reg(dev, RegPacketConfig2, &val));
+	TRY(spi_write_reg(dev->fd, RegPacketConfig2,
+			       val | PACKET_CONFIG2_RESTARTRX));
+
+	for (i = 0; i < sizeof(regs); i++) {
+		sparse_buf_write(&dev->shadow, RegFrfMsb + i, regs[i]);
+	}
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
 static int _sync_config(rf_dev_t *dev)
 {
+	sx1231_priv_t *priv = dev->priv;
 	int err = ERR_UNSPEC;
 	uint8_t val;
+	uint8_t len;
 
-	TRY(spi_read_reg(dev->fd, RegPacketConfig1, &val));
+	TRY(rf_read_cfg_reg(dev, RegPacketConfig1, &val));
+	TRY(rf_read_cfg_reg(dev, RegPayloadLength, &len));
 	if (val & PACKET_CONFIG1_PACKETFORMAT) {
+		// Payload length is the maximum length, excl. length byte
 		dev->fixpklen = 0;
+		priv->rx_stream = (len > SX1231_FIFO_SIZE - 1);
 	} else {
-		TRY(spi_read_reg(dev->fd, RegPayloadLength, &dev->fixpklen));
+		dev->fixpklen = len;
+		priv->rx_stream = (len > SX1231_FIFO_SIZE);
 	}
 
 	return ERR_OK;
@@ -187,10 +398,10 @@ static int _configure(rf_dev_t *dev, sparse_buf_t *regs)
 {
 	int err = ERR_UNSPEC;
 	size_t off = 0;
+	size_t len;
 
-	while ((off = sparse_buf_next_valid(regs, off))
-			!= SPARSE_BUF_OFF_END) {
-		const size_t len = sparse_buf_valid_length(regs, off);
+	// Write every run of configured registers in a single burst
+	while (sparse_buf_next_run(regs, &off, &len)) {
 		const uint8_t *startp = sparse_buf_at(regs, off);
 
 		if (startp == NULL) {
@@ -201,6 +412,7 @@ static int _configure(rf_dev_t *dev, sparse_buf_t *regs)
 
 		off += len;
 	}
+	TRY(rf_shadow_update(dev, regs));
 
 	TRY(_sync_config(dev));
 
@@ -212,87 +424,289 @@ fail:
 static int _switch_mode(rf_dev_t *dev, int mode)
 {
 	int err = ERR_UNSPEC;
-	uint8_t val;
 
 	assert((mode & ~0x1c) == 0);
 
 	TRY(spi_write_reg(dev->fd, RegOpMode, mode));
 
-	do {
-		// TODO: add timeout
-		TRY(spi_read_reg(dev->fd, RegIrqFlags1, &val));
-	} while (! (val & IRQ_FLAGS1_MODEREADY));
+	err = rf_poll_reg(dev, RF_POLL_MODE, RegIrqFlags1,
+			  IRQ_FLAGS1_MODEREADY, IRQ_FLAGS1_MODEREADY,
+			  SX1231_MODE_TIMEOUT_US, NULL);
+	if (err == ERR_RFM_TIMEOUT) {
+		fprintf(stderr, "ERROR: Timeout switching to mode 0x%.2x\n",
+			mode);
+		rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
+	}
+	TRY(err);
 
 	return ERR_OK;
 fail:
 	return err;
 }
 
-static int _send_frame(rf_dev_t *dev, ring_buf_t *tx_buf)
+/**
+ * Wait for packet reception to complete
+ *
+ * Waits until PayloadReady is set or the sync address match is lost, eg.
+ * because of a CRC error. If packets may exceed the FIFO size, the wait
+ * also ends when the FIFO level exceeds the threshold. On timeout reception
+ * is restarted.
+ *
+ * @param dev		Device object
+ * @param irq_flags	Current RegIrqFlags1/2 values, updated on return
+ */
+static int _wait_payload(rf_dev_t *dev, uint8_t irq_flags[2])
 {
+	sx1231_priv_t *priv = dev->priv;
 	int err = ERR_UNSPEC;
-	uint8_t hdrlen;
-	uint8_t pktlen;
+	uint8_t done_mask;
+	rf_wait_t w;
+
+	done_mask = IRQ_FLAGS2_PAYLOADREADY;
+	rf_wait_start(dev, &w, RF_POLL_RX, SX1231_RX_TIMEOUT_US);
+	if (priv->rx_stream) {
+		// FifoLevel isn't mapped to the IRQ line
+		done_mask |= IRQ_FLAGS2_FIFOLEVEL;
+		w.use_irq = false;
+	}
+	while ((err = rf_wait_next(dev, &w)) == ERR_OK) {
+		TRY(spi_read_regs(dev->fd, RegIrqFlags1, irq_flags, 2));
+		if (! (irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH) ||
+				(irq_flags[1] & done_mask)) {
+			return ERR_OK;
+		}
+	}
+	if (err == ERR_RFM_TIMEOUT) {
+		fprintf(stderr, "ERROR: Timeout receiving packet\n");
+		rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
+		irq_flags[1] &= ~(IRQ_FLAGS2_PAYLOADREADY | IRQ_FLAGS2_FIFOLEVEL);
+		TRY(_reset_rx_fifo(dev));
+		return ERR_OK;
+	}
+
+fail:
+	return err;
+}
+
+/**
+ * Check if transmission completed
+ *
+ * Transmission goes through STDBY, filling the FIFO, TX, PacketSent and
+ * back to RX, without waiting for the transceiver. The IRQ(DIO0 mapped to
+ * PacketSent) or dev->next_service make sure the state is advanced in time.
+ *
+ * When completed, the next frame is directly transmitted if no inter frame
+ * gap is configured. Else the transceiver returns to RX mode for at least
+ * the gap time.
+ *
+ * Frames that don't fit the FIFO are refilled from here while sending. The
+ * FIFO level isn't mapped to the IRQ line, so this relies on the
+ * SX1231_TX_POLL_NS timer.
+ */
+static int _tx_done(rf_dev_t *dev, pkt_buf_t *tx_buf)
+{
+	sx1231_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	uint64_t now;
 	uint8_t val;
 
-	// Determine next frame size
-	hdrlen = 0;
-	pktlen = dev->fixpklen;
-	if (pktlen == 0) {
-		pktlen = *ring_buf_begin(tx_buf);
-		hdrlen = 1;
+	now = rf_clock_ns();
+
+	TRY(spi_read_reg(dev->fd, RegIrqFlags2, &val));
+	if (! (val & IRQ_FLAGS2_PACKETSENT)) {
+		if (now < priv->tx_deadline) {
+			if (priv->tx_pkt != NULL &&
+					! (val & IRQ_FLAGS2_FIFOLEVEL)) {
+				TRY(_tx_refill(dev));
+			}
+			dev->next_service = now + SX1231_TX_POLL_NS;
+			return ERR_OK;
+		}
+		fprintf(stderr, "ERROR: TX timeout\n");
+		rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
 	}
-	if (pktlen == 0 || pktlen > SX1231_FIFO_SIZE - 1) {
-		err = ERR_RFM_TX_OUT_OF_SYNC;
-		goto fail;
+	priv->tx_state = SX1231_TX_IDLE;
+	if (priv->tx_pkt != NULL) {
+		priv->tx_pkt = NULL;
+		pkt_buf_pop(tx_buf);
 	}
 
-	if (pktlen <= ring_buf_bytes_used(tx_buf)) {
-		uint8_t pkt[SX1231_FIFO_SIZE];
-		TRY(_switch_mode(dev, OP_MODE_MODE_STDBY));
+	if (dev->tx_gap == 0 && ! pkt_buf_empty(tx_buf)) {
+		// Back-to-back frame, no need to go through RX
+		TRY(_send_frame(dev, tx_buf, now));
+		if (priv->tx_state == SX1231_TX_SENDING) {
+			return ERR_OK;
+		}
+	}
 
-		// Fill Fifo
-		ring_buf_get(tx_buf, pkt, hdrlen + pktlen);
-		TRY(spi_write_regs(dev->fd, RegFifo, pkt, pktlen));
+	TRY(_switch_mode(dev, OP_MODE_MODE_RX));
+	if (dev->tx_gap != 0) {
+		priv->tx_state = SX1231_TX_GAP;
+		priv->tx_deadline = now + (uint64_t) dev->tx_gap * 1000;
+		if (! pkt_buf_empty(tx_buf)) {
+			dev->next_service = priv->tx_deadline;
+		}
+	}
 
-		// Send frame
-		TRY(_switch_mode(dev, OP_MODE_MODE_TX));
-		do {
-			TRY(spi_read_reg(dev->fd, RegIrqFlags2, &val));
-		} while (! (val & IRQ_FLAGS2_PACKETSENT));
+	return ERR_OK;
+fail:
+	priv->tx_state = SX1231_TX_IDLE;
+	priv->tx_pkt = NULL;
+	return err;
+}
+
+/**
+ * Write next part of streamed frame to FIFO
+ *
+ * Must only be called when the FIFO level is at or below the threshold.
+ */
+static int _tx_refill(rf_dev_t *dev)
+{
+	sx1231_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	size_t len;
 
-		TRY(_switch_mode(dev, OP_MODE_MODE_RX));
-		// TODO: inter frame gap???
+	len = priv->tx_pkt->meta.len - priv->tx_off;
+	if (len > SX1231_FIFO_SIZE - SX1231_FIFO_THRESHOLD) {
+		len = SX1231_FIFO_SIZE - SX1231_FIFO_THRESHOLD;
+	}
+	if (len == 0) {
+		return ERR_OK;
 	}
 
+	TRY(spi_write_regs(dev->fd, RegFifo,
+			   &priv->tx_pkt->data[priv->tx_off], len));
+	priv->tx_off += len;
+
 	return ERR_OK;
 fail:
 	return err;
 }
 
-static int _receive_frame(rf_dev_t *dev, ring_buf_t *rx_buf)
+/**
+ * Start transmission of next frame, once the inter frame gap passed
+ */
+static int _tx_start(rf_dev_t *dev, pkt_buf_t *tx_buf)
+{
+	sx1231_priv_t *priv = dev->priv;
+	uint64_t now;
+
+	now = rf_clock_ns();
+
+	if (priv->tx_state == SX1231_TX_GAP) {
+		if (now < priv->tx_deadline) {
+			dev->next_service = priv->tx_deadline;
+			return ERR_OK;
+		}
+		priv->tx_state = SX1231_TX_IDLE;
+	}
+
+	return _send_frame(dev, tx_buf, now);
+}
+
+/**
+ * Transmit next frame
+ *
+ * Fills the FIFO in standby mode and switches to TX mode in one SPI
+ * transaction. Frames that don't fit the FIFO stay in the TX buffer until
+ * sent, the remainder is written by _tx_refill().
+ */
+static int _send_frame(rf_dev_t *dev, pkt_buf_t *tx_buf, uint64_t now)
 {
+	sx1231_priv_t *priv = dev->priv;
 	int err = ERR_UNSPEC;
-	uint8_t buf[64];
+	spi_batch_t batch;
+	const pkt_t *pkt;
+	size_t len;
+
+	// Frames are already delimited by the client interface
+	pkt = pkt_buf_peek(tx_buf);
+	if (pkt == NULL) {
+		return ERR_OK;
+	}
+
+	TRY(_switch_mode(dev, OP_MODE_MODE_STDBY));
+
+	len = pkt->meta.len;
+	if (len > SX1231_FIFO_SIZE) {
+		len = SX1231_FIFO_SIZE;
+	}
+
+	// Fill Fifo and start transmission in one transaction
+	spi_batch_init(&batch);
+	TRY(spi_batch_write(&batch, RegFifo, pkt->data, len));
+	TRY(spi_batch_write_reg(&batch, RegOpMode, OP_MODE_MODE_TX));
+	TRY(spi_batch_submit(dev->fd, &batch));
+	rf_stat_add(dev, RF_STAT_TX_PACKETS, 1);
+	rf_stat_add(dev, RF_STAT_TX_BYTES, pkt->meta.len);
+	if (len < pkt->meta.len) {
+		priv->tx_pkt = pkt;
+		priv->tx_off = len;
+	} else {
+		pkt_buf_pop(tx_buf);
+	}
+
+	priv->tx_state = SX1231_TX_SENDING;
+	priv->tx_deadline = now + SX1231_TX_TIMEOUT_NS;
+	dev->next_service = now + SX1231_TX_POLL_NS;
+
+	return ERR_OK;
+fail:
+	return err;
+}
+
+/**
+ * Read packet from FIFO
+ *
+ * If PayloadReady is set the complete packet is read in one SPI
+ * transaction. Else the packet is still being received, and is streamed
+ * from the FIFO by _receive_stream().
+ *
+ * @param dev		Device object
+ * @param rx_buf	Buffer to store packet in
+ * @param irq_flags	Current RegIrqFlags1/2 values
+ */
+static int _receive_frame(rf_dev_t *dev, pkt_buf_t *rx_buf,
+			  uint8_t irq_flags[2])
+{
+	sx1231_priv_t *priv = dev->priv;
+	int err = ERR_UNSPEC;
+	spi_batch_t batch;
+	pkt_t overflow_pkt;
+	pkt_t *pkt;
+	uint8_t *buf;
+	uint8_t status[SX1231_PKT_STATUS_LEN];
+	uint8_t lna;
 	uint8_t hdrlen;
 	uint8_t pktlen;
 	bool drop;
-	int i;
 
-	DBG_PRINTF(DBG_LVL_LOW, "> Received packet: \n");
-	DBG_EXEC(DBG_LVL_LOW, _dump_packet_status(dev));
-	DBG_EXEC(DBG_LVL_HIGH, _dump_status(dev));
+	// Read directly into the next free slot. The FIFO must be emptied even
+	// if there is no room, so use a scratch slot in that case.
+	pkt = pkt_buf_alloc(rx_buf);
+	if (pkt == NULL) {
+		pkt = &overflow_pkt;
+	}
+	buf = pkt->data;
+
+	// Packet status is read in the same transaction as the packet data
+	spi_batch_init(&batch);
+	TRY(spi_batch_read(&batch, RegAfcMsb, status, sizeof(status)));
+	TRY(spi_batch_read(&batch, RegLna, &lna, 1));
 
 	// Read Header
 	if (dev->fixpklen == 0) {
-		TRY(spi_read_reg(dev->fd, RegFifo, &buf[0]));
+		TRY(spi_batch_read(&batch, RegFifo, &buf[0], 1));
+		TRY(spi_batch_submit(dev->fd, &batch));
 
 		hdrlen = 1;
 		pktlen = buf[0];
 
-		if (pktlen == 0 || pktlen > SX1231_FIFO_SIZE - 1) {
+		if (pktlen == 0 || (! priv->rx_stream &&
+				    pktlen > SX1231_FIFO_SIZE - 1)) {
 			fprintf(stderr, "ERROR: Invalid Packet length(%u)\n",
 				pktlen);
+			rf_stat_add(dev, RF_STAT_LEN_ERRORS, 1);
 			TRY(_reset_rx_fifo(dev));
 			err = ERR_OK;
 			goto fail;
@@ -303,56 +717,151 @@ static int _receive_frame(rf_dev_t *dev, ring_buf_t *rx_buf)
 	}
 
 	// Read Payload
-	TRY(spi_read_regs(dev->fd, RegFifo, &buf[hdrlen], pktlen));
+	if (irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY) {
+		TRY(spi_batch_read(&batch, RegFifo, &buf[hdrlen], pktlen));
+		TRY(spi_batch_submit(dev->fd, &batch));
+	} else {
+		TRY(spi_batch_submit(dev->fd, &batch));
+		TRY(_receive_stream(dev, &buf[hdrlen], pktlen, irq_flags));
+		if (! (irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY)) {
+			return ERR_OK;
+		}
+	}
 
+	LAT_EXEC(rf_lat_fifo(dev));
+	pkt_meta_init(&pkt->meta, dev->irq_timestamp);
+	pkt->meta.channel = dev->channel;
+	dev->irq_timestamp = 0;
+	pkt->meta.afc = (int16_t) (status[0] << 8 | status[1]) * SX1231_FSTEP;
+	pkt->meta.fei = (int16_t) (status[2] << 8 | status[3]) * SX1231_FSTEP;
+	pkt->meta.rssi = -status[5];
+	pkt->meta.lna = (lna >> 3) & 0x7;
+	if (irq_flags[1] & IRQ_FLAGS2_CRCOK) {
+		pkt->meta.flags |= PKT_FLAG_CRC_OK;
+	}
+
+	DBG_PRINTF(DBG_LVL_LOW, "> Received packet: \n");
+	DBG_EXEC(DBG_LVL_LOW, _dump_packet_status(dev, &pkt->meta));
 	DBG_HEXDUMP(DBG_LVL_MID, &buf[hdrlen], pktlen);
 	DBG_EXEC(DBG_LVL_HIGH, _dump_status(dev));
 
-#if 1
-	// Local CRC calculation
-	// Currently calculates 0x8005 CRC-16 (IBM) on data only.
-	// TODO: remove this and switch sensof to CRC-CCITT
+	// Local CRC check
 	drop = false;
-	if (true) {
-		uint16_t crc = 0;
-		const uint16_t CRC_16_POLY = 0x8005;
-		if (pktlen < 2) {
+	if (dev->sw_crc != NULL) {
+		if (! crc16_check_frame(dev->sw_crc, &buf[hdrlen], pktlen)) {
 			drop = true;
 		} else {
+			// Strip CRC
 			pktlen -= 2;
-			for (i=hdrlen; i < pktlen; i++) {
-				// from sensof:crc.c:crc16()
-				uint8_t j=8;
-				bool do_xor;
-				uint8_t b = buf[i];
-
-				while (j) {
-					do_xor = (b ^ (crc >> 8)) & 0x80;
+			if (hdrlen) {
+				buf[0] = pktlen;
+			}
+			pkt->meta.flags |= PKT_FLAG_CRC_OK;
+		}
+	}
+	pkt->meta.len = hdrlen + pktlen;
+
+	// Add to packet buffer
+	if (!drop && pkt != &overflow_pkt) {
+		LAT_EXEC(*pkt_buf_stamp(rx_buf, pkt) = dev->lat_fifo_ns);
+		pkt_buf_commit(rx_buf);
+		rf_stat_add(dev, RF_STAT_RX_PACKETS, 1);
+		rf_stat_add(dev, RF_STAT_RX_BYTES, pkt->meta.len);
+	} else {
+		DBG_PRINTF(DBG_LVL_LOW, "Dropping packet: %s\n", drop ? "CRC error" : "RX buffer overflow");
+		rf_stat_add(dev, drop ? RF_STAT_CRC_ERRORS :
+				RF_STAT_RX_OVERFLOWS, 1);
+	}
 
-					crc = crc << 1;
+	return ERR_OK;
+fail:
+	return err;
+}
 
-					if (do_xor) {
-						crc ^= CRC_16_POLY;
-					}
+/**
+ * Stream payload from FIFO while packet is being received
+ *
+ * Reads SX1231_FIFO_THRESHOLD bytes every time the FIFO level exceeds the
+ * threshold, and the remainder once PayloadReady is set. Every chunk is read
+ * in the same transaction as the IRQ flags.
+ *
+ * @param dev		Device object
+ * @param buf		Buffer to store payload in
+ * @param len		Payload length
+ * @param irq_flags	Current RegIrqFlags1/2 values, updated on return.
+ *			PayloadReady is cleared if the packet was lost.
+ */
+static int _receive_stream(rf_dev_t *dev, uint8_t *buf, size_t len,
+			   uint8_t irq_flags[2])
+{
+	int err = ERR_UNSPEC;
+	spi_batch_t batch;
+	size_t off = 0;
+	size_t n;
+	rf_wait_t w;
 
-					b = b << 1;
-					j--;
-				}
-			}
-			if (buf[pktlen] != ((crc >> 8) & 0xff) ||
-			    buf[pktlen + 1] != (crc & 0xff)) {
-				drop = true;
+	while (off < len) {
+		if (irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY) {
+			n = len - off;
+		} else if (irq_flags[1] & IRQ_FLAGS2_FIFOLEVEL) {
+			n = len - off;
+			if (n > SX1231_FIFO_THRESHOLD) {
+				n = SX1231_FIFO_THRESHOLD;
 			}
-			//FIXME: if var length, length field should be corrected.
+		} else {
+			n = 0;
 		}
+
+		if (n != 0) {
+			spi_batch_init(&batch);
+			TRY(spi_batch_read(&batch, RegFifo, &buf[off], n));
+			TRY(spi_batch_read(&batch, RegIrqFlags1, irq_flags, 2));
+			TRY(spi_batch_submit(dev->fd, &batch));
+			off += n;
+			continue;
+		}
+		if (! (irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH)) {
+			// Reception restarted, eg. CRC error
+			return ERR_OK;
+		}
+
+		// FifoLevel isn't mapped to the IRQ line
+		rf_wait_start(dev, &w, RF_POLL_RX, SX1231_RX_TIMEOUT_US);
+		w.use_irq = false;
+		do {
+			err = rf_wait_next(dev, &w);
+			if (err == ERR_RFM_TIMEOUT) {
+				fprintf(stderr, "ERROR: Timeout receiving packet\n");
+				rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
+				irq_flags[1] &= ~IRQ_FLAGS2_PAYLOADREADY;
+				TRY(_reset_rx_fifo(dev));
+				return ERR_OK;
+			}
+			TRY(err);
+			TRY(spi_read_regs(dev->fd, RegIrqFlags1, irq_flags, 2));
+		} while ((irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH) &&
+			 ! (irq_flags[1] & (IRQ_FLAGS2_PAYLOADREADY |
+					    IRQ_FLAGS2_FIFOLEVEL)));
 	}
-#endif
 
-	// Add to ring buffer
-	if (!drop && ring_buf_bytes_free(rx_buf) >= hdrlen + pktlen) {
-		ring_buf_add(rx_buf, buf, hdrlen + pktlen);
-	} else {
-		DBG_PRINTF(DBG_LVL_LOW, "Dropping packet: %s\n", drop ? "CRC error" : "RX buffer overflow");
+	// PayloadReady is only set once the complete packet is received
+	if (! (irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY)) {
+		rf_wait_start(dev, &w, RF_POLL_RX, SX1231_RX_TIMEOUT_US);
+		w.use_irq = false;
+		while (! (irq_flags[1] & IRQ_FLAGS2_PAYLOADREADY)) {
+			if (! (irq_flags[0] & IRQ_FLAGS1_SYNCADDRESSMATCH)) {
+				return ERR_OK;
+			}
+			err = rf_wait_next(dev, &w);
+			if (err == ERR_RFM_TIMEOUT) {
+				fprintf(stderr, "ERROR: Timeout receiving packet\n");
+				rf_stat_add(dev, RF_STAT_TIMEOUTS, 1);
+				TRY(_reset_rx_fifo(dev));
+				return ERR_OK;
+			}
+			TRY(err);
+			TRY(spi_read_regs(dev->fd, RegIrqFlags1, irq_flags, 2));
+		}
 	}
 
 	return ERR_OK;
@@ -368,7 +877,6 @@ static void _dump_status(rf_dev_t *dev)
 	printf("Interrupt Flags: %.2x %.2x\n", buf[0], buf[1]);
 }
 
-#define SX1231_FSTEP 61 // Depends on Oscillator frequency!!!
 const char * const lna_values[8] = {
 	"??????",
 	"  Max.",
@@ -380,24 +888,21 @@ const char * const lna_values[8] = {
 	"??????",
 };
 
-static void _dump_packet_status(rf_dev_t *dev)
+/**
+ * Print packet status
+ *
+ * @param dev		Device object
+ * @param meta		Meta data of received packet
+ */
+static void _dump_packet_status(rf_dev_t *dev, const pkt_meta_t *meta)
 {
-	uint8_t buf[6];
-	int16_t afc;
-	int16_t fei;
-	uint8_t lna;
 	uint8_t temp;
 
-	spi_read_regs(dev->fd, RegAfcMsb, buf, 6);
 	spi_read_reg(dev->fd, RegTemp2, &temp);
-	spi_read_reg(dev->fd, RegLna, &lna);
 
-	afc = (buf[0] << 8 | buf[1]) * SX1231_FSTEP;
-	fei = (buf[2] << 8 | buf[3]) * SX1231_FSTEP;
 	printf("AFC: %7d Hz, FEI: %7d Hz, LNA: %s, RSSI: -%u%s dB, Temp: %u C\n",
-			afc, fei,
-			lna_values[(lna >> 3) & 0x7],
-			buf[5] >> 1, buf[5] & 1 ? ".5" : ".0",
+			meta->afc, meta->fei,
+			lna_values[meta->lna],
+			-meta->rssi >> 1, -meta->rssi & 1 ? ".5" : ".0",
 			temp);
-	//TODO: dump RegLna.LnaCurrentGain ??
 }
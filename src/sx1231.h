@@ -29,18 +29,8 @@
 #ifndef __SX1231_H__
 #define __SX1231_H__
 
-#include "ring_buf.h"
-#include "sparse_buf.h"
+#include "rf_dev.h"
 
-typedef struct {
-	int fd;
-	uint8_t fixpklen; /**< Length of packet or 0 if var. length */
-} rf_dev_t;
-
-int rf_open(rf_dev_t *dev, const char *spi_path);
-void rf_close(rf_dev_t *dev);
-
-int rf_init(rf_dev_t *dev, sparse_buf_t *regs);
-int rf_handle(rf_dev_t *dev, ring_buf_t *rx_buf, ring_buf_t *tx_buf);
+extern const rf_ops_t sx1231_ops;
 
 #endif // __SX1231_H__
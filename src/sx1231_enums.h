@@ -123,6 +123,17 @@ enum {
 	PACKET_CONFIG1_ADDRESSFILTERING_NODE_BCAST = (2 << 1),
 };
 
+// RegPacketConfig2
+enum {
+	PACKET_CONFIG2_RESTARTRX		= 0x04,
+};
+
+// RegFifoThresh
+enum {
+	FIFO_THRESH_TXSTARTCONDITION	= 0x80,
+	FIFO_THRESH_FIFOTHRESHOLD_MASK	= 0x7f,
+};
+
 // RegIrqFlags1
 enum {
         IRQ_FLAGS1_MODEREADY		= 0x80,
@@ -0,0 +1,116 @@
+/**
+ * uplink.c - Framing of messages exchanged with remote collectors
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "uplink.h"
+
+#include <string.h>
+
+static void _put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void _put32(uint8_t *p, uint32_t v)
+{
+	_put16(p, v >> 16);
+	_put16(p + 2, v);
+}
+
+static void _put64(uint8_t *p, uint64_t v)
+{
+	_put32(p, v >> 32);
+	_put32(p + 4, v);
+}
+
+static uint16_t _get16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t _get32(const uint8_t *p)
+{
+	return ((uint32_t) _get16(p) << 16) | _get16(p + 2);
+}
+
+static uint64_t _get64(const uint8_t *p)
+{
+	return ((uint64_t) _get32(p) << 32) | _get32(p + 4);
+}
+
+void uplink_encode(uint8_t *hdr, uplink_msg_type_t type, uint32_t gateway,
+		   const pkt_t *pkt)
+{
+	hdr[0] = UPLINK_VERSION;
+	hdr[1] = type;
+	_put16(&hdr[2], pkt->meta.len);
+	_put32(&hdr[4], gateway);
+	_put64(&hdr[8], pkt->meta.timestamp);
+	_put32(&hdr[16], pkt->meta.afc);
+	_put32(&hdr[20], pkt->meta.fei);
+	_put16(&hdr[24], pkt->meta.rssi);
+	hdr[26] = pkt->meta.lna;
+	hdr[27] = pkt->meta.flags;
+	hdr[28] = pkt->meta.radio;
+	hdr[29] = pkt->meta.channel;
+	_put16(&hdr[30], 0);
+}
+
+ssize_t uplink_decode(const uint8_t *buf, size_t len, uplink_msg_type_t *type,
+		      uint32_t *gateway, pkt_t *pkt)
+{
+	size_t data_len;
+
+	if (len < UPLINK_HDR_LEN) {
+		return 0;
+	}
+
+	data_len = _get16(&buf[2]);
+	if (buf[0] != UPLINK_VERSION || data_len > PKT_MAX_LEN ||
+	    (buf[1] != UPLINK_MSG_RX && buf[1] != UPLINK_MSG_TX)) {
+		return -1;
+	}
+	if (len < UPLINK_HDR_LEN + data_len) {
+		return 0;
+	}
+
+	*type = buf[1];
+	*gateway = _get32(&buf[4]);
+	pkt->meta.timestamp = _get64(&buf[8]);
+	pkt->meta.afc = (int32_t) _get32(&buf[16]);
+	pkt->meta.fei = (int32_t) _get32(&buf[20]);
+	pkt->meta.rssi = (int16_t) _get16(&buf[24]);
+	pkt->meta.len = data_len;
+	pkt->meta.lna = buf[26];
+	pkt->meta.flags = buf[27];
+	pkt->meta.radio = buf[28];
+	pkt->meta.channel = buf[29];
+	memcpy(pkt->data, &buf[UPLINK_HDR_LEN], data_len);
+
+	return UPLINK_HDR_LEN + data_len;
+}
@@ -0,0 +1,95 @@
+/**
+ * uplink.h - Framing of messages exchanged with remote collectors
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __UPLINK_H__
+#define __UPLINK_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "pkt_buf.h"
+
+/**
+ * Uplink message
+ *
+ * Every message is a fixed size header followed by the frame data. Over UDP
+ * every datagram contains one message, over TCP messages are concatenated.
+ * Header layout, all values in network byte order:
+ *
+ *    0 uint8	version, UPLINK_VERSION
+ *    1 uint8	type, UPLINK_MSG_*
+ *    2 uint16	length of frame data
+ *    4 uint32	gateway ID
+ *    8 uint64	time of arrival in ns (CLOCK_MONOTONIC of gateway)
+ *   16 int32	AFC correction in Hz
+ *   20 int32	frequency error in Hz
+ *   24 int16	RSSI in 0.5 dBm steps
+ *   26 uint8	LNA gain
+ *   27 uint8	flags, PKT_FLAG_*
+ *   28 uint8	transceiver index
+ *   29 uint8	channel index
+ *   30 uint16	reserved, 0
+ *
+ * The meta data fields are 0 in UPLINK_MSG_TX messages.
+ */
+#define UPLINK_VERSION 1
+#define UPLINK_HDR_LEN 32
+
+typedef enum {
+	UPLINK_MSG_RX = 1,	/**< Received frame, gateway to collector */
+	UPLINK_MSG_TX = 2,	/**< Frame to transmit, collector to gateway */
+} uplink_msg_type_t;
+
+/**
+ * Encode message header
+ *
+ * @param hdr		Buffer of UPLINK_HDR_LEN bytes to write header to
+ * @param type		Message type
+ * @param gateway	Gateway ID
+ * @param pkt		Frame and meta data, incl. transceiver index
+ */
+void uplink_encode(uint8_t *hdr, uplink_msg_type_t type, uint32_t gateway,
+		   const pkt_t *pkt);
+
+/**
+ * Decode message
+ *
+ * @param buf		Received data, starting at a message header
+ * @param len		Amount of received data
+ * @param type		Returns message type
+ * @param gateway	Returns gateway ID
+ * @param pkt		Returns frame and meta data
+ *
+ * @returns	Length of message, 0 if buf doesn't contain the complete
+ *		message yet, or -1 if the message is invalid
+ */
+ssize_t uplink_decode(const uint8_t *buf, size_t len, uplink_msg_type_t *type,
+		      uint32_t *gateway, pkt_t *pkt);
+
+#endif // __UPLINK_H__
@@ -0,0 +1,73 @@
+/**
+ * short_writev.c - Preload library limiting the size of writev() calls
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE // for RTLD_NEXT
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define MAX_IOV 64
+
+/**
+ * Max. bytes written per call, not a multiple of any frame length used in the
+ * tests
+ */
+#define MAX_WRITE 25
+
+/**
+ * Write at most MAX_WRITE bytes
+ *
+ * Sockets practically never accept part of a small write, this makes the
+ * daemon regularly stop in the middle of a frame when writing to a client.
+ */
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	static ssize_t (*real_writev)(int, const struct iovec *, int);
+	struct iovec tmp[MAX_IOV];
+	size_t len = 0;
+	int i;
+
+	if (real_writev == NULL) {
+		real_writev = dlsym(RTLD_NEXT, "writev");
+	}
+	if (iovcnt < 1 || iovcnt > MAX_IOV) {
+		return real_writev(fd, iov, iovcnt);
+	}
+
+	for (i = 0; i < iovcnt && len < MAX_WRITE; i++) {
+		tmp[i] = iov[i];
+		if (tmp[i].iov_len > MAX_WRITE - len) {
+			tmp[i].iov_len = MAX_WRITE - len;
+		}
+		len += tmp[i].iov_len;
+	}
+
+	return real_writev(fd, tmp, i);
+}
@@ -0,0 +1,199 @@
+/**
+ * test_crc16.c - Unit test for crc16.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "crc16.h"
+
+static const uint8_t check_str[] = "123456789";
+
+/**
+ * Calculate CRC over standard check string
+ *
+ * Expected: all implementations return the catalogued check value.
+ */
+START_TEST(test_check_values)
+{
+	crc16_t crc;
+	const size_t len = sizeof(check_str) - 1;
+
+	// CRC-16/BUYPASS
+	crc16_init(&crc, CRC16_POLY_IBM, CRC16_INIT_IBM);
+	ck_assert_uint_eq(crc16_bitwise(&crc, check_str, len), 0xfee8);
+	ck_assert_uint_eq(crc16_table(&crc, check_str, len), 0xfee8);
+	ck_assert_uint_eq(crc16_slice4(&crc, check_str, len), 0xfee8);
+	ck_assert_uint_eq(crc16_slice8(&crc, check_str, len), 0xfee8);
+
+	// CRC-16/CCITT-FALSE
+	crc16_init(&crc, CRC16_POLY_CCITT, CRC16_INIT_CCITT);
+	ck_assert_uint_eq(crc16_bitwise(&crc, check_str, len), 0x29b1);
+	ck_assert_uint_eq(crc16_table(&crc, check_str, len), 0x29b1);
+	ck_assert_uint_eq(crc16_slice4(&crc, check_str, len), 0x29b1);
+	ck_assert_uint_eq(crc16_slice8(&crc, check_str, len), 0x29b1);
+
+	// CRC-16/XMODEM
+	crc16_init(&crc, CRC16_POLY_CCITT, 0x0000);
+	ck_assert_uint_eq(crc16(&crc, check_str, len), 0x31c3);
+}
+END_TEST
+
+/**
+ * Compare implementations for all lengths up to 255 bytes
+ *
+ * Expected: table and sliced implementations equal bitwise reference.
+ */
+START_TEST(test_equal_to_bitwise)
+{
+	crc16_t crc;
+	uint8_t data[255];
+	size_t len;
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = (i * 151 + 7) & 0xff;
+	}
+
+	crc16_init(&crc, CRC16_POLY_CCITT, CRC16_INIT_CCITT);
+	for (len = 0; len <= sizeof(data); len++) {
+		const uint16_t ref = crc16_bitwise(&crc, data, len);
+		ck_assert_uint_eq(crc16_table(&crc, data, len), ref);
+		ck_assert_uint_eq(crc16_slice4(&crc, data, len), ref);
+		ck_assert_uint_eq(crc16_slice8(&crc, data, len), ref);
+	}
+}
+END_TEST
+
+/**
+ * Parse CRC specification strings
+ */
+START_TEST(test_parse)
+{
+	crc16_t crc;
+
+	ck_assert_int_eq(crc16_parse(&crc, "ibm"), 0);
+	ck_assert_uint_eq(crc.poly, CRC16_POLY_IBM);
+	ck_assert_uint_eq(crc.init, CRC16_INIT_IBM);
+	ck_assert_uint_eq(crc.skip, 0);
+	ck_assert(crc.lsb_first == false);
+
+	ck_assert_int_eq(crc16_parse(&crc, "ccitt,skip=2,lsb"), 0);
+	ck_assert_uint_eq(crc.poly, CRC16_POLY_CCITT);
+	ck_assert_uint_eq(crc.init, CRC16_INIT_CCITT);
+	ck_assert_uint_eq(crc.skip, 2);
+	ck_assert(crc.lsb_first == true);
+
+	ck_assert_int_eq(crc16_parse(&crc, "poly=1021,init=1d0f"), 0);
+	ck_assert_uint_eq(crc.poly, 0x1021);
+	ck_assert_uint_eq(crc.init, 0x1d0f);
+
+	ck_assert_int_eq(crc16_parse(&crc, "foo"), -1);
+	ck_assert_int_eq(crc16_parse(&crc, "poly=10000"), -1);
+	ck_assert_int_eq(crc16_parse(&crc, "init="), -1);
+	ck_assert_int_eq(crc16_parse(&crc, "skip=x"), -1);
+}
+END_TEST
+
+/**
+ * Verify CRC of frames
+ */
+START_TEST(test_check_frame)
+{
+	crc16_t crc;
+	uint8_t frame[] = { 0xaa, '1', '2', '3', '4', '5', '6', '7', '8', '9',
+			    0xfe, 0xe8 };
+
+	crc16_init(&crc, CRC16_POLY_IBM, CRC16_INIT_IBM);
+	crc.skip = 1;
+	ck_assert(crc16_check_frame(&crc, frame, sizeof(frame)) == true);
+
+	// Byte order
+	crc.lsb_first = true;
+	ck_assert(crc16_check_frame(&crc, frame, sizeof(frame)) == false);
+	frame[10] = 0xe8;
+	frame[11] = 0xfe;
+	ck_assert(crc16_check_frame(&crc, frame, sizeof(frame)) == true);
+
+	// Corrupted data
+	frame[3] ^= 0x01;
+	ck_assert(crc16_check_frame(&crc, frame, sizeof(frame)) == false);
+
+	// Too short
+	ck_assert(crc16_check_frame(&crc, frame, 2) == false);
+}
+END_TEST
+
+/**
+ * Generate test suite for CRC-16
+ */
+Suite *crc16_suite(void)
+{
+	Suite *s;
+	TCase *tc_calc;
+	TCase *tc_frame;
+
+	s = suite_create("crc16");
+
+	// Calculation
+	tc_calc = tcase_create("calculation");
+	tcase_add_test(tc_calc, test_check_values);
+	tcase_add_test(tc_calc, test_equal_to_bitwise);
+	suite_add_tcase(s, tc_calc);
+
+	// Frame handling
+	tc_frame = tcase_create("frame");
+	tcase_add_test(tc_frame, test_parse);
+	tcase_add_test(tc_frame, test_check_frame);
+	suite_add_tcase(s, tc_frame);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = crc16_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
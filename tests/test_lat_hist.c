@@ -0,0 +1,179 @@
+/**
+ * test_lat_hist.c - Unit test for lat_hist.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "lat_hist.h"
+
+/**
+ * Map latencies to buckets
+ *
+ * Expected: bucket is floor(log2(ns)), clamped to the first and last bucket.
+ */
+START_TEST(test_bucket)
+{
+	ck_assert_uint_eq(lat_hist_bucket(0), 0);
+	ck_assert_uint_eq(lat_hist_bucket(1), 0);
+	ck_assert_uint_eq(lat_hist_bucket(2), 1);
+	ck_assert_uint_eq(lat_hist_bucket(3), 1);
+	ck_assert_uint_eq(lat_hist_bucket(4), 2);
+	ck_assert_uint_eq(lat_hist_bucket(1023), 9);
+	ck_assert_uint_eq(lat_hist_bucket(1024), 10);
+	ck_assert_uint_eq(lat_hist_bucket((uint64_t) 1 << 31),
+			  LAT_HIST_BUCKETS - 1);
+	ck_assert_uint_eq(lat_hist_bucket(UINT64_MAX), LAT_HIST_BUCKETS - 1);
+}
+END_TEST
+
+/**
+ * Add latencies to histogram
+ *
+ * Expected: counts end up in the right buckets, sum is accumulated.
+ */
+START_TEST(test_add)
+{
+	lat_hist_t h;
+
+	memset(&h, 0, sizeof(h));
+	lat_hist_add(&h, 100);
+	lat_hist_add(&h, 120);
+	lat_hist_add(&h, 5000);
+
+	ck_assert_uint_eq(lat_hist_total(&h), 3);
+	ck_assert_uint_eq(h.count[6], 2);
+	ck_assert_uint_eq(h.count[12], 1);
+	ck_assert_uint_eq(h.sum_ns, 5220);
+}
+END_TEST
+
+/**
+ * Record stage latency
+ *
+ * Expected: only recorded if both timestamps are known and in order.
+ */
+START_TEST(test_record)
+{
+	lat_hist_t hists[LAT_STAGE_CNT];
+
+	memset(hists, 0, sizeof(hists));
+	lat_record(hists, LAT_STAGE_SPI, 1000, 1500);
+	lat_record(hists, LAT_STAGE_SPI, 0, 1500);
+	lat_record(hists, LAT_STAGE_SPI, 1500, 1000);
+	lat_record(NULL, LAT_STAGE_SPI, 1000, 1500);
+
+	ck_assert_uint_eq(lat_hist_total(&hists[LAT_STAGE_SPI]), 1);
+	ck_assert_uint_eq(hists[LAT_STAGE_SPI].sum_ns, 500);
+	ck_assert_uint_eq(lat_hist_total(&hists[LAT_STAGE_IRQ]), 0);
+}
+END_TEST
+
+/**
+ * Estimate percentiles
+ *
+ * Expected: upper bound of bucket containing the percentile, 0 if empty.
+ */
+START_TEST(test_percentile)
+{
+	lat_hist_t h;
+	int i;
+
+	memset(&h, 0, sizeof(h));
+	ck_assert_uint_eq(lat_hist_percentile(&h, 50), 0);
+
+	for (i = 0; i < 99; i++) {
+		lat_hist_add(&h, 1000);		// bucket 9
+	}
+	lat_hist_add(&h, 1000000);		// bucket 19
+
+	ck_assert_uint_eq(lat_hist_percentile(&h, 0), 1023);
+	ck_assert_uint_eq(lat_hist_percentile(&h, 50), 1023);
+	ck_assert_uint_eq(lat_hist_percentile(&h, 99), 1023);
+	ck_assert_uint_eq(lat_hist_percentile(&h, 100), (1 << 20) - 1);
+	ck_assert_uint_eq(lat_hist_percentile(&h, 200), (1 << 20) - 1);
+}
+END_TEST
+
+/**
+ * Stage names
+ *
+ * Expected: every stage has a name, out of range stages return "?".
+ */
+START_TEST(test_stage_name)
+{
+	ck_assert_str_eq(lat_stage_name(LAT_STAGE_IRQ), "irq");
+	ck_assert_str_eq(lat_stage_name(LAT_STAGE_TOTAL), "total");
+	ck_assert_str_eq(lat_stage_name(LAT_STAGE_CNT), "?");
+}
+END_TEST
+
+/**
+ * Generate test suite for latency histograms
+ */
+Suite *lat_hist_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("lat_hist");
+
+	// Core test case
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_bucket);
+	tcase_add_test(tc_core, test_add);
+	tcase_add_test(tc_core, test_record);
+	tcase_add_test(tc_core, test_percentile);
+	tcase_add_test(tc_core, test_stage_name);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = lat_hist_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+/**
+ * test_metrics.c - Unit test for metrics.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "metrics.h"
+
+/**
+ * Write metric description and samples
+ *
+ * Expected: Prometheus text format, labels in braces if given.
+ */
+START_TEST(test_format)
+{
+	char buf[256];
+	metrics_t m;
+
+	metrics_init(&m, buf, sizeof(buf));
+	ck_assert_str_eq(buf, "");
+
+	metrics_describe(&m, "rf_rx_packets_total", "counter",
+			 "Received frames");
+	metrics_sample(&m, "rf_rx_packets_total", "radio=\"0\"", 12);
+	metrics_sample(&m, "rf_rx_packets_total", NULL, 18446744073709551615ULL);
+	metrics_sample(&m, "rf_up", "", 1);
+
+	ck_assert_str_eq(buf,
+		"# HELP rf_rx_packets_total Received frames\n"
+		"# TYPE rf_rx_packets_total counter\n"
+		"rf_rx_packets_total{radio=\"0\"} 12\n"
+		"rf_rx_packets_total 18446744073709551615\n"
+		"rf_up 1\n");
+	ck_assert_uint_eq(m.len, strlen(buf));
+	ck_assert(! m.truncated);
+}
+END_TEST
+
+/**
+ * Write more than fits in the buffer
+ *
+ * Expected: only complete lines in buffer, marked as truncated, and
+ * nothing is written after the truncation.
+ */
+START_TEST(test_truncate)
+{
+	char buf[16];
+	metrics_t m;
+
+	metrics_init(&m, buf, sizeof(buf));
+	metrics_sample(&m, "a", NULL, 1);
+	metrics_sample(&m, "abcdefghij", NULL, 2);
+	metrics_sample(&m, "b", NULL, 3);
+
+	ck_assert_str_eq(buf, "a 1\n");
+	ck_assert_uint_eq(m.len, 4);
+	ck_assert(m.truncated);
+}
+END_TEST
+
+/**
+ * Exactly fill the buffer
+ *
+ * Expected: line fits including the terminating '\0'.
+ */
+START_TEST(test_exact_fit)
+{
+	char buf[5];
+	metrics_t m;
+
+	metrics_init(&m, buf, sizeof(buf));
+	metrics_sample(&m, "a", NULL, 1);
+
+	ck_assert_str_eq(buf, "a 1\n");
+	ck_assert(! m.truncated);
+
+	metrics_sample(&m, "b", NULL, 2);
+	ck_assert_str_eq(buf, "a 1\n");
+	ck_assert(m.truncated);
+}
+END_TEST
+
+/**
+ * Generate test suite for metrics writer
+ */
+Suite *metrics_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("metrics");
+
+	// Core test case
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_format);
+	tcase_add_test(tc_core, test_truncate);
+	tcase_add_test(tc_core, test_exact_fit);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = metrics_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
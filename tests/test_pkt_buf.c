@@ -0,0 +1,355 @@
+/**
+ * test_pkt_buf.c - Unit test for pkt_buf.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <check.h>
+
+#include "pkt_buf.h"
+
+/**
+ * Initialize with invalid slot counts
+ *
+ * Expected: only powers of 2 are accepted.
+ */
+START_TEST(test_init)
+{
+	pkt_buf_t buf;
+
+	ck_assert_int_ne(pkt_buf_init(&buf, 0), 0);
+	ck_assert_int_ne(pkt_buf_init(&buf, 6), 0);
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 8), 0);
+	ck_assert_uint_eq(pkt_buf_size(&buf), 8);
+	ck_assert(pkt_buf_empty(&buf));
+	ck_assert(! pkt_buf_full(&buf));
+	ck_assert_ptr_eq(pkt_buf_peek(&buf), NULL);
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Fill buffer completely and read back
+ *
+ * Expected: packets returned in order, alloc fails when full.
+ */
+START_TEST(test_fill)
+{
+	pkt_buf_t buf;
+	pkt_t *pkt;
+	size_t i;
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 4), 0);
+
+	for (i = 0; i < 4; i++) {
+		pkt = pkt_buf_alloc(&buf);
+		ck_assert_ptr_ne(pkt, NULL);
+		pkt_meta_init(&pkt->meta, 1000 + i);
+		pkt->meta.len = 1;
+		pkt->data[0] = i;
+		pkt_buf_commit(&buf);
+		ck_assert_uint_eq(pkt_buf_count(&buf), i + 1);
+	}
+	ck_assert(pkt_buf_full(&buf));
+	ck_assert_ptr_eq(pkt_buf_alloc(&buf), NULL);
+
+	for (i = 0; i < 4; i++) {
+		pkt = pkt_buf_peek(&buf);
+		ck_assert_ptr_ne(pkt, NULL);
+		ck_assert_uint_eq(pkt->meta.timestamp, 1000 + i);
+		ck_assert_uint_eq(pkt->data[0], i);
+		pkt_buf_pop(&buf);
+	}
+	ck_assert(pkt_buf_empty(&buf));
+
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Alloc without commit
+ *
+ * Expected: packet not visible until committed.
+ */
+START_TEST(test_commit)
+{
+	pkt_buf_t buf;
+	pkt_t *pkt;
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 2), 0);
+
+	pkt = pkt_buf_alloc(&buf);
+	ck_assert_ptr_ne(pkt, NULL);
+	ck_assert(pkt_buf_empty(&buf));
+
+	// Same slot is returned until committed
+	ck_assert_ptr_eq(pkt_buf_alloc(&buf), pkt);
+	pkt_buf_commit(&buf);
+	ck_assert_ptr_eq(pkt_buf_peek(&buf), pkt);
+	ck_assert_ptr_ne(pkt_buf_alloc(&buf), pkt);
+
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Add and remove packets many times
+ *
+ * Expected: indices wrap around slots correctly.
+ */
+START_TEST(test_wrap)
+{
+	pkt_buf_t buf;
+	pkt_t *pkt;
+	size_t i;
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 4), 0);
+
+	for (i = 0; i < 1000; i++) {
+		pkt = pkt_buf_alloc(&buf);
+		pkt->data[0] = i & 0xff;
+		pkt_buf_commit(&buf);
+		if (i % 3 != 0 || pkt_buf_full(&buf)) {
+			pkt_buf_pop(&buf);
+		}
+		ck_assert(! pkt_buf_full(&buf));
+	}
+
+	pkt_buf_clear(&buf);
+	ck_assert(pkt_buf_empty(&buf));
+
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Reserve and remove multiple slots at once
+ *
+ * Expected: indexed access matches sequential access.
+ */
+START_TEST(test_batch)
+{
+	pkt_buf_t buf;
+	pkt_t *pkt;
+	size_t i;
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 8), 0);
+
+	// Move indices, so batch wraps around end of slots
+	for (i = 0; i < 5; i++) {
+		pkt_buf_commit(&buf);
+		pkt_buf_pop(&buf);
+	}
+
+	for (i = 0; i < 6; i++) {
+		pkt = pkt_buf_alloc_at(&buf, i);
+		ck_assert_ptr_ne(pkt, NULL);
+		pkt->data[0] = i;
+	}
+	ck_assert_ptr_eq(pkt_buf_alloc_at(&buf, 8), NULL);
+	ck_assert(pkt_buf_empty(&buf));
+
+	pkt_buf_commit_n(&buf, 6);
+	ck_assert_uint_eq(pkt_buf_count(&buf), 6);
+	ck_assert_uint_eq(pkt_buf_free(&buf), 2);
+	ck_assert_ptr_eq(pkt_buf_alloc_at(&buf, 2), NULL);
+	ck_assert_ptr_eq(pkt_buf_peek_at(&buf, 6), NULL);
+
+	for (i = 0; i < 6; i++) {
+		ck_assert_uint_eq(pkt_buf_peek_at(&buf, i)->data[0], i);
+	}
+
+	pkt_buf_pop_n(&buf, 4);
+	ck_assert_uint_eq(pkt_buf_peek(&buf)->data[0], 4);
+
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Access packets by sequence number
+ *
+ * Expected: only packets still in buffer are returned.
+ */
+START_TEST(test_seq)
+{
+	pkt_buf_t buf;
+	size_t seq;
+	size_t i;
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 4), 0);
+
+	for (i = 0; i < 10; i++) {
+		if (pkt_buf_full(&buf)) {
+			pkt_buf_pop(&buf);
+		}
+		seq = pkt_buf_head(&buf);
+		pkt_buf_alloc(&buf)->data[0] = seq;
+		pkt_buf_commit(&buf);
+	}
+
+	ck_assert_uint_eq(pkt_buf_head(&buf), 10);
+	ck_assert_uint_eq(pkt_buf_tail(&buf), 6);
+	ck_assert_ptr_eq(pkt_buf_get(&buf, 5), NULL);
+	ck_assert_ptr_eq(pkt_buf_get(&buf, 10), NULL);
+	for (seq = 6; seq < 10; seq++) {
+		ck_assert_ptr_ne(pkt_buf_get(&buf, seq), NULL);
+		ck_assert_uint_eq(pkt_buf_get(&buf, seq)->data[0], seq);
+	}
+
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Initialize meta data
+ *
+ * Expected: fields cleared, time filled in when not given.
+ */
+START_TEST(test_meta_init)
+{
+	pkt_t pkt;
+
+	memset(&pkt, 0xff, sizeof(pkt));
+	pkt_meta_init(&pkt.meta, 1234);
+	ck_assert_uint_eq(pkt.meta.timestamp, 1234);
+	ck_assert_int_eq(pkt.meta.rssi, 0);
+	ck_assert_int_eq(pkt.meta.afc, 0);
+	ck_assert_uint_eq(pkt.meta.flags, 0);
+
+	pkt_meta_init(&pkt.meta, 0);
+	ck_assert_uint_ne(pkt.meta.timestamp, 0);
+
+	// Frame data must directly follow meta data
+	ck_assert_ptr_eq((uint8_t *) &pkt.meta + sizeof(pkt.meta), pkt.data);
+}
+END_TEST
+
+#define SPSC_PKT_CNT 100000
+
+static void *spsc_producer(void *arg)
+{
+	pkt_buf_t *buf = arg;
+	uint32_t i;
+	pkt_t *pkt;
+
+	for (i = 0; i < SPSC_PKT_CNT; i++) {
+		while ((pkt = pkt_buf_alloc(buf)) == NULL) {
+			sched_yield();
+		}
+		pkt->meta.len = sizeof(i);
+		memcpy(pkt->data, &i, sizeof(i));
+		pkt_buf_commit(buf);
+	}
+
+	return NULL;
+}
+
+/**
+ * Producer and consumer in different threads
+ *
+ * Expected: all packets received in order with their contents intact.
+ */
+START_TEST(test_spsc)
+{
+	pkt_buf_t buf;
+	pthread_t producer;
+	uint32_t i;
+	uint32_t val;
+	pkt_t *pkt;
+
+	ck_assert_int_eq(pkt_buf_init(&buf, 8), 0);
+	ck_assert_int_eq(pthread_create(&producer, NULL, &spsc_producer, &buf),
+			 0);
+
+	for (i = 0; i < SPSC_PKT_CNT; i++) {
+		while ((pkt = pkt_buf_peek(&buf)) == NULL) {
+			sched_yield();
+		}
+		ck_assert_uint_eq(pkt->meta.len, sizeof(val));
+		memcpy(&val, pkt->data, sizeof(val));
+		ck_assert_uint_eq(val, i);
+		pkt_buf_pop(&buf);
+	}
+
+	pthread_join(producer, NULL);
+	ck_assert(pkt_buf_empty(&buf));
+
+	pkt_buf_destroy(&buf);
+}
+END_TEST
+
+Suite *pkt_buf_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+	TCase *tc_spsc;
+
+	s = suite_create("pkt_buf");
+
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_init);
+	tcase_add_test(tc_core, test_fill);
+	tcase_add_test(tc_core, test_commit);
+	tcase_add_test(tc_core, test_wrap);
+	tcase_add_test(tc_core, test_batch);
+	tcase_add_test(tc_core, test_seq);
+	tcase_add_test(tc_core, test_meta_init);
+	suite_add_tcase(s, tc_core);
+
+	tc_spsc = tcase_create("spsc");
+	tcase_add_test(tc_spsc, test_spsc);
+	suite_add_tcase(s, tc_spsc);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = pkt_buf_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+/**
+ * test_pkt_dedup.c - Unit test for pkt_dedup.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "pkt_dedup.h"
+
+#define MS 1000000ULL
+
+static pkt_dedup_t dedup;
+
+/**
+ * Repeated frames within and after the window
+ *
+ * Expected: copies are duplicates until the window of the first copy ends.
+ */
+START_TEST(test_window)
+{
+	const uint8_t a[] = { 0x03, 0x01, 0x02, 0x03 };
+	const uint8_t b[] = { 0x03, 0x01, 0x02, 0x04 };
+	const uint64_t t0 = 1000 * MS;
+
+	pkt_dedup_init(&dedup, 100 * MS);
+
+	ck_assert(! pkt_dedup_check(&dedup, a, sizeof(a), t0));
+	ck_assert(pkt_dedup_check(&dedup, a, sizeof(a), t0 + 10 * MS));
+	ck_assert(! pkt_dedup_check(&dedup, b, sizeof(b), t0 + 20 * MS));
+	ck_assert(pkt_dedup_check(&dedup, b, sizeof(b), t0 + 30 * MS));
+	ck_assert(pkt_dedup_check(&dedup, a, sizeof(a), t0 + 99 * MS));
+
+	// Duplicates don't extend the window
+	ck_assert(! pkt_dedup_check(&dedup, a, sizeof(a), t0 + 100 * MS));
+	ck_assert(pkt_dedup_check(&dedup, a, sizeof(a), t0 + 150 * MS));
+
+	// Frames of different length
+	ck_assert(! pkt_dedup_check(&dedup, a, sizeof(a) - 1, t0 + 150 * MS));
+
+	// Out of order timestamps of other transceivers
+	ck_assert(pkt_dedup_check(&dedup, b, sizeof(b), t0 + 10 * MS));
+}
+END_TEST
+
+/**
+ * More distinct frames than slots
+ *
+ * Expected: recent frames are still detected, oldest frames are forgotten.
+ */
+START_TEST(test_capacity)
+{
+	uint8_t frame[8];
+	uint32_t i;
+	size_t hits = 0;
+
+	pkt_dedup_init(&dedup, 1000000 * MS);
+
+	for (i = 0; i < 4 * PKT_DEDUP_SLOTS; i++) {
+		memset(frame, 0, sizeof(frame));
+		memcpy(frame, &i, sizeof(i));
+		ck_assert(! pkt_dedup_check(&dedup, frame, sizeof(frame), i));
+	}
+
+	// Last frame is always remembered
+	i--;
+	memcpy(frame, &i, sizeof(i));
+	ck_assert(pkt_dedup_check(&dedup, frame, sizeof(frame), i + 1));
+
+	// At most capacity frames are remembered. Check newest first, as
+	// frames that aren't found are added again.
+	for (i = 4 * PKT_DEDUP_SLOTS; i-- > 0; ) {
+		memcpy(frame, &i, sizeof(i));
+		if (pkt_dedup_check(&dedup, frame, sizeof(frame),
+				    4 * PKT_DEDUP_SLOTS)) {
+			hits++;
+		}
+	}
+	ck_assert_uint_le(hits, PKT_DEDUP_SLOTS);
+	ck_assert_uint_ge(hits, PKT_DEDUP_SLOTS * 3 / 4);
+}
+END_TEST
+
+/**
+ * Generate test suite for duplicate detector
+ */
+Suite *pkt_dedup_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("pkt_dedup");
+
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_window);
+	tcase_add_test(tc_core, test_capacity);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = pkt_dedup_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
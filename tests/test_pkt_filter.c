@@ -0,0 +1,175 @@
+/**
+ * test_pkt_filter.c - Unit test for pkt_filter.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "pkt_filter.h"
+
+// Two header bytes, length byte and payload
+static const uint8_t frame[] = { 0xa5, 0x12, 0x04, 0x01, 0x02, 0x03, 0x04 };
+static const pkt_filter_layout_t layout = { 2, true };
+
+/**
+ * Parse filter specifications
+ */
+START_TEST(test_parse)
+{
+	pkt_filter_t f;
+
+	ck_assert_int_eq(pkt_filter_parse(&f, ""), 0);
+	ck_assert_uint_eq(f.cnt, 0);
+
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr1=12:addr0!=0102/ff0f"), 0);
+	ck_assert_uint_eq(f.cnt, 2);
+	ck_assert_int_eq(f.rules[0].field, PKT_FILTER_HDR);
+	ck_assert_uint_eq(f.rules[0].off, 1);
+	ck_assert_uint_eq(f.rules[0].len, 1);
+	ck_assert_uint_eq(f.rules[0].mask[0], 0xff);
+	ck_assert(f.rules[0].negate == false);
+	ck_assert_int_eq(f.rules[1].field, PKT_FILTER_ADDR);
+	ck_assert_uint_eq(f.rules[1].len, 2);
+	ck_assert_uint_eq(f.rules[1].value[1], 0x02);
+	ck_assert_uint_eq(f.rules[1].mask[1], 0x0f);
+	ck_assert(f.rules[1].negate == true);
+
+	ck_assert_int_eq(pkt_filter_parse(&f, "foo0=12"), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr=12"), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=1"), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0="), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=12/ffff"), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr256=12"), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "addr0=000102030405060708"), -1);
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=12:"), 0);
+	ck_assert_int_eq(pkt_filter_parse(&f,
+		"hdr0=1:hdr0=1:hdr0=1:hdr0=1:hdr0=1:hdr0=1:hdr0=1:hdr0=1:hdr0=1"),
+		-1);
+}
+END_TEST
+
+/**
+ * Match header and address bytes
+ *
+ * Expected: all rules of a filter must match, negated rules must not match.
+ */
+START_TEST(test_match)
+{
+	pkt_filter_t f;
+
+	ck_assert_int_eq(pkt_filter_parse(&f, ""), 0);
+	ck_assert(pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=a512"), 0);
+	ck_assert(pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=a513"), 0);
+	ck_assert(! pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+
+	ck_assert_int_eq(pkt_filter_parse(&f, "addr1=0203"), 0);
+	ck_assert(pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+	ck_assert_int_eq(pkt_filter_parse(&f, "addr0=f1/0f"), 0);
+	ck_assert(pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=a5:addr0!=01"), 0);
+	ck_assert(! pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0=a5:addr0!=ff"), 0);
+	ck_assert(pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+}
+END_TEST
+
+/**
+ * Rules referencing bytes outside of their field
+ *
+ * Expected: rules never match, also when negated.
+ */
+START_TEST(test_out_of_field)
+{
+	const pkt_filter_layout_t no_hdr = { 0, false };
+	pkt_filter_t f;
+
+	// Header rule must not match payload bytes
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr1=1204"), 0);
+	ck_assert(! pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+	ck_assert_int_eq(pkt_filter_parse(&f, "hdr0!=00"), 0);
+	ck_assert(! pkt_filter_match(&f, &no_hdr, frame, sizeof(frame)));
+
+	// Payload starts at frame start without header and length byte
+	ck_assert_int_eq(pkt_filter_parse(&f, "addr0=a5"), 0);
+	ck_assert(pkt_filter_match(&f, &no_hdr, frame, sizeof(frame)));
+
+	// Truncated frames
+	ck_assert_int_eq(pkt_filter_parse(&f, "addr3=04"), 0);
+	ck_assert(pkt_filter_match(&f, &layout, frame, sizeof(frame)));
+	ck_assert(! pkt_filter_match(&f, &layout, frame, sizeof(frame) - 1));
+	ck_assert_int_eq(pkt_filter_parse(&f, "addr0!=ff"), 0);
+	ck_assert(! pkt_filter_match(&f, &layout, frame, 2));
+	ck_assert(! pkt_filter_match(&f, &layout, frame, 0));
+}
+END_TEST
+
+/**
+ * Generate test suite for packet filter
+ */
+Suite *pkt_filter_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("pkt_filter");
+
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_parse);
+	tcase_add_test(tc_core, test_match);
+	tcase_add_test(tc_core, test_out_of_field);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = pkt_filter_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,246 @@
+/**
+ * test_reg_profile.c - Unit test for reg_profile.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "reg_profile.h"
+
+#define REGS_SIZE 0x80
+
+static sparse_buf_t regs[3];
+static const char * const names[3] = { "base", "fast", "ch2" };
+
+/**
+ * Create register configurations of test profiles
+ */
+static void setup(void)
+{
+	size_t i;
+
+	for (i = 0; i < 3; i++) {
+		ck_assert_int_eq(sparse_buf_init(&regs[i], REGS_SIZE), 0);
+		sparse_buf_clear(&regs[i]);
+	}
+
+	// Base: two runs
+	for (i = 0x10; i < 0x18; i++) {
+		sparse_buf_write(&regs[0], i, i);
+	}
+	sparse_buf_write(&regs[0], 0x30, 0xaa);
+
+	// Same as base, except two registers and an extra one
+	for (i = 0x10; i < 0x18; i++) {
+		sparse_buf_write(&regs[1], i, i);
+	}
+	sparse_buf_write(&regs[1], 0x12, 0x55);
+	sparse_buf_write(&regs[1], 0x13, 0x66);
+	sparse_buf_write(&regs[1], 0x40, 0x01);
+
+	// Subset of base, with one change
+	sparse_buf_write(&regs[2], 0x30, 0xbb);
+}
+
+/**
+ * Free register configurations of test profiles
+ */
+static void teardown(void)
+{
+	size_t i;
+
+	for (i = 0; i < 3; i++) {
+		sparse_buf_destroy(&regs[i]);
+	}
+}
+
+/**
+ * Compile profiles and read them back
+ *
+ * Expected: base profile contains all registers in one burst per run,
+ * other profiles only the registers that differ from base, and getting a
+ * profile returns base overlaid with the profile.
+ */
+START_TEST(test_roundtrip)
+{
+	reg_profile_t prof;
+	sparse_buf_t out;
+	uint8_t *image;
+	size_t size;
+	size_t i;
+
+	setup();
+
+	ck_assert_int_eq(reg_profile_compile(regs, names, 3, &image, &size), 0);
+	ck_assert_int_eq(reg_profile_init(&prof, image, size), 0);
+	ck_assert_uint_eq(prof.cnt, 3);
+
+	ck_assert_int_eq(reg_profile_find(&prof, "base"), 0);
+	ck_assert_int_eq(reg_profile_find(&prof, "ch2"), 2);
+	ck_assert_int_eq(reg_profile_find(&prof, "slow"), -1);
+	ck_assert_str_eq(reg_profile_name(&prof, 1), "fast");
+
+	ck_assert_uint_eq(prof.entries[0].burst_cnt, 2);
+	ck_assert_uint_eq(prof.entries[0].len, 2 + 8 + 2 + 1);
+	ck_assert_uint_eq(prof.entries[1].burst_cnt, 2);
+	ck_assert_uint_eq(prof.entries[1].len, 2 + 2 + 2 + 1);
+	ck_assert_uint_eq(prof.entries[2].burst_cnt, 1);
+	ck_assert_uint_eq(prof.entries[2].len, 2 + 1);
+
+	ck_assert_int_eq(sparse_buf_init(&out, REGS_SIZE), 0);
+
+	ck_assert_int_eq(reg_profile_get(&prof, 0, &out), 0);
+	for (i = 0; i < REGS_SIZE; i++) {
+		ck_assert_int_eq(sparse_buf_is_valid(&out, i),
+				 sparse_buf_is_valid(&regs[0], i));
+		if (sparse_buf_is_valid(&out, i)) {
+			ck_assert_uint_eq(*sparse_buf_at(&out, i),
+					  *sparse_buf_at(&regs[0], i));
+		}
+	}
+
+	ck_assert_int_eq(reg_profile_get(&prof, 1, &out), 0);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x11), 0x11);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x12), 0x55);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x13), 0x66);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x30), 0xaa);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x40), 0x01);
+	ck_assert_uint_eq(sparse_buf_next_valid(&out, 0x41), SPARSE_BUF_OFF_END);
+
+	ck_assert_int_eq(reg_profile_get(&prof, 2, &out), 0);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x12), 0x12);
+	ck_assert_uint_eq(*sparse_buf_at(&out, 0x30), 0xbb);
+	ck_assert(! sparse_buf_is_valid(&out, 0x40));
+
+	sparse_buf_destroy(&out);
+	free(image);
+
+	teardown();
+}
+END_TEST
+
+/**
+ * Validate damaged images
+ *
+ * Expected: truncated images, wrong magic and changed data are rejected
+ */
+START_TEST(test_corrupt)
+{
+	reg_profile_t prof;
+	uint8_t *image;
+	size_t size;
+
+	setup();
+
+	ck_assert_int_eq(reg_profile_compile(regs, names, 3, &image, &size), 0);
+
+	ck_assert_int_eq(reg_profile_init(&prof, image, size - 1), -1);
+	ck_assert_int_eq(reg_profile_init(&prof, image, 4), -1);
+
+	image[size - 1] ^= 0x01;
+	ck_assert_int_eq(reg_profile_init(&prof, image, size), -1);
+	image[size - 1] ^= 0x01;
+
+	image[0] = 'X';
+	ck_assert_int_eq(reg_profile_init(&prof, image, size), -1);
+	image[0] = REG_PROFILE_MAGIC[0];
+
+	ck_assert_int_eq(reg_profile_init(&prof, image, size), 0);
+
+	free(image);
+
+	teardown();
+}
+END_TEST
+
+/**
+ * Compile invalid profile sets
+ *
+ * Expected: duplicate and too long names, and no profiles are rejected
+ */
+START_TEST(test_invalid_names)
+{
+	static const char * const dup[2] = { "a", "a" };
+	static const char * const long_name[1] = { "0123456789abcdef" };
+	uint8_t *image;
+	size_t size;
+
+	setup();
+
+	ck_assert_int_eq(reg_profile_compile(regs, dup, 2, &image, &size), -1);
+	ck_assert_int_eq(reg_profile_compile(regs, long_name, 1, &image,
+					     &size), -1);
+	ck_assert_int_eq(reg_profile_compile(regs, names, 0, &image, &size),
+			 -1);
+
+	teardown();
+}
+END_TEST
+
+/**
+ * Generate test suite for register profiles
+ */
+Suite *reg_profile_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("reg_profile");
+
+	// Core test case
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_roundtrip);
+	tcase_add_test(tc_core, test_corrupt);
+	tcase_add_test(tc_core, test_invalid_names);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = reg_profile_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
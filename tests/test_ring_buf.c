@@ -29,6 +29,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <check.h>
 
@@ -174,6 +176,34 @@ START_TEST(test_wrap)
 }
 END_TEST
 
+/**
+ * Peek at bytes before and after the end of the buffer memory
+ *
+ * Expected: bytes are returned in order, without consuming them
+ */
+START_TEST(test_peek_wrap)
+{
+	ring_buf_t buf;
+	uint8_t data[] = { 0x11, 0x22, 0x33, 0x44 };
+	uint8_t data2[] = { 0x55, 0x66 };
+
+	ring_buf_init(&buf, 5);
+
+	// queue:    |DFFDD|
+	// pointers: | w r |
+	ring_buf_add(&buf, data, sizeof(data));
+	ring_buf_consume(&buf, sizeof(data)-1);
+	ring_buf_add(&buf, data2, sizeof(data2));
+
+	ck_assert(ring_buf_peek(&buf, 0) == 0x44);
+	ck_assert(ring_buf_peek(&buf, 1) == 0x55);
+	ck_assert(ring_buf_peek(&buf, 2) == 0x66);
+	ck_assert_uint_eq(ring_buf_bytes_used(&buf), 3);
+
+	ring_buf_destroy(&buf);
+}
+END_TEST
+
 /**
  * Overflow buffer
  *
@@ -286,6 +316,177 @@ START_TEST(test_overflow_add_eq_to_cap)
 }
 END_TEST
 
+START_TEST(test_iov_empty)
+{
+	ring_buf_t buf;
+	struct iovec iov[2];
+
+	ring_buf_init(&buf, 4);
+	ck_assert_int_eq(ring_buf_readable_iov(&buf, iov), 0);
+	ck_assert_int_eq(ring_buf_writable_iov(&buf, iov), 1);
+	ck_assert_ptr_eq(iov[0].iov_base, buf.buf);
+	ck_assert_uint_eq(iov[0].iov_len, 3);
+	ring_buf_destroy(&buf);
+}
+END_TEST
+
+START_TEST(test_iov_full)
+{
+	ring_buf_t buf;
+	struct iovec iov[2];
+	uint8_t data[] = { 0x11, 0x22, 0x33 };
+
+	ring_buf_init(&buf, 4);
+	ring_buf_add(&buf, data, sizeof(data));
+	ck_assert_int_eq(ring_buf_writable_iov(&buf, iov), 0);
+	ck_assert_int_eq(ring_buf_readable_iov(&buf, iov), 1);
+	ck_assert_uint_eq(iov[0].iov_len, 3);
+	ck_assert(memcmp(iov[0].iov_base, data, 3) == 0);
+	ring_buf_destroy(&buf);
+}
+END_TEST
+
+START_TEST(test_iov_wrap)
+{
+	ring_buf_t buf;
+	struct iovec iov[2];
+	uint8_t data[] = { 0x11, 0x22, 0x33, 0x44, 0x55 };
+
+	// Move pointers to the middle of the buffer:
+	// | - | - | r | w | - | - | - | - |
+	ring_buf_init(&buf, 8);
+	ring_buf_add(&buf, data, 3);
+	ring_buf_consume(&buf, 2);
+	ck_assert_uint_eq(buf.roff, 2);
+	ck_assert_uint_eq(buf.woff, 3);
+
+	// Free space is split in two segments, keeping one byte before roff
+	ck_assert_int_eq(ring_buf_writable_iov(&buf, iov), 2);
+	ck_assert_ptr_eq(iov[0].iov_base, &buf.buf[3]);
+	ck_assert_uint_eq(iov[0].iov_len, 5);
+	ck_assert_ptr_eq(iov[1].iov_base, &buf.buf[0]);
+	ck_assert_uint_eq(iov[1].iov_len, 1);
+
+	// Write wrapping data through the I/O vectors
+	memcpy(iov[0].iov_base, data, 5);
+	memcpy(iov[1].iov_base, &data[1], 1);
+	ring_buf_commit(&buf, 6);
+	ck_assert(ring_buf_full(&buf));
+	ck_assert_uint_eq(ring_buf_bytes_used(&buf), 7);
+
+	// Data is readable as two segments
+	ck_assert_int_eq(ring_buf_readable_iov(&buf, iov), 2);
+	ck_assert_ptr_eq(iov[0].iov_base, &buf.buf[2]);
+	ck_assert_uint_eq(iov[0].iov_len, 6);
+	ck_assert_ptr_eq(iov[1].iov_base, &buf.buf[0]);
+	ck_assert_uint_eq(iov[1].iov_len, 1);
+	ck_assert_uint_eq(((uint8_t *) iov[0].iov_base)[0], 0x33);
+	ck_assert_uint_eq(((uint8_t *) iov[1].iov_base)[0], 0x22);
+
+	ring_buf_consume(&buf, 7);
+	ck_assert(ring_buf_empty(&buf));
+
+	ring_buf_destroy(&buf);
+}
+END_TEST
+
+START_TEST(test_iov_write_end)
+{
+	ring_buf_t buf;
+	struct iovec iov[2];
+	uint8_t data[] = { 0x11, 0x22, 0x33, 0x44 };
+
+	// Read pointer at 1, no room at begin of buffer
+	ring_buf_init(&buf, 4);
+	ring_buf_add(&buf, data, 2);
+	ring_buf_consume(&buf, 1);
+	ck_assert_int_eq(ring_buf_writable_iov(&buf, iov), 1);
+	ck_assert_ptr_eq(iov[0].iov_base, &buf.buf[2]);
+	ck_assert_uint_eq(iov[0].iov_len, 2);
+
+	ring_buf_commit(&buf, 2);
+	ck_assert_uint_eq(buf.woff, 0);
+	ck_assert(ring_buf_full(&buf));
+	ck_assert_int_eq(ring_buf_readable_iov(&buf, iov), 1);
+	ck_assert_uint_eq(iov[0].iov_len, 3);
+
+	ring_buf_destroy(&buf);
+}
+END_TEST
+
+START_TEST(test_mirror_create)
+{
+	ring_buf_t buf;
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+
+	// Unaligned sizes fall back to heap buffer
+	ring_buf_init(&buf, page_size + 1);
+	ck_assert(buf.mirrored == false);
+	ring_buf_destroy(&buf);
+
+	ring_buf_init(&buf, page_size);
+	ck_assert(buf.mirrored == true);
+	ck_assert_uint_eq(ring_buf_size(&buf), page_size);
+	ck_assert_uint_eq(ring_buf_bytes_writable(&buf), page_size - 1);
+
+	// Second mapping aliases first
+	buf.buf[0] = 0x5a;
+	ck_assert_uint_eq(buf.buf[page_size], 0x5a);
+	buf.buf[page_size + 1] = 0xa5;
+	ck_assert_uint_eq(buf.buf[1], 0xa5);
+
+	ring_buf_destroy(&buf);
+	ck_assert_ptr_eq(buf.buf, NULL);
+}
+END_TEST
+
+START_TEST(test_mirror_wrap)
+{
+	ring_buf_t buf;
+	struct iovec iov[2];
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	uint8_t data[16];
+	uint8_t out[16];
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = i + 1;
+	}
+
+	ring_buf_init(&buf, page_size);
+	ck_assert(buf.mirrored == true);
+
+	// Move pointers close to end of buffer
+	buf.roff = buf.woff = page_size - 4;
+
+	// Free space and data are contiguous across the end of the buffer
+	ck_assert_int_eq(ring_buf_writable_iov(&buf, iov), 1);
+	ck_assert_ptr_eq(iov[0].iov_base, &buf.buf[page_size - 4]);
+	ck_assert_uint_eq(iov[0].iov_len, page_size - 1);
+
+	ring_buf_add(&buf, data, sizeof(data));
+	ck_assert_uint_eq(buf.woff, sizeof(data) - 4);
+	ck_assert_uint_eq(ring_buf_bytes_readable(&buf), sizeof(data));
+	ck_assert(memcmp(ring_buf_begin(&buf), data, sizeof(data)) == 0);
+
+	ck_assert_int_eq(ring_buf_readable_iov(&buf, iov), 1);
+	ck_assert_uint_eq(iov[0].iov_len, sizeof(data));
+
+	ring_buf_get(&buf, out, sizeof(out));
+	ck_assert(memcmp(out, data, sizeof(data)) == 0);
+	ck_assert(ring_buf_empty(&buf));
+
+	// Commit across end of buffer
+	buf.roff = buf.woff = page_size - 2;
+	ring_buf_commit(&buf, 5);
+	ck_assert_uint_eq(buf.woff, 3);
+	ring_buf_consume(&buf, 5);
+	ck_assert(ring_buf_empty(&buf));
+
+	ring_buf_destroy(&buf);
+}
+END_TEST
+
 /**
  * Generate test suite for ring buffer
  */
@@ -296,6 +497,8 @@ Suite *ring_buf_suite(void)
 	TCase *tc_simple;
 	TCase *tc_wrap;
 	TCase *tc_overflow;
+	TCase *tc_iov;
+	TCase *tc_mirror;
 
 	s = suite_create("ring_buf");
 
@@ -315,6 +518,7 @@ Suite *ring_buf_suite(void)
 	// Wrapping
 	tc_wrap = tcase_create("wrapping");
 	tcase_add_test(tc_wrap, test_wrap);
+	tcase_add_test(tc_wrap, test_peek_wrap);
 	suite_add_tcase(s, tc_wrap);
 
 	// Overflow
@@ -324,6 +528,20 @@ Suite *ring_buf_suite(void)
 	tcase_add_test(tc_overflow, test_overflow_add_eq_to_cap);
 	suite_add_tcase(s, tc_overflow);
 
+	// I/O vectors
+	tc_iov = tcase_create("iov");
+	tcase_add_test(tc_iov, test_iov_empty);
+	tcase_add_test(tc_iov, test_iov_full);
+	tcase_add_test(tc_iov, test_iov_wrap);
+	tcase_add_test(tc_iov, test_iov_write_end);
+	suite_add_tcase(s, tc_iov);
+
+	// Mirrored mapping
+	tc_mirror = tcase_create("mirror");
+	tcase_add_test(tc_mirror, test_mirror_create);
+	tcase_add_test(tc_mirror, test_mirror_wrap);
+	suite_add_tcase(s, tc_mirror);
+
 	return s;
 }
 
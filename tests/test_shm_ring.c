@@ -0,0 +1,226 @@
+/**
+ * test_shm_ring.c - Unit test for shm_ring.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "shm_ring.h"
+#include "error.h"
+
+/**
+ * Create ring and attach a consumer to it
+ */
+static void create_pair(shm_ring_t *prod, shm_ring_t *cons, size_t cnt)
+{
+	ck_assert_int_eq(shm_ring_create(prod, cnt), ERR_OK);
+	ck_assert_int_eq(shm_ring_attach(cons, dup(prod->mem_fd),
+					 dup(prod->event_fd)), ERR_OK);
+}
+
+/**
+ * Create rings with invalid slot counts
+ *
+ * Expected: only powers of 2 are accepted.
+ */
+START_TEST(test_create)
+{
+	shm_ring_t ring;
+
+	ck_assert_int_eq(shm_ring_create(&ring, 0), ERR_INVAL);
+	ck_assert_int_eq(shm_ring_create(&ring, 3), ERR_INVAL);
+
+	ck_assert_int_eq(shm_ring_create(&ring, 4), ERR_OK);
+	ck_assert_uint_eq(ring.hdr->magic, SHM_RING_MAGIC);
+	ck_assert_uint_eq(ring.hdr->slot_cnt, 4);
+	ck_assert(ftruncate(ring.mem_fd, 0) == -1);
+	shm_ring_destroy(&ring);
+	ck_assert_int_eq(ring.mem_fd, -1);
+}
+END_TEST
+
+/**
+ * Attach to memory that isn't a ring
+ *
+ * Expected: attach fails with ERR_INVAL.
+ */
+START_TEST(test_attach_invalid)
+{
+	shm_ring_t prod;
+	shm_ring_t cons;
+
+	ck_assert_int_eq(shm_ring_create(&prod, 4), ERR_OK);
+
+	prod.hdr->magic = 0;
+	ck_assert_int_eq(shm_ring_attach(&cons, prod.mem_fd, prod.event_fd),
+			 ERR_INVAL);
+	prod.hdr->magic = SHM_RING_MAGIC;
+
+	prod.hdr->slot_cnt = 1024;
+	ck_assert_int_eq(shm_ring_attach(&cons, prod.mem_fd, prod.event_fd),
+			 ERR_INVAL);
+
+	shm_ring_destroy(&prod);
+}
+END_TEST
+
+/**
+ * Publish packets and consume them through second mapping
+ *
+ * Expected: packets are received in order, ring full after slot_cnt
+ * packets.
+ */
+START_TEST(test_publish_consume)
+{
+	shm_ring_t prod;
+	shm_ring_t cons;
+	const pkt_t *rpkt;
+	pkt_t *pkt;
+	size_t i;
+
+	create_pair(&prod, &cons, 4);
+	ck_assert_ptr_eq(shm_ring_peek(&cons), NULL);
+
+	for (i = 0; i < 7; i++) {
+		pkt = shm_ring_alloc(&prod);
+		ck_assert_ptr_ne(pkt, NULL);
+		pkt->meta.len = 1;
+		pkt->data[0] = i;
+		shm_ring_publish(&prod);
+
+		if (i % 2 == 1) {
+			rpkt = shm_ring_peek(&cons);
+			ck_assert_ptr_ne(rpkt, NULL);
+			ck_assert_uint_eq(rpkt->data[0], i / 2);
+			shm_ring_pop(&cons);
+		}
+	}
+
+	// 3 packets consumed, 4 outstanding, so ring must be full
+	ck_assert_ptr_eq(shm_ring_alloc(&prod), NULL);
+
+	for (i = 3; i < 7; i++) {
+		rpkt = shm_ring_peek(&cons);
+		ck_assert_ptr_ne(rpkt, NULL);
+		ck_assert_uint_eq(rpkt->data[0], i);
+		shm_ring_pop(&cons);
+	}
+	ck_assert_ptr_eq(shm_ring_peek(&cons), NULL);
+
+	shm_ring_destroy(&cons);
+	shm_ring_destroy(&prod);
+}
+END_TEST
+
+/**
+ * Notify consumer
+ *
+ * Expected: event fd only signaled if consumer is waiting, and only once
+ * per batch of packets.
+ */
+START_TEST(test_notify)
+{
+	shm_ring_t prod;
+	shm_ring_t cons;
+	uint64_t cnt;
+
+	create_pair(&prod, &cons, 4);
+
+	// Not waiting
+	shm_ring_alloc(&prod);
+	shm_ring_publish(&prod);
+	ck_assert_int_eq(shm_ring_notify(&prod), ERR_OK);
+	ck_assert(read(cons.event_fd, &cnt, sizeof(cnt)) == -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	// Packet available, so wait must return directly
+	ck_assert_int_eq(shm_ring_wait(&cons, -1), ERR_OK);
+	shm_ring_pop(&cons);
+
+	// Waiting, notification coalesced
+	cons.hdr->waiting = 1;
+	shm_ring_alloc(&prod);
+	shm_ring_publish(&prod);
+	ck_assert_int_eq(shm_ring_notify(&prod), ERR_OK);
+	ck_assert_int_eq(shm_ring_notify(&prod), ERR_OK);
+	ck_assert(read(cons.event_fd, &cnt, sizeof(cnt)) == sizeof(cnt));
+	ck_assert_uint_eq(cnt, 1);
+
+	// Empty ring, wait times out
+	cons.hdr->waiting = 0;
+	shm_ring_pop(&cons);
+	ck_assert_int_eq(shm_ring_wait(&cons, 10), ERR_OK);
+	ck_assert_ptr_eq(shm_ring_peek(&cons), NULL);
+	ck_assert_uint_eq(cons.hdr->waiting, 0);
+
+	shm_ring_destroy(&cons);
+	shm_ring_destroy(&prod);
+}
+END_TEST
+
+Suite *shm_ring_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("shm_ring");
+
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_create);
+	tcase_add_test(tc_core, test_attach_invalid);
+	tcase_add_test(tc_core, test_publish_consume);
+	tcase_add_test(tc_core, test_notify);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = shm_ring_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,254 @@
+/**
+ * test_slow_client.c - Test of dropping frames for slow stream clients
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <check.h>
+
+/**
+ * Simulated transceiver: variable length frames that fit in the FIFO, many
+ * more than fit in the socket buffer of a client that doesn't read
+ */
+#define SIM_SPEC "sim:si443x:rate=5000:count=5000:len=60:delay=300"
+#define SIM_FRAMES 5000
+#define SIM_LEN 60
+#define SI443X_REGS "33 02\n"
+
+/**
+ * Time the client doesn't read, longer than the simulated reception
+ */
+#define STALL_MS 1500
+#define IDLE_TIMEOUT_MS 1000
+#define CONNECT_TIMEOUT_MS 2000
+
+/**
+ * Path of daemon under test and of preload library cutting its writes short,
+ * given on the command line
+ */
+static const char *daemon_path;
+static const char *preload_path;
+
+static int connect_client(const char *path)
+{
+	struct sockaddr_un addr;
+	unsigned int i;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	for (i = 0; i < CONNECT_TIMEOUT_MS / 10; i++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1) {
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+			return fd;
+		}
+		close(fd);
+		usleep(10000);
+	}
+
+	return -1;
+}
+
+static pid_t start_daemon(const char *cfg_path, const char *sock_path)
+{
+	pid_t pid;
+	int fd;
+
+	pid = fork();
+	if (pid == 0) {
+		// Keep the test output free of daemon logging
+		if ((fd = open("/dev/null", O_WRONLY)) != -1) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		setenv("LD_PRELOAD", preload_path, 1);
+		execl(daemon_path, daemon_path, "-d", SIM_SPEC, "-c", cfg_path,
+		      "-s", sock_path, "-C", "none", (char *) NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	return pid;
+}
+
+/**
+ * Check that stream consists of complete simulated frames
+ *
+ * @returns	Amount of frames, or -1 if the framing is broken
+ */
+static int check_frames(const uint8_t *buf, size_t len)
+{
+	size_t off = 0;
+	size_t i;
+	int cnt = 0;
+
+	while (off < len) {
+		const uint8_t *payload = &buf[off + 1];
+		const size_t plen = buf[off];
+
+		// Last 8 payload bytes are the send time
+		if (plen != SIM_LEN || len - off < 1 + plen) {
+			return -1;
+		}
+		for (i = 0; i < plen - 8; i++) {
+			if (payload[i] != (uint8_t) (payload[0] + i)) {
+				return -1;
+			}
+		}
+		off += 1 + plen;
+		cnt++;
+	}
+
+	return cnt;
+}
+
+/**
+ * Stall stream client while the RX buffer overflows
+ *
+ * Writes of the daemon are cut short, so when the socket buffer fills up a
+ * frame is partially written. While the client stalls, frames are dropped
+ * several times in a row in that state.
+ *
+ * Expected: frames are dropped, but the client receives a stream of
+ * complete frames.
+ */
+START_TEST(test_stream_drop)
+{
+	char dir[] = "/tmp/test_slow_client.XXXXXX";
+	char cfg_path[sizeof(dir) + 16];
+	char sock_path[sizeof(dir) + 16];
+	const size_t size = (size_t) SIM_FRAMES * (1 + SIM_LEN);
+	struct pollfd pfd;
+	uint8_t *buf;
+	size_t len = 0;
+	ssize_t ret;
+	FILE *fp;
+	pid_t pid;
+	int status;
+	int cnt;
+	int fd;
+
+	ck_assert_ptr_ne(mkdtemp(dir), NULL);
+	snprintf(cfg_path, sizeof(cfg_path), "%s/regs.cfg", dir);
+	snprintf(sock_path, sizeof(sock_path), "%s/rf.sock", dir);
+	ck_assert_ptr_ne(fp = fopen(cfg_path, "w"), NULL);
+	fputs(SI443X_REGS, fp);
+	ck_assert_int_eq(fclose(fp), 0);
+	ck_assert_ptr_ne(buf = malloc(size), NULL);
+
+	pid = start_daemon(cfg_path, sock_path);
+	ck_assert_int_ne(pid, -1);
+	fd = connect_client(sock_path);
+	ck_assert_int_ne(fd, -1);
+
+	usleep(STALL_MS * 1000);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (len < size && poll(&pfd, 1, IDLE_TIMEOUT_MS) > 0) {
+		ret = read(fd, &buf[len], size - len);
+		if (ret <= 0) {
+			break;
+		}
+		len += ret;
+	}
+	close(fd);
+
+	kill(pid, SIGTERM);
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	unlink(sock_path);
+	unlink(cfg_path);
+	rmdir(dir);
+
+	cnt = check_frames(buf, len);
+	free(buf);
+	ck_assert_int_gt(cnt, 0);
+	ck_assert_int_lt(cnt, SIM_FRAMES);
+}
+END_TEST
+
+/**
+ * Generate test suite for slow clients
+ */
+Suite *slow_client_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("slow_client");
+
+	// Core test case
+	tc_core = tcase_create("core");
+	tcase_set_timeout(tc_core, 10);
+	tcase_add_test(tc_core, test_stream_drop);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(int argc, char *argv[])
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <path of rf_pkt_drv> <path of "
+			"short_writev library>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	daemon_path = argv[1];
+	preload_path = argv[2];
+
+	s = slow_client_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
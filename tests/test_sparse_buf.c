@@ -125,8 +125,112 @@ END_TEST
  *
  * The validity bitset is an array of unsigned integers.
  * Expected: The code correctly handles a bitset consisting of more than 1
- * element.
+ * element, with runs crossing and ending at element boundaries and a size
+ * that isn't a multiple of the element size.
  */
+START_TEST(test_multi_element)
+{
+	const size_t size = 200;
+	sparse_buf_t buf;
+	size_t i;
+	size_t j;
+
+	ck_assert_int_eq(sparse_buf_init(&buf, size), 0);
+
+	// Valid: 0, 30-33, 64-127, 190-199
+	ck_assert_int_eq(sparse_buf_write(&buf, 0, 0), 0);
+	for (i = 30; i < 34; i++) {
+		ck_assert_int_eq(sparse_buf_write(&buf, i, i), 0);
+	}
+	for (i = 64; i < 128; i++) {
+		ck_assert_int_eq(sparse_buf_write(&buf, i, i), 0);
+	}
+	for (i = 190; i < 200; i++) {
+		ck_assert_int_eq(sparse_buf_write(&buf, i, i), 0);
+	}
+	ck_assert_int_ne(sparse_buf_write(&buf, 200, 0), 0);
+
+	// Compare with bit by bit scan
+	for (i = 0; i <= size; i++) {
+		size_t next_valid = SPARSE_BUF_OFF_END;
+		size_t next_invalid = SPARSE_BUF_OFF_END;
+		size_t len = 0;
+
+		for (j = i; j < size; j++) {
+			if (sparse_buf_is_valid(&buf, j)) {
+				next_valid = j;
+				break;
+			}
+		}
+		for (j = i; j < size; j++) {
+			if (! sparse_buf_is_valid(&buf, j)) {
+				next_invalid = j;
+				break;
+			}
+		}
+		for (j = i; j < size && sparse_buf_is_valid(&buf, j); j++) {
+			len++;
+		}
+
+		ck_assert_uint_eq(sparse_buf_next_valid(&buf, i), next_valid);
+		ck_assert_uint_eq(sparse_buf_next_invalid(&buf, i), next_invalid);
+		ck_assert_uint_eq(sparse_buf_valid_length(&buf, i), len);
+	}
+
+	sparse_buf_destroy(&buf);
+}
+END_TEST
+
+/**
+ * Iterate over runs of valid bytes
+ *
+ * Expected: every run returned once with its length, end of iteration
+ * after the last run, also when the last run ends at the end of the buffer.
+ */
+START_TEST(test_runs)
+{
+	sparse_buf_t buf;
+	size_t off;
+	size_t len;
+	size_t i;
+
+	ck_assert_int_eq(sparse_buf_init(&buf, 0x80), 0);
+
+	off = 0;
+	ck_assert(! sparse_buf_next_run(&buf, &off, &len));
+	ck_assert_uint_eq(off, SPARSE_BUF_OFF_END);
+
+	for (i = 0x1c; i < 0x24; i++) {
+		ck_assert_int_eq(sparse_buf_write(&buf, i, i), 0);
+	}
+	ck_assert_int_eq(sparse_buf_write(&buf, 0x40, 0), 0);
+	ck_assert_int_eq(sparse_buf_write(&buf, 0x7e, 0), 0);
+	ck_assert_int_eq(sparse_buf_write(&buf, 0x7f, 0), 0);
+
+	off = 0;
+	ck_assert(sparse_buf_next_run(&buf, &off, &len));
+	ck_assert_uint_eq(off, 0x1c);
+	ck_assert_uint_eq(len, 8);
+	off += len;
+	ck_assert(sparse_buf_next_run(&buf, &off, &len));
+	ck_assert_uint_eq(off, 0x40);
+	ck_assert_uint_eq(len, 1);
+	off += len;
+	ck_assert(sparse_buf_next_run(&buf, &off, &len));
+	ck_assert_uint_eq(off, 0x7e);
+	ck_assert_uint_eq(len, 2);
+	off += len;
+	ck_assert(! sparse_buf_next_run(&buf, &off, &len));
+
+	// Start in middle of run
+	off = 0x20;
+	ck_assert(sparse_buf_next_run(&buf, &off, &len));
+	ck_assert_uint_eq(off, 0x20);
+	ck_assert_uint_eq(len, 4);
+
+	sparse_buf_destroy(&buf);
+}
+END_TEST
 
 
 /**
@@ -150,6 +254,8 @@ Suite *sparse_buffer_suite(void)
 	tcase_add_test(tc_simple, test_simple_write);
 	tcase_add_test(tc_simple, test_all_invalid);
 	tcase_add_test(tc_simple, test_all_valid);
+	tcase_add_test(tc_simple, test_multi_element);
+	tcase_add_test(tc_simple, test_runs);
 	suite_add_tcase(s, tc_simple);
 
 	return s;
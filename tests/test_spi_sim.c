@@ -0,0 +1,373 @@
+/**
+ * test_spi_sim.c - Unit tests for SPI tracing and simulated transceivers
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "spi.h"
+#include "spi_sim.h"
+#include "error.h"
+#include "si443x_enums.h"
+#include "sx1231_enums.h"
+
+unsigned int debug_level = 0;
+
+/**
+ * Receive frame on emulated Si443x
+ *
+ * Expected: chip detected by device type, frame in FIFO with length byte,
+ * interrupt status cleared on read, FIFO empty after reading frame.
+ */
+START_TEST(test_si443x_rx)
+{
+	uint8_t status[3];
+	uint8_t frame[1 + 12];
+	uint8_t val;
+	spi_sim_stats_t stats;
+	int fd;
+
+	ck_assert_int_eq(spi_sim_open(&fd, "si443x:rate=0:len=12"), ERR_OK);
+
+	ck_assert_int_eq(spi_read_reg(fd, DEVICE_TYPE, &val), ERR_OK);
+	ck_assert_uint_eq(val, DEVICE_TYPE_EZRADIOPRO);
+
+	ck_assert_int_eq(spi_write_reg(fd, HEADER_CONTROL_2, 0x02), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd,
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON |
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1_RXON), ERR_OK);
+	ck_assert_int_eq(spi_sim_rx(fd), ERR_OK);
+
+	ck_assert_int_eq(spi_read_regs(fd, DEVICE_STATUS, status, 3), ERR_OK);
+	ck_assert_uint_eq(status[0] & DEVICE_STATUS_RXFFEM, 0);
+	ck_assert_uint_ne(status[1] & INTERRUPT_STATUS_1_IPKVALID, 0);
+	ck_assert_int_eq(spi_read_reg(fd, INTERRUPT_STATUS_1, &val), ERR_OK);
+	ck_assert_uint_eq(val, 0);
+
+	ck_assert_int_eq(spi_read_regs(fd, FIFO_ACCESS, frame, sizeof(frame)),
+			 ERR_OK);
+	ck_assert_uint_eq(frame[0], 12);
+	ck_assert_uint_ne(spi_sim_frame_time(&frame[1], 12), 0);
+	ck_assert_int_eq(spi_read_reg(fd, DEVICE_STATUS, &val), ERR_OK);
+	ck_assert_uint_eq(val, DEVICE_STATUS_RXFFEM);
+
+	spi_sim_get_stats(fd, &stats);
+	ck_assert_uint_eq(stats.rx_generated, 1);
+	ck_assert_uint_eq(stats.rx_dropped, 0);
+
+	ck_assert(spi_sim_close(fd));
+}
+END_TEST
+
+/**
+ * Transmit frame on emulated Si443x, streaming the payload into the FIFO
+ *
+ * Expected: TX FIFO almost empty interrupt while the payload isn't complete,
+ * packet sent interrupt and TXON cleared once the complete payload is
+ * written.
+ */
+START_TEST(test_si443x_tx)
+{
+	const uint8_t payload[] = { 0xaa, 0xbb, 0xcc };
+	uint8_t status[2];
+	uint8_t val;
+	spi_sim_stats_t stats;
+	int fd;
+
+	ck_assert_int_eq(spi_sim_open(&fd, "si443x:rate=0"), ERR_OK);
+	ck_assert_int_eq(spi_read_regs(fd, INTERRUPT_STATUS_1, status, 2),
+			 ERR_OK);
+
+	ck_assert_int_eq(spi_write_reg(fd, TRANSMIT_PACKET_LENGTH,
+			sizeof(payload)), ERR_OK);
+	ck_assert_int_eq(spi_write_regs(fd, FIFO_ACCESS, payload, 2), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd,
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1,
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1_XTON |
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1_TXON), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, INTERRUPT_STATUS_1, &val), ERR_OK);
+	ck_assert_uint_ne(val & INTERRUPT_STATUS_1_ITXFFAEM, 0);
+	ck_assert_uint_eq(val & INTERRUPT_STATUS_1_IPKSENT, 0);
+
+	ck_assert_int_eq(spi_write_regs(fd, FIFO_ACCESS, &payload[2], 1),
+			 ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, INTERRUPT_STATUS_1, &val), ERR_OK);
+	ck_assert_uint_ne(val & INTERRUPT_STATUS_1_IPKSENT, 0);
+	ck_assert_int_eq(spi_read_reg(fd,
+			OPERATING_MODE_AND_FUNCTION_CONTROL_1, &val), ERR_OK);
+	ck_assert_uint_eq(val & OPERATING_MODE_AND_FUNCTION_CONTROL_1_TXON, 0);
+
+	spi_sim_get_stats(fd, &stats);
+	ck_assert_uint_eq(stats.tx_frames, 1);
+
+	ck_assert(spi_sim_close(fd));
+}
+END_TEST
+
+/**
+ * Receive frames on emulated SX1231 faster than they are read
+ *
+ * Expected: second frame dropped while PayloadReady is set, PayloadReady
+ * cleared once the FIFO is empty.
+ */
+START_TEST(test_sx1231_rx)
+{
+	uint8_t frame[1 + 16];
+	uint8_t val;
+	spi_sim_stats_t stats;
+	int fd;
+
+	ck_assert_int_eq(spi_sim_open(&fd, "sx1231:rate=0"), ERR_OK);
+
+	ck_assert_int_eq(spi_read_reg(fd, RegVersion, &val), ERR_OK);
+	ck_assert_uint_eq(val & SX1231_VERSION_MASK, SX1231_VERSION);
+
+	ck_assert_int_eq(spi_write_reg(fd, RegPacketConfig1,
+			PACKET_CONFIG1_PACKETFORMAT), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd, RegOpMode, OP_MODE_MODE_RX), ERR_OK);
+	ck_assert_int_eq(spi_sim_rx(fd), ERR_OK);
+	ck_assert_int_eq(spi_sim_rx(fd), ERR_OK);
+
+	ck_assert_int_eq(spi_read_reg(fd, RegIrqFlags2, &val), ERR_OK);
+	ck_assert_uint_ne(val & IRQ_FLAGS2_PAYLOADREADY, 0);
+
+	ck_assert_int_eq(spi_read_regs(fd, RegFifo, frame, sizeof(frame)),
+			 ERR_OK);
+	ck_assert_uint_eq(frame[0], 16);
+	ck_assert_int_eq(spi_read_reg(fd, RegIrqFlags2, &val), ERR_OK);
+	ck_assert_uint_eq(val & (IRQ_FLAGS2_PAYLOADREADY |
+				 IRQ_FLAGS2_FIFONOTEMPTY), 0);
+
+	spi_sim_get_stats(fd, &stats);
+	ck_assert_uint_eq(stats.rx_generated, 2);
+	ck_assert_uint_eq(stats.rx_dropped, 1);
+
+	ck_assert(spi_sim_close(fd));
+}
+END_TEST
+
+/**
+ * Transmit frame on emulated SX1231
+ *
+ * Expected: PacketSent once the complete frame is written in TX mode,
+ * cleared when leaving TX mode.
+ */
+START_TEST(test_sx1231_tx)
+{
+	const uint8_t frame[] = { 3, 0xaa, 0xbb, 0xcc };
+	uint8_t val;
+	spi_sim_stats_t stats;
+	int fd;
+
+	ck_assert_int_eq(spi_sim_open(&fd, "sx1231:rate=0"), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd, RegPacketConfig1,
+			PACKET_CONFIG1_PACKETFORMAT), ERR_OK);
+
+	ck_assert_int_eq(spi_write_regs(fd, RegFifo, frame, 2), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd, RegOpMode, OP_MODE_MODE_TX), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, RegIrqFlags2, &val), ERR_OK);
+	ck_assert_uint_eq(val & IRQ_FLAGS2_PACKETSENT, 0);
+
+	ck_assert_int_eq(spi_write_regs(fd, RegFifo, &frame[2], 2), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, RegIrqFlags2, &val), ERR_OK);
+	ck_assert_uint_ne(val & IRQ_FLAGS2_PACKETSENT, 0);
+
+	ck_assert_int_eq(spi_write_reg(fd, RegOpMode, OP_MODE_MODE_STDBY),
+			 ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, RegIrqFlags2, &val), ERR_OK);
+	ck_assert_uint_eq(val & IRQ_FLAGS2_PACKETSENT, 0);
+
+	spi_sim_get_stats(fd, &stats);
+	ck_assert_uint_eq(stats.tx_frames, 1);
+
+	ck_assert(spi_sim_close(fd));
+}
+END_TEST
+
+/**
+ * Record accesses to a trace and replay it
+ *
+ * Expected: replay returns the recorded read data, fails when the accesses
+ * diverge from the trace or the trace ends.
+ */
+START_TEST(test_replay)
+{
+	char path[] = "/tmp/test_spi_sim.XXXXXX";
+	char spec[64];
+	uint8_t status[2];
+	uint8_t val;
+	int tmp_fd;
+	int fd;
+
+	tmp_fd = mkstemp(path);
+	ck_assert_int_ne(tmp_fd, -1);
+	close(tmp_fd);
+	snprintf(spec, sizeof(spec), "replay=%s", path);
+
+	// Record
+	ck_assert_int_eq(spi_sim_open(&fd, "si443x:rate=0"), ERR_OK);
+	ck_assert_int_eq(spi_trace_open(path), 0);
+	ck_assert_int_eq(spi_read_reg(fd, DEVICE_TYPE, &val), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd, TRANSMIT_PACKET_LENGTH, 0x42),
+			 ERR_OK);
+	ck_assert_int_eq(spi_read_regs(fd, INTERRUPT_STATUS_1, status, 2),
+			 ERR_OK);
+	ck_assert_uint_eq(status[1], INTERRUPT_STATUS_2_IPOR |
+					INTERRUPT_STATUS_2_ICHIPRDY);
+	spi_trace_close();
+	ck_assert(spi_sim_close(fd));
+
+	// Replay
+	ck_assert_int_eq(spi_sim_open(&fd, spec), ERR_OK);
+	ck_assert_int_ne(spi_sim_irq_fd(fd), -1);
+	ck_assert_int_eq(spi_read_reg(fd, DEVICE_TYPE, &val), ERR_OK);
+	ck_assert_uint_eq(val, DEVICE_TYPE_EZRADIOPRO);
+	ck_assert_int_eq(spi_write_reg(fd, TRANSMIT_PACKET_LENGTH, 0x42),
+			 ERR_OK);
+	memset(status, 0, sizeof(status));
+	ck_assert_int_eq(spi_read_regs(fd, INTERRUPT_STATUS_1, status, 2),
+			 ERR_OK);
+	ck_assert_uint_eq(status[1], INTERRUPT_STATUS_2_IPOR |
+					INTERRUPT_STATUS_2_ICHIPRDY);
+	ck_assert_int_eq(spi_read_reg(fd, DEVICE_TYPE, &val), ERR_SPI_IOCTL);
+	ck_assert(spi_sim_close(fd));
+
+	// Diverging write
+	ck_assert_int_eq(spi_sim_open(&fd, spec), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, DEVICE_TYPE, &val), ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd, TRANSMIT_PACKET_LENGTH, 0x43),
+			 ERR_SPI_IOCTL);
+	ck_assert(spi_sim_close(fd));
+
+	unlink(path);
+}
+END_TEST
+
+/**
+ * Open invalid specifications
+ *
+ * Expected: ERR_INVAL, and non simulated file descriptors aren't closed.
+ */
+/**
+ * Reads made faster than the simulated link allows return corrupt data
+ */
+START_TEST(test_clock)
+{
+	spi_config_t cfg = { .speed_hz = 500000, .fifo_speed_hz = 2000000,
+			     .mode = 0 };
+	uint8_t val;
+	int fd;
+
+	ck_assert_int_eq(spi_sim_open(&fd, "sx1231:rate=0:clock=1000000"),
+			 ERR_OK);
+	ck_assert_int_eq(spi_write_reg(fd, RegSyncValue, 0x5a), ERR_OK);
+
+	// Register accesses use the register clock
+	ck_assert_int_eq(spi_configure(fd, &cfg, RegFifo), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, RegSyncValue, &val), ERR_OK);
+	ck_assert_int_eq(val, 0x5a);
+
+	// Register clock above the limit of the link
+	cfg.speed_hz = 2000000;
+	cfg.fifo_speed_hz = 0;
+	ck_assert_int_eq(spi_configure(fd, &cfg, RegFifo), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, RegSyncValue, &val), ERR_OK);
+	ck_assert_int_eq(val, 0x5b);
+
+	ck_assert_int_eq(spi_configure(fd, NULL, -1), ERR_OK);
+	ck_assert_int_eq(spi_read_reg(fd, RegSyncValue, &val), ERR_OK);
+	ck_assert_int_eq(val, 0x5a);
+
+	ck_assert(spi_sim_close(fd));
+}
+END_TEST
+
+START_TEST(test_invalid)
+{
+	int fd;
+
+	ck_assert_int_eq(spi_sim_open(&fd, ""), ERR_INVAL);
+	ck_assert_int_eq(spi_sim_open(&fd, "rfm69"), ERR_INVAL);
+	ck_assert_int_eq(spi_sim_open(&fd, "si443x:len=4"), ERR_INVAL);
+	ck_assert_int_eq(spi_sim_open(&fd, "si443x:rate"), ERR_INVAL);
+	ck_assert_int_eq(spi_sim_open(&fd, "sx1231:speed=1"), ERR_INVAL);
+
+	ck_assert(! spi_sim_close(STDIN_FILENO));
+	ck_assert_int_eq(spi_sim_irq_fd(STDIN_FILENO), -1);
+	ck_assert_int_eq(spi_sim_rx(STDIN_FILENO), ERR_INVAL);
+}
+END_TEST
+
+/**
+ * Generate test suite for simulated transceivers
+ */
+Suite *spi_sim_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("spi_sim");
+
+	// Core test case
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_si443x_rx);
+	tcase_add_test(tc_core, test_si443x_tx);
+	tcase_add_test(tc_core, test_sx1231_rx);
+	tcase_add_test(tc_core, test_sx1231_tx);
+	tcase_add_test(tc_core, test_replay);
+	tcase_add_test(tc_core, test_clock);
+	tcase_add_test(tc_core, test_invalid);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = spi_sim_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,169 @@
+/**
+ * test_uplink.c - Unit test for uplink.c
+ *
+ * Copyright (c) 2019, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "uplink.h"
+
+/**
+ * Encode received frame and decode it again
+ *
+ * Expected: header is in network byte order, all fields survive roundtrip.
+ */
+START_TEST(test_roundtrip)
+{
+	uint8_t buf[UPLINK_HDR_LEN + PKT_MAX_LEN];
+	uplink_msg_type_t type;
+	uint32_t gateway;
+	pkt_t in;
+	pkt_t out;
+
+	memset(&in, 0, sizeof(in));
+	in.meta.timestamp = 0x0102030405060708ULL;
+	in.meta.afc = -1000;
+	in.meta.fei = 2000;
+	in.meta.rssi = -180;
+	in.meta.len = 3;
+	in.meta.lna = 4;
+	in.meta.flags = PKT_FLAG_CRC_OK;
+	in.meta.radio = 2;
+	in.meta.channel = 5;
+	in.data[0] = 0x02;
+	in.data[1] = 0xaa;
+	in.data[2] = 0x55;
+
+	uplink_encode(buf, UPLINK_MSG_RX, 0xdeadbeef, &in);
+	memcpy(&buf[UPLINK_HDR_LEN], in.data, in.meta.len);
+
+	ck_assert_uint_eq(buf[0], UPLINK_VERSION);
+	ck_assert_uint_eq(buf[1], UPLINK_MSG_RX);
+	ck_assert_uint_eq(buf[2], 0x00);
+	ck_assert_uint_eq(buf[3], 0x03);
+	ck_assert_uint_eq(buf[4], 0xde);
+	ck_assert_uint_eq(buf[7], 0xef);
+	ck_assert_uint_eq(buf[8], 0x01);
+	ck_assert_uint_eq(buf[15], 0x08);
+	ck_assert_uint_eq(buf[28], 2);
+
+	memset(&out, 0, sizeof(out));
+	ck_assert_int_eq(uplink_decode(buf, UPLINK_HDR_LEN + 3, &type,
+				       &gateway, &out), UPLINK_HDR_LEN + 3);
+	ck_assert_int_eq(type, UPLINK_MSG_RX);
+	ck_assert_uint_eq(gateway, 0xdeadbeef);
+	ck_assert_int_eq(memcmp(&in.meta, &out.meta, sizeof(in.meta)), 0);
+	ck_assert_int_eq(memcmp(in.data, out.data, in.meta.len), 0);
+}
+END_TEST
+
+/**
+ * Decode incomplete and invalid messages
+ *
+ * Expected: incomplete messages return 0, invalid ones -1.
+ */
+START_TEST(test_decode_invalid)
+{
+	uint8_t buf[UPLINK_HDR_LEN + 4];
+	uplink_msg_type_t type;
+	uint32_t gateway;
+	pkt_t pkt;
+
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.meta.len = 4;
+	uplink_encode(buf, UPLINK_MSG_TX, 1, &pkt);
+	memset(&buf[UPLINK_HDR_LEN], 0x11, 4);
+
+	ck_assert_int_eq(uplink_decode(buf, 0, &type, &gateway, &pkt), 0);
+	ck_assert_int_eq(uplink_decode(buf, UPLINK_HDR_LEN - 1, &type,
+				       &gateway, &pkt), 0);
+	ck_assert_int_eq(uplink_decode(buf, UPLINK_HDR_LEN + 3, &type,
+				       &gateway, &pkt), 0);
+	ck_assert_int_eq(uplink_decode(buf, sizeof(buf), &type, &gateway,
+				       &pkt), sizeof(buf));
+	ck_assert_int_eq(type, UPLINK_MSG_TX);
+
+	// Trailing data of next message is ignored
+	ck_assert_int_eq(uplink_decode(buf, sizeof(buf) - 1, &type, &gateway,
+				       &pkt), 0);
+
+	buf[0] = UPLINK_VERSION + 1;
+	ck_assert_int_eq(uplink_decode(buf, sizeof(buf), &type, &gateway,
+				       &pkt), -1);
+	buf[0] = UPLINK_VERSION;
+	buf[1] = 0;
+	ck_assert_int_eq(uplink_decode(buf, sizeof(buf), &type, &gateway,
+				       &pkt), -1);
+	buf[1] = UPLINK_MSG_TX;
+	buf[2] = 0x01;
+	buf[3] = 0x01;
+	ck_assert_int_eq(uplink_decode(buf, sizeof(buf), &type, &gateway,
+				       &pkt), -1);
+}
+END_TEST
+
+/**
+ * Generate test suite for uplink framing
+ */
+Suite *uplink_suite(void)
+{
+	Suite *s;
+	TCase *tc_core;
+
+	s = suite_create("uplink");
+
+	tc_core = tcase_create("core");
+	tcase_add_test(tc_core, test_roundtrip);
+	tcase_add_test(tc_core, test_decode_invalid);
+	suite_add_tcase(s, tc_core);
+
+	return s;
+}
+
+/**
+ * Main function
+ *
+ * Invokes the Check unit test framework test suites
+ */
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = uplink_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}